@@ -0,0 +1,70 @@
+#ifndef AcceptanceMask_h
+#define AcceptanceMask_h 1
+
+#include "lcio.h"
+
+#include <string>
+#include <vector>
+
+#include <EVENT/LCCollection.h>
+#include <EVENT/LCEvent.h>
+#include <EVENT/LCGenericObject.h>
+#include <IMPL/LCCollectionVec.h>
+#include <IMPL/LCGenericObjectImpl.h>
+
+/**  Run-length encoded selection of the elements of a collection.
+ *
+ *  In the "Mask" output mode the processors do not write subset collections.
+ *  They write one LCGenericObject collection named <output name>_Mask instead,
+ *  with one element per selection and the collection parameters
+ *  <ul>
+ *  <li>InputCollection: name of the selected collection</li>
+ *  <li>MaskNames: name of the subset collection each selection stands for</li>
+ *  </ul>
+ *  Each mask element holds integers only, so it survives LCIO persistency:
+ *  the size of the input collection followed by the alternating lengths of
+ *  rejected and accepted runs, starting with a (possibly empty) rejected run.
+ *
+ *  expand() and expandToEvent() turn the masks back into the subset
+ *  collections the "Subset" mode would have written, with the same names.
+ *
+ * @author F. Meloni, DESY
+ * @version $Id: AcceptanceMask.h,v 0.1 2022-03-15 11:24:21 fmeloni Exp $
+ */
+
+namespace AcceptanceMask
+{
+
+  // Name of the mask collection replacing an output collection
+  inline std::string collectionName(const std::string &outputName) { return outputName + "_Mask"; }
+
+  // "Subset" or "Mask", returns true for the latter and throws EVENT::Exception otherwise
+  bool parseOutputMode(const std::string &outputMode, const std::string &processorName);
+
+  // Mask of the accepted indices, in increasing order, of a collection of nElements
+  IMPL::LCGenericObjectImpl *encode(const std::vector<size_t> &accepted, size_t nElements);
+
+  // Accepted indices of a mask, returns the size of the masked collection; throws EVENT::Exception if malformed
+  size_t decode(const EVENT::LCGenericObject *mask, std::vector<size_t> &accepted);
+
+  // Empty mask collection for selections of an input collection
+  IMPL::LCCollectionVec *newMaskCollection(const std::string &inputCollectionName);
+
+  // Append a mask to a mask collection
+  void addMask(IMPL::LCCollectionVec *maskCollection, const std::string &maskName,
+               const std::vector<size_t> &accepted, size_t nElements);
+
+  // Write a single selection of an input collection as mask collection <outputName>_Mask
+  IMPL::LCCollectionVec *storeSelection(EVENT::LCEvent *evt, const std::string &outputName, const std::string &inputCollectionName,
+                                        const std::vector<size_t> &accepted, size_t nElements);
+
+  // Subset collection of the named mask (the first one if empty) of <outputName>_Mask, owned by the caller
+  IMPL::LCCollectionVec *expand(EVENT::LCEvent *evt, const std::string &outputName, const std::string &maskName = "");
+
+  // Add the subset collections of all masks of <outputName>_Mask to the event under their mask names;
+  // names already in the event are left alone and returned in existingNames
+  void expandToEvent(EVENT::LCEvent *evt, const std::string &outputName, std::vector<std::string> &existingNames);
+
+} // namespace AcceptanceMask
+
+#endif
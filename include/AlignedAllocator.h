@@ -0,0 +1,51 @@
+#ifndef AlignedAllocator_h
+#define AlignedAllocator_h 1
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+/**  Minimal allocator returning storage aligned to a cache line.
+ *
+ *  Used for the structure-of-arrays hit columns so that the SIMD kernels
+ *  never split a vector load across two cache lines.
+ *
+ * @author F. Meloni, DESY
+ * @version $Id: AlignedAllocator.h,v 0.1 2022-03-15 11:24:21 fmeloni Exp $
+ */
+
+template <class T, std::size_t Alignment = 64>
+struct AlignedAllocator
+{
+  typedef T value_type;
+
+  template <class U>
+  struct rebind
+  {
+    typedef AlignedAllocator<U, Alignment> other;
+  };
+
+  AlignedAllocator() noexcept {}
+  template <class U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment> &) noexcept {}
+
+  T *allocate(std::size_t n)
+  {
+    return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+  }
+
+  void deallocate(T *p, std::size_t) noexcept
+  {
+    ::operator delete(p, std::align_val_t(Alignment));
+  }
+
+  template <class U>
+  bool operator==(const AlignedAllocator<U, Alignment> &) const noexcept { return true; }
+  template <class U>
+  bool operator!=(const AlignedAllocator<U, Alignment> &) const noexcept { return false; }
+};
+
+template <class T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+#endif
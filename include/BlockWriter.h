@@ -0,0 +1,86 @@
+#ifndef BlockWriter_h
+#define BlockWriter_h 1
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**  Asynchronous writer of a binary block file.
+ *
+ *  The file starts with an 8 byte magic, followed by blocks of a uint32 type,
+ *  a uint32 payload size in bytes and the payload. Filling threads submit
+ *  blocks to a bounded queue and only wait when it is full; a writer thread
+ *  encodes each payload and writes it. DecisionTrace and FeatureExport use it
+ *  for their formats and share one writer between the processors writing to
+ *  the same file.
+ *
+ * @author F. Meloni, DESY
+ * @version $Id: BlockWriter.h,v 0.1 2022-03-15 11:24:21 fmeloni Exp $
+ */
+
+class BlockWriter
+{
+
+public:
+  // Block of the file, encoded on the writer thread
+  struct Block
+  {
+    virtual ~Block() = default;
+    virtual uint32_t type() const = 0;
+    // Append the payload to out
+    virtual void encode(std::vector<char> &out) = 0;
+  };
+
+  // Open fileName and write magic; throws EVENT::Exception, prefixed with owner, if it cannot be opened.
+  // At most maxQueuedBlocks wait for the writer, fileBufferSize sets the stdio buffer (0 keeps the default)
+  BlockWriter(const std::string &fileName, const char *magic, size_t maxQueuedBlocks, size_t fileBufferSize, const std::string &owner);
+  BlockWriter(const BlockWriter &) = delete;
+  BlockWriter &operator=(const BlockWriter &) = delete;
+
+  // Write the queued blocks and close the file
+  ~BlockWriter();
+
+  void submit(std::unique_ptr<Block> block);
+
+  // Object of type T writing to fileName, made by make() unless one is still in use
+  template <class T, class Make>
+  static std::shared_ptr<T> shared(const std::string &fileName, Make make)
+  {
+    static std::mutex mutex;
+    static std::map<std::string, std::weak_ptr<T>> openFiles;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<T> writer = openFiles[fileName].lock();
+    if (!writer)
+    {
+      writer.reset(make());
+      openFiles[fileName] = writer;
+    }
+    return writer;
+  }
+
+protected:
+  void writeLoop();
+
+  std::FILE *m_file = nullptr;
+  std::vector<char> m_fileBuffer{};
+  size_t m_maxQueuedBlocks;
+
+  std::mutex m_mutex{};
+  std::condition_variable m_queueChanged{};
+  std::deque<std::unique_ptr<Block>> m_queue{};
+  bool m_stopping = false;
+  std::thread m_writer{};
+
+  // writer thread scratch
+  std::vector<char> m_payload{};
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef CaloConeSelection_h
+#define CaloConeSelection_h 1
+
+#include <cstddef>
+#include <vector>
+
+#include "CaloHitColumns.h"
+#include "ParticleConeGrid.h"
+
+/**  Calorimeter hit cone selection shared by the CaloConer frontends.
+ *
+ *  Keeps the hits within a fixed angle of any generator-level particle,
+ *  given as momentum columns. Above the occupancy guard (hits x particles)
+ *  the particles are binned in a ParticleConeGrid first, with the same
+ *  decisions. The object is read-only once configured; the grid lives in the
+ *  caller's Scratch.
+ *
+ * @author F. Meloni, DESY
+ * @version $Id: CaloConeSelection.h,v 0.1 2022-03-15 11:24:21 fmeloni Exp $
+ */
+
+class CaloConeSelection
+{
+
+public:
+  struct Settings
+  {
+    double coneSize = 0.2;
+    int guardMaxPairs = 0;
+  };
+
+  // Per-event buffers of one caller
+  struct Scratch
+  {
+    ParticleConeGrid grid{};
+  };
+
+  void configure(const Settings &settings) { m_settings = settings; }
+  const Settings &settings() const { return m_settings; }
+
+  // Indices of the accepted hits, in input order; returns true if the occupancy guard switched to the grid
+  bool select(const CaloHitColumns &columns, const double *px, const double *py, const double *pz, size_t nParticles,
+              Scratch &scratch, std::vector<size_t> &accepted) const;
+
+protected:
+  Settings m_settings{};
+};
+
+#endif
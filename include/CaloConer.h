@@ -5,10 +5,15 @@
 #include "lcio.h"
 
 #include <string>
+#include <vector>
 #include "TH2D.h"
 #include "TMath.h"
 #include "TFile.h"
 
+#include "CaloConeSelection.h"
+#include "CaloHitColumns.h"
+#include "DifferentialValidator.h"
+
 using namespace lcio;
 using namespace marlin;
 
@@ -59,6 +64,14 @@ public:
   // Call to get collections
   void getCollection(LCCollection *&, const std::string &, LCEvent *);
 
+  // Straightforward hit by particle cone test from the LCIO objects, the reference of the differential validation
+  void referenceSelection(LCCollection *MCpartCollection, LCCollection *caloHitCollection,
+                          std::vector<size_t> &accepted, std::vector<DifferentialValidator::RelationPair> &relations);
+
+  // Run the reference on this event and report any difference to the accepted hits and stored relations
+  void validateEvent(LCCollection *MCpartCollection, LCCollection *caloHitCollection, LCCollection *inputHitRel,
+                     LCCollection *outputHitRel);
+
 protected:
   // Collection names for (in/out)put
   std::string m_inputMCParticleCollection = "";
@@ -71,6 +84,34 @@ protected:
 
   int _nRun{};
   int _nEvt{};
+
+  // generator-level particle directions
+  std::vector<double> m_partPx{};
+  std::vector<double> m_partPy{};
+  std::vector<double> m_partPz{};
+
+  // hit columns and indices of the accepted hits
+  CaloHitColumns m_columns{};
+  std::vector<size_t> m_accepted{};
+
+  // output as subset collections or as run-length masks
+  std::string m_outputMode = "Subset";
+  bool m_outputMask = false;
+
+  // occupancy guard
+  int m_guardMaxPairs = 0;
+  int m_nGuardedEvents = 0;
+
+  // selection shared with the Key4hep frontend, and its per-event buffers
+  CaloConeSelection m_selection{};
+  CaloConeSelection::Scratch m_scratch{};
+
+  // differential validation against referenceSelection
+  double m_validationFraction = 0.;
+  int m_validationMaxReports = 20;
+  DifferentialValidator m_validator{};
+  std::vector<size_t> m_referenceAccepted{};
+  std::vector<DifferentialValidator::RelationPair> m_referenceRelations{};
 };
 
 #endif
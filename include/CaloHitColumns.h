@@ -0,0 +1,49 @@
+#ifndef CaloHitColumns_h
+#define CaloHitColumns_h 1
+
+#include <cstdint>
+#include <vector>
+
+#include "AlignedAllocator.h"
+#include "SelectionKernel.h"
+
+/**  Structure-of-arrays copy of a calorimeter hit collection.
+ *
+ *  The frontends (LCIOColumns::gather, EDM4hepColumns::gather) read every hit
+ *  once into cache-line aligned columns; the selection policies then run on
+ *  the columns through view(). The threshold and correction columns are left
+ *  for the owning processor to fill.
+ *
+ * @author F. Meloni, DESY
+ * @version $Id: CaloHitColumns.h,v 0.1 2022-03-15 11:24:21 fmeloni Exp $
+ */
+
+class CaloHitColumns
+{
+
+public:
+  // Resize, fill energy, time, position and layer, then call finish()
+  void resize(size_t nHits);
+  void finish();
+
+  size_t size() const { return energy.size(); }
+
+  SelectionKernel::CaloHitView view() const;
+
+  // Sort key grouping hits by layer, then theta, then phi (unfolded, 24 bits each)
+  uint64_t cellKey(size_t i) const;
+
+  AlignedVector<float> energy{};
+  AlignedVector<float> time{};
+  AlignedVector<float> x{};
+  AlignedVector<float> y{};
+  AlignedVector<float> z{};
+  AlignedVector<unsigned int> layer{};
+  AlignedVector<double> theta{}; // folded around pi/2
+
+  // filled by the processor
+  AlignedVector<double> threshold{};
+  AlignedVector<double> correction{};
+};
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef CaloHitGanger_h
+#define CaloHitGanger_h 1
+
+#include "marlin/Processor.h"
+#include "lcio.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "RadixSort.h"
+
+using namespace lcio;
+using namespace marlin;
+
+/**  Merging of calorimeter cells into coarser virtual cells for marlin.
+ *
+ *  The segmentation indices named in GangingFactors are divided (rounding
+ *  down) by their factor, and all hits falling into the same virtual cell
+ *  are merged: energies summed, earliest time, energy-weighted position.
+ *  The ganged hits keep the CellIDEncoding of the input with the coarse
+ *  indices and are stored ordered by cellID. Meant to run before
+ *  CaloHitSelector on HCAL collections crowded with single-cell BIB
+ *  deposits.
+ *
+ * @param CaloHitCollectionName Name of the input CalorimeterHit collection
+ * @param CaloRelationCollectionName Name of the input hit to SimCalorimeterHit relations, index aligned (empty disables the sim relations)
+ * @param GangedHitCollection Name of the output collection of ganged hits
+ * @param GangedRelationCollection Name of the ganged hit -> original hit relations, weighted by energy fraction
+ * @param GangedSimRelationCollection Name of the ganged hit -> SimCalorimeterHit relations, index aligned with the ganged hits
+ * @param GangingFactors Pairs of cellID field name and number of cells merged along it
+ *
+ * @author F. Meloni, DESY
+ * @version $Id: CaloHitGanger.h,v 0.1 2022-03-15 11:24:21 fmeloni Exp $
+ */
+
+class CaloHitGanger : public Processor
+{
+
+public:
+  virtual Processor *newProcessor() { return new CaloHitGanger; }
+
+  CaloHitGanger();
+
+  /** Called at the begin of the job before anything is read.
+   * Use to initialize the processor, e.g. book histograms.
+   */
+  virtual void init();
+
+  /** Called for every run.
+   */
+  virtual void processRunHeader(LCRunHeader *run);
+
+  /** Called for every event - the working horse.
+   */
+  virtual void processEvent(LCEvent *evt);
+
+  virtual void check(LCEvent *evt);
+
+  /** Called after data processing for clean up.
+   */
+  virtual void end();
+
+  // Call to get collections
+  void getCollection(LCCollection *&, const std::string &, LCEvent *);
+
+  // Look up the ganged fields in a CellIDEncoding; throws EVENT::Exception for unknown fields
+  void configureFields(const std::string &encoderString);
+
+  // 64-bit cellID of the virtual cell holding cellID
+  uint64_t gangedCellID(uint64_t cellID) const;
+
+protected:
+  // cellID field merged by factor cells, located in the current encoding
+  struct GangedField
+  {
+    std::string name;
+    int64_t factor;
+    unsigned int offset;
+    uint64_t mask; // of the field width, before shifting by offset
+    bool isSigned;
+  };
+
+  // Collection names for (in/out)put
+  std::string m_inputHitCollection = "";
+  std::string m_inputRelationCollection = "";
+  std::string m_outputHitCollection = "";
+  std::string m_outputRelationCollection = "";
+  std::string m_outputSimRelationCollection = "";
+
+  // (field, factor) pairs from steering
+  StringVec m_gangingFactors{};
+  std::vector<GangedField> m_fields{};
+  std::string m_encoderString = "";
+
+  // per-event scratch: ganged cellIDs of the hits, sorted together with the hit indices
+  std::vector<uint64_t> m_keys{};
+  std::vector<size_t> m_order{};
+  RadixSorter m_sorter{};
+
+  uint64_t m_nInputHits = 0;
+  uint64_t m_nGangedHits = 0;
+
+  int _nRun{};
+  int _nEvt{};
+};
+
+#endif
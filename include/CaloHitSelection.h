@@ -0,0 +1,84 @@
+#ifndef CaloHitSelection_h
+#define CaloHitSelection_h 1
+
+#include <string>
+#include <vector>
+
+#include "AlignedAllocator.h"
+#include "CaloHitColumns.h"
+#include "CaloSelectionSimd.h"
+#include "DecisionForest.h"
+#include "ThresholdMap.h"
+
+/**  Calorimeter hit selection shared by the CaloHitSelector frontends.
+ *
+ *  Works on CaloHitColumns only, so the Marlin and Key4hep processors keep
+ *  identical decisions: thresholds from the map (bin contents or bilinear
+ *  interpolation) or a flat cut, then either the energy threshold and time
+ *  window kernel or a decision forest score cut. The object is read-only
+ *  once configured; per-event buffers live in the caller's Scratch.
+ *
+ * @author F. Meloni, DESY
+ * @version $Id: CaloHitSelection.h,v 0.1 2022-03-15 11:24:21 fmeloni Exp $
+ */
+
+class CaloHitSelection
+{
+
+public:
+  enum class ForestFeature
+  {
+    Energy,
+    Time,
+    Theta,
+    Layer,
+    Threshold,
+    BIB
+  };
+
+  struct Settings
+  {
+    int nSigma = 3;
+    double flatThreshold = 0.;
+    bool interpolateThresholds = false;
+    bool subtractBIB = false;
+    double timeWindowMin = -0.5;
+    double timeWindowMax = 10.;
+    double forestCut = 0.;
+    SelectionKernel::SimdLevel simdLevel = SelectionKernel::SimdLevel::Scalar;
+  };
+
+  // Per-event buffers of one caller
+  struct Scratch
+  {
+    AlignedVector<float> featureMatrix{};
+    AlignedVector<float> scores{};
+  };
+
+  void configure(const Settings &settings) { m_settings = settings; }
+  const Settings &settings() const { return m_settings; }
+
+  // Select with a decision forest, features among energy, time, theta, layer, threshold, bib;
+  // throws std::runtime_error, prefixed with owner, for unknown features
+  void loadForest(const std::string &modelFile, const std::string &owner);
+  bool useForest() const { return m_useForest; }
+  const DecisionForest &forest() const { return m_forest; }
+  const std::vector<ForestFeature> &forestFeatures() const { return m_forestFeatures; }
+
+  // Threshold and expected BIB energy of every hit
+  void fillThresholds(CaloHitColumns &columns, const ThresholdMap &thresholdMap) const;
+
+  // Forest feature matrix, one row of columns.size() values per feature
+  void fillForestFeatures(const CaloHitColumns &columns, AlignedVector<float> &featureMatrix) const;
+
+  // Indices of the accepted hits, in input order; scores are kept in scratch with the forest
+  void select(const CaloHitColumns &columns, Scratch &scratch, std::vector<size_t> &accepted) const;
+
+protected:
+  Settings m_settings{};
+  bool m_useForest = false;
+  DecisionForest m_forest{};
+  std::vector<ForestFeature> m_forestFeatures{};
+};
+
+#endif
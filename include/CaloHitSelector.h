@@ -4,11 +4,22 @@
 #include "marlin/Processor.h"
 #include "lcio.h"
 
+#include <memory>
 #include <string>
+#include <vector>
 #include "TH2D.h"
 #include "TMath.h"
 #include "TFile.h"
 
+#include "CaloHitColumns.h"
+#include "CaloHitSelection.h"
+#include "DecisionTrace.h"
+#include "FeatureExport.h"
+#include "DifferentialValidator.h"
+#include "RadixSort.h"
+#include "StageProfiler.h"
+#include "ThresholdMap.h"
+
 using namespace lcio;
 using namespace marlin;
 
@@ -59,6 +70,29 @@ public:
   // Call to get collections
   void getCollection(LCCollection *&, const std::string &, LCEvent *);
 
+  // Threshold file of a run from ThresholdsFileMap, or ThresholdsFilePath
+  const std::string &thresholdFileForRun(const LCRunHeader *run) const;
+
+  // Decision code of every hit: accepted, below_threshold or outside_time (or low_score with the forest)
+  void fillDecisions();
+
+  // Trace record of every hit with its decision code
+  void traceDecisions(const LCEvent *evt);
+
+  // Feature export row of every hit
+  void exportFeatures(const LCEvent *evt);
+
+  // Mode and stddev histograms of the current threshold file, read back for the reference lookup
+  void loadReferenceHistograms();
+
+  // Straightforward per-hit selection from the LCIO hits and the threshold histograms, the reference of the
+  // differential validation
+  void referenceSelection(LCCollection *caloHitCollection, LCCollection *inputHitRel,
+                          std::vector<size_t> &accepted, std::vector<DifferentialValidator::RelationPair> &relations);
+
+  // Run the reference on this event and report any difference to the accepted hits and stored relations
+  void validateEvent(LCCollection *caloHitCollection, LCCollection *inputHitRel, LCCollection *outputHitRel);
+
 protected:
   // Collection names for (in/out)put
   std::string m_inputHitCollection = "";
@@ -70,16 +104,76 @@ protected:
   double m_FlatThreshold = 0.;
   std::string m_thFile = "";
   bool m_doBIBsubtraction = false;
+  bool m_thresholdInterpolation = false;
   double m_time_windowMin = -0.5;
   double m_time_windowMax = 10.;
+  std::string m_simdLevelName = "auto";
+
+  // decision forest selection
+  std::string m_selectionMode = "Cuts";
+  std::string m_forestModelFile = "";
+  double m_forestCut = 0.;
+
+  // selection shared with the Key4hep frontend, and its per-event buffers
+  CaloHitSelection m_selection{};
+  CaloHitSelection::Scratch m_scratch{};
+
+  // binary decision trace, one record per hit
+  std::string m_traceFile = "";
+  std::shared_ptr<DecisionTrace> m_trace{};
+  DecisionTrace::Buffer m_traceBuffer{};
+  uint16_t m_traceStream = 0;
+  std::vector<uint8_t> m_decisions{};
+
+  // columnar feature export, one row per hit
+  std::string m_exportFile = "";
+  std::shared_ptr<FeatureExport> m_export{};
+  FeatureExport::Table m_exportTable{};
+
+  // differential validation against referenceSelection
+  double m_validationFraction = 0.;
+  int m_validationMaxReports = 20;
+  DifferentialValidator m_validator{};
+  std::vector<size_t> m_referenceAccepted{};
+  std::vector<DifferentialValidator::RelationPair> m_referenceRelations{};
+  const ThresholdMap *m_referenceMap = nullptr;
+  std::unique_ptr<TH2D> m_referenceMode{};
+  std::unique_ptr<TH2D> m_referenceStddev{};
 
   int _nRun{};
   int _nEvt{};
 
-  // --- Output threshold histograms:
-  TFile *m_th_file = nullptr;
-  TH2D *m_thresholdMap = nullptr;
-  TH2D *m_stddevMap = nullptr;
+  // hit columns and indices of the accepted hits
+  CaloHitColumns m_columns{};
+  std::vector<size_t> m_accepted{};
+
+  // output as subset collections or as run-length masks
+  std::string m_outputMode = "Subset";
+  bool m_outputMask = false;
+
+  // order of the subset output, sorted by a locality key when spatial
+  std::string m_outputOrder = "Input";
+  bool m_spatialOrder = false;
+  std::vector<uint64_t> m_sortKeys{};
+  RadixSorter m_sorter{};
+
+  // opt-in stage profiling
+  bool m_profileStages = false;
+  StageProfiler m_profiler{};
+
+  // --- Threshold maps, by run key
+  struct ThresholdRule
+  {
+    std::string key = "";
+    int firstRun = 0;
+    int lastRun = 0;
+    std::string fileName = "";
+  };
+  StringVec m_thFileMap{};
+  std::string m_thRunParameter = "";
+  std::vector<ThresholdRule> m_thresholdRules{};
+  ThresholdMapCache m_thresholdMaps{};
+  const ThresholdMap *m_thresholdMap = nullptr;
 };
 
 #endif
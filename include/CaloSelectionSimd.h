@@ -0,0 +1,47 @@
+#ifndef CaloSelectionSimd_h
+#define CaloSelectionSimd_h 1
+
+#include <string>
+#include <vector>
+
+#include "SelectionKernel.h"
+
+/**  Vectorised energy threshold and time window selection of calorimeter hits.
+ *
+ *  Evaluates CaloEnergyThreshold and CaloTimeWindow on a CaloHitView several
+ *  hits at a time and compresses the indices of the accepted hits. AVX-512 and
+ *  AVX2 paths are compiled with function target attributes and picked at run
+ *  time; the scalar path is the selectHits() loop itself. Every path follows
+ *  the float/double rounding steps of the scalar policies, so all of them
+ *  accept exactly the same hits.
+ *
+ * @author F. Meloni, DESY
+ * @version $Id: CaloSelectionSimd.h,v 0.1 2022-03-15 11:24:21 fmeloni Exp $
+ */
+
+namespace SelectionKernel
+{
+
+  enum class SimdLevel
+  {
+    Scalar,
+    AVX2,
+    AVX512
+  };
+
+  // Best level supported by the running CPU
+  SimdLevel detectSimdLevel();
+
+  // "auto", "avx512", "avx2" or "scalar"; a level the CPU lacks falls back to the best supported one,
+  // any other value throws std::runtime_error, prefixed with owner
+  SimdLevel resolveSimdLevel(const std::string &requested, const std::string &owner);
+
+  const char *simdLevelName(SimdLevel level);
+
+  // Indices of the hits passing both cuts, in input order
+  size_t selectCaloHits(const CaloHitView &view, const CaloEnergyThreshold &energyCut, const CaloTimeWindow &timeCut,
+                        SimdLevel level, std::vector<size_t> &accepted);
+
+} // namespace SelectionKernel
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef DecisionForest_h
+#define DecisionForest_h 1
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "CaloSelectionSimd.h"
+
+/**  Boosted decision forest compiled into flat node arrays.
+ *
+ *  The model is read from a text file:
+ *  <pre>
+ *  # comment
+ *  features energy time theta
+ *  base_score -0.25
+ *  tree
+ *  0 split energy 0.002 1 2
+ *  1 leaf -0.4
+ *  2 leaf 0.3
+ *  tree
+ *  ...
+ *  </pre>
+ *  Node 0 is the root of each tree. A split sends a hit to the left child when
+ *  its feature value is below the threshold (or NaN) and to the right child
+ *  otherwise. The score of a hit is base_score plus the sum of its leaf values.
+ *
+ *  At load time every tree is padded to a perfect binary tree of the forest
+ *  depth and stored breadth-first, so evaluation is a fixed number of
+ *  compare-and-descend steps without branches. Hits are evaluated in blocks,
+ *  sixteen at a time with AVX-512 when available.
+ *
+ * @author F. Meloni, DESY
+ * @version $Id: DecisionForest.h,v 0.1 2022-03-15 11:24:21 fmeloni Exp $
+ */
+
+class DecisionForest
+{
+
+public:
+  // Node of the model as read from the file
+  struct Node
+  {
+    bool isLeaf = false;
+    int feature = 0;
+    float threshold = 0.;
+    int left = -1;
+    int right = -1;
+    float value = 0.;
+  };
+
+  // Nodes of one tree by id, node 0 being the root
+  typedef std::map<int, Node> Tree;
+
+  // Read and compile a model file, throws std::runtime_error on malformed input
+  void load(const std::string &fileName);
+
+  bool empty() const { return m_nTrees == 0; }
+  size_t nTrees() const { return m_nTrees; }
+  unsigned int depth() const { return m_depth; }
+
+  // Feature names in the order of the feature matrix rows
+  const std::vector<std::string> &featureNames() const { return m_featureNames; }
+
+  // Model trees before padding, for reference evaluations walking them node by node
+  const std::vector<Tree> &trees() const { return m_trees; }
+  float baseScore() const { return m_baseScore; }
+
+  // Scores of n hits; feature f of hit i is features[f * stride + i]
+  void evaluate(const float *features, size_t stride, size_t n, float *scores,
+                SelectionKernel::SimdLevel level = SelectionKernel::SimdLevel::Scalar) const;
+
+protected:
+  void evaluateScalar(const float *features, size_t stride, size_t begin, size_t end, float *scores) const;
+
+  std::vector<std::string> m_featureNames{};
+  float m_baseScore = 0.;
+  std::vector<Tree> m_trees{};
+  size_t m_nTrees = 0;
+  unsigned int m_depth = 0;
+
+  // per tree: (2^depth - 1) split nodes followed in m_leaf by 2^depth leaves
+  std::vector<int> m_feature{};
+  std::vector<float> m_threshold{};
+  std::vector<float> m_leaf{};
+
+  // first levels of every tree, padded to 32 nodes, for the vector path
+  std::vector<int> m_headFeature{};
+  std::vector<float> m_headThreshold{};
+};
+
+#endif
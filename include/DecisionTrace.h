@@ -0,0 +1,109 @@
+#ifndef DecisionTrace_h
+#define DecisionTrace_h 1
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "BlockWriter.h"
+
+/**  Binary trace of per-hit selection decisions.
+ *
+ *  Processors register a stream (processor and collection, with the names of
+ *  the recorded values and decision codes) and append fixed-size records to
+ *  a Buffer owned by the filling thread. Full buffers are handed to a
+ *  BlockWriter thread, so tracing costs a store per hit instead of formatted
+ *  text. Processors tracing to the same file share one writer.
+ *
+ *  File layout: BlockWriter blocks after the 8 byte magic "MYBIBTR1". Stream blocks hold the stream id
+ *  (uint16) and the text "name|value,...|decision,..."; record blocks hold
+ *  packed Records. Read with mybib-trace.
+ *
+ * @author F. Meloni, DESY
+ * @version $Id: DecisionTrace.h,v 0.1 2022-03-15 11:24:21 fmeloni Exp $
+ */
+
+class DecisionTrace
+{
+
+public:
+  static const unsigned int kNValues = 4;
+
+  struct Record
+  {
+    uint32_t run;
+    uint32_t event;
+    uint32_t hit;
+    uint16_t stream;
+    uint8_t decision;
+    uint8_t nValues;
+    float values[kNValues];
+  };
+  static_assert(sizeof(Record) == 32, "DecisionTrace::Record must stay 32 bytes");
+
+  enum BlockType : uint32_t
+  {
+    StreamBlock = 1,
+    RecordBlock = 2
+  };
+
+  static constexpr char kMagic[9] = "MYBIBTR1";
+
+  // Trace writing to a file, shared by all users of the same file name
+  static std::shared_ptr<DecisionTrace> open(const std::string &fileName);
+
+  // Id of a new stream, to be stored in its records
+  uint16_t registerStream(const std::string &name, const std::vector<std::string> &valueNames,
+                          const std::vector<std::string> &decisionNames);
+
+  // Records of one thread, sent to the writer when full and when destroyed
+  class Buffer
+  {
+  public:
+    explicit Buffer(DecisionTrace *trace = nullptr) : m_trace(trace) {}
+    Buffer(const Buffer &) = delete;
+    Buffer &operator=(const Buffer &) = delete;
+    ~Buffer() { flush(); }
+
+    void setTrace(DecisionTrace *trace)
+    {
+      flush();
+      m_trace = trace;
+    }
+    bool active() const { return m_trace != nullptr; }
+
+    void setEvent(int run, int event)
+    {
+      m_run = run;
+      m_event = event;
+    }
+
+    void add(uint16_t stream, size_t hit, uint8_t decision, float v0 = 0.f, float v1 = 0.f, float v2 = 0.f, float v3 = 0.f)
+    {
+      m_records.push_back({static_cast<uint32_t>(m_run), static_cast<uint32_t>(m_event), static_cast<uint32_t>(hit),
+                           stream, decision, kNValues, {v0, v1, v2, v3}});
+      if (m_records.size() >= kBufferRecords)
+        flush();
+    }
+
+    void flush();
+
+  private:
+    static const size_t kBufferRecords = 4096;
+
+    DecisionTrace *m_trace;
+    int m_run = 0;
+    int m_event = 0;
+    std::vector<Record> m_records{};
+  };
+
+protected:
+  explicit DecisionTrace(const std::string &fileName);
+
+  BlockWriter m_writer;
+  std::atomic<uint16_t> m_nStreams{0};
+};
+
+#endif
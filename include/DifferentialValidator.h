@@ -0,0 +1,90 @@
+#ifndef DifferentialValidator_h
+#define DifferentialValidator_h 1
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <EVENT/LCCollection.h>
+
+/**  Comparison of a processor's optimised selection with its reference algorithm.
+ *
+ *  On a sampled fraction of the events the processor also runs the plain
+ *  per-hit loop it was derived from, and hands both results to the
+ *  validator: the indices of the accepted hits and the relation pairs
+ *  (indices in the input collections of both ends). Hits or pairs found by
+ *  only one of the two are reported with the details the processor gives for
+ *  them. Both paths are timed over the selection step only, without traces,
+ *  exports or output collections, and the totals and the reference to
+ *  optimised time ratio are printed at the end of the job.
+ *
+ * @author F. Meloni, DESY
+ * @version $Id: DifferentialValidator.h,v 0.1 2022-03-15 11:24:21 fmeloni Exp $
+ */
+
+class DifferentialValidator
+{
+
+public:
+  typedef std::pair<size_t, size_t> RelationPair;
+  typedef std::function<std::string(size_t)> HitDescription;
+
+  // Validate this fraction of the events, evenly spread (<= 0 disables); at most maxReports mismatches are detailed
+  void configure(double fraction, size_t maxReports);
+  bool enabled() const { return m_fraction > 0.; }
+
+  // Whether the event is validated, to be called once per event
+  bool sampleEvent(int run, int event);
+
+  // Give up a sampled event the reference does not model, the next event is sampled instead
+  void skipEvent();
+
+  void beginFast() { m_begin = std::chrono::steady_clock::now(); }
+  void endFast() { m_fastSeconds += elapsed(); }
+  void beginReference() { m_begin = std::chrono::steady_clock::now(); }
+  void endReference() { m_referenceSeconds += elapsed(); }
+
+  // Compare the results of the sampled event, in any order; returns the number of differences, detailed in report
+  size_t compare(std::vector<size_t> fastHits, std::vector<size_t> referenceHits,
+                 std::vector<RelationPair> fastPairs, std::vector<RelationPair> referencePairs,
+                 const HitDescription &describeHit, std::ostream &report);
+
+  void print(std::ostream &out, const std::string &processorName) const;
+
+  // Relations of an output collection as (index of the from object in hitCollection, index of the same relation in inputRelations)
+  static std::vector<RelationPair> carriedRelations(const EVENT::LCCollection *hitCollection, const EVENT::LCCollection *inputRelations,
+                                                    const EVENT::LCCollection *outputRelations);
+
+protected:
+  double elapsed() const { return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_begin).count(); }
+
+  double m_fraction = 0.;
+  size_t m_maxReports = 0;
+
+  // events are validated whenever the credit reaches one
+  double m_credit = 1.;
+  int m_run = 0;
+  int m_event = 0;
+  std::chrono::steady_clock::time_point m_begin{};
+
+  size_t m_nEvents = 0;
+  size_t m_nValidated = 0;
+  size_t m_nSkipped = 0;
+  size_t m_nMismatchedEvents = 0;
+  size_t m_nReports = 0;
+  uint64_t m_nHits = 0;
+  uint64_t m_nFastOnlyHits = 0;
+  uint64_t m_nReferenceOnlyHits = 0;
+  uint64_t m_nPairs = 0;
+  uint64_t m_nFastOnlyPairs = 0;
+  uint64_t m_nReferenceOnlyPairs = 0;
+  double m_fastSeconds = 0.;
+  double m_referenceSeconds = 0.;
+};
+
+#endif
@@ -0,0 +1,182 @@
+#ifndef DoubletMatcher_h
+#define DoubletMatcher_h 1
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "CaloSelectionSimd.h"
+#include "EventArena.h"
+#include "TrackerHitColumns.h"
+
+/**  Doublet matching of tracker hits shared by the HitSelectorSpace frontends.
+ *
+ *  Hits of a sensor on the inner layer of a configured layer pair are matched
+ *  with the hits of the same sensor on the outer layer, in theta (barrel) or
+ *  r (endcap disks) and phi, optionally requiring the segment to point back
+ *  to the beamline. Works on a TrackerHitColumns only, so the Marlin and
+ *  Key4hep processors keep identical decisions. Sensor pairs never share
+ *  hits and are matched concurrently; crowded pairs use a phi window with a
+ *  bounded number of candidates (occupancy guard), as do pairs with a hot
+ *  sensor; pairs with a masked sensor are skipped. Other pairs are either
+ *  scanned against all outer hits (vectorised) or walked in a phi-sorted
+ *  window, which give the same decisions: with the Auto strategy the window
+ *  is taken from a number of inner x outer hits, 512 unless steered, so that
+ *  the matching path taken does not depend on the machine. On request it is measured per
+ *  layer pair in configure() by a short benchmark instead. The object is read-only
+ *  once configured; per-event buffers live in the caller's Scratch, the
+ *  doublets in its arenas, one per matching thread, so that they are not
+ *  reallocated every event and threads never wait for each other.
+ *
+ * @author F. Meloni, DESY; R. Simoniello, CERN
+ * @version $Id: DoubletMatcher.h,v 0.1 2022-03-15 11:24:21 fmeloni Exp $
+ */
+
+class DoubletMatcher
+{
+
+public:
+  // pair of layers forming a doublet, with the matching cuts
+  struct LayerPair
+  {
+    unsigned int innerLayer;
+    unsigned int outerLayer;
+    double dcoord_cut; // dtheta in barrel mode, dr [mm] in endcap mode
+    double dphi_cut;
+    size_t windowMinPairHits; // Auto strategy: inner x outer hits from which the phi window is used
+  };
+
+  enum class Strategy
+  {
+    Auto,       // per sensor pair, from its number of hits
+    BruteForce, // scan of all outer hits for every inner hit
+    Window      // phi-sorted outer hits, walked outwards from each inner hit
+  };
+
+  // matched pair of hits with an accepted inner hit, stored as indices in the input collection
+  struct Doublet
+  {
+    size_t innerHit;
+    size_t outerHit;
+    float dR;
+
+    bool operator<(const Doublet &rhs) const
+    {
+      return std::tie(innerHit, outerHit) < std::tie(rhs.innerHit, rhs.outerHit);
+    }
+  };
+
+  // doublets of one sensor pair, grown in the Scratch arena of the thread matching it
+  typedef std::vector<Doublet, ArenaAllocator<Doublet>> DoubletVector;
+
+  // pair of sensors (inner, outer) to be matched, independent of all others
+  struct SensorPairTask
+  {
+    TrackerHitColumns::HitRange innerHits;
+    TrackerHitColumns::HitRange outerHits;
+    const LayerPair *layerPair;
+    DoubletVector doublets{};
+    bool guarded = false;  // matched through the bounded phi window
+    bool windowed = false; // matched through the unbounded phi window, by the strategy
+    bool hot = false;     // a sensor is hot, always bounded
+  };
+
+  struct Settings
+  {
+    bool matchInR = false;
+    double maxZ0 = 0.;
+    double beamSpotZ = 0.;
+    double maxD0 = 0.;
+    int nThreads = 1;
+    int guardMaxHits = 0;
+    int guardMaxPairHits = 0;
+    int guardMaxCandidates = 32;
+    bool storeDoublets = false;
+    Strategy strategy = Strategy::BruteForce;
+    size_t windowMinPairHits = 512; // Auto strategy, 0 to calibrate in configure()
+    SelectionKernel::SimdLevel simdLevel = SelectionKernel::SimdLevel::Scalar;
+  };
+
+  // Per-event buffers of one caller
+  struct Scratch
+  {
+    // SensorOccupancy::State of every sensor of the hit index, set by the caller (empty if all are normal)
+    std::vector<uint8_t> sensorStates{};
+    std::vector<SensorPairTask> tasks{};
+    // pairs with a masked sensor, not matched and all their hits rejected
+    std::vector<SensorPairTask> maskedPairs{};
+    std::vector<uint8_t> accepted{};
+    size_t nGuardedPairs = 0;
+    size_t nHotPairs = 0; // bounded because of a hot sensor
+    size_t nScanPairs = 0;   // matched by the brute-force scan
+    size_t nWindowPairs = 0; // matched in the unbounded phi window
+    unsigned int nThreads = 1;
+    // storage of the doublets and matching buffers, reset by match(): arena for the calling thread,
+    // one more per additional matching thread
+    EventArena arena{};
+    std::vector<std::unique_ptr<EventArena>> workerArenas{};
+
+    size_t arenaCapacity() const
+    {
+      size_t bytes = arena.capacity();
+      for (const std::unique_ptr<EventArena> &workerArena : workerArenas)
+        bytes += workerArena->capacity();
+      return bytes;
+    }
+  };
+
+  // Layer pairs as (inner, outer, coordinate cut, phi cut) quadruplets, calibrated if requested;
+  // throws std::runtime_error, prefixed with owner, for malformed or overlapping pairs
+  void configure(const Settings &settings, const std::vector<std::string> &layerPairs, const std::string &owner);
+  const Settings &settings() const { return m_settings; }
+  const std::map<unsigned int, LayerPair> &layerPairs() const { return m_layerPairs; }
+
+  // Coordinate matched with phi, theta or r of the hit index
+  const double *coordinates(const TrackerHitColumns &hitIndex) const
+  {
+    return m_settings.matchInR ? hitIndex.r.data() : hitIndex.theta.data();
+  }
+
+  // Match all sensor pairs; accepted hit indices in input order, decisions and doublets per task in scratch
+  void match(const TrackerHitColumns &hitIndex, Scratch &scratch, std::vector<size_t> &acceptedHits) const;
+
+  // Check that the straight segment through two hits points back to the luminous region
+  bool pointsToBeamline(const double *innerPosition, const double *outerPosition) const;
+
+protected:
+  // coordinates used by the matching, from the hit index
+  struct Columns
+  {
+    const double *coord;
+    const double *phi;
+    const double *x;
+    const double *y;
+    const double *z;
+  };
+
+  // Match the hits of one sensor pair, only touching their own decisions and doublets; buffers go in arena
+  void matchSensorPair(const Columns &columns, SensorPairTask &task, uint8_t *accepted, EventArena &arena) const;
+
+  // Distances of every inner hit to all outer hits, computed in contiguous columns
+  void matchSensorPairScan(const Columns &columns, SensorPairTask &task, uint8_t *accepted, EventArena &arena) const;
+
+  // Same matching visiting the outer hits in order of phi distance, at most maxCandidates (0 for all) per inner hit
+  void matchSensorPairWindowed(const Columns &columns, SensorPairTask &task, uint8_t *accepted, EventArena &arena,
+                               size_t maxCandidates) const;
+
+  // Smallest inner x outer hits for which the window beats the scan on synthetic sensor pairs of a layer pair
+  size_t calibrateWindowMinPairHits(const LayerPair &layerPair) const;
+
+  bool pointsToBeamline(const Columns &columns, size_t innerHit, size_t outerHit) const;
+
+  Settings m_settings{};
+
+  // layer pairs keyed by their inner layer
+  std::map<unsigned int, LayerPair> m_layerPairs{};
+};
+
+#endif
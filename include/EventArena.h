@@ -0,0 +1,102 @@
+#ifndef EventArena_h
+#define EventArena_h 1
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/**  Per-event bump allocator of a processor.
+ *
+ *  Hands out memory from large blocks and frees nothing until reset(), which
+ *  the owner calls at the start of each event once nothing uses the previous
+ *  event's memory. The blocks are kept, so after the first events per-event
+ *  buffers cost no heap allocation. An arena serves one thread at a time,
+ *  without locking: threads filling buffers concurrently each take their
+ *  own. ArenaAllocator lets standard containers grow inside the arena.
+ *
+ * @author F. Meloni, DESY
+ * @version $Id: EventArena.h,v 0.1 2022-03-15 11:24:21 fmeloni Exp $
+ */
+
+class EventArena
+{
+
+public:
+  explicit EventArena(size_t blockSize = 1 << 20) : m_blockSize(blockSize) {}
+  EventArena(const EventArena &) = delete;
+  EventArena &operator=(const EventArena &) = delete;
+
+  void *allocate(size_t bytes, size_t alignment);
+
+  // Forget every allocation, keeping the blocks for the next event
+  void reset();
+
+  size_t nBlocks() const { return m_blocks.size(); }
+  size_t capacity() const;
+  size_t highWater() const { return m_highWater; }
+  uint64_t nAllocations() const { return m_nAllocations; }
+
+  // Blocks, capacity, largest event and allocations, prefixed with the processor name
+  void print(std::ostream &out, const std::string &processorName) const;
+
+protected:
+  struct Block
+  {
+    std::unique_ptr<char[]> data;
+    size_t size;
+  };
+
+  size_t m_blockSize;
+  std::vector<Block> m_blocks{};
+  size_t m_block = 0;    // block being filled
+  size_t m_offset = 0;   // first free byte of that block
+  size_t m_used = 0;     // bytes handed out since the last reset, in full blocks before m_block
+  size_t m_highWater = 0;
+  uint64_t m_nAllocations = 0;
+};
+
+// Standard allocator drawing from an EventArena, or from the heap without one
+template <class T>
+class ArenaAllocator
+{
+
+public:
+  typedef T value_type;
+  typedef std::true_type propagate_on_container_move_assignment;
+  typedef std::true_type propagate_on_container_swap;
+
+  ArenaAllocator() = default;
+  explicit ArenaAllocator(EventArena *arena) : m_arena(arena) {}
+  template <class U>
+  ArenaAllocator(const ArenaAllocator<U> &other) : m_arena(other.arena()) {}
+
+  T *allocate(size_t n)
+  {
+    if (m_arena == nullptr)
+      return std::allocator<T>().allocate(n);
+    return static_cast<T *>(m_arena->allocate(n * sizeof(T), alignof(T)));
+  }
+
+  // arena memory is released all at once by EventArena::reset()
+  void deallocate(T *p, size_t n)
+  {
+    if (m_arena == nullptr)
+      std::allocator<T>().deallocate(p, n);
+  }
+
+  EventArena *arena() const { return m_arena; }
+
+  template <class U>
+  bool operator==(const ArenaAllocator<U> &other) const { return m_arena == other.arena(); }
+  template <class U>
+  bool operator!=(const ArenaAllocator<U> &other) const { return m_arena != other.arena(); }
+
+private:
+  EventArena *m_arena = nullptr;
+};
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef FeatureExport_h
+#define FeatureExport_h 1
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "BlockWriter.h"
+
+/**  Columnar export of the per-hit selection features.
+ *
+ *  Processors register a table (processor and collection, with its column
+ *  names and types) and append the features they already computed to a
+ *  Table owned by the filling thread, one event at a time and column by
+ *  column. Full chunks of rows are handed to a BlockWriter thread that
+ *  compresses every column and writes the file through a large buffer.
+ *  Processors exporting to the same file share one writer. The compression
+ *  needs zlib: without it the package is built with open() throwing.
+ *
+ *  File layout: BlockWriter blocks after the 8 byte magic "MYBIBFX1". Schema blocks hold the table id
+ *  (uint16) and the text "name|column:type,..." with types f32, u32 and u8.
+ *  Chunk blocks hold the table id (uint16), the number of columns (uint16)
+ *  and of rows (uint32), then per column its compressed and raw sizes
+ *  (uint32 each) and the zlib stream of the little-endian values, bytes
+ *  shuffled by significance (all first bytes, then all second bytes...).
+ *  A column zlib failed on is stored shuffled but uncompressed, its
+ *  compressed size being the raw size with the kStoredColumn bit set.
+ *  Read or unpack into memory-mappable column files with mybib-features.
+ *
+ * @author F. Meloni, DESY
+ * @version $Id: FeatureExport.h,v 0.1 2022-03-15 11:24:21 fmeloni Exp $
+ */
+
+class FeatureExport
+{
+
+public:
+  enum ColumnType : uint8_t
+  {
+    Float32,
+    UInt32,
+    UInt8
+  };
+
+  struct Column
+  {
+    std::string name;
+    ColumnType type;
+  };
+
+  enum BlockType : uint32_t
+  {
+    SchemaBlock = 1,
+    ChunkBlock = 2
+  };
+
+  static constexpr char kMagic[9] = "MYBIBFX1";
+
+  // flag in the compressed size of a column stored uncompressed
+  static constexpr uint32_t kStoredColumn = 0x80000000u;
+
+  static size_t typeSize(ColumnType type) { return type == Float32 || type == UInt32 ? 4 : 1; }
+  static const char *typeName(ColumnType type) { return type == Float32 ? "f32" : (type == UInt32 ? "u32" : "u8"); }
+
+  // Export writing to a file, shared by all users of the same file name;
+  // throws EVENT::Exception if built without zlib
+  static std::shared_ptr<FeatureExport> open(const std::string &fileName);
+
+  // Rows of one table filled by one thread, sent to the writer in chunks and when closed
+  class Table
+  {
+  public:
+    Table() = default;
+    Table(const Table &) = delete;
+    Table &operator=(const Table &) = delete;
+    ~Table() { close(); }
+
+    // Register the table in the export, chunks of at least chunkRows rows are written
+    void open(FeatureExport *exporter, const std::string &name, const std::vector<Column> &columns,
+              const std::vector<std::string> &decisionNames, size_t chunkRows = 65536);
+    void close();
+    bool active() const { return m_export != nullptr; }
+
+    // Add rows to every column and return the index of the first; fill the columns, then call endRows()
+    size_t addRows(size_t nRows);
+
+    template <class T>
+    T *column(size_t column, size_t firstRow)
+    {
+      return reinterpret_cast<T *>(m_columns[column].data()) + firstRow;
+    }
+
+    void endRows();
+    void flush();
+
+  private:
+    FeatureExport *m_export = nullptr;
+    uint16_t m_id = 0;
+    size_t m_chunkRows = 0;
+    size_t m_nRows = 0;
+    std::vector<ColumnType> m_types{};
+    std::vector<std::vector<uint8_t>> m_columns{};
+  };
+
+protected:
+  explicit FeatureExport(const std::string &fileName);
+
+  uint16_t registerTable(const std::string &name, const std::vector<Column> &columns, const std::vector<std::string> &decisionNames);
+
+  BlockWriter m_writer;
+  std::atomic<uint16_t> m_nTables{0};
+};
+
+#endif
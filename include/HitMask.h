@@ -0,0 +1,64 @@
+#ifndef HitMask_h
+#define HitMask_h 1
+
+#include "lcio.h"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include <EVENT/LCCollection.h>
+#include <EVENT/LCEvent.h>
+#include <IMPL/LCGenericObjectImpl.h>
+
+using namespace lcio;
+
+/**  Per-event mask of used hits, shared between tracking iterations.
+ *
+ *  One mask is attached to the event for each hit collection, as the single
+ *  element of a transient LCGenericObject collection named
+ *  <hit collection>_HitMask. Bits are keyed by the hit index in that collection,
+ *  so downstream steps can skip used hits without a new subset collection.
+ *
+ * @author F. Meloni, DESY
+ * @version $Id: HitMask.h,v 0.1 2022-03-15 11:24:21 fmeloni Exp $
+ */
+
+class HitMask : public IMPL::LCGenericObjectImpl
+{
+
+public:
+  explicit HitMask(const LCCollection *hitCollection);
+
+  // Name of the event collection holding the mask of a hit collection
+  static std::string collectionName(const std::string &hitCollectionName) { return hitCollectionName + "_HitMask"; }
+
+  // Mask attached to the event for a hit collection, nullptr if there is none
+  static HitMask *fromEvent(LCEvent *evt, const std::string &hitCollectionName);
+
+  // Mask attached to the event for a hit collection, created and attached if needed
+  static HitMask *getOrCreate(LCEvent *evt, const std::string &hitCollectionName);
+
+  size_t size() const { return m_nHits; }
+  bool isUsed(size_t index) const { return (m_words[index >> 5] >> (index & 31)) & 1u; }
+  void setUsed(size_t index) { m_words[index >> 5] |= 1u << (index & 31); }
+
+  // Mark a hit of the masked collection, returns false if it does not belong to it
+  bool setUsedHit(const LCObject *hit);
+
+  // Number of hits marked as used
+  size_t countUsed() const;
+
+  // Collection the mask refers to
+  const LCCollection *hitCollection() const { return m_hitCollection; }
+
+protected:
+  const LCCollection *m_hitCollection = nullptr;
+  size_t m_nHits = 0;
+  std::vector<unsigned int> m_words{};
+
+  // hit -> index lookup, built on first use and reused by later iterations
+  std::unordered_map<const LCObject *, size_t> m_hitIndex{};
+};
+
+#endif
@@ -5,8 +5,20 @@
 
 #include "lcio.h"
 #include <map>
+#include <memory>
+#include <set>
 #include <vector>
 
+#include "DecisionTrace.h"
+#include "DifferentialValidator.h"
+#include "DoubletMatcher.h"
+#include "FeatureExport.h"
+#include "MemoryMonitor.h"
+#include "RadixSort.h"
+#include "SensorOccupancy.h"
+#include "StageProfiler.h"
+#include "TrackerHitIndex.h"
+
 #include <EVENT/LCCollection.h>
 
 using namespace lcio;
@@ -16,6 +28,32 @@ using namespace marlin;
  * 
  * @param TrackerHitCollectionName Name of the input hit collection
  * @param GoodHitCollection Base name of the output hit collections
+ * @param DoubletCollection Name of the output inner -> outer hit relations of the accepted inner hits, weighted by dR (empty disables)
+ * @param LayerPairs Table of (inner layer, outer layer, coordinate cut, dphi cut) quadruplets
+ * @param DoubletMatching Coordinate matched with phi: "ThetaPhi" (barrel) or "RPhi" (endcap disks)
+ * @param MaxZ0 Maximum |z0 - BeamSpotZ| of the doublet extrapolated to the beamline, in mm (<= 0 disables)
+ * @param BeamSpotZ Centre of the z0 window, in mm
+ * @param MaxD0 Maximum transverse impact parameter of the doublet, in mm (<= 0 disables)
+ * @param NumberOfThreads Number of threads used to match sensor pairs
+ * @param GuardMaxHits Event size above which all sensor pairs use the bounded matching (<= 0 disables)
+ * @param GuardMaxSensorPairHits Inner x outer hits above which a sensor pair uses the bounded matching (<= 0 disables)
+ * @param GuardMaxCandidates Outer hits examined per inner hit by the bounded matching (<= 0 for no limit)
+ * @param MaskedSensors Sensors masked in every event, as (layer, side, ladder, module) quadruplets
+ * @param HotSensorMaxHits Hits of a sensor in one event above which it is hot (<= 0 disables)
+ * @param HotSensorMaxAverageHits Running average of the hits of a sensor above which it is hot (<= 0 disables)
+ * @param HotSensorAverageEvents Number of events of the running average
+ * @param HotSensorMode Mask (hot sensors rejected) or Bounded (hot sensors use the bounded matching)
+ * @param MatchingStrategy Auto (per sensor pair from its hits), BruteForce (scan) or Window (phi-sorted window)
+ * @param StrategyCrossoverPairHits Inner x outer hits from which Auto uses the window, 512 by default (<= 0 calibrates in init)
+ * @param SimdLevel Kernel of the brute-force scan: auto (best supported), scalar, avx2 or avx512
+ * @param MonitorMemory Report heap, RSS and allocations per event and stage at the end
+ * @param MemoryMonitorWorstEvents Number of worst events in the memory report
+ * @param ProfileStages Report wall time and hardware counters per stage at the end
+ * @param DecisionTraceFile Binary trace of the decision and matching inputs of every hit (empty disables)
+ * @param FeatureExportFile Columnar export of the matching coordinates, doublet dR and decision of every hit (empty disables)
+ * @param ValidationFraction Fraction of the events compared with the serial reference loop (0 disables); events
+ *        with a pair bounded by the occupancy guard or a hot sensor are skipped
+ * @param ValidationMaxReports Number of differing hits and doublets detailed over the job
  * 
  * @author F. Meloni, DESY; R. Simoniello, CERN
  * @version $Id: HitSelectorSpace.h,v 0.1 2020-09-27 11:24:21 fmeloni Exp $ 
@@ -25,19 +63,14 @@ class HitSelectorSpace : public Processor
 {
 
 protected:
-  static const size_t MAX_NHITS = 10000000;
-
-  struct MySensorPos
+  // decision codes of the trace records
+  enum TraceDecision : uint8_t
   {
-    unsigned int layer;
-    unsigned int side;
-    unsigned int ladder;
-    unsigned int module;
-
-    bool operator<(const MySensorPos &rhs) const
-    {
-      return std::tie(layer, side, ladder, module) < std::tie(rhs.layer, rhs.side, rhs.ladder, rhs.module);
-    }
+    TraceAccepted,
+    TraceNoSensorPair,
+    TraceNoMatch,
+    TraceNoMatchGuarded,
+    TraceMaskedSensor
   };
 
 public:
@@ -67,16 +100,111 @@ public:
   // Call to get collections
   void getCollection(LCCollection *&, std::string, LCEvent *);
 
+  // TraceDecision of every hit
+  void fillDecisions(const TrackerHitIndex *hitIndex, const std::vector<DoubletMatcher::SensorPairTask> &tasks);
+
+  // Trace record of every hit with its matching coordinates and TraceDecision
+  void traceDecisions(const LCEvent *evt, const TrackerHitIndex *hitIndex);
+
+  // Feature export row of every hit, with the smallest dR of its doublets
+  void exportFeatures(const LCEvent *evt, const TrackerHitIndex *hitIndex, const std::vector<DoubletMatcher::SensorPairTask> &tasks);
+
+  // Straightforward serial matching from the LCIO hits, the reference of the differential validation
+  void referenceSelection(LCCollection *trackerHitCollection, const std::set<TrackerHitIndex::SensorKey> &maskedSensors,
+                          std::vector<size_t> &accepted, std::vector<DifferentialValidator::RelationPair> &doublets);
+
+  // Run the reference on this event and report any difference to the accepted hits and doublets
+  void validateEvent(LCCollection *trackerHitCollection, const TrackerHitIndex *hitIndex,
+                     const std::vector<DoubletMatcher::SensorPairTask> &tasks);
+
 protected:
   // Collection names for (in/out)put
   std::string m_inputHitCollection = "";
   std::string m_outputHitCollection = "";
-
-  // map hits in the detector by layer
-  std::map<MySensorPos, std::vector<size_t>> m_hitsMap;
-
-  // hit decisions
-  bool m_accepted[MAX_NHITS];
+  std::string m_outputDoubletCollection = "";
+
+  // layer pairs and cuts as (inner, outer, dcoord, dphi) quadruplets from steering
+  StringVec m_layerPairsParam{};
+  std::string m_doubletMatching = "ThetaPhi";
+
+  // beamline pointing cuts
+  double m_maxZ0 = 0.;
+  double m_beamSpotZ = 0.;
+  double m_maxD0 = 0.;
+
+  // number of threads used to match the sensor pairs
+  int m_nThreads = 1;
+
+  // hit index built here when no shared one is available
+  std::unique_ptr<TrackerHitIndex> m_localIndex{};
+
+  // matching shared with the Key4hep frontend, and its per-event buffers
+  DoubletMatcher m_matcher{};
+  DoubletMatcher::Scratch m_scratch{};
+  std::vector<size_t> m_acceptedHits{};
+  std::vector<DoubletMatcher::Doublet> m_doublets{};
+
+  // occupancy guard
+  int m_guardMaxHits = 0;
+  int m_guardMaxPairHits = 0;
+  int m_guardMaxCandidates = 32;
+  int m_nGuardedEvents = 0;
+
+  // hot sensor masking
+  StringVec m_maskedSensorsParam{};
+  int m_hotMaxHits = 0;
+  double m_hotMaxAverageHits = 0.;
+  int m_hotAverageEvents = 100;
+  std::string m_hotSensorMode = "Mask";
+  SensorOccupancy m_occupancy{};
+  uint64_t m_nMaskedPairs = 0;
+  uint64_t m_nHotPairs = 0;
+
+  // matching strategy per sensor pair
+  std::string m_strategyName = "Auto";
+  int m_crossoverPairHits = 512;
+  std::string m_simdLevelName = "auto";
+  uint64_t m_nScanPairs = 0;
+  uint64_t m_nWindowPairs = 0;
+  uint64_t m_nBoundedPairs = 0;
+
+  // output as subset collections or as run-length masks
+  std::string m_outputMode = "Subset";
+  bool m_outputMask = false;
+
+  // order of the subset output, sorted by a locality key when spatial
+  std::string m_outputOrder = "Input";
+  bool m_spatialOrder = false;
+  std::vector<uint64_t> m_sortKeys{};
+  RadixSorter m_sorter{};
+
+  // opt-in memory instrumentation
+  bool m_monitorMemory = false;
+  int m_memoryWorstEvents = 5;
+  MemoryMonitor m_memory{};
+
+  // binary decision trace, one record per hit
+  std::string m_traceFile = "";
+  std::shared_ptr<DecisionTrace> m_trace{};
+  DecisionTrace::Buffer m_traceBuffer{};
+  uint16_t m_traceStream = 0;
+  std::vector<uint8_t> m_decisions{};
+
+  // columnar feature export, one row per hit
+  std::string m_exportFile = "";
+  std::shared_ptr<FeatureExport> m_export{};
+  FeatureExport::Table m_exportTable{};
+
+  // opt-in stage profiling
+  bool m_profileStages = false;
+  StageProfiler m_profiler{};
+
+  // differential validation against referenceSelection
+  double m_validationFraction = 0.;
+  int m_validationMaxReports = 20;
+  DifferentialValidator m_validator{};
+  std::vector<size_t> m_referenceAccepted{};
+  std::vector<DifferentialValidator::RelationPair> m_referenceDoublets{};
 
   int _nRun{};
   int _nEvt{};
@@ -5,6 +5,7 @@
 
 #include "lcio.h"
 
+#include <memory>
 #include <string>
 #include <vector>
 #include <map>
@@ -17,6 +18,13 @@
 #include <IMPL/TrackerHitPlaneImpl.h>
 #include <UTIL/CellIDDecoder.h>
 
+#include "DecisionTrace.h"
+#include "FeatureExport.h"
+#include "DifferentialValidator.h"
+#include "RadixSort.h"
+#include "TrackerHitIndex.h"
+#include "TrackerTimeSelection.h"
+
 using namespace lcio;
 using namespace marlin;
 
@@ -67,11 +75,72 @@ public:
   // Call to get collections
   void getCollection(LCCollection *&, std::string, LCEvent *);
 
+  // Decision code of every hit: accepted, early or late (or low_score with the forest)
+  void fillDecisions(const TrackerHitIndex *hitIndex, const SelectionKernel::TrackerToFWindow &tofWindow);
+
+  // Trace record of every hit with its decision code
+  void traceDecisions(const LCEvent *evt, const TrackerHitIndex *hitIndex, const SelectionKernel::TrackerToFWindow &tofWindow);
+
+  // Feature export row of every hit
+  void exportFeatures(const LCEvent *evt, const TrackerHitIndex *hitIndex, const SelectionKernel::TrackerToFWindow &tofWindow);
+
+  // Straightforward per-hit selection from the LCIO hits, the reference of the differential validation
+  void referenceSelection(LCCollection *trackerHitCollection, const SelectionKernel::TrackerToFWindow &tofWindow,
+                          std::vector<size_t> &accepted);
+
+  // Run the reference on this event and report any difference to m_accepted
+  void validateEvent(LCCollection *trackerHitCollection, const SelectionKernel::TrackerToFWindow &tofWindow);
+
 protected:
   // Collection names for (in/out)put
   std::string m_inputHitCollection = "";
   std::string m_outputHitCollection = "";
 
+  // hit index built here when no shared one is available, with only the columns in use
+  std::unique_ptr<TrackerHitIndex> m_localIndex{};
+  TrackerHitIndex::Content m_indexContent = TrackerHitIndex::Positions;
+
+  // indices of the accepted hits
+  std::vector<size_t> m_accepted{};
+
+  // output as subset collections or as run-length masks
+  std::string m_outputMode = "Subset";
+  bool m_outputMask = false;
+
+  // order of the subset output, sorted by a locality key when spatial
+  std::string m_outputOrder = "Input";
+  bool m_spatialOrder = false;
+  std::vector<uint64_t> m_sortKeys{};
+  RadixSorter m_sorter{};
+
+  // decision forest selection
+  std::string m_selectionMode = "Cuts";
+  std::string m_forestModelFile = "";
+  double m_forestCut = 0.;
+  std::string m_simdLevelName = "auto";
+
+  // selection shared with the Key4hep frontend, and its per-event buffers
+  TrackerTimeSelection m_selection{};
+  TrackerTimeSelection::Scratch m_scratch{};
+
+  // binary decision trace, one record per hit
+  std::string m_traceFile = "";
+  std::shared_ptr<DecisionTrace> m_trace{};
+  DecisionTrace::Buffer m_traceBuffer{};
+  uint16_t m_traceStream = 0;
+  std::vector<uint8_t> m_decisions{};
+
+  // columnar feature export, one row per hit
+  std::string m_exportFile = "";
+  std::shared_ptr<FeatureExport> m_export{};
+  FeatureExport::Table m_exportTable{};
+
+  // differential validation against referenceSelection
+  double m_validationFraction = 0.;
+  int m_validationMaxReports = 20;
+  DifferentialValidator m_validator{};
+  std::vector<size_t> m_referenceAccepted{};
+
   int _nRun{};
   int _nEvt{};
 };
@@ -9,6 +9,10 @@
 
 #include <EVENT/LCCollection.h>
 
+#include "DifferentialValidator.h"
+#include "HitMask.h"
+#include "MemoryMonitor.h"
+
 using namespace lcio;
 using namespace marlin;
 
@@ -17,6 +21,14 @@ using namespace marlin;
  * @param TrackerHitCollectionName Name of the input hit collection
  * @param TrackCollectionName Name of the input track collection
  * @param SlimmedHitCollection Base name of the output hit collections
+ * @param MonitorMemory Report heap, RSS and allocations per event and stage at the end
+ * @param MemoryMonitorWorstEvents Number of worst events in the memory report
+ * @param ValidationFraction Fraction of the events also slimmed with the reference per-hit loop
+ * @param ValidationMaxReports Number of differing hits reported in detail
+ *
+ * Hits of the input tracks are also marked in the HitMask attached to the event
+ * for the input hit collection, so that successive iterations only add the hits
+ * of their new tracks and later steps can read the mask directly.
  *
  * @author F. Meloni, DESY
  * @version $Id: HitSlimmer.h,v 0.1 2022-03-15 11:24:21 fmeloni Exp $
@@ -25,22 +37,6 @@ using namespace marlin;
 class HitSlimmer : public Processor
 {
 
-protected:
-  static const size_t MAX_NHITS = 10000000;
-
-  struct MySensorPos
-  {
-    unsigned int layer;
-    unsigned int side;
-    unsigned int ladder;
-    unsigned int module;
-
-    bool operator<(const MySensorPos &rhs) const
-    {
-      return std::tie(layer, side, ladder, module) < std::tie(rhs.layer, rhs.side, rhs.ladder, rhs.module);
-    }
-  };
-
 public:
   virtual Processor *newProcessor() { return new HitSlimmer; }
 
@@ -68,17 +64,30 @@ public:
   // Call to get collections
   void getCollection(LCCollection *&, std::string, LCEvent *);
 
+  // Straightforward unused hits from the track hits and the hits used before, the reference of the differential validation
+  void referenceSlimming(LCCollection *trackerHitCollection, LCCollection *trackCollection, std::vector<size_t> &unused) const;
+
+  // Run the reference on this event and report any difference to the hit mask
+  void validateEvent(LCCollection *trackerHitCollection, LCCollection *trackCollection, const HitMask *usedHits);
+
 protected:
   // Collection names for (in/out)put
   std::string m_inputHitCollection = "";
   std::string m_inputTrackCollection = "";
   std::string m_outputHitCollection = "";
 
-  // map hits in the detector by layer
-  std::map<MySensorPos, std::vector<size_t>> m_hitsMap;
-
-  // hit decisions
-  bool m_used[MAX_NHITS];
+  // opt-in memory instrumentation
+  bool m_monitorMemory = false;
+  int m_memoryWorstEvents = 5;
+  MemoryMonitor m_memory{};
+
+  // differential validation against referenceSlimming
+  double m_validationFraction = 0.;
+  int m_validationMaxReports = 20;
+  DifferentialValidator m_validator{};
+  std::vector<char> m_usedBefore{};
+  std::vector<size_t> m_unused{};
+  std::vector<size_t> m_referenceUnused{};
 
   int _nRun{};
   int _nEvt{};
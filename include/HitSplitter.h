@@ -5,17 +5,38 @@
 
 #include "lcio.h"
 #include <map>
+#include <memory>
 #include <vector>
 
 #include <EVENT/LCCollection.h>
+#include <IMPL/LCCollectionVec.h>
+
+#include "DifferentialValidator.h"
+#include "RegionGrid.h"
+#include "StageProfiler.h"
+#include "TrackerHitIndex.h"
 
 using namespace lcio;
 using namespace marlin;
 
 /**  Hit filtering processor for marlin.
+ *
+ *  Splits the hits in a grid of theta (or eta) bins and equal phi sectors for
+ *  parallel tracking. With overlap margins a hit near a boundary is written to
+ *  every region whose widened bounds contain it. The default grid gives the
+ *  eight theta bins 030 ... N030 of one phi sector.
  * 
  * @param TrackerHitCollectionName Name of the input hit collection
  * @param SplitHitCollection Base name of the output hit collections
+ * @param PolarVariable Theta (degrees) or Eta
+ * @param PolarEdges Increasing bin edges of the polar variable
+ * @param PhiSectors Number of phi sectors, suffixed _P<n> when more than one
+ * @param PolarOverlap Overlap margin of the polar bins
+ * @param PhiOverlap Overlap margin of the phi sectors [rad]
+ * @param RegionMapCollection Region bounds and the home region of each hit
+ * @param ProfileStages Report wall time and hardware counters per stage at the end
+ * @param ValidationFraction Fraction of the events also split with the reference per-hit loop
+ * @param ValidationMaxReports Number of differing region assignments reported in detail
  * 
  * @author F. Meloni, DESY; R. Simoniello, CERN
  * @version $Id: HitSplitter.h,v 0.1 2020-09-27 11:24:21 fmeloni Exp $ 
@@ -51,11 +72,51 @@ public:
   // Call to get collections
   void getCollection(LCCollection *&, std::string, LCEvent *);
 
+  // Straightforward per-hit region assignment from the LCIO hits, the reference of the differential validation
+  void referenceAssignment(LCCollection *trackerHitCollection, std::vector<DifferentialValidator::RelationPair> &hitRegions) const;
+
+  // Run the reference on this event and report any difference to m_assignment
+  void validateEvent(LCCollection *trackerHitCollection);
+
 protected:
   // Collection names for (in/out)put
   std::string m_inputHitCollection = "";
   std::string m_outputHitCollection = "";
 
+  // hit index built here when no shared one is available
+  std::unique_ptr<TrackerHitIndex> m_localIndex{};
+
+  // Region bounds plus, as the last element, the home region of every hit
+  IMPL::LCCollectionVec *newRegionMap(size_t nHits) const;
+
+  // region grid
+  std::string m_polarVariable = "Theta";
+  FloatVec m_polarEdgesParameter{};
+  int m_nPhiSectors = 1;
+  float m_polarOverlap = 0.;
+  float m_phiOverlap = 0.;
+  std::string m_regionMapCollection = "";
+  RegionGrid m_grid{};
+
+  // output collection names and the hits of each region
+  std::vector<std::string> m_regionNames{};
+  RegionGrid::Assignment m_assignment{};
+
+  // output as subset collections or as run-length masks
+  std::string m_outputMode = "Subset";
+  bool m_outputMask = false;
+
+  // opt-in stage profiling
+  bool m_profileStages = false;
+  StageProfiler m_profiler{};
+
+  // differential validation against referenceAssignment, on (hit, region) pairs
+  double m_validationFraction = 0.;
+  int m_validationMaxReports = 20;
+  DifferentialValidator m_validator{};
+  std::vector<DifferentialValidator::RelationPair> m_hitRegions{};
+  std::vector<DifferentialValidator::RelationPair> m_referenceHitRegions{};
+
   int _nRun{};
   int _nEvt{};
 };
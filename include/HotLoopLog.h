@@ -0,0 +1,28 @@
+#ifndef HotLoopLog_h
+#define HotLoopLog_h 1
+
+#include "marlin/VerbosityLevels.h"
+
+/**  Text logging inside per-hit loops.
+ *
+ *  hotloop_out(level) behaves as streamlog_out(level) when the package is
+ *  built with ENABLE_HOT_LOOP_LOGGING, and is compiled out otherwise, so
+ *  release builds do not pay for the level check and formatting per hit.
+ *  Use DecisionTraceFile to follow hit decisions at production statistics.
+ *
+ * @author F. Meloni, DESY
+ * @version $Id: HotLoopLog.h,v 0.1 2022-03-15 11:24:21 fmeloni Exp $
+ */
+
+#ifdef MYBIBUTILS_HOT_LOOP_LOGGING
+#define hotloop_out(level) streamlog_out(level)
+#else
+#define hotloop_out(level) \
+  if (true)                \
+  {                        \
+  }                        \
+  else                     \
+    std::cout
+#endif
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef LCIOColumns_h
+#define LCIOColumns_h 1
+
+#include "lcio.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <EVENT/LCCollection.h>
+#include <IMPL/LCCollectionVec.h>
+
+#include "CaloHitColumns.h"
+
+/**  Columns of the shared selection cores filled from LCIO collections.
+ *
+ *  The LCIO counterpart of EDM4hepColumns for the Marlin processors: the
+ *  calorimeter hits are read once into CaloHitColumns (tracker hits go through
+ *  TrackerHitIndex, which can also be shared through the event), and outputs
+ *  are subset collections of the input.
+ *
+ * @author F. Meloni, DESY
+ * @version $Id: LCIOColumns.h,v 0.1 2022-03-15 11:24:21 fmeloni Exp $
+ */
+
+namespace LCIOColumns
+{
+
+  // Calorimeter hit columns with the "layer" field of the encoding, prefetching the hit objects a few elements ahead
+  void gather(const EVENT::LCCollection *caloHitCollection, CaloHitColumns &columns);
+
+  // Empty subset collection of the same type and cellID encoding as the input
+  inline IMPL::LCCollectionVec *newSubsetCollection(const EVENT::LCCollection *input, const std::string &encoderString)
+  {
+    IMPL::LCCollectionVec *output = new IMPL::LCCollectionVec(input->getTypeName());
+    output->setSubset(true);
+    output->parameters().setValue("CellIDEncoding", encoderString);
+    return output;
+  }
+
+  // Add the selected elements of the input collection to an output subset collection
+  inline void fillSubset(IMPL::LCCollectionVec *output, const EVENT::LCCollection *input, const std::vector<size_t> &accepted)
+  {
+    output->reserve(output->size() + accepted.size());
+    for (size_t itHit : accepted)
+      output->addElement(input->getElementAt(itHit));
+  }
+
+} // namespace LCIOColumns
+
+#endif
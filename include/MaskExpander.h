@@ -0,0 +1,65 @@
+#ifndef MaskExpander_h
+#define MaskExpander_h 1
+
+#include "marlin/Processor.h"
+
+#include "lcio.h"
+#include <string>
+#include <vector>
+
+#include <EVENT/LCCollection.h>
+
+using namespace lcio;
+using namespace marlin;
+
+/**  Turns the acceptance masks written in the Mask output mode back into subset collections.
+ *
+ *  Run it before processors expecting the subset collections: each <name>_Mask
+ *  collection is expanded into the subset collections it stands for. A subset
+ *  collection whose name is already in the event is kept, with a warning.
+ *
+ * @param MaskedCollectionNames Output collection names given to the processors writing masks
+ *
+ * @author F. Meloni, DESY
+ * @version $Id: MaskExpander.h,v 0.1 2022-03-15 11:24:21 fmeloni Exp $
+ */
+
+class MaskExpander : public Processor
+{
+
+public:
+  virtual Processor *newProcessor() { return new MaskExpander; }
+
+  MaskExpander();
+
+  /** Called at the begin of the job before anything is read.
+   * Use to initialize the processor, e.g. book histograms.
+   */
+  virtual void init();
+
+  /** Called for every run.
+   */
+  virtual void processRunHeader(LCRunHeader *run);
+
+  /** Called for every event - the working horse.
+   */
+  virtual void processEvent(LCEvent *evt);
+
+  virtual void check(LCEvent *evt);
+
+  /** Called after data processing for clean up.
+   */
+  virtual void end();
+
+protected:
+  // Output names of the mask collections
+  StringVec m_maskedCollections{};
+
+  // subset collection names found in the event already, not expanded
+  std::vector<std::string> m_existingNames{};
+
+  int _nRun{};
+  int _nEvt{};
+};
+
+#endif
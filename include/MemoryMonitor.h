@@ -0,0 +1,127 @@
+#ifndef MemoryMonitor_h
+#define MemoryMonitor_h 1
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**  Opt-in per-event memory accounting of a processor.
+ *
+ *  Samples the heap in use (mallinfo2), the resident set size
+ *  (/proc/self/statm) and, when libMyBIBUtilsAllocationCounter is preloaded,
+ *  the number and size of C++ allocations at the start and end of each event
+ *  and of each named stage within it. Processors also report the size of
+ *  their scratch buffers. The worst events, by heap or RSS growth, and the
+ *  totals per stage are printed at the end of the job.
+ *
+ * @author F. Meloni, DESY
+ * @version $Id: MemoryMonitor.h,v 0.1 2022-03-15 11:24:21 fmeloni Exp $
+ */
+
+class MemoryMonitor
+{
+
+public:
+  struct Sample
+  {
+    int64_t heapBytes = 0;
+    int64_t rssBytes = 0;
+    uint64_t allocations = 0;
+    uint64_t allocatedBytes = 0;
+  };
+
+  // Current process memory; allocation counts are zero without the counter
+  static Sample sample();
+  static bool countsAllocations();
+
+  void configure(bool enabled, size_t nWorstEvents);
+  bool enabled() const { return m_enabled; }
+
+  // An event still open when the next begins, after an exception in the processor, is closed first
+  void beginEvent(int run, int event);
+  void endEvent();
+
+  // Stage names must outlive the monitor, e.g. string literals
+  void beginStage(const char *stage);
+  void endStage();
+
+  // Largest scratch size of the event, in bytes
+  void recordScratch(size_t bytes);
+
+  void print(std::ostream &out, const std::string &processorName) const;
+
+  // Event scope, closing the sample on every path out of processEvent
+  class Event
+  {
+  public:
+    Event(MemoryMonitor &monitor, int run, int event) : m_monitor(monitor) { m_monitor.beginEvent(run, event); }
+    ~Event() { m_monitor.endEvent(); }
+
+  private:
+    MemoryMonitor &m_monitor;
+  };
+
+  // Stage scope, does nothing when the monitor is disabled
+  class Stage
+  {
+  public:
+    Stage(MemoryMonitor &monitor, const char *stage) : m_monitor(monitor) { m_monitor.beginStage(stage); }
+    ~Stage() { m_monitor.endStage(); }
+
+  private:
+    MemoryMonitor &m_monitor;
+  };
+
+protected:
+  struct Usage
+  {
+    uint64_t allocations = 0;
+    uint64_t allocatedBytes = 0;
+    int64_t heapDelta = 0;
+    int64_t rssDelta = 0;
+
+    void add(const Sample &begin, const Sample &end);
+  };
+
+  struct EventRecord
+  {
+    int run = 0;
+    int event = 0;
+    Usage usage{};
+    int64_t peakHeapGrowth = 0;
+    size_t peakScratch = 0;
+    std::vector<Usage> stages{};
+
+    int64_t growth() const { return peakHeapGrowth > usage.rssDelta ? peakHeapGrowth : usage.rssDelta; }
+  };
+
+  struct StageTotal
+  {
+    size_t calls = 0;
+    Usage usage{};
+    int64_t maxHeapDelta = 0;
+  };
+
+  size_t stageIndex(const char *stage);
+
+  bool m_enabled = false;
+  size_t m_nWorstEvents = 5;
+
+  // event in progress
+  EventRecord m_event{};
+  Sample m_eventBegin{};
+  Sample m_stageBegin{};
+  size_t m_stage = 0;
+  bool m_inEvent = false;
+  bool m_inStage = false;
+
+  std::vector<const char *> m_stageNames{};
+  std::vector<StageTotal> m_stageTotals{};
+  std::vector<EventRecord> m_worstEvents{};
+  size_t m_nEvents = 0;
+  Usage m_total{};
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef ParticleConeGrid_h
+#define ParticleConeGrid_h 1
+
+#include <cstddef>
+#include <vector>
+
+#include "SelectionKernel.h"
+
+/**  Particle directions binned in theta and phi for cone matching.
+ *
+ *  Cells are at least one cone wide, so a hit only has to be compared with
+ *  the particles of the theta rows within one cone of it, and within each row
+ *  with the phi cells allowed by the haversine bound
+ *  sin^2(d/2) = sin^2(dtheta/2) + sin(theta1) sin(theta2) sin^2(dphi/2).
+ *  Candidates are tested with ConeAroundAny::angle(), so the decision is the
+ *  same as the loop over all particles. Degenerate particles and hits (zero
+ *  or invalid vectors) and wide cones use the full loop.
+ *
+ * @author F. Meloni, DESY
+ * @version $Id: ParticleConeGrid.h,v 0.1 2022-03-15 11:24:21 fmeloni Exp $
+ */
+
+class ParticleConeGrid
+{
+
+public:
+  // Bin n particle directions for cones of the given size
+  void build(const double *px, const double *py, const double *pz, size_t n, double coneSize);
+
+  // True if the hit position is within the cone of any particle
+  bool inAnyCone(double x, double y, double z) const;
+
+  size_t nCells() const { return m_nTheta * m_nPhi; }
+
+protected:
+  bool inAnyConeFullLoop(double x, double y, double z, double hitMag2) const;
+  bool inAnyConeOfCell(size_t cell, double x, double y, double z, double hitMag2) const;
+
+  const double *m_px = nullptr;
+  const double *m_py = nullptr;
+  const double *m_pz = nullptr;
+  size_t m_n = 0;
+  double m_coneSize = 0.;
+
+  bool m_useGrid = false;
+  size_t m_nTheta = 0;
+  size_t m_nPhi = 0;
+  double m_cellTheta = 0.;
+  double m_cellPhi = 0.;
+
+  // smallest sin(theta) in each theta row
+  std::vector<double> m_rowMinSin{};
+
+  // particles of cell c are m_cellParticles[m_cellOffsets[c], m_cellOffsets[c+1])
+  std::vector<size_t> m_cellOffsets{};
+  std::vector<size_t> m_cellParticles{};
+
+  // particles without a usable direction, tested against every hit
+  std::vector<size_t> m_degenerate{};
+};
+
+namespace SelectionKernel
+{
+
+  // Hit direction within a cone around any of the particles of a grid
+  struct ConeAroundGrid
+  {
+    const ParticleConeGrid *grid;
+
+    template <class View>
+    bool operator()(const View &view, size_t i) const
+    {
+      return grid->inAnyCone(view.x[i], view.y[i], view.z[i]);
+    }
+  };
+
+} // namespace SelectionKernel
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef RadixSort_h
+#define RadixSort_h 1
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**  Stable LSD radix sort of hit indices by 64-bit keys.
+ *
+ *  One pass over the keys builds the histograms of all eight byte digits;
+ *  digits shared by every key are skipped, so small keys such as a sensor
+ *  number cost one or two passes. Scratch buffers are kept between calls.
+ *
+ * @author F. Meloni, DESY
+ * @version $Id: RadixSort.h,v 0.1 2022-03-15 11:24:21 fmeloni Exp $
+ */
+
+class RadixSorter
+{
+
+public:
+  // Reorder keys and values together by increasing key, keeping the order of equal keys
+  void sort(std::vector<uint64_t> &keys, std::vector<size_t> &values)
+  {
+    const size_t n = keys.size();
+    if (n < 2)
+      return;
+
+    size_t counts[kDigits][kBuckets] = {};
+    for (uint64_t key : keys)
+      for (unsigned int digit = 0; digit < kDigits; digit++)
+        counts[digit][(key >> (8 * digit)) & 0xFF]++;
+
+    m_keyScratch.resize(n);
+    m_valueScratch.resize(n);
+
+    for (unsigned int digit = 0; digit < kDigits; digit++)
+    {
+      size_t *count = counts[digit];
+      if (count[(keys[0] >> (8 * digit)) & 0xFF] == n)
+        continue;
+
+      // bucket offsets
+      size_t offset = 0;
+      for (unsigned int bucket = 0; bucket < kBuckets; bucket++)
+      {
+        size_t bucketSize = count[bucket];
+        count[bucket] = offset;
+        offset += bucketSize;
+      }
+
+      for (size_t i = 0; i < n; i++)
+      {
+        size_t position = count[(keys[i] >> (8 * digit)) & 0xFF]++;
+        m_keyScratch[position] = keys[i];
+        m_valueScratch[position] = values[i];
+      }
+      keys.swap(m_keyScratch);
+      values.swap(m_valueScratch);
+    }
+  }
+
+private:
+  static const unsigned int kDigits = 8;
+  static const unsigned int kBuckets = 256;
+
+  std::vector<uint64_t> m_keyScratch{};
+  std::vector<size_t> m_valueScratch{};
+};
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef RegionGrid_h
+#define RegionGrid_h 1
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**  Theta (or eta) by phi region grid of the hit splitters.
+ *
+ *  Shared by the Marlin and Key4hep frontends of HitSplitter. The polar bins
+ *  and the equal phi sectors (from -pi) are found column by column, without
+ *  branches, and a hit is assigned to every region whose bounds widened by
+ *  the overlap margins contain it. Regions are numbered polar bin major.
+ *
+ * @author F. Meloni, DESY
+ * @version $Id: RegionGrid.h,v 0.1 2022-03-15 11:24:21 fmeloni Exp $
+ */
+
+class RegionGrid
+{
+
+public:
+  // Per-event assignment, owned by the caller
+  struct Assignment
+  {
+    std::vector<std::vector<size_t>> regionHits{};
+
+    // per-hit polar value and bins, home and reached through the overlaps
+    std::vector<double> polar{};
+    std::vector<int> polarHome{};
+    std::vector<int> polarFirst{};
+    std::vector<int> polarLast{};
+    std::vector<int> phiHome{};
+    std::vector<int> phiFirst{};
+    std::vector<int> phiLast{};
+  };
+
+  // Throws std::runtime_error, prefixed with owner, for an invalid grid
+  void configure(const std::string &polarVariable, const std::vector<double> &polarEdges, int nPhiSectors,
+                 double polarOverlap, double phiOverlap, const std::string &owner);
+
+  // Region names appended to the output collection name: theta bins by their edges in
+  // degrees, mirrored with an N prefix in the backward half, eta bins as E<n>, plus _P<n>
+  // with more than one phi sector, so the default grid keeps the names 030 ... N030
+  const std::vector<std::string> &regionSuffixes() const { return m_regionSuffixes; }
+  size_t nRegions() const { return m_regionSuffixes.size(); }
+
+  bool useEta() const { return m_useEta; }
+  int nPhiSectors() const { return m_nPhiSectors; }
+  const std::vector<double> &polarEdges() const { return m_polarEdges; }
+
+  // Bounds of a region without overlap: polar bin edges and phi [rad]
+  void regionBounds(size_t region, double bounds[4]) const;
+
+  // Assign hits given by their theta and phi
+  void assign(const double *theta, const double *phi, size_t nHits, Assignment &assignment) const;
+
+  // Region of a hit without overlap
+  int homeRegion(const Assignment &assignment, size_t hit) const
+  {
+    int sector = (assignment.phiHome[hit] % m_nPhiSectors + m_nPhiSectors) % m_nPhiSectors;
+    return assignment.polarHome[hit] * m_nPhiSectors + sector;
+  }
+
+protected:
+  bool m_useEta = false;
+  std::vector<double> m_polarEdges{};
+  std::vector<double> m_innerEdges{};
+  int m_nPhiSectors = 1;
+  double m_polarOverlap = 0.;
+  double m_phiOverlap = 0.;
+  std::vector<std::string> m_regionSuffixes{};
+};
+
+#endif
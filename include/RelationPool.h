@@ -0,0 +1,63 @@
+#ifndef RelationPool_h
+#define RelationPool_h 1
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#include <EVENT/LCObject.h>
+#include <IMPL/LCCollectionVec.h>
+#include <IMPL/LCRelationImpl.h>
+
+/**  Recycled storage of the LCRelations the processors hand to the event.
+ *
+ *  PooledRelation is an LCRelationImpl whose operator new and delete take
+ *  and return slots of a free list carved from large blocks. The event owns
+ *  the relations like any other and deletes them when it is done with them,
+ *  which returns their slots to the pool: after the first events creating a
+ *  relation costs no heap allocation. The pool is shared by all processors
+ *  and its blocks live until the end of the job.
+ *
+ * @author F. Meloni, DESY
+ * @version $Id: RelationPool.h,v 0.1 2022-03-15 11:24:21 fmeloni Exp $
+ */
+
+class RelationPool
+{
+
+public:
+  struct Stats
+  {
+    uint64_t nServed = 0;   // relations created
+    uint64_t nReused = 0;   // of them in a slot freed by an earlier event
+    size_t nBlocks = 0;     // heap allocations of the pool
+    size_t nSlots = 0;
+    size_t nLive = 0;       // relations not yet deleted by their event
+  };
+
+  static void *allocate(size_t bytes);
+  static void release(void *slot, size_t bytes);
+  static Stats stats();
+
+  // Relation collection with the FromType and ToType parameters set as LCRelationNavigator does;
+  // weighted sets LCREL_WEIGHTED, without which the weights are not written out
+  static IMPL::LCCollectionVec *newCollection(const std::string &fromType, const std::string &toType, size_t reserve,
+                                              bool weighted = false);
+
+  // Pool usage, prefixed with the processor name
+  static void print(std::ostream &out, const std::string &processorName);
+};
+
+class PooledRelation : public IMPL::LCRelationImpl
+{
+
+public:
+  PooledRelation(EVENT::LCObject *from, EVENT::LCObject *to, float weight = 1.f) : IMPL::LCRelationImpl(from, to, weight) {}
+
+  // found through the virtual destructor when the event deletes the relation
+  static void *operator new(size_t bytes) { return RelationPool::allocate(bytes); }
+  static void operator delete(void *slot, size_t bytes) { RelationPool::release(slot, bytes); }
+};
+
+#endif
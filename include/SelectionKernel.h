@@ -0,0 +1,226 @@
+#ifndef SelectionKernel_h
+#define SelectionKernel_h 1
+
+#include <cmath>
+#include <cstddef>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "TMath.h"
+
+/**  Compile-time composable per-hit selections.
+ *
+ *  A selection is a policy type with an inline
+ *  <code>bool operator()(const View &view, size_t index) const</code>
+ *  reading the structure-of-arrays columns of a hit view. Policies are combined
+ *  with AllOf and run by selectHits() in one fused loop, so each processor only
+ *  has to gather its columns and pick the policies it needs.
+ *
+ * @author F. Meloni, DESY
+ * @version $Id: SelectionKernel.h,v 0.1 2022-03-15 11:24:21 fmeloni Exp $
+ */
+
+namespace SelectionKernel
+{
+
+  // ----- views -----
+
+  // Tracker hit columns, usually pointing into a TrackerHitIndex
+  struct TrackerHitView
+  {
+    size_t size = 0;
+    const double *r = nullptr;
+    const double *theta = nullptr;
+    const float *time = nullptr;
+  };
+
+  // Calorimeter hit columns, usually pointing into CaloHitColumns
+  struct CaloHitView
+  {
+    size_t size = 0;
+    const float *energy = nullptr;
+    const float *time = nullptr;
+    const float *x = nullptr;
+    const float *y = nullptr;
+    const float *z = nullptr;
+    const double *threshold = nullptr;  // per-hit energy threshold
+    const double *correction = nullptr; // per-hit expected BIB energy
+  };
+
+  // Per-hit classifier scores
+  struct ScoreView
+  {
+    size_t size = 0;
+    const float *score = nullptr;
+  };
+
+  // ----- policies -----
+
+  // Tracker hit arrival time, corrected for the time of flight, within a window
+  struct TrackerToFWindow
+  {
+    double tmin;
+    double tmax;
+    double offset;
+
+    template <class View>
+    bool operator()(const View &view, size_t i) const
+    {
+      double t_arr = arrivalTime(view, i, offset);
+      return t_arr > tmin && t_arr < tmax;
+    }
+
+    template <class View>
+    static double arrivalTime(const View &view, size_t i, double offset)
+    {
+      double t_fly = view.r[i] * 1.E6 / TMath::C();
+      return view.time[i] - t_fly + offset;
+    }
+  };
+
+  // Calorimeter hit energy, optionally BIB subtracted, above the per-hit threshold
+  struct CaloEnergyThreshold
+  {
+    bool subtractBIB;
+
+    template <class View>
+    bool operator()(const View &view, size_t i) const
+    {
+      double energy = view.energy[i];
+      energy = energy - (subtractBIB ? view.correction[i] : 0.);
+      return energy > view.threshold[i];
+    }
+  };
+
+  // Calorimeter hit time, corrected for the time of flight as done so far by CaloHitSelector, within a window
+  struct CaloTimeWindow
+  {
+    double tmin;
+    double tmax;
+
+    template <class View>
+    bool operator()(const View &view, size_t i) const
+    {
+      float relativetime = relativeTime(view, i);
+      return relativetime > tmin && relativetime < tmax;
+    }
+
+    template <class View>
+    static float relativeTime(const View &view, size_t i)
+    {
+      float r(0);
+      r += std::pow(view.x[i], 2);
+      r += std::pow(view.y[i], 2);
+      r += std::pow(view.z[i], 2);
+      float timeCorrection = std::sqrt(r) / TMath::C();
+      return view.time[i] - timeCorrection;
+    }
+  };
+
+  // Hit direction within a cone around any of a set of directions (same arithmetic as TVector3::Angle)
+  struct ConeAroundAny
+  {
+    const double *px;
+    const double *py;
+    const double *pz;
+    size_t n;
+    double coneSize;
+
+    template <class View>
+    bool operator()(const View &view, size_t i) const
+    {
+      double x = view.x[i];
+      double y = view.y[i];
+      double z = view.z[i];
+      double hitMag2 = x * x + y * y + z * z;
+      for (size_t itPart = 0; itPart < n; itPart++)
+      {
+        if (std::fabs(angle(px[itPart], py[itPart], pz[itPart], x, y, z, hitMag2)) < coneSize)
+          return true;
+      }
+      return false;
+    }
+
+    // Angle between a direction and a hit position of squared magnitude hitMag2
+    static double angle(double px, double py, double pz, double x, double y, double z, double hitMag2)
+    {
+      double ptot2 = (px * px + py * py + pz * pz) * hitMag2;
+      if (!(ptot2 > 0.))
+        return 0.;
+      double arg = (px * x + py * y + pz * z) / std::sqrt(ptot2);
+      if (arg > 1.0)
+        arg = 1.0;
+      if (arg < -1.0)
+        arg = -1.0;
+      return std::acos(arg);
+    }
+  };
+
+  // Hit polar angle within [min, max)
+  struct ThetaRange
+  {
+    double thetaMin;
+    double thetaMax;
+
+    template <class View>
+    bool operator()(const View &view, size_t i) const
+    {
+      return view.theta[i] >= thetaMin && view.theta[i] < thetaMax;
+    }
+  };
+
+  // Classifier score above a cut
+  struct ScoreAbove
+  {
+    double cut;
+
+    template <class View>
+    bool operator()(const View &view, size_t i) const
+    {
+      return view.score[i] > cut;
+    }
+  };
+
+  // ----- composition -----
+
+  // Logical AND of policies, evaluated left to right
+  template <class... Cuts>
+  struct AllOf
+  {
+    std::tuple<Cuts...> cuts;
+
+    explicit AllOf(Cuts... c) : cuts(c...) {}
+
+    template <class View>
+    bool operator()(const View &view, size_t i) const
+    {
+      return std::apply([&](const Cuts &...cut)
+                        { return (cut(view, i) && ...); },
+                        cuts);
+    }
+  };
+
+  template <class... Cuts>
+  AllOf<Cuts...> allOf(Cuts... cuts) { return AllOf<Cuts...>(cuts...); }
+
+  // ----- loop -----
+
+  // Indices of the hits passing the selection, in input order
+  template <class View, class Selection>
+  size_t selectHits(const View &view, const Selection &selection, std::vector<size_t> &accepted)
+  {
+    accepted.resize(view.size);
+    size_t nAccepted = 0;
+    for (size_t i = 0; i < view.size; i++)
+    {
+      accepted[nAccepted] = i;
+      nAccepted += selection(view, i) ? 1 : 0;
+    }
+    accepted.resize(nAccepted);
+    return nAccepted;
+  }
+
+} // namespace SelectionKernel
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef SensorOccupancy_h
+#define SensorOccupancy_h 1
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "TrackerHitColumns.h"
+
+/**  Per-sensor occupancy of a tracker collection and the hot sensors it implies.
+ *
+ *  Counts the hits of every sensor in each event and keeps a running average
+ *  over the last events (exponential, window of averageEvents). A sensor is
+ *  hot in an event when its hits exceed maxEventHits or its average exceeds
+ *  maxAverageHits; hot sensors are either masked or sent to the bounded
+ *  matching. Sensors listed in the steering are masked in every event. The
+ *  hot sensors of each run are reported with a MaskedSensors line that can
+ *  be pasted into the steering of the next jobs.
+ *
+ * @author F. Meloni, DESY
+ * @version $Id: SensorOccupancy.h,v 0.1 2022-03-15 11:24:21 fmeloni Exp $
+ */
+
+class SensorOccupancy
+{
+
+public:
+  enum State : uint8_t
+  {
+    Normal = 0,
+    Bounded = 1,
+    Masked = 2
+  };
+
+  struct Settings
+  {
+    int maxEventHits = 0;      // hits of a sensor in one event (<= 0 disables)
+    double maxAverageHits = 0; // running average of the hits of a sensor (<= 0 disables)
+    int averageEvents = 100;   // window of the running average
+    bool maskHot = true;       // hot sensors Masked, otherwise Bounded
+  };
+
+  // Masked sensors as (layer, side, ladder, module) quadruplets; throws std::runtime_error, prefixed with owner, if malformed
+  void configure(const Settings &settings, const std::vector<std::string> &maskedSensors, const std::string &owner);
+  bool enabled() const { return m_settings.maxEventHits > 0 || m_settings.maxAverageHits > 0. || !m_maskedSensors.empty(); }
+
+  // Add the event to the occupancies and give the State of every sensor of the index, in the order of sensors()
+  void update(const TrackerHitColumns &hitIndex, int run, std::vector<uint8_t> &states);
+
+  // Hot sensors of the current run, then start a new one
+  void report(std::ostream &out, const std::string &processorName);
+
+protected:
+  struct Average
+  {
+    double sum = 0.; // decayed sum of the hits, normalised by m_weight
+    size_t lastEvent = 0;
+  };
+
+  struct RunEntry
+  {
+    size_t hotEvents = 0;
+    size_t maxHits = 0;
+    double lastAverage = 0.;
+  };
+
+  Settings m_settings{};
+  std::set<TrackerHitColumns::SensorKey> m_maskedSensors{};
+
+  // running averages, decayed lazily when a sensor has hits again
+  double m_decay = 1.;
+  double m_weight = 0.;
+  size_t m_nEvents = 0;
+  std::map<TrackerHitColumns::SensorKey, Average> m_averages{};
+
+  // hot sensors of the current run
+  int m_run = 0;
+  size_t m_nRunEvents = 0;
+  std::map<TrackerHitColumns::SensorKey, RunEntry> m_runHot{};
+};
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef StageProfiler_h
+#define StageProfiler_h 1
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**  Opt-in hardware counter profiling of processor stages.
+ *
+ *  Cycles, instructions, last level cache misses and branch misses of the
+ *  calling thread are read from one perf_event_open group around each stage
+ *  and summed per stage name, with the number of hits processed, so the end
+ *  of job report gives IPC and misses per hit. Counters are scaled when the
+ *  kernel multiplexes them. When perf events are not available (containers,
+ *  perf_event_paranoid) only the wall time is reported. Worker threads are
+ *  not counted: stages run on several threads are flagged in the report,
+ *  their counts and per-hit values covering the calling thread only.
+ *
+ * @author F. Meloni, DESY
+ * @version $Id: StageProfiler.h,v 0.1 2022-03-15 11:24:21 fmeloni Exp $
+ */
+
+class StageProfiler
+{
+
+public:
+  enum Counter
+  {
+    Cycles,
+    Instructions,
+    CacheMisses,
+    BranchMisses,
+    kNCounters
+  };
+
+  StageProfiler() = default;
+  StageProfiler(const StageProfiler &) = delete;
+  StageProfiler &operator=(const StageProfiler &) = delete;
+  ~StageProfiler();
+
+  // Open the counters; returns false (and keeps timing only) if they are unavailable
+  bool configure(bool enabled);
+  bool enabled() const { return m_enabled; }
+  bool countersAvailable() const { return m_groupFd >= 0; }
+
+  // Stage names must outlive the profiler, e.g. string literals
+  void beginStage(const char *stage, size_t nItems);
+  void endStage();
+
+  // Threads the stage in progress ran on, when it ran on more than the calling thread
+  void setStageThreads(size_t nThreads);
+
+  void print(std::ostream &out, const std::string &processorName) const;
+
+  // Stage scope, does nothing when the profiler is disabled
+  class Stage
+  {
+  public:
+    Stage(StageProfiler &profiler, const char *stage, size_t nItems) : m_profiler(profiler) { m_profiler.beginStage(stage, nItems); }
+    ~Stage() { m_profiler.endStage(); }
+
+  private:
+    StageProfiler &m_profiler;
+  };
+
+protected:
+  struct Reading
+  {
+    double values[kNCounters] = {};
+    std::chrono::steady_clock::time_point time{};
+  };
+
+  struct StageTotal
+  {
+    const char *name = nullptr;
+    size_t calls = 0;
+    size_t threadedCalls = 0; // calls on several threads, counted on the calling thread only
+    uint64_t items = 0;
+    double seconds = 0.;
+    double values[kNCounters] = {};
+  };
+
+  Reading read() const;
+  void close();
+
+  bool m_enabled = false;
+  int m_groupFd = -1;
+  int m_fds[kNCounters] = {-1, -1, -1, -1};
+  std::string m_unavailableReason = "";
+
+  // stage in progress
+  size_t m_stage = 0;
+  bool m_inStage = false;
+  size_t m_stageThreads = 1;
+  Reading m_begin{};
+
+  std::vector<StageTotal> m_stages{};
+};
+
+#endif
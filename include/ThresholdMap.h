@@ -0,0 +1,121 @@
+#ifndef ThresholdMap_h
+#define ThresholdMap_h 1
+
+#include <algorithm>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+class TAxis;
+class TH2D;
+
+/**  Calorimeter threshold map in flat arrays.
+ *
+ *  Holds the BIB energy mode (th_2dmode_sym) and standard deviation
+ *  (stddev_sym) histograms of a threshold file in theta and layer, with the
+ *  bin lookup of TAxis::FindBin, so the values match the histograms exactly
+ *  without keeping ROOT objects around.
+ *
+ *  For interpolated thresholds the plane between the four neighbouring bin
+ *  centres is stored per cell as a + b*theta + c*layer + d*theta*layer, so a
+ *  lookup is one cell search and a few multiply-adds. Outside the outermost
+ *  bin centres the values are held constant.
+ *
+ * @author F. Meloni, DESY
+ * @version $Id: ThresholdMap.h,v 0.1 2022-03-15 11:24:21 fmeloni Exp $
+ */
+
+class ThresholdMap
+{
+
+public:
+  // Read the mode and stddev histograms of a ROOT threshold file
+  void load(const std::string &fileName);
+
+  // Global bin of a hit, including under- and overflow bins as in TH2
+  size_t bin(double theta, double layer) const { return m_yAxis.findBin(layer) * (m_xAxis.nBins + 2) + m_xAxis.findBin(theta); }
+
+  double mode(size_t bin) const { return m_mode[bin]; }
+  double stddev(size_t bin) const { return m_stddev[bin]; }
+
+  // Bilinear interpolation of mode and stddev between the bin centres
+  void interpolate(double theta, double layer, double &mode, double &stddev) const
+  {
+    const Cell &cell = m_cells[m_yAxis.findCell(layer) * (m_xAxis.nBins + 1) + m_xAxis.findCell(theta)];
+    mode = cell.mode[0] + cell.mode[1] * theta + (cell.mode[2] + cell.mode[3] * theta) * layer;
+    stddev = cell.stddev[0] + cell.stddev[1] * theta + (cell.stddev[2] + cell.stddev[3] * theta) * layer;
+  }
+
+  const std::string &fileName() const { return m_fileName; }
+
+protected:
+  struct Axis
+  {
+    size_t nBins = 0;
+    double min = 0.;
+    double max = 0.;
+    bool variable = false;
+    std::vector<double> edges{};
+    std::vector<double> centres{};
+
+    void copy(const TAxis *axis);
+    size_t findBin(double x) const;
+
+    // Interpolation cell: number of bin centres at or below x
+    size_t findCell(double x) const
+    {
+      if (!variable)
+      {
+        double u = std::max(0., std::min((x - min) * nBins / (max - min) + 0.5, static_cast<double>(nBins)));
+        return static_cast<size_t>(u);
+      }
+      return std::upper_bound(centres.begin(), centres.end(), x) - centres.begin();
+    }
+  };
+
+  // Coefficients a, b, c, d of mode and stddev in one interpolation cell
+  struct alignas(64) Cell
+  {
+    double mode[4];
+    double stddev[4];
+  };
+
+  void copyContents(const TH2D *histogram, std::vector<double> &contents) const;
+  void computeCells();
+
+  std::string m_fileName = "";
+  Axis m_xAxis{};
+  Axis m_yAxis{};
+  std::vector<double> m_mode{};
+  std::vector<double> m_stddev{};
+  std::vector<Cell> m_cells{};
+};
+
+/**  Threshold maps loaded on first use and kept for the rest of the job.
+ *
+ *  A file is read again only if its modification time changed since it was
+ *  loaded.
+ */
+
+class ThresholdMapCache
+{
+
+public:
+  const ThresholdMap &get(const std::string &fileName);
+
+  size_t nLoads() const { return m_nLoads; }
+
+protected:
+  struct Entry
+  {
+    long modificationTime = 0;
+    std::unique_ptr<ThresholdMap> map{};
+  };
+
+  std::map<std::string, Entry> m_entries{};
+  size_t m_nLoads = 0;
+};
+
+#endif
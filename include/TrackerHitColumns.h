@@ -0,0 +1,114 @@
+#ifndef TrackerHitColumns_h
+#define TrackerHitColumns_h 1
+
+#include <cstddef>
+#include <tuple>
+#include <vector>
+
+#include "SelectionKernel.h"
+
+/**  Structure-of-arrays columns of a tracker hit collection.
+ *
+ *  Holds the decoded cellID fields, position, r/theta/phi and time of every hit,
+ *  plus the hit indices grouped by sensor, up to the Content a consumer needs.
+ *  It does not depend on an event model: the LCIO TrackerHitIndex and the
+ *  EDM4hep frontends fill the columns and call finish(), and the selection
+ *  cores only read them.
+ *
+ * @author F. Meloni, DESY
+ * @version $Id: TrackerHitColumns.h,v 0.1 2022-03-15 11:24:21 fmeloni Exp $
+ */
+
+class TrackerHitColumns
+{
+
+public:
+  struct SensorKey
+  {
+    unsigned int layer;
+    unsigned int side; // bits of the signed field
+    unsigned int ladder;
+    unsigned int module;
+
+    bool operator<(const SensorKey &rhs) const
+    {
+      return std::tie(layer, side, ladder, module) < std::tie(rhs.layer, rhs.side, rhs.ladder, rhs.module);
+    }
+    bool operator==(const SensorKey &rhs) const
+    {
+      return std::tie(layer, side, ladder, module) == std::tie(rhs.layer, rhs.side, rhs.ladder, rhs.module);
+    }
+  };
+
+  // Range of hit indices belonging to one sensor
+  struct HitRange
+  {
+    const size_t *first = nullptr;
+    const size_t *last = nullptr;
+
+    const size_t *begin() const { return first; }
+    const size_t *end() const { return last; }
+    size_t size() const { return last - first; }
+    bool empty() const { return first == last; }
+  };
+
+  // Columns held, each level including the previous ones
+  enum Content
+  {
+    Positions,    // x, y, z, time, r, theta, phi
+    CellIDFields, // layer, side, ladder, module
+    Sensors       // hits grouped by sensor, sensorNumber
+  };
+
+  // Columns of nHits hits: fill the cellID fields, position and time columns, then call finish()
+  explicit TrackerHitColumns(size_t nHits = 0);
+
+  // Resize the columns for nHits hits, keeping their storage
+  void resize(size_t nHits);
+
+  // Derive r, theta and phi and, for Sensors, group the hits by sensor
+  void finish(Content content = Sensors);
+
+  size_t size() const { return m_nHits; }
+  Content content() const { return m_content; }
+
+  // Columns used by the selection kernels
+  SelectionKernel::TrackerHitView view() const;
+
+  // Hits of one sensor, in collection order
+  HitRange sensorHits(const SensorKey &key) const;
+
+  // Sensors with at least one hit, sorted, and their hits; empty below the Sensors content
+  const std::vector<SensorKey> &sensors() const { return m_sensors; }
+  HitRange sensorHits(size_t sensor) const { return {m_sensorHits.data() + m_sensorOffsets[sensor], m_sensorHits.data() + m_sensorOffsets[sensor + 1]}; }
+
+  // Decoded cellID fields ("layer", "side", "module", "sensor"); side is signed (-1 and 1 in the
+  // endcaps) and holds the bits of the int, to be cast back with static_cast<int> when printed
+  std::vector<unsigned int> layer{};
+  std::vector<unsigned int> side{};
+  std::vector<unsigned int> ladder{};
+  std::vector<unsigned int> module{};
+
+  // Position and derived quantities
+  std::vector<double> x{};
+  std::vector<double> y{};
+  std::vector<double> z{};
+  std::vector<double> r{};
+  std::vector<double> theta{};
+  std::vector<double> phi{};
+  std::vector<float> time{};
+
+  // Position of the sensor of each hit in sensors()
+  std::vector<unsigned int> sensorNumber{};
+
+protected:
+  size_t m_nHits = 0;
+  Content m_content = Sensors;
+
+  // sensor grouping: hits of sensor i are m_sensorHits[m_sensorOffsets[i], m_sensorOffsets[i+1])
+  std::vector<SensorKey> m_sensors{};
+  std::vector<size_t> m_sensorOffsets{};
+  std::vector<size_t> m_sensorHits{};
+};
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef TrackerHitIndex_h
+#define TrackerHitIndex_h 1
+
+#include "lcio.h"
+
+#include <memory>
+#include <string>
+
+#include <EVENT/LCCollection.h>
+#include <EVENT/LCEvent.h>
+#include <IMPL/LCGenericObjectImpl.h>
+
+#include "TrackerHitColumns.h"
+
+using namespace lcio;
+
+/**  Immutable per-event index of an LCIO tracker hit collection.
+ *
+ *  The TrackerHitColumns of the collection, built once by the TrackerHitIndexer
+ *  processor and attached to the event as the single element of a transient
+ *  LCGenericObject collection named <hit collection>_HitIndex.
+ *  MyBIBUtils processors use it when present and decode the hits themselves otherwise,
+ *  only up to the Content they need: processors working on positions and times do
+ *  not pay for, nor depend on, the cellID fields and the sensor grouping.
+ *
+ * @author F. Meloni, DESY
+ * @version $Id: TrackerHitIndex.h,v 0.1 2022-03-15 11:24:21 fmeloni Exp $
+ */
+
+class TrackerHitIndex : public IMPL::LCGenericObjectImpl, public TrackerHitColumns
+{
+
+public:
+  // Decode and index all hits of a TrackerHitPlane collection
+  explicit TrackerHitIndex(const LCCollection *hitCollection, Content content = Sensors);
+
+  // Empty index, to be rebuilt
+  TrackerHitIndex() = default;
+
+  // Decode and index the hits of another collection, reusing the storage of the columns
+  void rebuild(const LCCollection *hitCollection, Content content = Sensors);
+
+  // Name of the event collection holding the index of a hit collection
+  static std::string collectionName(const std::string &hitCollectionName) { return hitCollectionName + "_HitIndex"; }
+
+  // Index attached to the event for a hit collection, nullptr if there is none or it is stale
+  static const TrackerHitIndex *fromEvent(LCEvent *evt, const std::string &hitCollectionName, const LCCollection *hitCollection);
+
+  // Build the index of a hit collection and attach it to the event
+  static const TrackerHitIndex *publish(LCEvent *evt, const std::string &hitCollectionName);
+
+  // Index attached to the event if valid, otherwise a private one built into localIndex with the given content
+  static const TrackerHitIndex *fromEventOrBuild(LCEvent *evt, const std::string &hitCollectionName, const LCCollection *hitCollection,
+                                                 std::unique_ptr<TrackerHitIndex> &localIndex, Content content = Sensors);
+
+  const LCCollection *hitCollection() const { return m_hitCollection; }
+
+protected:
+  const LCCollection *m_hitCollection = nullptr;
+};
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef TrackerHitIndexer_h
+#define TrackerHitIndexer_h 1
+
+#include "marlin/Processor.h"
+
+#include "lcio.h"
+#include <string>
+#include <vector>
+
+#include <EVENT/LCCollection.h>
+
+using namespace lcio;
+using namespace marlin;
+
+/**  Builds the shared TrackerHitIndex of tracker hit collections.
+ *
+ *  Run it once before the other MyBIBUtils tracker processors: they pick up
+ *  the published index instead of decoding the same hits again.
+ *
+ * @param TrackerHitCollectionNames Names of the input hit collections to index
+ *
+ * @author F. Meloni, DESY
+ * @version $Id: TrackerHitIndexer.h,v 0.1 2022-03-15 11:24:21 fmeloni Exp $
+ */
+
+class TrackerHitIndexer : public Processor
+{
+
+public:
+  virtual Processor *newProcessor() { return new TrackerHitIndexer; }
+
+  TrackerHitIndexer();
+
+  /** Called at the begin of the job before anything is read.
+   * Use to initialize the processor, e.g. book histograms.
+   */
+  virtual void init();
+
+  /** Called for every run.
+   */
+  virtual void processRunHeader(LCRunHeader *run);
+
+  /** Called for every event - the working horse.
+   */
+  virtual void processEvent(LCEvent *evt);
+
+  virtual void check(LCEvent *evt);
+
+  /** Called after data processing for clean up.
+   */
+  virtual void end();
+
+protected:
+  // Collection names for input
+  StringVec m_inputHitCollections{};
+
+  int _nRun{};
+  int _nEvt{};
+};
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef TrackerTimeSelection_h
+#define TrackerTimeSelection_h 1
+
+#include <string>
+#include <vector>
+
+#include "AlignedAllocator.h"
+#include "DecisionForest.h"
+#include "SelectionKernel.h"
+#include "TrackerHitColumns.h"
+
+/**  Tracker hit timing selection shared by the HitSelectorTime frontends.
+ *
+ *  Works on a TrackerHitColumns only, so the Marlin and Key4hep processors keep
+ *  identical decisions: either the arrival time window after the time of
+ *  flight correction or a decision forest score cut. The object is read-only
+ *  once configured; per-event buffers live in the caller's Scratch.
+ *
+ * @author F. Meloni, DESY
+ * @version $Id: TrackerTimeSelection.h,v 0.1 2022-03-15 11:24:21 fmeloni Exp $
+ */
+
+class TrackerTimeSelection
+{
+
+public:
+  enum class ForestFeature
+  {
+    Time,
+    Theta,
+    R,
+    Layer
+  };
+
+  struct Settings
+  {
+    // The window is tentative, the time offset should be implemented in the digitizer
+    SelectionKernel::TrackerToFWindow tofWindow = {-0.15, 0.15, 0.2167};
+    double forestCut = 0.;
+    SelectionKernel::SimdLevel simdLevel = SelectionKernel::SimdLevel::Scalar;
+  };
+
+  // Per-event buffers of one caller
+  struct Scratch
+  {
+    AlignedVector<float> featureMatrix{};
+    AlignedVector<float> scores{};
+  };
+
+  void configure(const Settings &settings) { m_settings = settings; }
+  const Settings &settings() const { return m_settings; }
+
+  // Select with a decision forest, features among time, theta, r, layer;
+  // throws std::runtime_error, prefixed with owner, for unknown features
+  void loadForest(const std::string &modelFile, const std::string &owner);
+  bool useForest() const { return m_useForest; }
+  const DecisionForest &forest() const { return m_forest; }
+  const std::vector<ForestFeature> &forestFeatures() const { return m_forestFeatures; }
+
+  // Forest feature matrix, one row of hitIndex.size() values per feature
+  void fillForestFeatures(const TrackerHitColumns &hitIndex, AlignedVector<float> &featureMatrix) const;
+
+  // Indices of the accepted hits, in input order; scores are kept in scratch with the forest
+  void select(const TrackerHitColumns &hitIndex, Scratch &scratch, std::vector<size_t> &accepted) const;
+
+protected:
+  Settings m_settings{};
+  bool m_useForest = false;
+  DecisionForest m_forest{};
+  std::vector<ForestFeature> m_forestFeatures{};
+};
+
+#endif
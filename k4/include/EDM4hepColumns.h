@@ -0,0 +1,101 @@
+#ifndef EDM4hepColumns_h
+#define EDM4hepColumns_h 1
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <DDSegmentation/BitFieldCoder.h>
+#include <edm4hep/CalorimeterHitCollection.h>
+#include <edm4hep/TrackerHitPlaneCollection.h>
+
+#include "CaloHitColumns.h"
+#include "TrackerHitColumns.h"
+
+namespace Gaudi
+{
+  class Algorithm;
+}
+
+/**  Columns of the shared selection cores filled from EDM4hep collections.
+ *
+ *  The Key4hep algorithms read the hits through the collection's inline
+ *  handles, in collection order, without per-hit virtual calls, and decode
+ *  the cellID fields with a BitFieldCoder whose field indices are looked up
+ *  once. The encoding is the CellIDEncoding metadata of the input
+ *  collection, as the LCIO frontends read the collection parameter, unless
+ *  an algorithm overrides it. The columns are the same as those of the LCIO
+ *  frontends, so both give identical decisions. Outputs are subset collections of the input and
+ *  links copied from the input links of the accepted hits.
+ *
+ * @author F. Meloni, DESY
+ * @version $Id: EDM4hepColumns.h,v 0.1 2022-03-15 11:24:21 fmeloni Exp $
+ */
+
+namespace EDM4hepColumns
+{
+
+  // CellIDEncoding of an input collection: encodingOverride if not empty, otherwise the collection metadata;
+  // throws std::runtime_error if neither is set
+  std::string cellIDEncoding(const Gaudi::Algorithm *algorithm, const std::string &collectionName, const std::string &encodingOverride);
+
+  // Tracker hit columns with, from the CellIDFields content on, the "layer", "side", "module" and "sensor" fields of the
+  // encoding; the decoder may be null below that content
+  std::unique_ptr<TrackerHitColumns> trackerHitColumns(const edm4hep::TrackerHitPlaneCollection &hits,
+                                                       const dd4hep::DDSegmentation::BitFieldCoder *decoder,
+                                                       TrackerHitColumns::Content content = TrackerHitColumns::Sensors);
+
+  // Calorimeter hit columns with the "layer" field of the encoding
+  void gather(const edm4hep::CalorimeterHitCollection &hits, const dd4hep::DDSegmentation::BitFieldCoder &decoder,
+              CaloHitColumns &columns);
+
+  // Subset collection of the hits at the given indices, in the order given
+  template <class Collection>
+  Collection subset(const Collection &input, const std::vector<size_t> &indices)
+  {
+    Collection output;
+    output.setSubsetCollection();
+    for (size_t itHit : indices)
+      output.push_back(input[itHit]);
+    return output;
+  }
+
+  // Position in links of the first link from each hit of the collection, -1 for none
+  template <class HitCollection, class LinkCollection>
+  std::vector<int> linksByHit(const HitCollection &hits, const LinkCollection &links)
+  {
+    std::vector<int> hitLinks(hits.size(), -1);
+    for (size_t itLink = 0; itLink < links.size(); itLink++)
+    {
+      podio::ObjectID from = links[itLink].getFrom().getObjectID();
+      if (from.collectionID != hits.getID() || from.index < 0 || static_cast<size_t>(from.index) >= hits.size())
+        continue;
+      if (hitLinks[from.index] < 0)
+        hitLinks[from.index] = static_cast<int>(itLink);
+    }
+    return hitLinks;
+  }
+
+  // Links of the accepted hits, pointing to the same simulated hits as their input links
+  template <class HitCollection, class LinkCollection>
+  LinkCollection carriedLinks(const HitCollection &hits, const LinkCollection &links, const std::vector<size_t> &accepted)
+  {
+    std::vector<int> hitLinks = linksByHit(hits, links);
+    LinkCollection output;
+    for (size_t itHit : accepted)
+    {
+      if (hitLinks[itHit] < 0)
+        continue;
+      auto inputLink = links[hitLinks[itHit]];
+      auto link = output.create();
+      link.setFrom(hits[itHit]);
+      link.setTo(inputLink.getTo());
+      link.setWeight(inputLink.getWeight());
+    }
+    return output;
+  }
+
+} // namespace EDM4hepColumns
+
+#endif
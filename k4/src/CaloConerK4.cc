@@ -0,0 +1,98 @@
+// Key4hep frontend of CaloConer: EDM4hep calorimeter hits within a cone
+// around the generator-level particles, through the same CaloConeSelection
+// as the Marlin processor.
+
+#include "CaloConeSelection.h"
+#include "EDM4hepColumns.h"
+
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <edm4hep/CaloHitSimCaloHitLinkCollection.h>
+#include <edm4hep/CalorimeterHitCollection.h>
+#include <edm4hep/MCParticleCollection.h>
+
+#include "Gaudi/Property.h"
+#include "k4FWCore/Transformer.h"
+
+struct CaloConerK4 final
+    : k4FWCore::MultiTransformer<std::tuple<edm4hep::CalorimeterHitCollection, edm4hep::CaloHitSimCaloHitLinkCollection>(
+          const edm4hep::MCParticleCollection &, const edm4hep::CalorimeterHitCollection &,
+          const edm4hep::CaloHitSimCaloHitLinkCollection &)>
+{
+    CaloConerK4(const std::string &name, ISvcLocator *svcLoc)
+        : MultiTransformer(name, svcLoc,
+                           {KeyValues("MCParticleCollectionName", {"MCParticle"}),
+                            KeyValues("CaloHitCollectionName", {"EcalBarrelCollectionRec"}),
+                            KeyValues("CaloLinkCollectionName", {"EcalBarrelLinksSimRec"})},
+                           {KeyValues("GoodHitCollection", {"EcalBarrelCollectionConed"}),
+                            KeyValues("GoodLinkCollection", {"EcalBarrelLinksSimConed"})})
+    {
+    }
+
+    StatusCode initialize() override
+    {
+        CaloConeSelection::Settings settings;
+        settings.coneSize = m_coneSize;
+        settings.guardMaxPairs = m_guardMaxPairs;
+        m_selection.configure(settings);
+
+        try
+        {
+            std::string encoding = EDM4hepColumns::cellIDEncoding(this, inputLocations("CaloHitCollectionName")[0], m_cellIDEncoding);
+            m_decoder = std::make_unique<dd4hep::DDSegmentation::BitFieldCoder>(encoding);
+            info() << "cellID encoding " << encoding << endmsg;
+        }
+        catch (std::exception &e)
+        {
+            error() << e.what() << endmsg;
+            return StatusCode::FAILURE;
+        }
+        return StatusCode::SUCCESS;
+    }
+
+    std::tuple<edm4hep::CalorimeterHitCollection, edm4hep::CaloHitSimCaloHitLinkCollection>
+    operator()(const edm4hep::MCParticleCollection &particles, const edm4hep::CalorimeterHitCollection &hits,
+               const edm4hep::CaloHitSimCaloHitLinkCollection &links) const override
+    {
+        // per-call buffers, the algorithm may run on several events at once
+        CaloHitColumns columns;
+        CaloConeSelection::Scratch scratch;
+        std::vector<size_t> accepted;
+
+        // Directions of the generator-level particles
+        std::vector<double> partPx, partPy, partPz;
+        for (const auto &particle : particles)
+        {
+            if (particle.getGeneratorStatus() != 1)
+                continue;
+
+            const auto &momentum = particle.getMomentum();
+            partPx.push_back(momentum.x);
+            partPy.push_back(momentum.y);
+            partPz.push_back(momentum.z);
+        }
+
+        // Keep hits within the cone of any of them
+        EDM4hepColumns::gather(hits, *m_decoder, columns);
+        bool guarded = m_selection.select(columns, partPx.data(), partPy.data(), partPz.data(), partPx.size(), scratch, accepted);
+        debug() << "Accepted " << accepted.size() << " of " << hits.size() << " hits"
+                << (guarded ? ", occupancy guard triggered" : "") << endmsg;
+
+        return std::make_tuple(EDM4hepColumns::subset(hits, accepted), EDM4hepColumns::carriedLinks(hits, links, accepted));
+    }
+
+    Gaudi::Property<std::string> m_cellIDEncoding{this, "CellIDEncoding", "",
+                                                   "Encoding of the hit cellIDs, providing the layer field "
+                                                   "(empty: the CellIDEncoding metadata of the input collection)"};
+    Gaudi::Property<double> m_coneSize{this, "ConeWidth", 0.2, "Cut in radians"};
+    Gaudi::Property<int> m_guardMaxPairs{this, "GuardMaxHitParticlePairs", 0,
+                                         "Above this number of hits x particles, match hits through a theta-phi particle grid (<= 0 disables)"};
+
+    CaloConeSelection m_selection{};
+    std::unique_ptr<dd4hep::DDSegmentation::BitFieldCoder> m_decoder{};
+};
+
+DECLARE_COMPONENT(CaloConerK4)
@@ -0,0 +1,108 @@
+// Key4hep frontend of CaloHitSelector: energy threshold and time window (or
+// decision forest) selection of EDM4hep calorimeter hits, through the same
+// CaloHitSelection as the Marlin processor.
+
+#include "CaloHitSelection.h"
+#include "EDM4hepColumns.h"
+#include "ThresholdMap.h"
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <edm4hep/CaloHitSimCaloHitLinkCollection.h>
+#include <edm4hep/CalorimeterHitCollection.h>
+
+#include "Gaudi/Property.h"
+#include "k4FWCore/Transformer.h"
+
+struct CaloHitSelectorK4 final
+    : k4FWCore::MultiTransformer<std::tuple<edm4hep::CalorimeterHitCollection, edm4hep::CaloHitSimCaloHitLinkCollection>(
+          const edm4hep::CalorimeterHitCollection &, const edm4hep::CaloHitSimCaloHitLinkCollection &)>
+{
+    CaloHitSelectorK4(const std::string &name, ISvcLocator *svcLoc)
+        : MultiTransformer(name, svcLoc,
+                           {KeyValues("CaloHitCollectionName", {"EcalBarrelCollectionRec"}),
+                            KeyValues("CaloLinkCollectionName", {"EcalBarrelLinksSimRec"})},
+                           {KeyValues("GoodHitCollection", {"EcalBarrelCollectionSel"}),
+                            KeyValues("GoodLinkCollection", {"EcalBarrelLinksSimSel"})})
+    {
+    }
+
+    StatusCode initialize() override
+    {
+        CaloHitSelection::Settings settings;
+        settings.nSigma = m_nSigma;
+        settings.flatThreshold = m_flatThreshold;
+        settings.interpolateThresholds = m_thresholdInterpolation;
+        settings.subtractBIB = m_doBIBsubtraction;
+        settings.timeWindowMin = m_timeWindowMin;
+        settings.timeWindowMax = m_timeWindowMax;
+        settings.forestCut = m_forestCut;
+        try
+        {
+            settings.simdLevel = SelectionKernel::resolveSimdLevel(m_simdLevelName, name());
+            m_selection.configure(settings);
+            info() << "selection kernel: " << SelectionKernel::simdLevelName(settings.simdLevel) << endmsg;
+
+            if (m_selectionMode.value() == "Forest")
+                m_selection.loadForest(m_forestModelFile, name());
+            else if (m_selectionMode.value() != "Cuts")
+                throw std::runtime_error(name() + ": unknown SelectionMode " + m_selectionMode.value() + ", use Cuts or Forest");
+
+            m_thresholdMap.load(m_thresholdsFile);
+            std::string encoding = EDM4hepColumns::cellIDEncoding(this, inputLocations("CaloHitCollectionName")[0], m_cellIDEncoding);
+            m_decoder = std::make_unique<dd4hep::DDSegmentation::BitFieldCoder>(encoding);
+            info() << "cellID encoding " << encoding << endmsg;
+        }
+        catch (std::exception &e)
+        {
+            error() << e.what() << endmsg;
+            return StatusCode::FAILURE;
+        }
+        return StatusCode::SUCCESS;
+    }
+
+    std::tuple<edm4hep::CalorimeterHitCollection, edm4hep::CaloHitSimCaloHitLinkCollection>
+    operator()(const edm4hep::CalorimeterHitCollection &hits, const edm4hep::CaloHitSimCaloHitLinkCollection &links) const override
+    {
+        // per-call buffers, the algorithm may run on several events at once
+        CaloHitColumns columns;
+        CaloHitSelection::Scratch scratch;
+        std::vector<size_t> accepted;
+
+        EDM4hepColumns::gather(hits, *m_decoder, columns);
+        m_selection.fillThresholds(columns, m_thresholdMap);
+        m_selection.select(columns, scratch, accepted);
+        debug() << "Accepted " << accepted.size() << " of " << hits.size() << " hits" << endmsg;
+
+        return std::make_tuple(EDM4hepColumns::subset(hits, accepted), EDM4hepColumns::carriedLinks(hits, links, accepted));
+    }
+
+    Gaudi::Property<std::string> m_cellIDEncoding{this, "CellIDEncoding", "",
+                                                   "Encoding of the hit cellIDs, providing the layer field "
+                                                   "(empty: the CellIDEncoding metadata of the input collection)"};
+    Gaudi::Property<std::string> m_thresholdsFile{this, "ThresholdsFilePath", "", "Path to ROOT file"};
+    Gaudi::Property<int> m_nSigma{this, "Nsigma", 3, "Number of BIB E sigma"};
+    Gaudi::Property<double> m_flatThreshold{this, "FlatThreshold", 0., "Cut in GeV"};
+    Gaudi::Property<bool> m_thresholdInterpolation{this, "ThresholdInterpolation", false,
+                                                   "Interpolate mode and stddev bilinearly between bin centres instead of using bin contents"};
+    Gaudi::Property<double> m_timeWindowMin{this, "TimeWindowMin", -0.5, "Minimum time window for hit selection"};
+    Gaudi::Property<double> m_timeWindowMax{this, "TimeWindowMax", 10., "Maximum time window for hit selection"};
+    Gaudi::Property<bool> m_doBIBsubtraction{this, "DoBIBsubtraction", false, "Correct cell energy for mean expected BIB contribution"};
+    Gaudi::Property<std::string> m_simdLevelName{this, "SimdLevel", "auto",
+                                                 "Selection kernel: auto, avx512, avx2 or scalar (falls back to what the CPU supports)"};
+    Gaudi::Property<std::string> m_selectionMode{this, "SelectionMode", "Cuts",
+                                                 "Cuts (energy threshold and time window) or Forest (decision forest score)"};
+    Gaudi::Property<std::string> m_forestModelFile{this, "ForestModelFile", "",
+                                                   "Decision forest model, features among energy, time, theta, layer, threshold, bib"};
+    Gaudi::Property<double> m_forestCut{this, "ForestCut", 0., "Minimum decision forest score of accepted hits"};
+
+    CaloHitSelection m_selection{};
+    ThresholdMap m_thresholdMap{};
+    std::unique_ptr<dd4hep::DDSegmentation::BitFieldCoder> m_decoder{};
+};
+
+DECLARE_COMPONENT(CaloHitSelectorK4)
@@ -0,0 +1,83 @@
+#include "EDM4hepColumns.h"
+
+#include <optional>
+#include <stdexcept>
+
+#include <edm4hep/Constants.h>
+#include <podio/FrameCategories.h>
+
+#include "Gaudi/Algorithm.h"
+#include "k4FWCore/MetadataUtils.h"
+
+std::string EDM4hepColumns::cellIDEncoding(const Gaudi::Algorithm *algorithm, const std::string &collectionName,
+                                           const std::string &encodingOverride)
+{
+    if (!encodingOverride.empty())
+        return encodingOverride;
+
+    std::optional<std::string> encoding =
+        k4FWCore::getParameter<std::string>(podio::collMetadataParamName(collectionName, edm4hep::labels::CellIDEncoding), algorithm);
+    if (!encoding || encoding->empty())
+        throw std::runtime_error(algorithm->name() + ": no CellIDEncoding metadata for " + collectionName +
+                                 ", set the CellIDEncoding property");
+    return *encoding;
+}
+
+std::unique_ptr<TrackerHitColumns> EDM4hepColumns::trackerHitColumns(const edm4hep::TrackerHitPlaneCollection &hits,
+                                                                     const dd4hep::DDSegmentation::BitFieldCoder *decoder,
+                                                                     TrackerHitColumns::Content content)
+{
+    std::unique_ptr<TrackerHitColumns> columns(new TrackerHitColumns(hits.size()));
+
+    // the encoding must have the fields only if they are decoded
+    if (content >= TrackerHitColumns::CellIDFields)
+    {
+        const size_t layerField = decoder->index("layer");
+        const size_t sideField = decoder->index("side");
+        const size_t ladderField = decoder->index("module");
+        const size_t moduleField = decoder->index("sensor");
+        for (size_t itHit = 0; itHit < hits.size(); itHit++)
+        {
+            const uint64_t cellID = hits[itHit].getCellID();
+            columns->layer[itHit] = decoder->get(cellID, layerField);
+            columns->side[itHit] = decoder->get(cellID, sideField);
+            columns->ladder[itHit] = decoder->get(cellID, ladderField);
+            columns->module[itHit] = decoder->get(cellID, moduleField);
+        }
+    }
+
+    for (size_t itHit = 0; itHit < hits.size(); itHit++)
+    {
+        const auto hit = hits[itHit];
+        const auto &position = hit.getPosition();
+        columns->x[itHit] = position.x;
+        columns->y[itHit] = position.y;
+        columns->z[itHit] = position.z;
+        columns->time[itHit] = hit.getTime();
+    }
+
+    columns->finish(content);
+    return columns;
+}
+
+void EDM4hepColumns::gather(const edm4hep::CalorimeterHitCollection &hits, const dd4hep::DDSegmentation::BitFieldCoder &decoder,
+                            CaloHitColumns &columns)
+{
+    const size_t layerField = decoder.index("layer");
+
+    columns.resize(hits.size());
+    for (size_t itHit = 0; itHit < hits.size(); itHit++)
+    {
+        const auto hit = hits[itHit];
+        const auto &position = hit.getPosition();
+
+        columns.energy[itHit] = hit.getEnergy();
+        columns.time[itHit] = hit.getTime();
+        columns.x[itHit] = position.x;
+        columns.y[itHit] = position.y;
+        columns.z[itHit] = position.z;
+        columns.layer[itHit] = decoder.get(hit.getCellID(), layerField);
+    }
+
+    columns.finish();
+}
@@ -0,0 +1,128 @@
+// Key4hep frontend of HitSelectorSpace: doublet matching of EDM4hep tracker
+// hits on paired layers, through the same DoubletMatcher as the Marlin
+// processor. Doublets are not stored, EDM4hep has no hit to hit link.
+
+#include "DoubletMatcher.h"
+#include "EDM4hepColumns.h"
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <edm4hep/TrackerHitPlaneCollection.h>
+
+#include "Gaudi/Property.h"
+#include "k4FWCore/Transformer.h"
+
+struct HitSelectorSpaceK4 final
+    : k4FWCore::Transformer<edm4hep::TrackerHitPlaneCollection(const edm4hep::TrackerHitPlaneCollection &)>
+{
+    HitSelectorSpaceK4(const std::string &name, ISvcLocator *svcLoc)
+        : Transformer(name, svcLoc,
+                      {KeyValues("TrackerHitCollectionName", {"VertexBarrelCollection"})},
+                      {KeyValues("GoodHitCollection", {"VertexBarrelGoodCollection"})})
+    {
+    }
+
+    StatusCode initialize() override
+    {
+        DoubletMatcher::Settings settings;
+        settings.maxZ0 = m_maxZ0;
+        settings.beamSpotZ = m_beamSpotZ;
+        settings.maxD0 = m_maxD0;
+        settings.nThreads = m_nThreads;
+        settings.guardMaxHits = m_guardMaxHits;
+        settings.guardMaxPairHits = m_guardMaxPairHits;
+        settings.guardMaxCandidates = m_guardMaxCandidates;
+        settings.windowMinPairHits = std::max(m_crossoverPairHits.value(), 0);
+
+        try
+        {
+            if (m_doubletMatching.value() == "RPhi")
+                settings.matchInR = true;
+            else if (m_doubletMatching.value() != "ThetaPhi")
+                throw std::runtime_error(name() + ": unknown DoubletMatching " + m_doubletMatching.value() + ", use ThetaPhi or RPhi");
+
+            if (m_strategyName.value() == "Auto")
+                settings.strategy = DoubletMatcher::Strategy::Auto;
+            else if (m_strategyName.value() == "BruteForce")
+                settings.strategy = DoubletMatcher::Strategy::BruteForce;
+            else if (m_strategyName.value() == "Window")
+                settings.strategy = DoubletMatcher::Strategy::Window;
+            else
+                throw std::runtime_error(name() + ": unknown MatchingStrategy " + m_strategyName.value() + ", use Auto, BruteForce or Window");
+            settings.simdLevel = SelectionKernel::resolveSimdLevel(m_simdLevelName, name());
+
+            m_matcher.configure(settings, m_layerPairs, name());
+
+            std::string encoding = EDM4hepColumns::cellIDEncoding(this, inputLocations("TrackerHitCollectionName")[0], m_cellIDEncoding);
+            m_decoder = std::make_unique<dd4hep::DDSegmentation::BitFieldCoder>(encoding);
+            info() << "cellID encoding " << encoding << endmsg;
+        }
+        catch (std::exception &e)
+        {
+            error() << e.what() << endmsg;
+            return StatusCode::FAILURE;
+        }
+
+        info() << "Matching strategy " << m_strategyName.value() << ", " << SelectionKernel::simdLevelName(settings.simdLevel)
+               << " scan kernel" << endmsg;
+
+        for (const auto &layerPair : m_matcher.layerPairs())
+        {
+            info() << "Layer pair " << layerPair.second.innerLayer << " -> " << layerPair.second.outerLayer
+                   << " cuts " << layerPair.second.dcoord_cut << " " << layerPair.second.dphi_cut << endmsg;
+        }
+        return StatusCode::SUCCESS;
+    }
+
+    edm4hep::TrackerHitPlaneCollection operator()(const edm4hep::TrackerHitPlaneCollection &hits) const override
+    {
+        // per-call buffers, the algorithm may run on several events at once
+        DoubletMatcher::Scratch scratch;
+        std::vector<size_t> accepted;
+
+        std::unique_ptr<TrackerHitColumns> hitIndex = EDM4hepColumns::trackerHitColumns(hits, m_decoder.get());
+        m_matcher.match(*hitIndex, scratch, accepted);
+        debug() << "Accepted " << accepted.size() << " of " << hits.size() << " hits, " << scratch.nGuardedPairs << " of "
+                << scratch.tasks.size() << " sensor pairs matched in a bounded phi window" << endmsg;
+
+        return EDM4hepColumns::subset(hits, accepted);
+    }
+
+    Gaudi::Property<std::string> m_cellIDEncoding{this, "CellIDEncoding", "",
+                                                   "Encoding of the hit cellIDs, providing the layer, side, module and sensor fields "
+                                                   "(empty: the CellIDEncoding metadata of the input collection)"};
+    Gaudi::Property<std::vector<std::string>> m_layerPairs{this, "LayerPairs",
+                                                           {"0", "1", "0.01", "0.001",
+                                                            "2", "3", "0.005", "0.001",
+                                                            "4", "5", "0.002", "0.001",
+                                                            "6", "7", "0.001", "0.001"},
+                                                           "Doublet layer pairs as quadruplets: inner layer, outer layer, max |dtheta| (or |dr| in mm), max |dphi|"};
+    Gaudi::Property<std::string> m_doubletMatching{this, "DoubletMatching", "ThetaPhi",
+                                                   "Coordinates used to match doublets: ThetaPhi for barrel layers, RPhi for endcap disks"};
+    Gaudi::Property<double> m_maxZ0{this, "MaxZ0", 0.,
+                                    "Maximum distance in z from BeamSpotZ of the doublet extrapolated to the beamline, in mm (<= 0 disables the cut)"};
+    Gaudi::Property<double> m_beamSpotZ{this, "BeamSpotZ", 0., "Centre of the luminous region in z used by the MaxZ0 cut, in mm"};
+    Gaudi::Property<double> m_maxD0{this, "MaxD0", 0., "Maximum transverse impact parameter of the doublet, in mm (<= 0 disables the cut)"};
+    Gaudi::Property<std::string> m_strategyName{this, "MatchingStrategy", "Auto",
+                                                "Auto (per sensor pair, from its number of hits), BruteForce (scan of all outer hits) or Window (phi-sorted outer hits)"};
+    Gaudi::Property<int> m_crossoverPairHits{this, "StrategyCrossoverPairHits", 512,
+                                             "Inner x outer hits of a sensor pair from which Auto uses the phi window (<= 0 measures it in initialize with a short, machine dependent benchmark)"};
+    Gaudi::Property<std::string> m_simdLevelName{this, "SimdLevel", "auto",
+                                                 "Instruction set of the brute-force scan: auto (best supported), scalar, avx2 or avx512"};
+    Gaudi::Property<int> m_nThreads{this, "NumberOfThreads", 1, "Number of threads used to match sensor pairs (1 = serial)"};
+    Gaudi::Property<int> m_guardMaxHits{this, "GuardMaxHits", 0,
+                                        "Above this number of input hits all sensor pairs use the bounded phi-window matching (<= 0 disables)"};
+    Gaudi::Property<int> m_guardMaxPairHits{this, "GuardMaxSensorPairHits", 0,
+                                            "Above this number of inner x outer hits a sensor pair uses the bounded phi-window matching (<= 0 disables)"};
+    Gaudi::Property<int> m_guardMaxCandidates{this, "GuardMaxCandidates", 32,
+                                              "Outer hits, closest in phi first, examined per inner hit by the bounded matching (<= 0 for no limit)"};
+
+    DoubletMatcher m_matcher{};
+    std::unique_ptr<dd4hep::DDSegmentation::BitFieldCoder> m_decoder{};
+};
+
+DECLARE_COMPONENT(HitSelectorSpaceK4)
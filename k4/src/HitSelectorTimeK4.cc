@@ -0,0 +1,98 @@
+// Key4hep frontend of HitSelectorTime: time of flight window (or decision
+// forest) selection of EDM4hep tracker hits, through the same
+// TrackerTimeSelection as the Marlin processor.
+
+#include "EDM4hepColumns.h"
+#include "TrackerTimeSelection.h"
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <edm4hep/TrackerHitPlaneCollection.h>
+
+#include "Gaudi/Property.h"
+#include "k4FWCore/Transformer.h"
+
+struct HitSelectorTimeK4 final
+    : k4FWCore::Transformer<edm4hep::TrackerHitPlaneCollection(const edm4hep::TrackerHitPlaneCollection &)>
+{
+    HitSelectorTimeK4(const std::string &name, ISvcLocator *svcLoc)
+        : Transformer(name, svcLoc,
+                      {KeyValues("TrackerHitCollectionName", {"VertexBarrelCollection"})},
+                      {KeyValues("GoodHitCollection", {"VertexBarrelGoodCollection"})})
+    {
+    }
+
+    StatusCode initialize() override
+    {
+        TrackerTimeSelection::Settings settings;
+        settings.forestCut = m_forestCut;
+        try
+        {
+            settings.simdLevel = SelectionKernel::resolveSimdLevel(m_simdLevelName, name());
+            m_selection.configure(settings);
+
+            if (m_selectionMode.value() == "Forest")
+            {
+                m_selection.loadForest(m_forestModelFile, name());
+                info() << "decision forest: " << m_selection.forest().nTrees() << " trees of depth " << m_selection.forest().depth()
+                       << ", " << SelectionKernel::simdLevelName(settings.simdLevel) << " kernel" << endmsg;
+            }
+            else if (m_selectionMode.value() != "Cuts")
+            {
+                throw std::runtime_error(name() + ": unknown SelectionMode " + m_selectionMode.value() + ", use Cuts or Forest");
+            }
+
+            const std::vector<TrackerTimeSelection::ForestFeature> &features = m_selection.forestFeatures();
+            if (m_selection.useForest() &&
+                std::find(features.begin(), features.end(), TrackerTimeSelection::ForestFeature::Layer) != features.end())
+                m_indexContent = TrackerHitColumns::CellIDFields;
+
+            // the encoding is needed only when the cellIDs are decoded
+            if (m_indexContent >= TrackerHitColumns::CellIDFields)
+            {
+                std::string encoding = EDM4hepColumns::cellIDEncoding(this, inputLocations("TrackerHitCollectionName")[0], m_cellIDEncoding);
+                m_decoder = std::make_unique<dd4hep::DDSegmentation::BitFieldCoder>(encoding);
+                info() << "cellID encoding " << encoding << endmsg;
+            }
+        }
+        catch (std::exception &e)
+        {
+            error() << e.what() << endmsg;
+            return StatusCode::FAILURE;
+        }
+        return StatusCode::SUCCESS;
+    }
+
+    edm4hep::TrackerHitPlaneCollection operator()(const edm4hep::TrackerHitPlaneCollection &hits) const override
+    {
+        // per-call buffers, the algorithm may run on several events at once
+        TrackerTimeSelection::Scratch scratch;
+        std::vector<size_t> accepted;
+
+        std::unique_ptr<TrackerHitColumns> hitIndex = EDM4hepColumns::trackerHitColumns(hits, m_decoder.get(), m_indexContent);
+        m_selection.select(*hitIndex, scratch, accepted);
+        debug() << "Accepted " << accepted.size() << " of " << hits.size() << " hits" << endmsg;
+
+        return EDM4hepColumns::subset(hits, accepted);
+    }
+
+    Gaudi::Property<std::string> m_cellIDEncoding{this, "CellIDEncoding", "",
+                                                   "Encoding of the hit cellIDs, providing the layer field for the forest "
+                                                   "(empty: the CellIDEncoding metadata of the input collection)"};
+    Gaudi::Property<std::string> m_selectionMode{this, "SelectionMode", "Cuts", "Cuts (time of flight window) or Forest (decision forest score)"};
+    Gaudi::Property<std::string> m_forestModelFile{this, "ForestModelFile", "", "Decision forest model, features among time, theta, r, layer"};
+    Gaudi::Property<double> m_forestCut{this, "ForestCut", 0., "Minimum decision forest score of accepted hits"};
+    Gaudi::Property<std::string> m_simdLevelName{this, "SimdLevel", "auto",
+                                                 "Forest evaluation: auto, avx512, avx2 or scalar (falls back to what the CPU supports)"};
+
+    TrackerTimeSelection m_selection{};
+    std::unique_ptr<dd4hep::DDSegmentation::BitFieldCoder> m_decoder{};
+    // the cellID fields are only decoded for a forest using the layer
+    TrackerHitColumns::Content m_indexContent = TrackerHitColumns::Positions;
+};
+
+DECLARE_COMPONENT(HitSelectorTimeK4)
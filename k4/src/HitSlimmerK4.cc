@@ -0,0 +1,55 @@
+// Key4hep frontend of HitSlimmer: EDM4hep tracker hits not used by any of
+// the input tracks. Track hits are matched to the input collection by their
+// object ids, so no hit lookup table is needed.
+
+#include "EDM4hepColumns.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <edm4hep/TrackCollection.h>
+#include <edm4hep/TrackerHitPlaneCollection.h>
+
+#include "k4FWCore/Transformer.h"
+
+struct HitSlimmerK4 final
+    : k4FWCore::Transformer<edm4hep::TrackerHitPlaneCollection(const edm4hep::TrackerHitPlaneCollection &,
+                                                               const edm4hep::TrackCollection &)>
+{
+    HitSlimmerK4(const std::string &name, ISvcLocator *svcLoc)
+        : Transformer(name, svcLoc,
+                      {KeyValues("HitsCollectionName", {"HitsCollection"}),
+                       KeyValues("TrackCollectionName", {"Tracks"})},
+                      {KeyValues("SlimmedHitsCollectionName", {"SlimmedHits"})})
+    {
+    }
+
+    edm4hep::TrackerHitPlaneCollection operator()(const edm4hep::TrackerHitPlaneCollection &hits,
+                                                  const edm4hep::TrackCollection &tracks) const override
+    {
+        // Mark the hits of the tracks that belong to the input collection
+        std::vector<uint8_t> used(hits.size(), 0);
+        for (const auto &track : tracks)
+        {
+            for (const auto &hit : track.getTrackerHits())
+            {
+                podio::ObjectID id = hit.getObjectID();
+                if (id.collectionID == hits.getID() && id.index >= 0 && static_cast<size_t>(id.index) < hits.size())
+                    used[id.index] = 1;
+            }
+        }
+
+        std::vector<size_t> unused;
+        for (size_t itHit = 0; itHit < hits.size(); itHit++)
+        {
+            if (!used[itHit])
+                unused.push_back(itHit);
+        }
+        debug() << "Total hits: " << hits.size() << ", unused hits: " << unused.size() << endmsg;
+
+        return EDM4hepColumns::subset(hits, unused);
+    }
+};
+
+DECLARE_COMPONENT(HitSlimmerK4)
@@ -0,0 +1,85 @@
+// Key4hep frontend of HitSplitter: EDM4hep tracker hits split in theta (or
+// eta) and phi regions, through the same RegionGrid as the Marlin processor.
+// The output collections are listed in region order, see regionSuffixes().
+
+#include "EDM4hepColumns.h"
+#include "RegionGrid.h"
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include <edm4hep/TrackerHitPlaneCollection.h>
+
+#include "Gaudi/Property.h"
+#include "k4FWCore/Transformer.h"
+
+struct HitSplitterK4 final
+    : k4FWCore::Transformer<std::vector<edm4hep::TrackerHitPlaneCollection>(const edm4hep::TrackerHitPlaneCollection &)>
+{
+    HitSplitterK4(const std::string &name, ISvcLocator *svcLoc)
+        : Transformer(name, svcLoc,
+                      {KeyValues("TrackerHitCollectionName", {"InputCollection"})},
+                      {KeyValues("SplitHitCollections", {"SplitCollection030", "SplitCollection3050", "SplitCollection5070",
+                                                         "SplitCollection7090", "SplitCollectionN7090", "SplitCollectionN5070",
+                                                         "SplitCollectionN3050", "SplitCollectionN030"})})
+    {
+    }
+
+    StatusCode initialize() override
+    {
+        try
+        {
+            m_grid.configure(m_polarVariable, m_polarEdges, m_nPhiSectors, m_polarOverlap, m_phiOverlap, name());
+        }
+        catch (std::exception &e)
+        {
+            error() << e.what() << endmsg;
+            return StatusCode::FAILURE;
+        }
+
+        // one output collection per region, in the order of the region names of the Marlin processor
+        if (outputLocations(0).size() != m_grid.nRegions())
+        {
+            error() << "SplitHitCollections must list " << m_grid.nRegions() << " collections, for the regions";
+            for (const std::string &suffix : m_grid.regionSuffixes())
+                error() << " " << suffix;
+            error() << endmsg;
+            return StatusCode::FAILURE;
+        }
+        return StatusCode::SUCCESS;
+    }
+
+    std::vector<edm4hep::TrackerHitPlaneCollection> operator()(const edm4hep::TrackerHitPlaneCollection &hits) const override
+    {
+        // theta and phi columns of the hits, and the per-call assignment
+        std::vector<double> theta(hits.size());
+        std::vector<double> phi(hits.size());
+        for (size_t itHit = 0; itHit < hits.size(); itHit++)
+        {
+            const auto &position = hits[itHit].getPosition();
+            theta[itHit] = std::atan2(std::sqrt(position.x * position.x + position.y * position.y), position.z);
+            phi[itHit] = std::atan2(position.y, position.x);
+        }
+
+        RegionGrid::Assignment assignment;
+        m_grid.assign(theta.data(), phi.data(), hits.size(), assignment);
+
+        std::vector<edm4hep::TrackerHitPlaneCollection> regions;
+        regions.reserve(m_grid.nRegions());
+        for (size_t itRegion = 0; itRegion < m_grid.nRegions(); itRegion++)
+            regions.push_back(EDM4hepColumns::subset(hits, assignment.regionHits[itRegion]));
+        return regions;
+    }
+
+    Gaudi::Property<std::string> m_polarVariable{this, "PolarVariable", "Theta", "Theta (edges in degrees) or Eta"};
+    Gaudi::Property<std::vector<double>> m_polarEdges{this, "PolarEdges", {0., 30., 50., 70., 90., 110., 130., 150., 180.},
+                                                      "Increasing bin edges of the polar variable"};
+    Gaudi::Property<int> m_nPhiSectors{this, "PhiSectors", 1, "Number of equal phi sectors, starting at -pi"};
+    Gaudi::Property<double> m_polarOverlap{this, "PolarOverlap", 0., "Margin added on both sides of each polar bin, in units of the polar variable"};
+    Gaudi::Property<double> m_phiOverlap{this, "PhiOverlap", 0., "Margin added on both sides of each phi sector [rad]"};
+
+    RegionGrid m_grid{};
+};
+
+DECLARE_COMPONENT(HitSplitterK4)
@@ -0,0 +1,152 @@
+#include "AcceptanceMask.h"
+
+#include <algorithm>
+
+#include <EVENT/Exceptions.h>
+#include <EVENT/LCIO.h>
+
+namespace AcceptanceMask
+{
+
+    bool parseOutputMode(const std::string &outputMode, const std::string &processorName)
+    {
+        if (outputMode == "Subset")
+            return false;
+        if (outputMode == "Mask")
+            return true;
+        throw EVENT::Exception(processorName + ": unknown OutputMode " + outputMode + ", use Subset or Mask");
+    }
+
+    IMPL::LCGenericObjectImpl *encode(const std::vector<size_t> &accepted, size_t nElements)
+    {
+        IMPL::LCGenericObjectImpl *mask = new IMPL::LCGenericObjectImpl();
+        unsigned int nValues = 0;
+        mask->setIntVal(nValues++, static_cast<int>(nElements));
+
+        // alternating rejected and accepted run lengths
+        size_t position = 0;
+        size_t itAccepted = 0;
+        while (itAccepted < accepted.size())
+        {
+            size_t runBegin = accepted[itAccepted];
+            size_t runEnd = runBegin + 1;
+            itAccepted++;
+            while (itAccepted < accepted.size() && accepted[itAccepted] == runEnd)
+            {
+                runEnd++;
+                itAccepted++;
+            }
+
+            mask->setIntVal(nValues++, static_cast<int>(runBegin - position));
+            mask->setIntVal(nValues++, static_cast<int>(runEnd - runBegin));
+            position = runEnd;
+        }
+        if (position < nElements)
+            mask->setIntVal(nValues++, static_cast<int>(nElements - position));
+
+        return mask;
+    }
+
+    size_t decode(const EVENT::LCGenericObject *mask, std::vector<size_t> &accepted)
+    {
+        accepted.clear();
+        if (mask == nullptr || mask->getNInt() < 1)
+            throw EVENT::Exception("AcceptanceMask: empty mask");
+
+        size_t nElements = mask->getIntVal(0);
+        size_t position = 0;
+        for (int itRun = 1; itRun < mask->getNInt(); itRun++)
+        {
+            int runLength = mask->getIntVal(itRun);
+            if (runLength < 0 || position + runLength > nElements)
+                throw EVENT::Exception("AcceptanceMask: run lengths do not match the collection size");
+
+            // even runs are accepted
+            if (itRun % 2 == 0)
+                for (int itElement = 0; itElement < runLength; itElement++)
+                    accepted.push_back(position + itElement);
+            position += runLength;
+        }
+        return nElements;
+    }
+
+    IMPL::LCCollectionVec *newMaskCollection(const std::string &inputCollectionName)
+    {
+        IMPL::LCCollectionVec *maskCollection = new IMPL::LCCollectionVec(EVENT::LCIO::LCGENERICOBJECT);
+        maskCollection->parameters().setValue("InputCollection", inputCollectionName);
+        return maskCollection;
+    }
+
+    void addMask(IMPL::LCCollectionVec *maskCollection, const std::string &maskName,
+                 const std::vector<size_t> &accepted, size_t nElements)
+    {
+        EVENT::StringVec maskNames;
+        maskCollection->getParameters().getStringVals("MaskNames", maskNames);
+        maskNames.push_back(maskName);
+        maskCollection->parameters().setValues("MaskNames", maskNames);
+        maskCollection->addElement(encode(accepted, nElements));
+    }
+
+    IMPL::LCCollectionVec *storeSelection(EVENT::LCEvent *evt, const std::string &outputName, const std::string &inputCollectionName,
+                                          const std::vector<size_t> &accepted, size_t nElements)
+    {
+        IMPL::LCCollectionVec *maskCollection = newMaskCollection(inputCollectionName);
+        addMask(maskCollection, outputName, accepted, nElements);
+        evt->addCollection(maskCollection, collectionName(outputName));
+        return maskCollection;
+    }
+
+    IMPL::LCCollectionVec *expand(EVENT::LCEvent *evt, const std::string &outputName, const std::string &maskName)
+    {
+        // throws DataNotAvailableException if either collection is missing
+        EVENT::LCCollection *maskCollection = evt->getCollection(collectionName(outputName));
+        EVENT::LCCollection *input = evt->getCollection(maskCollection->getParameters().getStringVal("InputCollection"));
+
+        EVENT::StringVec maskNames;
+        maskCollection->getParameters().getStringVals("MaskNames", maskNames);
+        size_t itMask = 0;
+        if (!maskName.empty())
+        {
+            itMask = std::find(maskNames.begin(), maskNames.end(), maskName) - maskNames.begin();
+            if (itMask == maskNames.size())
+                throw EVENT::Exception("AcceptanceMask: no mask " + maskName + " in " + collectionName(outputName));
+        }
+        if (static_cast<int>(itMask) >= maskCollection->getNumberOfElements())
+            throw EVENT::Exception("AcceptanceMask: no masks in " + collectionName(outputName));
+
+        std::vector<size_t> accepted;
+        const EVENT::LCGenericObject *mask = static_cast<EVENT::LCGenericObject *>(maskCollection->getElementAt(itMask));
+        if (decode(mask, accepted) != static_cast<size_t>(input->getNumberOfElements()))
+            throw EVENT::Exception("AcceptanceMask: " + collectionName(outputName) + " does not match the size of its input collection");
+
+        IMPL::LCCollectionVec *subset = new IMPL::LCCollectionVec(input->getTypeName());
+        subset->setFlag(input->getFlag());
+        subset->setSubset(true);
+        subset->parameters().setValue(EVENT::LCIO::CellIDEncoding, input->getParameters().getStringVal(EVENT::LCIO::CellIDEncoding));
+        subset->reserve(accepted.size());
+        for (size_t itElement : accepted)
+            subset->addElement(input->getElementAt(itElement));
+        return subset;
+    }
+
+    void expandToEvent(EVENT::LCEvent *evt, const std::string &outputName, std::vector<std::string> &existingNames)
+    {
+        EVENT::LCCollection *maskCollection = evt->getCollection(collectionName(outputName));
+
+        EVENT::StringVec maskNames;
+        maskCollection->getParameters().getStringVals("MaskNames", maskNames);
+        existingNames.clear();
+        for (const std::string &maskName : maskNames)
+        {
+            // addCollection would throw on a name already taken
+            const std::vector<std::string> *eventNames = evt->getCollectionNames();
+            if (std::find(eventNames->begin(), eventNames->end(), maskName) != eventNames->end())
+            {
+                existingNames.push_back(maskName);
+                continue;
+            }
+            evt->addCollection(expand(evt, outputName, maskName), maskName);
+        }
+    }
+
+} // namespace AcceptanceMask
@@ -0,0 +1,68 @@
+#include "BlockWriter.h"
+
+#include <EVENT/Exceptions.h>
+
+BlockWriter::BlockWriter(const std::string &fileName, const char *magic, size_t maxQueuedBlocks, size_t fileBufferSize,
+                         const std::string &owner)
+    : m_maxQueuedBlocks(maxQueuedBlocks)
+{
+    m_file = std::fopen(fileName.c_str(), "wb");
+    if (m_file == nullptr)
+        throw EVENT::Exception(owner + ": cannot open " + fileName);
+    if (fileBufferSize > 0)
+    {
+        m_fileBuffer.resize(fileBufferSize);
+        std::setvbuf(m_file, m_fileBuffer.data(), _IOFBF, m_fileBuffer.size());
+    }
+    std::fwrite(magic, 1, 8, m_file);
+
+    m_writer = std::thread(&BlockWriter::writeLoop, this);
+}
+
+BlockWriter::~BlockWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_queueChanged.notify_all();
+    m_writer.join();
+    std::fclose(m_file);
+}
+
+void BlockWriter::submit(std::unique_ptr<Block> block)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_queueChanged.wait(lock, [this]()
+                        { return m_queue.size() < m_maxQueuedBlocks || m_stopping; });
+    m_queue.push_back(std::move(block));
+    lock.unlock();
+    m_queueChanged.notify_all();
+}
+
+void BlockWriter::writeLoop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_queueChanged.wait(lock, [this]()
+                            { return !m_queue.empty() || m_stopping; });
+        if (m_queue.empty())
+            return;
+
+        std::unique_ptr<Block> block = std::move(m_queue.front());
+        m_queue.pop_front();
+        lock.unlock();
+        m_queueChanged.notify_all();
+
+        // the size leads the payload, so the whole payload is encoded first
+        m_payload.clear();
+        block->encode(m_payload);
+        uint32_t header[2] = {block->type(), static_cast<uint32_t>(m_payload.size())};
+        std::fwrite(header, sizeof(uint32_t), 2, m_file);
+        std::fwrite(m_payload.data(), 1, m_payload.size(), m_file);
+        block.reset();
+
+        lock.lock();
+    }
+}
@@ -0,0 +1,21 @@
+#include "CaloConeSelection.h"
+
+#include "SelectionKernel.h"
+
+bool CaloConeSelection::select(const CaloHitColumns &columns, const double *px, const double *py, const double *pz, size_t nParticles,
+                               Scratch &scratch, std::vector<size_t> &accepted) const
+{
+    bool guarded = m_settings.guardMaxPairs > 0 && columns.size() * nParticles > static_cast<size_t>(m_settings.guardMaxPairs);
+    if (guarded)
+    {
+        // same decisions, but each hit only meets the particles of the nearby grid cells
+        scratch.grid.build(px, py, pz, nParticles, m_settings.coneSize);
+        SelectionKernel::selectHits(columns.view(), SelectionKernel::ConeAroundGrid{&scratch.grid}, accepted);
+    }
+    else
+    {
+        SelectionKernel::ConeAroundAny cone = {px, py, pz, nParticles, m_settings.coneSize};
+        SelectionKernel::selectHits(columns.view(), cone, accepted);
+    }
+    return guarded;
+}
@@ -1,16 +1,22 @@
 #include "CaloConer.h"
+#include "SelectionKernel.h"
+#include "LCIOColumns.h"
+#include "AcceptanceMask.h"
+#include "HotLoopLog.h"
+#include "RelationPool.h"
+#include <algorithm>
 #include <iostream>
 #include <vector>
 #include <map>
 #include <math.h>
 #include <filesystem>
+#include <sstream>
 
 #include <EVENT/LCCollection.h>
 #include <EVENT/CalorimeterHit.h>
 #include <EVENT/SimCalorimeterHit.h>
 #include <EVENT/MCParticle.h>
 
-#include <UTIL/LCRelationNavigator.h>
 #include <IMPL/LCCollectionVec.h>
 
 #include <UTIL/CellIDDecoder.h>
@@ -69,6 +75,29 @@ CaloConer::CaloConer() : Processor("CaloConer")
                                "Cut in radians",
                                m_ConeSize,
                                0.2);
+
+    // Subset collections or run-length masks
+    registerProcessorParameter("OutputMode",
+                               "Subset (subset collections) or Mask (run-length encoded masks in <output>_Mask)",
+                               m_outputMode,
+                               std::string("Subset"));
+
+    // Occupancy guard
+    registerProcessorParameter("GuardMaxHitParticlePairs",
+                               "Above this number of hits x particles, match hits through a theta-phi particle grid and flag the event (<= 0 disables)",
+                               m_guardMaxPairs,
+                               int(0));
+
+    // Differential validation
+    registerProcessorParameter("ValidationFraction",
+                               "Fraction of the events also selected with the reference per-hit loop and compared (0 disables)",
+                               m_validationFraction,
+                               double(0.));
+
+    registerProcessorParameter("ValidationMaxReports",
+                               "Number of differing hits and relations reported in detail over the job",
+                               m_validationMaxReports,
+                               int(20));
 }
 
 void CaloConer::init()
@@ -81,6 +110,14 @@ void CaloConer::init()
 
     _nRun = 0;
     _nEvt = 0;
+
+    m_outputMask = AcceptanceMask::parseOutputMode(m_outputMode, name());
+
+    CaloConeSelection::Settings settings;
+    settings.coneSize = m_ConeSize;
+    settings.guardMaxPairs = m_guardMaxPairs;
+    m_selection.configure(settings);
+    m_validator.configure(m_validationFraction, std::max(m_validationMaxReports, 0));
 }
 
 void CaloConer::processRunHeader(LCRunHeader *run)
@@ -112,68 +149,78 @@ void CaloConer::processEvent(LCEvent *evt)
     if (caloHitCollection != 0 && inputHitRel != 0)
     {
 
+        bool validate = m_validator.sampleEvent(evt->getRunNumber(), evt->getEventNumber());
+
         std::string encoderString = caloHitCollection->getParameters().getStringVal(LCIO::CellIDEncoding);
 
         // Make the output collections
-        outputHitCol = new LCCollectionVec(caloHitCollection->getTypeName());
-        outputHitCol->setSubset(true);
-        outputHitCol->parameters().setValue(LCIO::CellIDEncoding, encoderString);
-        outputHitCol->setFlag(outputHitCol->getFlag() | (1 << EVENT::LCIO::CHBIT_LONG));
-        outputHitCol->setFlag(outputHitCol->getFlag() | (1 << EVENT::LCIO::RCHBIT_TIME));
+        if (!m_outputMask)
+        {
+            outputHitCol = LCIOColumns::newSubsetCollection(caloHitCollection, encoderString);
+            outputHitCol->setFlag(outputHitCol->getFlag() | (1 << EVENT::LCIO::CHBIT_LONG));
+            outputHitCol->setFlag(outputHitCol->getFlag() | (1 << EVENT::LCIO::RCHBIT_TIME));
+        }
 
-        // reco-sim relation output collections
-        UTIL::LCRelationNavigator thitNav = UTIL::LCRelationNavigator( LCIO::CALORIMETERHIT, LCIO::SIMCALORIMETERHIT );
 
-        int nHits = caloHitCollection->getNumberOfElements();
+        // Directions of the generator-level particles; the validator times the same steps as the reference
+        if (validate)
+            m_validator.beginFast();
+        m_partPx.clear();
+        m_partPy.clear();
+        m_partPz.clear();
+        int nParts = MCpartCollection->getNumberOfElements();
+        for (int itPart = 0; itPart < nParts; itPart++)
+        {
+            MCParticle *part = static_cast<MCParticle *>(MCpartCollection->getElementAt(itPart));
+            if (part->getGeneratorStatus() != 1)
+                continue;
+
+            m_partPx.push_back(part->getMomentum()[0]);
+            m_partPy.push_back(part->getMomentum()[1]);
+            m_partPz.push_back(part->getMomentum()[2]);
+        }
 
-        // Now loop over hits again applying threshold
-        for (int itHit = 0; itHit < nHits; itHit++)
+        // Keep hits within the cone of any of them
+        LCIOColumns::gather(caloHitCollection, m_columns);
+        bool guarded = m_selection.select(m_columns, m_partPx.data(), m_partPy.data(), m_partPz.data(), m_partPx.size(), m_scratch, m_accepted);
+        if (validate)
+            m_validator.endFast();
+        if (guarded)
         {
-            // Get the hit
-            CalorimeterHit *hit = dynamic_cast<CalorimeterHit *>(caloHitCollection->getElementAt(itHit));
-
-            // hit position
-            TVector3 hitPos(hit->getPosition()[0], hit->getPosition()[1], hit->getPosition()[2]);
-            bool save = false;
-
-            // Loop over MC particles and keep hit if within cone from particle 
-            int nParts = MCpartCollection->getNumberOfElements();
-            
-            for (int itPart = 0; itPart < nParts; itPart++)
-            {
-                // Get MC part
-                MCParticle *part = dynamic_cast<MCParticle *>(MCpartCollection->getElementAt(itPart));
-                
-                // --- Keep only the generator-level particles:
-                if ( part->getGeneratorStatus() != 1 ) continue;
-                
-                TLorentzVector part_TLV(part->getMomentum()[0],part->getMomentum()[1],part->getMomentum()[2],part->getEnergy());
-
-                double deltaR = fabs(part_TLV.Angle(hitPos));
-                if(deltaR < m_ConeSize){
-                    save =  true;
-                    break;
-                }
-                
-            }
+            m_nGuardedEvents++;
+            streamlog_out(DEBUG5) << "Occupancy guard: " << m_columns.size() << " hits x " << m_partPx.size()
+                                  << " particles, using a grid of " << m_scratch.grid.nCells() << " cells" << std::endl;
+        }
 
-            if (save)
-            {
-                streamlog_out(DEBUG0) << " accepted hit " << std::endl;
+        // reco-sim relations of the accepted hits, handed to the event
+        LCCollectionVec *outputRelCol = RelationPool::newCollection(LCIO::CALORIMETERHIT, LCIO::SIMCALORIMETERHIT, m_accepted.size());
+        for (size_t itHit : m_accepted)
+        {
+            CalorimeterHit *hit = static_cast<CalorimeterHit *>(caloHitCollection->getElementAt(itHit));
+
+            hotloop_out(DEBUG0) << " accepted hit " << std::endl;
 
+            if (outputHitCol != 0)
                 outputHitCol->addElement(hit);
 
-                LCRelation *rel = static_cast<LCRelation *>(inputHitRel->getElementAt(itHit));
-                SimCalorimeterHit *simhit = static_cast<SimCalorimeterHit *>(rel->getTo());
+            LCRelation *rel = static_cast<LCRelation *>(inputHitRel->getElementAt(itHit));
+            SimCalorimeterHit *simhit = static_cast<SimCalorimeterHit *>(rel->getTo());
 
-                thitNav.addRelation(hit, simhit);
-            }
+            outputRelCol->addElement(new PooledRelation(hit, simhit));
         }
 
         // Store the filtered hit collections
-        evt->addCollection(outputHitCol, m_outputHitCollection);
-        outputHitRel = thitNav.createLCCollection();
+        LCCollection *storedHitCol = outputHitCol;
+        if (m_outputMask)
+            storedHitCol = AcceptanceMask::storeSelection(evt, m_outputHitCollection, m_inputHitCollection, m_accepted, m_columns.size());
+        else
+            evt->addCollection(outputHitCol, m_outputHitCollection);
+        storedHitCol->parameters().setValue("OccupancyGuard", int(guarded));
+        outputHitRel = outputRelCol;
         evt->addCollection(outputHitRel, m_outputRelationCollection);
+
+        if (validate)
+            validateEvent(MCpartCollection, caloHitCollection, inputHitRel, outputHitRel);
     }
 
     //-- note: this will not be printed if compiled w/o MARLINDEBUG=1 !
@@ -190,11 +237,101 @@ void CaloConer::check(LCEvent *evt)
 
 void CaloConer::end()
 {
+    streamlog_out(MESSAGE) << name() << ": occupancy guard triggered in " << m_nGuardedEvents
+                           << " of " << _nEvt << " events" << std::endl;
+
+    std::ostringstream pool;
+    RelationPool::print(pool, name());
+    streamlog_out(MESSAGE) << pool.str();
+
+    if (m_validator.enabled())
+    {
+        std::ostringstream summary;
+        m_validator.print(summary, name());
+        streamlog_out(MESSAGE) << summary.str();
+    }
+
     //   std::cout << "CaloConer::end()  " << name()
     // 	    << " processed " << _nEvt << " events in " << _nRun << " runs "
     // 	    << std::endl ;
 }
 
+void CaloConer::referenceSelection(LCCollection *MCpartCollection, LCCollection *caloHitCollection,
+                                   std::vector<size_t> &accepted, std::vector<DifferentialValidator::RelationPair> &relations)
+{
+    accepted.clear();
+    relations.clear();
+    int nHits = caloHitCollection->getNumberOfElements();
+    for (int itHit = 0; itHit < nHits; itHit++)
+    {
+        // Get the hit
+        CalorimeterHit *hit = static_cast<CalorimeterHit *>(caloHitCollection->getElementAt(itHit));
+
+        // hit position
+        TVector3 hitPos(hit->getPosition()[0], hit->getPosition()[1], hit->getPosition()[2]);
+        bool save = false;
+
+        // Loop over MC particles and keep hit if within cone from particle
+        int nParts = MCpartCollection->getNumberOfElements();
+
+        for (int itPart = 0; itPart < nParts; itPart++)
+        {
+            // Get MC part
+            MCParticle *part = static_cast<MCParticle *>(MCpartCollection->getElementAt(itPart));
+
+            // --- Keep only the generator-level particles:
+            if ( part->getGeneratorStatus() != 1 ) continue;
+
+            TLorentzVector part_TLV(part->getMomentum()[0],part->getMomentum()[1],part->getMomentum()[2],part->getEnergy());
+
+            double deltaR = fabs(part_TLV.Angle(hitPos));
+            if(deltaR < m_ConeSize){
+                save =  true;
+                break;
+            }
+        }
+
+        if (save)
+        {
+            // the relation at the index of the hit is carried over
+            accepted.push_back(itHit);
+            relations.push_back({itHit, itHit});
+        }
+    }
+}
+
+void CaloConer::validateEvent(LCCollection *MCpartCollection, LCCollection *caloHitCollection, LCCollection *inputHitRel,
+                              LCCollection *outputHitRel)
+{
+    m_validator.beginReference();
+    referenceSelection(MCpartCollection, caloHitCollection, m_referenceAccepted, m_referenceRelations);
+    m_validator.endReference();
+
+    // relations as (hit, input relation) indices
+    std::vector<DifferentialValidator::RelationPair> fastPairs = DifferentialValidator::carriedRelations(caloHitCollection, inputHitRel, outputHitRel);
+
+    auto describeHit = [&](size_t itHit)
+    {
+        if (itHit >= m_columns.size())
+            return std::string("not in the input collection");
+
+        // angle to the closest generator-level particle
+        TVector3 hitPos(m_columns.x[itHit], m_columns.y[itHit], m_columns.z[itHit]);
+        double closest = TMath::Pi();
+        for (size_t itPart = 0; itPart < m_partPx.size(); itPart++)
+            closest = std::min(closest, hitPos.Angle(TVector3(m_partPx[itPart], m_partPy[itPart], m_partPz[itPart])));
+
+        std::ostringstream details;
+        details << "position (" << m_columns.x[itHit] << ", " << m_columns.y[itHit] << ", " << m_columns.z[itHit]
+                << ") closest particle at " << closest << " rad, cone " << m_ConeSize;
+        return details.str();
+    };
+
+    std::ostringstream report;
+    if (m_validator.compare(m_accepted, m_referenceAccepted, fastPairs, m_referenceRelations, describeHit, report) > 0)
+        streamlog_out(WARNING) << name() << " differs from the reference selection in " << report.str();
+}
+
 void CaloConer::getCollection(LCCollection *&collection, const std::string &collectionName, LCEvent *evt)
 {
     try
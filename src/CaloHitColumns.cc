@@ -0,0 +1,61 @@
+#include "CaloHitColumns.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "TMath.h"
+#include "TVector3.h"
+
+void CaloHitColumns::resize(size_t nHits)
+{
+    energy.resize(nHits);
+    time.resize(nHits);
+    x.resize(nHits);
+    y.resize(nHits);
+    z.resize(nHits);
+    layer.resize(nHits);
+    theta.resize(nHits);
+    threshold.resize(nHits);
+    correction.resize(nHits);
+}
+
+void CaloHitColumns::finish()
+{
+    for (size_t itHit = 0; itHit < size(); itHit++)
+    {
+        TVector3 hitPos(x[itHit], y[itHit], z[itHit]);
+        double hit_theta = hitPos.Theta();
+        if (hit_theta > TMath::Pi() / 2) // maps are symmetrized around pi/2
+        {
+            hit_theta = TMath::Pi() - hit_theta;
+        }
+        theta[itHit] = hit_theta;
+    }
+}
+
+uint64_t CaloHitColumns::cellKey(size_t i) const
+{
+    const double angleBins = (1 << 24) - 1;
+
+    double hit_theta = std::atan2(std::sqrt(double(x[i]) * x[i] + double(y[i]) * y[i]), double(z[i]));
+    double hit_phi = std::atan2(double(y[i]), double(x[i])) + TMath::Pi();
+    uint64_t thetaBin = static_cast<uint64_t>(hit_theta / TMath::Pi() * angleBins);
+    uint64_t phiBin = static_cast<uint64_t>(hit_phi / TMath::TwoPi() * angleBins);
+    uint64_t layerBin = std::min<uint64_t>(layer[i], 0xFFFF);
+
+    return (layerBin << 48) | (thetaBin << 24) | phiBin;
+}
+
+SelectionKernel::CaloHitView CaloHitColumns::view() const
+{
+    SelectionKernel::CaloHitView view;
+    view.size = size();
+    view.energy = energy.data();
+    view.time = time.data();
+    view.x = x.data();
+    view.y = y.data();
+    view.z = z.data();
+    view.threshold = threshold.data();
+    view.correction = correction.data();
+    return view;
+}
@@ -0,0 +1,314 @@
+#include "CaloHitGanger.h"
+#include "HotLoopLog.h"
+#include "RelationPool.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+#include <EVENT/LCCollection.h>
+#include <EVENT/CalorimeterHit.h>
+#include <EVENT/Exceptions.h>
+#include <EVENT/LCRelation.h>
+
+#include <IMPL/CalorimeterHitImpl.h>
+#include <IMPL/LCCollectionVec.h>
+
+#include <UTIL/BitField64.h>
+
+// ----- include for verbosity dependend logging ---------
+#include "marlin/VerbosityLevels.h"
+
+using namespace lcio;
+using namespace marlin;
+
+CaloHitGanger aCaloHitGanger;
+
+CaloHitGanger::CaloHitGanger() : Processor("CaloHitGanger")
+{
+
+    // Modify processor description
+    _description = "CaloHitGanger merges calo hits into coarser virtual cells before the selection";
+
+    // Input collection
+    registerProcessorParameter("CaloHitCollectionName",
+                               "Name of the CalorimeterHit input collection",
+                               m_inputHitCollection,
+                               std::string("HcalBarrelCollectionRec"));
+
+    // Input relation collection
+    registerProcessorParameter("CaloRelationCollectionName",
+                               "Name of the CalorimeterHit input relation collection, one per hit (empty disables the sim relations)",
+                               m_inputRelationCollection,
+                               std::string("HcalBarrelRelationsSimRec"));
+
+    // Output collection
+    registerProcessorParameter("GangedHitCollection",
+                               "Hits merged into virtual cells",
+                               m_outputHitCollection,
+                               std::string("HcalBarrelCollectionGanged"));
+
+    // Output relation collections
+    registerProcessorParameter("GangedRelationCollection",
+                               "Relations from the ganged hits to the original hits, weighted by energy fraction",
+                               m_outputRelationCollection,
+                               std::string("HcalBarrelRelationsGangedRec"));
+
+    registerProcessorParameter("GangedSimRelationCollection",
+                               "Relations from the ganged hits to the SimCalorimeterHit of their most energetic original, one per ganged hit",
+                               m_outputSimRelationCollection,
+                               std::string("HcalBarrelRelationsSimGanged"));
+
+    // Virtual cell size
+    StringVec defaultGangingFactors = {"x", "2", "y", "2"};
+    registerProcessorParameter("GangingFactors",
+                               "Pairs of cellID field name and number of cells merged along it",
+                               m_gangingFactors,
+                               defaultGangingFactors);
+}
+
+void CaloHitGanger::init()
+{
+
+    streamlog_out(DEBUG) << "   init called  " << std::endl;
+
+    // usually a good idea to
+    printParameters();
+
+    _nRun = 0;
+    _nEvt = 0;
+
+    if (m_gangingFactors.empty() || m_gangingFactors.size() % 2 != 0)
+        throw EVENT::Exception("CaloHitGanger: GangingFactors must contain pairs of cellID field name and factor");
+
+    m_fields.clear();
+    for (size_t itField = 0; itField < m_gangingFactors.size(); itField += 2)
+    {
+        long factor = 0;
+        try
+        {
+            factor = std::stol(m_gangingFactors[itField + 1]);
+        }
+        catch (std::exception &e)
+        {
+            throw EVENT::Exception("CaloHitGanger: cannot parse the GangingFactors factor of " + m_gangingFactors[itField]);
+        }
+        if (factor < 1)
+            throw EVENT::Exception("CaloHitGanger: GangingFactors factor of " + m_gangingFactors[itField] + " must be at least 1");
+
+        m_fields.push_back({m_gangingFactors[itField], factor, 0, 0, false});
+    }
+    m_encoderString.clear();
+}
+
+void CaloHitGanger::configureFields(const std::string &encoderString)
+{
+    UTIL::BitField64 bitField(encoderString);
+    for (GangedField &field : m_fields)
+    {
+        size_t index = 0;
+        try
+        {
+            index = bitField.index(field.name);
+        }
+        catch (std::exception &e)
+        {
+            throw EVENT::Exception("CaloHitGanger: no field " + field.name + " in the CellIDEncoding " + encoderString);
+        }
+
+        unsigned int width = bitField[index].width();
+        field.offset = bitField[index].offset();
+        field.mask = width >= 64 ? ~uint64_t(0) : (uint64_t(1) << width) - 1;
+        field.isSigned = bitField[index].isSigned();
+    }
+    m_encoderString = encoderString;
+}
+
+uint64_t CaloHitGanger::gangedCellID(uint64_t cellID) const
+{
+    for (const GangedField &field : m_fields)
+    {
+        uint64_t raw = (cellID >> field.offset) & field.mask;
+        int64_t value = static_cast<int64_t>(raw);
+        if (field.isSigned && (raw & ~(field.mask >> 1)) != 0)
+            value = static_cast<int64_t>(raw | ~field.mask);
+
+        // round down, so that the cells on both sides of zero are not merged into one
+        int64_t ganged = value >= 0 ? value / field.factor : -((-value + field.factor - 1) / field.factor);
+        cellID = (cellID & ~(field.mask << field.offset)) | ((static_cast<uint64_t>(ganged) & field.mask) << field.offset);
+    }
+    return cellID;
+}
+
+void CaloHitGanger::processRunHeader(LCRunHeader *run)
+{
+
+    _nRun++;
+}
+
+void CaloHitGanger::processEvent(LCEvent *evt)
+{
+
+    streamlog_out(DEBUG) << "Processing event " << _nEvt << std::endl;
+
+    // Get the collection of calo hits
+    LCCollection *caloHitCollection = 0;
+    getCollection(caloHitCollection, m_inputHitCollection, evt);
+
+    LCCollection *inputHitRel = 0;
+    if (!m_inputRelationCollection.empty())
+        getCollection(inputHitRel, m_inputRelationCollection, evt);
+
+    if (caloHitCollection != 0)
+    {
+        std::string encoderString = caloHitCollection->getParameters().getStringVal(LCIO::CellIDEncoding);
+        if (encoderString != m_encoderString)
+            configureFields(encoderString);
+
+        int nHits = caloHitCollection->getNumberOfElements();
+        if (inputHitRel != 0 && inputHitRel->getNumberOfElements() != nHits)
+        {
+            streamlog_out(WARNING) << "Relation collection " << m_inputRelationCollection << " has " << inputHitRel->getNumberOfElements()
+                                   << " elements for " << nHits << " hits, no sim relations stored" << std::endl;
+            inputHitRel = 0;
+        }
+
+        // Group the hits by virtual cell, keeping the input order within each cell
+        m_keys.resize(nHits);
+        m_order.resize(nHits);
+        for (int itHit = 0; itHit < nHits; itHit++)
+        {
+            CalorimeterHit *hit = static_cast<CalorimeterHit *>(caloHitCollection->getElementAt(itHit));
+            uint64_t cellID = (static_cast<uint64_t>(static_cast<uint32_t>(hit->getCellID1())) << 32) |
+                              static_cast<uint32_t>(hit->getCellID0());
+            m_keys[itHit] = gangedCellID(cellID);
+            m_order[itHit] = itHit;
+        }
+        m_sorter.sort(m_keys, m_order);
+
+        // Make the output collections
+        LCCollectionVec *gangedHitCol = new LCCollectionVec(LCIO::CALORIMETERHIT);
+        gangedHitCol->setFlag(gangedHitCol->getFlag() | (1 << EVENT::LCIO::CHBIT_LONG));
+        gangedHitCol->setFlag(gangedHitCol->getFlag() | (1 << EVENT::LCIO::RCHBIT_TIME));
+        gangedHitCol->parameters().setValue(LCIO::CellIDEncoding, encoderString);
+
+        LCCollectionVec *gangedRelCol = RelationPool::newCollection(LCIO::CALORIMETERHIT, LCIO::CALORIMETERHIT, nHits, true);
+
+        LCCollectionVec *gangedSimRelCol = 0;
+        if (inputHitRel != 0)
+            gangedSimRelCol = RelationPool::newCollection(LCIO::CALORIMETERHIT, LCIO::SIMCALORIMETERHIT, 0, true);
+
+        for (int first = 0, last = 0; first < nHits; first = last)
+        {
+            // hits of one virtual cell
+            for (last = first + 1; last < nHits && m_keys[last] == m_keys[first]; last++)
+                ;
+
+            double energy = 0.;
+            double energyError2 = 0.;
+            double weight = 0.;
+            double position[3] = {0., 0., 0.};
+            float time = std::numeric_limits<float>::max();
+            size_t mostEnergetic = m_order[first];
+            float maxEnergy = -std::numeric_limits<float>::max();
+            for (int itCell = first; itCell < last; itCell++)
+            {
+                CalorimeterHit *hit = static_cast<CalorimeterHit *>(caloHitCollection->getElementAt(m_order[itCell]));
+                float hitEnergy = hit->getEnergy();
+                energy += hitEnergy;
+                energyError2 += hit->getEnergyError() * hit->getEnergyError();
+                time = std::min(time, hit->getTime());
+
+                // position weighted by the positive energies
+                double hitWeight = std::max(hitEnergy, 0.f);
+                weight += hitWeight;
+                for (int itCoord = 0; itCoord < 3; itCoord++)
+                    position[itCoord] += hitWeight * hit->getPosition()[itCoord];
+
+                if (hitEnergy > maxEnergy)
+                {
+                    maxEnergy = hitEnergy;
+                    mostEnergetic = m_order[itCell];
+                }
+            }
+
+            CalorimeterHit *firstHit = static_cast<CalorimeterHit *>(caloHitCollection->getElementAt(m_order[first]));
+            float gangedPosition[3];
+            for (int itCoord = 0; itCoord < 3; itCoord++)
+                gangedPosition[itCoord] = weight > 0. ? position[itCoord] / weight : firstHit->getPosition()[itCoord];
+
+            CalorimeterHitImpl *gangedHit = new CalorimeterHitImpl();
+            gangedHit->setCellID0(static_cast<int>(m_keys[first] & 0xFFFFFFFF));
+            gangedHit->setCellID1(static_cast<int>(m_keys[first] >> 32));
+            gangedHit->setEnergy(energy);
+            gangedHit->setEnergyError(std::sqrt(energyError2));
+            gangedHit->setTime(time);
+            gangedHit->setPosition(gangedPosition);
+            gangedHit->setType(firstHit->getType());
+            gangedHitCol->addElement(gangedHit);
+
+            hotloop_out(DEBUG0) << " ganged " << last - first << " hits, energy " << energy << std::endl;
+
+            for (int itCell = first; itCell < last; itCell++)
+            {
+                CalorimeterHit *hit = static_cast<CalorimeterHit *>(caloHitCollection->getElementAt(m_order[itCell]));
+                float fraction = energy != 0. ? hit->getEnergy() / energy : 1.f / (last - first);
+                gangedRelCol->addElement(new PooledRelation(gangedHit, hit, fraction));
+            }
+
+            // one relation per ganged hit, as the selectors expect
+            if (gangedSimRelCol != 0)
+            {
+                LCRelation *rel = static_cast<LCRelation *>(inputHitRel->getElementAt(mostEnergetic));
+                gangedSimRelCol->addElement(new PooledRelation(gangedHit, rel->getTo(), rel->getWeight()));
+            }
+        }
+
+        m_nInputHits += nHits;
+        m_nGangedHits += gangedHitCol->getNumberOfElements();
+        streamlog_out(DEBUG5) << "Ganged " << nHits << " hits into " << gangedHitCol->getNumberOfElements() << " virtual cells" << std::endl;
+
+        evt->addCollection(gangedHitCol, m_outputHitCollection);
+        evt->addCollection(gangedRelCol, m_outputRelationCollection);
+        if (gangedSimRelCol != 0)
+            evt->addCollection(gangedSimRelCol, m_outputSimRelationCollection);
+    }
+
+    //-- note: this will not be printed if compiled w/o MARLINDEBUG=1 !
+    streamlog_out(DEBUG) << "   done processing event: " << evt->getEventNumber()
+                         << "   in run:  " << evt->getRunNumber() << std::endl;
+
+    _nEvt++;
+}
+
+void CaloHitGanger::check(LCEvent *evt)
+{
+    // nothing to check here - could be used to fill checkplots in reconstruction processor
+}
+
+void CaloHitGanger::end()
+{
+    streamlog_out(MESSAGE) << name() << ": " << m_nInputHits << " hits ganged into " << m_nGangedHits << " virtual cells";
+    if (m_nGangedHits > 0)
+        streamlog_out(MESSAGE) << ", " << static_cast<double>(m_nInputHits) / m_nGangedHits << " hits per cell";
+    streamlog_out(MESSAGE) << std::endl;
+
+    std::ostringstream pool;
+    RelationPool::print(pool, name());
+    streamlog_out(MESSAGE) << pool.str();
+}
+
+void CaloHitGanger::getCollection(LCCollection *&collection, const std::string &collectionName, LCEvent *evt)
+{
+    try
+    {
+        collection = evt->getCollection(collectionName);
+    }
+    catch (DataNotAvailableException &e)
+    {
+        streamlog_out(DEBUG5) << "- cannot get collection. Collection " << collectionName.c_str() << " is unavailable" << std::endl;
+        return;
+    }
+    return;
+}
@@ -0,0 +1,108 @@
+#include "CaloHitSelection.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+void CaloHitSelection::loadForest(const std::string &modelFile, const std::string &owner)
+{
+    m_forest.load(modelFile);
+
+    static const std::vector<std::string> knownFeatures = {"energy", "time", "theta", "layer", "threshold", "bib"};
+    m_forestFeatures.clear();
+    for (const std::string &name : m_forest.featureNames())
+    {
+        auto found = std::find(knownFeatures.begin(), knownFeatures.end(), name);
+        if (found == knownFeatures.end())
+            throw std::runtime_error(owner + ": unknown forest feature " + name);
+        m_forestFeatures.push_back(static_cast<ForestFeature>(found - knownFeatures.begin()));
+    }
+    m_useForest = true;
+}
+
+void CaloHitSelection::fillThresholds(CaloHitColumns &columns, const ThresholdMap &thresholdMap) const
+{
+    size_t nHits = columns.size();
+    for (size_t itHit = 0; itHit < nHits; itHit++)
+    {
+        double mode = 0.;
+        double stddev = 0.;
+        if (m_settings.interpolateThresholds)
+        {
+            thresholdMap.interpolate(columns.theta[itHit], columns.layer[itHit], mode, stddev);
+        }
+        else
+        {
+            size_t bin = thresholdMap.bin(columns.theta[itHit], columns.layer[itHit]);
+            mode = thresholdMap.mode(bin);
+            stddev = thresholdMap.stddev(bin);
+        }
+
+        double threshold = mode + m_settings.nSigma * stddev;
+        if (m_settings.flatThreshold > 0.)
+        {
+            threshold = m_settings.flatThreshold;
+        }
+
+        columns.threshold[itHit] = threshold;
+        columns.correction[itHit] = mode;
+    }
+}
+
+void CaloHitSelection::fillForestFeatures(const CaloHitColumns &columns, AlignedVector<float> &featureMatrix) const
+{
+    size_t nHits = columns.size();
+    SelectionKernel::CaloHitView view = columns.view();
+    featureMatrix.resize(m_forestFeatures.size() * nHits);
+
+    for (size_t itFeature = 0; itFeature < m_forestFeatures.size(); itFeature++)
+    {
+        float *column = featureMatrix.data() + itFeature * nHits;
+        switch (m_forestFeatures[itFeature])
+        {
+        case ForestFeature::Energy:
+            std::copy(columns.energy.begin(), columns.energy.end(), column);
+            break;
+        case ForestFeature::Time:
+            for (size_t itHit = 0; itHit < nHits; itHit++)
+                column[itHit] = SelectionKernel::CaloTimeWindow::relativeTime(view, itHit);
+            break;
+        case ForestFeature::Theta:
+            std::copy(columns.theta.begin(), columns.theta.end(), column);
+            break;
+        case ForestFeature::Layer:
+            std::copy(columns.layer.begin(), columns.layer.end(), column);
+            break;
+        case ForestFeature::Threshold:
+            std::copy(columns.threshold.begin(), columns.threshold.end(), column);
+            break;
+        case ForestFeature::BIB:
+            std::copy(columns.correction.begin(), columns.correction.end(), column);
+            break;
+        }
+    }
+}
+
+void CaloHitSelection::select(const CaloHitColumns &columns, Scratch &scratch, std::vector<size_t> &accepted) const
+{
+    size_t nHits = columns.size();
+    if (m_useForest)
+    {
+        // Score the hits with the decision forest
+        fillForestFeatures(columns, scratch.featureMatrix);
+        scratch.scores.resize(nHits);
+        m_forest.evaluate(scratch.featureMatrix.data(), nHits, nHits, scratch.scores.data(), m_settings.simdLevel);
+
+        SelectionKernel::ScoreView scoreView;
+        scoreView.size = nHits;
+        scoreView.score = scratch.scores.data();
+        SelectionKernel::selectHits(scoreView, SelectionKernel::ScoreAbove{m_settings.forestCut}, accepted);
+    }
+    else
+    {
+        // Apply energy threshold and time window in one pass
+        SelectionKernel::selectCaloHits(columns.view(),
+                                        SelectionKernel::CaloEnergyThreshold{m_settings.subtractBIB},
+                                        SelectionKernel::CaloTimeWindow{m_settings.timeWindowMin, m_settings.timeWindowMax},
+                                        m_settings.simdLevel, accepted);
+    }
+}
@@ -1,15 +1,25 @@
 #include "CaloHitSelector.h"
+#include "SelectionKernel.h"
+#include "LCIOColumns.h"
+#include "AcceptanceMask.h"
+#include "CaloSelectionSimd.h"
+#include "HotLoopLog.h"
+#include "RelationPool.h"
 #include <iostream>
 #include <vector>
 #include <map>
+#include <algorithm>
+#include <limits>
 #include <math.h>
 #include <filesystem>
+#include <sstream>
+
+#include <EVENT/Exceptions.h>
 
 #include <EVENT/LCCollection.h>
 #include <EVENT/CalorimeterHit.h>
 #include <EVENT/SimCalorimeterHit.h>
 
-#include <UTIL/LCRelationNavigator.h>
 #include <IMPL/LCCollectionVec.h>
 
 #include <UTIL/CellIDDecoder.h>
@@ -29,6 +39,12 @@ using namespace marlin;
 
 CaloHitSelector aCaloHitSelector;
 
+// Clamp x between the first and last bin centres of an axis
+static double clampToBinCentres(TAxis *axis, double x)
+{
+    return std::max(axis->GetBinCenter(1), std::min(x, axis->GetBinCenter(axis->GetNbins())));
+}
+
 CaloHitSelector::CaloHitSelector() : Processor("CaloHitSelector")
 {
 
@@ -65,6 +81,18 @@ CaloHitSelector::CaloHitSelector() : Processor("CaloHitSelector")
                                m_thFile,
                                std::string(""));
 
+    // Threshold files per run
+    StringVec defaultFileMap;
+    registerProcessorParameter("ThresholdsFileMap",
+                               "Pairs of run key and ROOT file; keys are run numbers, ranges first-last, or values of ThresholdsRunParameter (the first file also serves events before the first run header when ThresholdsFilePath is empty)",
+                               m_thFileMap,
+                               defaultFileMap);
+
+    registerProcessorParameter("ThresholdsRunParameter",
+                               "Run header parameter matched against the keys of ThresholdsFileMap (empty: run number)",
+                               m_thRunParameter,
+                               std::string(""));
+
     // N sigma for dynamic threshold
     registerProcessorParameter("Nsigma",
                                "Number of BIB E sigma",
@@ -77,6 +105,12 @@ CaloHitSelector::CaloHitSelector() : Processor("CaloHitSelector")
                                m_FlatThreshold,
                                0.);
 
+    // Interpolate the threshold map
+    registerProcessorParameter("ThresholdInterpolation",
+                               "Interpolate mode and stddev bilinearly between bin centres instead of using bin contents",
+                               m_thresholdInterpolation,
+                               bool(false));
+
     //TimeWindowMin
     registerProcessorParameter("TimeWindowMin",
                                "Minimum time window for hit selection",
@@ -94,6 +128,71 @@ CaloHitSelector::CaloHitSelector() : Processor("CaloHitSelector")
                                "Correct cell energy for mean expected BIB contribution",
                                m_doBIBsubtraction,
                                bool(false));
+
+    // Instruction set of the selection kernel
+    registerProcessorParameter("SimdLevel",
+                               "Selection kernel: auto, avx512, avx2 or scalar (falls back to what the CPU supports)",
+                               m_simdLevelName,
+                               std::string("auto"));
+
+    // Cuts or decision forest
+    registerProcessorParameter("SelectionMode",
+                               "Cuts (energy threshold and time window) or Forest (decision forest score)",
+                               m_selectionMode,
+                               std::string("Cuts"));
+
+    // Forest model
+    registerProcessorParameter("ForestModelFile",
+                               "Decision forest model, features among energy, time, theta, layer, threshold, bib",
+                               m_forestModelFile,
+                               std::string(""));
+
+    // Forest score cut
+    registerProcessorParameter("ForestCut",
+                               "Minimum decision forest score of accepted hits",
+                               m_forestCut,
+                               0.);
+
+    // Subset collections or run-length masks
+    registerProcessorParameter("OutputMode",
+                               "Subset (subset collections) or Mask (run-length encoded masks in <output>_Mask)",
+                               m_outputMode,
+                               std::string("Subset"));
+
+    // Output ordering
+    registerProcessorParameter("OutputOrder",
+                               "Input (keep the input order) or Spatial (accepted hits ordered by layer, theta, phi); Subset output mode only",
+                               m_outputOrder,
+                               std::string("Input"));
+
+    // Hardware counter profiling
+    registerProcessorParameter("ProfileStages",
+                               "Report wall time, IPC and cache and branch misses per hit of each stage at the end",
+                               m_profileStages,
+                               bool(false));
+
+    // Binary decision trace
+    registerProcessorParameter("DecisionTraceFile",
+                               "File receiving the decision and cut values of every hit (empty disables)",
+                               m_traceFile,
+                               std::string(""));
+
+    // Columnar feature export
+    registerProcessorParameter("FeatureExportFile",
+                               "File receiving the features and decision of every hit as compressed columns (empty disables)",
+                               m_exportFile,
+                               std::string(""));
+
+    // Differential validation
+    registerProcessorParameter("ValidationFraction",
+                               "Fraction of the events also selected with the reference per-hit loop and compared (0 disables)",
+                               m_validationFraction,
+                               double(0.));
+
+    registerProcessorParameter("ValidationMaxReports",
+                               "Number of differing hits and relations reported in detail over the job",
+                               m_validationMaxReports,
+                               int(20));
 }
 
 void CaloHitSelector::init()
@@ -107,21 +206,129 @@ void CaloHitSelector::init()
     _nRun = 0;
     _nEvt = 0;
 
-    // open ROOT file and get threshold histograms
-    m_th_file = new TFile(m_thFile.c_str());
-    m_thresholdMap = (TH2D *)m_th_file->Get("th_2dmode_sym");
-    m_thresholdMap->SetDirectory(0);
-    m_stddevMap = (TH2D *)m_th_file->Get("stddev_sym");
-    m_stddevMap->SetDirectory(0);
-    m_th_file->Close();
+    m_outputMask = AcceptanceMask::parseOutputMode(m_outputMode, name());
+
+    if (m_outputOrder != "Input" && m_outputOrder != "Spatial")
+        throw EVENT::Exception("CaloHitSelector: unknown OutputOrder " + m_outputOrder + ", use Input or Spatial");
+    m_spatialOrder = (m_outputOrder == "Spatial");
+
+    // Threshold files per run, resolved at each run header
+    if (m_thFileMap.size() % 2 != 0)
+        throw EVENT::Exception("CaloHitSelector: ThresholdsFileMap needs pairs of run key and file");
+    m_thresholdRules.clear();
+    for (size_t itRule = 0; itRule < m_thFileMap.size(); itRule += 2)
+    {
+        ThresholdRule rule;
+        rule.key = m_thFileMap[itRule];
+        rule.fileName = m_thFileMap[itRule + 1];
+        if (m_thRunParameter.empty())
+        {
+            size_t dash = rule.key.find('-', 1);
+            try
+            {
+                rule.firstRun = std::stoi(rule.key.substr(0, dash));
+                rule.lastRun = (dash == std::string::npos) ? rule.firstRun : std::stoi(rule.key.substr(dash + 1));
+            }
+            catch (std::exception &)
+            {
+                throw EVENT::Exception("CaloHitSelector: bad run number or range " + rule.key + " in ThresholdsFileMap");
+            }
+        }
+        m_thresholdRules.push_back(rule);
+    }
+
+    // the map used until the first run header: ThresholdsFilePath, or the first file of ThresholdsFileMap
+    if (m_thFile.empty() && m_thresholdRules.empty())
+        throw EVENT::Exception("CaloHitSelector: set ThresholdsFilePath or ThresholdsFileMap");
+    const std::string &defaultFile = m_thFile.empty() ? m_thresholdRules.front().fileName : m_thFile;
+    m_thresholdMap = &m_thresholdMaps.get(defaultFile);
+    if (!m_thresholdRules.empty())
+        streamlog_out(MESSAGE) << " thresholds before the first run header from " << defaultFile << std::endl;
+
+    if (m_profileStages && !m_profiler.configure(true))
+        streamlog_out(WARNING) << "Hardware counters unavailable, profiling wall time only" << std::endl;
+
+    CaloHitSelection::Settings settings;
+    settings.nSigma = m_Nsigma;
+    settings.flatThreshold = m_FlatThreshold;
+    settings.interpolateThresholds = m_thresholdInterpolation;
+    settings.subtractBIB = m_doBIBsubtraction;
+    settings.timeWindowMin = m_time_windowMin;
+    settings.timeWindowMax = m_time_windowMax;
+    settings.forestCut = m_forestCut;
+    settings.simdLevel = SelectionKernel::resolveSimdLevel(m_simdLevelName, "CaloHitSelector");
+    m_selection.configure(settings);
+    streamlog_out(MESSAGE) << " selection kernel: " << SelectionKernel::simdLevelName(settings.simdLevel) << std::endl;
+
+    if (m_selectionMode == "Forest")
+    {
+        m_selection.loadForest(m_forestModelFile, "CaloHitSelector");
+        streamlog_out(MESSAGE) << " decision forest: " << m_selection.forest().nTrees() << " trees of depth "
+                               << m_selection.forest().depth() << std::endl;
+    }
+    else if (m_selectionMode != "Cuts")
+    {
+        throw EVENT::Exception("CaloHitSelector: unknown SelectionMode " + m_selectionMode + ", use Cuts or Forest");
+    }
+
+    if (!m_traceFile.empty())
+    {
+        m_trace = DecisionTrace::open(m_traceFile);
+        if (m_selection.useForest())
+            m_traceStream = m_trace->registerStream(name() + ":" + m_inputHitCollection, {"score", "cut"}, {"accepted", "low_score"});
+        else
+            m_traceStream = m_trace->registerStream(name() + ":" + m_inputHitCollection, {"energy", "threshold", "time"},
+                                                    {"accepted", "below_threshold", "outside_time"});
+        m_traceBuffer.setTrace(m_trace.get());
+    }
+
+    if (!m_exportFile.empty())
+    {
+        m_export = FeatureExport::open(m_exportFile);
+        std::vector<std::string> decisionNames = {"accepted", "below_threshold", "outside_time"};
+        if (m_selection.useForest())
+            decisionNames = {"accepted", "low_score"};
+        m_exportTable.open(m_export.get(), name() + ":" + m_inputHitCollection,
+                           {{"run", FeatureExport::UInt32}, {"event", FeatureExport::UInt32}, {"hit", FeatureExport::UInt32},
+                            {"energy", FeatureExport::Float32}, {"time", FeatureExport::Float32}, {"theta", FeatureExport::Float32},
+                            {"layer", FeatureExport::UInt32}, {"threshold", FeatureExport::Float32}, {"bib", FeatureExport::Float32},
+                            {"score", FeatureExport::Float32}, {"decision", FeatureExport::UInt8}},
+                           decisionNames);
+    }
+
+    m_validator.configure(m_validationFraction, std::max(m_validationMaxReports, 0));
 }
 
 void CaloHitSelector::processRunHeader(LCRunHeader *run)
 {
 
+    if (!m_thresholdRules.empty())
+    {
+        const std::string &fileName = thresholdFileForRun(run);
+        m_thresholdMap = &m_thresholdMaps.get(fileName);
+        streamlog_out(MESSAGE) << " run " << run->getRunNumber() << ": thresholds from " << fileName << std::endl;
+    }
+
     _nRun++;
 }
 
+const std::string &CaloHitSelector::thresholdFileForRun(const LCRunHeader *run) const
+{
+    std::string value = m_thRunParameter.empty() ? "" : run->getParameters().getStringVal(m_thRunParameter);
+    for (const ThresholdRule &rule : m_thresholdRules)
+    {
+        bool matches = m_thRunParameter.empty() ? (run->getRunNumber() >= rule.firstRun && run->getRunNumber() <= rule.lastRun)
+                                                : (value == rule.key);
+        if (matches)
+            return rule.fileName;
+    }
+
+    // runs without an entry use ThresholdsFilePath
+    if (m_thFile.empty())
+        throw EVENT::Exception("CaloHitSelector: no threshold file for run " + std::to_string(run->getRunNumber()));
+    return m_thFile;
+}
+
 void CaloHitSelector::processEvent(LCEvent *evt)
 {
 
@@ -141,82 +348,77 @@ void CaloHitSelector::processEvent(LCEvent *evt)
     if (caloHitCollection != 0 && inputHitRel != 0)
     {
 
+        bool validate = m_validator.sampleEvent(evt->getRunNumber(), evt->getEventNumber());
+
         std::string encoderString = caloHitCollection->getParameters().getStringVal(LCIO::CellIDEncoding);
-        UTIL::CellIDDecoder<CalorimeterHit> myCellIDEncoding(encoderString);
 
         // Make the output collections
-        outputHitCol = new LCCollectionVec(caloHitCollection->getTypeName());
-        outputHitCol->setSubset(true);
-        outputHitCol->parameters().setValue(LCIO::CellIDEncoding, encoderString);
-        outputHitCol->setFlag(outputHitCol->getFlag() | (1 << EVENT::LCIO::CHBIT_LONG));
-        outputHitCol->setFlag(outputHitCol->getFlag() | (1 << EVENT::LCIO::RCHBIT_TIME));
+        if (!m_outputMask)
+        {
+            outputHitCol = LCIOColumns::newSubsetCollection(caloHitCollection, encoderString);
+            outputHitCol->setFlag(outputHitCol->getFlag() | (1 << EVENT::LCIO::CHBIT_LONG));
+            outputHitCol->setFlag(outputHitCol->getFlag() | (1 << EVENT::LCIO::RCHBIT_TIME));
+        }
 
-        // reco-sim relation output collections
-        UTIL::LCRelationNavigator thitNav = UTIL::LCRelationNavigator( LCIO::CALORIMETERHIT, LCIO::SIMCALORIMETERHIT );
 
-        int nHits = caloHitCollection->getNumberOfElements();
+        // Gather the hit columns and look up the threshold of each hit; the validator times the same steps as the reference
+        if (validate)
+            m_validator.beginFast();
+        m_profiler.beginStage("decode", caloHitCollection->getNumberOfElements());
+        LCIOColumns::gather(caloHitCollection, m_columns);
+        m_selection.fillThresholds(m_columns, *m_thresholdMap);
+
+        int nHits = m_columns.size();
+        m_profiler.beginStage("select", nHits);
+        m_selection.select(m_columns, m_scratch, m_accepted);
+        if (validate)
+            m_validator.endFast();
+
+        if (m_traceBuffer.active() || m_exportTable.active())
+            fillDecisions();
+        if (m_traceBuffer.active())
+            traceDecisions(evt);
+        if (m_exportTable.active())
+            exportFeatures(evt);
+
+        // Order the accepted hits by calorimeter cell position
+        m_profiler.beginStage("fill", m_accepted.size());
+        if (m_spatialOrder && !m_outputMask)
+        {
+            m_sortKeys.resize(m_accepted.size());
+            for (size_t itAccepted = 0; itAccepted < m_accepted.size(); itAccepted++)
+                m_sortKeys[itAccepted] = m_columns.cellKey(m_accepted[itAccepted]);
+            m_sorter.sort(m_sortKeys, m_accepted);
+        }
 
-        // Now loop over hits again applying threshold
-        for (int itHit = 0; itHit < nHits; itHit++)
+        // reco-sim relations of the accepted hits, handed to the event
+        LCCollectionVec *outputRelCol = RelationPool::newCollection(LCIO::CALORIMETERHIT, LCIO::SIMCALORIMETERHIT, m_accepted.size());
+        for (size_t itHit : m_accepted)
         {
-            // Get the hit
             CalorimeterHit *hit = static_cast<CalorimeterHit *>(caloHitCollection->getElementAt(itHit));
-            unsigned int layer = myCellIDEncoding(hit)["layer"];
 
-            // hit position
-            TVector3 hitPos(hit->getPosition()[0], hit->getPosition()[1], hit->getPosition()[2]);
-            double hit_theta = hitPos.Theta();
-            if (hit_theta > TMath::Pi() / 2) // map is symmetrized around pi/2
-            {
-                hit_theta = TMath::Pi() - hit_theta;
-            }
+            hotloop_out(DEBUG0) << " accepted hit " << m_columns.energy[itHit] << " theta " << m_columns.theta[itHit] << std::endl;
 
-            unsigned int binx = m_thresholdMap->GetXaxis()->FindBin(hit_theta);
-            unsigned int biny = m_thresholdMap->GetYaxis()->FindBin(layer);
+            if (outputHitCol != 0)
+                outputHitCol->addElement(hit);
 
-            double threshold = m_thresholdMap->GetBinContent(binx, biny) + m_Nsigma * m_stddevMap->GetBinContent(binx, biny);
-            if (m_FlatThreshold > 0.)
-            {
-                threshold = m_FlatThreshold;
-            }
-
-            double correction = m_thresholdMap->GetBinContent(binx, biny);
-
-            double hit_energy = hit->getEnergy();
-            if (m_doBIBsubtraction)
-            {
-                hit_energy = hit_energy - correction;
-            }
-
-            if (hit_energy > threshold)
-            {
-                // Compute time correction
-                float timeCorrection(0);
-                float r(0);
-                for (int i=0; i<3; i++)
-                    r+=pow(hit->getPosition()[i],2);
-                timeCorrection = sqrt(r)/TMath::C(); // [speed of light in mm/ns]
+            LCRelation *rel = static_cast<LCRelation *>(inputHitRel->getElementAt(itHit));
+            SimCalorimeterHit *simhit = static_cast<SimCalorimeterHit *>(rel->getTo());
 
-                float relativetime = hit->getTime() - timeCorrection; // wrt time of flight
-
-                if (relativetime>m_time_windowMin && relativetime<m_time_windowMax){
-
-                    streamlog_out(DEBUG0) << " accepted hit " << hit_energy << " theta " << hit_theta << std::endl;
-
-                    outputHitCol->addElement(hit);
-
-                    LCRelation *rel = static_cast<LCRelation *>(inputHitRel->getElementAt(itHit));
-                    SimCalorimeterHit *simhit = static_cast<SimCalorimeterHit *>(rel->getTo());
-
-                    thitNav.addRelation(hit, simhit);
-                }
-            }
+            outputRelCol->addElement(new PooledRelation(hit, simhit));
         }
 
         // Store the filtered hit collections
-        evt->addCollection(outputHitCol, m_outputHitCollection);
-        outputHitRel = thitNav.createLCCollection();
+        if (m_outputMask)
+            AcceptanceMask::storeSelection(evt, m_outputHitCollection, m_inputHitCollection, m_accepted, m_columns.size());
+        else
+            evt->addCollection(outputHitCol, m_outputHitCollection);
+        outputHitRel = outputRelCol;
         evt->addCollection(outputHitRel, m_outputRelationCollection);
+        m_profiler.endStage();
+
+        if (validate)
+            validateEvent(caloHitCollection, inputHitRel, outputHitRel);
     }
 
     //-- note: this will not be printed if compiled w/o MARLINDEBUG=1 !
@@ -233,11 +435,284 @@ void CaloHitSelector::check(LCEvent *evt)
 
 void CaloHitSelector::end()
 {
+    // flush the last records before the writer is released
+    m_traceBuffer.setTrace(nullptr);
+    m_trace.reset();
+    m_exportTable.close();
+    m_export.reset();
+
+    streamlog_out(MESSAGE) << name() << ": " << m_thresholdMaps.nLoads() << " threshold file loads for " << _nRun << " runs" << std::endl;
+
+    std::ostringstream pool;
+    RelationPool::print(pool, name());
+    streamlog_out(MESSAGE) << pool.str();
+
+    if (m_profiler.enabled())
+    {
+        std::ostringstream profile;
+        m_profiler.print(profile, name());
+        streamlog_out(MESSAGE) << profile.str();
+    }
+
+    if (m_validator.enabled())
+    {
+        std::ostringstream summary;
+        m_validator.print(summary, name());
+        streamlog_out(MESSAGE) << summary.str();
+    }
+
     //   std::cout << "CaloHitSelector::end()  " << name()
     // 	    << " processed " << _nEvt << " events in " << _nRun << " runs "
     // 	    << std::endl ;
 }
 
+void CaloHitSelector::fillDecisions()
+{
+    SelectionKernel::CaloHitView view = m_columns.view();
+    SelectionKernel::CaloEnergyThreshold energyThreshold{m_doBIBsubtraction};
+    m_decisions.resize(m_columns.size());
+
+    // m_accepted is still in input order here
+    size_t itAccepted = 0;
+    for (size_t itHit = 0; itHit < m_columns.size(); itHit++)
+    {
+        bool accepted = itAccepted < m_accepted.size() && m_accepted[itAccepted] == itHit;
+        itAccepted += accepted ? 1 : 0;
+
+        if (accepted)
+            m_decisions[itHit] = 0;
+        else if (m_selection.useForest())
+            m_decisions[itHit] = 1;
+        else
+            m_decisions[itHit] = energyThreshold(view, itHit) ? 2 : 1;
+    }
+}
+
+void CaloHitSelector::traceDecisions(const LCEvent *evt)
+{
+    m_traceBuffer.setEvent(evt->getRunNumber(), evt->getEventNumber());
+    SelectionKernel::CaloHitView view = m_columns.view();
+
+    for (size_t itHit = 0; itHit < m_columns.size(); itHit++)
+    {
+        if (m_selection.useForest())
+        {
+            m_traceBuffer.add(m_traceStream, itHit, m_decisions[itHit], m_scratch.scores[itHit], m_forestCut);
+        }
+        else
+        {
+            double energy = m_columns.energy[itHit] - (m_doBIBsubtraction ? m_columns.correction[itHit] : 0.);
+            m_traceBuffer.add(m_traceStream, itHit, m_decisions[itHit], energy, m_columns.threshold[itHit],
+                              SelectionKernel::CaloTimeWindow::relativeTime(view, itHit));
+        }
+    }
+}
+
+void CaloHitSelector::exportFeatures(const LCEvent *evt)
+{
+    SelectionKernel::CaloHitView view = m_columns.view();
+    size_t nHits = m_columns.size();
+    size_t first = m_exportTable.addRows(nHits);
+
+    // columns in the order of the schema registered in init()
+    uint32_t *run = m_exportTable.column<uint32_t>(0, first);
+    uint32_t *event = m_exportTable.column<uint32_t>(1, first);
+    uint32_t *hit = m_exportTable.column<uint32_t>(2, first);
+    float *energy = m_exportTable.column<float>(3, first);
+    float *time = m_exportTable.column<float>(4, first);
+    float *theta = m_exportTable.column<float>(5, first);
+    uint32_t *layer = m_exportTable.column<uint32_t>(6, first);
+    float *threshold = m_exportTable.column<float>(7, first);
+    float *bib = m_exportTable.column<float>(8, first);
+    float *score = m_exportTable.column<float>(9, first);
+    uint8_t *decision = m_exportTable.column<uint8_t>(10, first);
+
+    for (size_t itHit = 0; itHit < nHits; itHit++)
+    {
+        run[itHit] = evt->getRunNumber();
+        event[itHit] = evt->getEventNumber();
+        hit[itHit] = itHit;
+        energy[itHit] = m_columns.energy[itHit];
+        time[itHit] = SelectionKernel::CaloTimeWindow::relativeTime(view, itHit);
+        theta[itHit] = m_columns.theta[itHit];
+        layer[itHit] = m_columns.layer[itHit];
+        threshold[itHit] = m_columns.threshold[itHit];
+        bib[itHit] = m_columns.correction[itHit];
+        score[itHit] = m_selection.useForest() ? m_scratch.scores[itHit] : std::numeric_limits<float>::quiet_NaN();
+        decision[itHit] = m_decisions[itHit];
+    }
+    m_exportTable.endRows();
+}
+
+void CaloHitSelector::referenceSelection(LCCollection *caloHitCollection, LCCollection *inputHitRel,
+                                         std::vector<size_t> &accepted, std::vector<DifferentialValidator::RelationPair> &relations)
+{
+    std::string encoderString = caloHitCollection->getParameters().getStringVal(LCIO::CellIDEncoding);
+    UTIL::CellIDDecoder<CalorimeterHit> myCellIDEncoding(encoderString);
+
+    accepted.clear();
+    relations.clear();
+    const std::vector<CaloHitSelection::ForestFeature> &forestFeatures = m_selection.forestFeatures();
+    std::vector<float> features(forestFeatures.size());
+    int nHits = caloHitCollection->getNumberOfElements();
+    for (int itHit = 0; itHit < nHits; itHit++)
+    {
+        // Get the hit
+        CalorimeterHit *hit = static_cast<CalorimeterHit *>(caloHitCollection->getElementAt(itHit));
+        unsigned int layer = myCellIDEncoding(hit)["layer"];
+
+        // hit position
+        TVector3 hitPos(hit->getPosition()[0], hit->getPosition()[1], hit->getPosition()[2]);
+        double hit_theta = hitPos.Theta();
+        if (hit_theta > TMath::Pi() / 2) // map is symmetrized around pi/2
+        {
+            hit_theta = TMath::Pi() - hit_theta;
+        }
+
+        double mode = 0.;
+        double stddev = 0.;
+        if (m_thresholdInterpolation)
+        {
+            // held constant beyond the outermost bin centres, where TH2::Interpolate gives up
+            double x = clampToBinCentres(m_referenceMode->GetXaxis(), hit_theta);
+            double y = clampToBinCentres(m_referenceMode->GetYaxis(), layer);
+            mode = m_referenceMode->Interpolate(x, y);
+            stddev = m_referenceStddev->Interpolate(x, y);
+        }
+        else
+        {
+            unsigned int binx = m_referenceMode->GetXaxis()->FindBin(hit_theta);
+            unsigned int biny = m_referenceMode->GetYaxis()->FindBin(layer);
+            mode = m_referenceMode->GetBinContent(binx, biny);
+            stddev = m_referenceStddev->GetBinContent(binx, biny);
+        }
+
+        double threshold = mode + m_Nsigma * stddev;
+        if (m_FlatThreshold > 0.)
+        {
+            threshold = m_FlatThreshold;
+        }
+
+        double correction = mode;
+
+        // Compute time correction
+        float timeCorrection(0);
+        float r(0);
+        for (int i=0; i<3; i++)
+            r+=pow(hit->getPosition()[i],2);
+        timeCorrection = sqrt(r)/TMath::C(); // [speed of light in mm/ns]
+
+        float relativetime = hit->getTime() - timeCorrection; // wrt time of flight
+
+        bool accept = false;
+        if (m_selection.useForest())
+        {
+            // one hit at a time through the scalar forest
+            for (size_t itFeature = 0; itFeature < forestFeatures.size(); itFeature++)
+            {
+                switch (forestFeatures[itFeature])
+                {
+                case CaloHitSelection::ForestFeature::Energy:
+                    features[itFeature] = hit->getEnergy();
+                    break;
+                case CaloHitSelection::ForestFeature::Time:
+                    features[itFeature] = relativetime;
+                    break;
+                case CaloHitSelection::ForestFeature::Theta:
+                    features[itFeature] = hit_theta;
+                    break;
+                case CaloHitSelection::ForestFeature::Layer:
+                    features[itFeature] = layer;
+                    break;
+                case CaloHitSelection::ForestFeature::Threshold:
+                    features[itFeature] = threshold;
+                    break;
+                case CaloHitSelection::ForestFeature::BIB:
+                    features[itFeature] = correction;
+                    break;
+                }
+            }
+            // walk the model trees node by node
+            float score = m_selection.forest().baseScore();
+            for (const DecisionForest::Tree &tree : m_selection.forest().trees())
+            {
+                const DecisionForest::Node *node = &tree.at(0);
+                while (!node->isLeaf)
+                    node = &tree.at(features[node->feature] >= node->threshold ? node->right : node->left);
+                score += node->value;
+            }
+            accept = score > m_forestCut;
+        }
+        else
+        {
+            double hit_energy = hit->getEnergy();
+            if (m_doBIBsubtraction)
+            {
+                hit_energy = hit_energy - correction;
+            }
+
+            accept = hit_energy > threshold && relativetime > m_time_windowMin && relativetime < m_time_windowMax;
+        }
+
+        if (accept)
+        {
+            accepted.push_back(itHit);
+
+            // the relation at the index of the hit is carried over
+            relations.push_back({itHit, itHit});
+        }
+    }
+}
+
+void CaloHitSelector::loadReferenceHistograms()
+{
+    if (m_referenceMap == m_thresholdMap)
+        return;
+
+    const std::string &fileName = m_thresholdMap->fileName();
+    TFile file(fileName.c_str());
+    TH2D *modeMap = file.IsZombie() ? nullptr : (TH2D *)file.Get("th_2dmode_sym");
+    TH2D *stddevMap = file.IsZombie() ? nullptr : (TH2D *)file.Get("stddev_sym");
+    if (modeMap == nullptr || stddevMap == nullptr)
+        throw EVENT::Exception("CaloHitSelector: cannot read the reference threshold histograms from " + fileName);
+
+    // kept after the file is closed
+    modeMap->SetDirectory(nullptr);
+    stddevMap->SetDirectory(nullptr);
+    m_referenceMode.reset(modeMap);
+    m_referenceStddev.reset(stddevMap);
+    file.Close();
+    m_referenceMap = m_thresholdMap;
+}
+
+void CaloHitSelector::validateEvent(LCCollection *caloHitCollection, LCCollection *inputHitRel, LCCollection *outputHitRel)
+{
+    loadReferenceHistograms();
+
+    m_validator.beginReference();
+    referenceSelection(caloHitCollection, inputHitRel, m_referenceAccepted, m_referenceRelations);
+    m_validator.endReference();
+
+    // relations as (hit, input relation) indices
+    std::vector<DifferentialValidator::RelationPair> fastPairs = DifferentialValidator::carriedRelations(caloHitCollection, inputHitRel, outputHitRel);
+
+    auto describeHit = [&](size_t itHit)
+    {
+        if (itHit >= m_columns.size())
+            return std::string("not in the input collection");
+        std::ostringstream details;
+        details << "layer " << m_columns.layer[itHit] << " theta " << m_columns.theta[itHit] << " energy " << m_columns.energy[itHit]
+                << " threshold " << m_columns.threshold[itHit] << " time " << m_columns.time[itHit];
+        if (m_selection.useForest() && itHit < m_scratch.scores.size())
+            details << " score " << m_scratch.scores[itHit];
+        return details.str();
+    };
+
+    std::ostringstream report;
+    if (m_validator.compare(m_accepted, m_referenceAccepted, fastPairs, m_referenceRelations, describeHit, report) > 0)
+        streamlog_out(WARNING) << name() << " differs from the reference selection in " << report.str();
+}
+
 void CaloHitSelector::getCollection(LCCollection *&collection, const std::string &collectionName, LCEvent *evt)
 {
     try
@@ -0,0 +1,189 @@
+#include "CaloSelectionSimd.h"
+
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define MYBIBUTILS_X86_SIMD 1
+#endif
+
+namespace SelectionKernel
+{
+
+  namespace
+  {
+
+#ifdef MYBIBUTILS_X86_SIMD
+
+    static_assert(sizeof(size_t) == sizeof(long long), "accepted indices are stored as 64-bit lanes");
+
+    // 4 hits per iteration: floats in __m128, doubles in __m256d
+    __attribute__((target("avx2"))) size_t selectAVX2(const CaloHitView &view, const CaloEnergyThreshold &energyCut,
+                                                      const CaloTimeWindow &timeCut, size_t *accepted)
+    {
+      const __m256d speedOfLight = _mm256_set1_pd(TMath::C());
+      const __m256d tmin = _mm256_set1_pd(timeCut.tmin);
+      const __m256d tmax = _mm256_set1_pd(timeCut.tmax);
+      const __m256d zero = _mm256_setzero_pd();
+
+      size_t nAccepted = 0;
+      size_t i = 0;
+      for (; i + 4 <= view.size; i += 4)
+      {
+        // r accumulated in float from exact double squares, as in CaloTimeWindow
+        __m256d x = _mm256_cvtps_pd(_mm_loadu_ps(view.x + i));
+        __m256d y = _mm256_cvtps_pd(_mm_loadu_ps(view.y + i));
+        __m256d z = _mm256_cvtps_pd(_mm_loadu_ps(view.z + i));
+        __m128 r = _mm256_cvtpd_ps(_mm256_mul_pd(x, x));
+        r = _mm256_cvtpd_ps(_mm256_add_pd(_mm256_cvtps_pd(r), _mm256_mul_pd(y, y)));
+        r = _mm256_cvtpd_ps(_mm256_add_pd(_mm256_cvtps_pd(r), _mm256_mul_pd(z, z)));
+
+        __m128 timeCorrection = _mm256_cvtpd_ps(_mm256_div_pd(_mm256_cvtps_pd(_mm_sqrt_ps(r)), speedOfLight));
+        __m256d relativetime = _mm256_cvtps_pd(_mm_sub_ps(_mm_loadu_ps(view.time + i), timeCorrection));
+        __m256d pass = _mm256_and_pd(_mm256_cmp_pd(relativetime, tmin, _CMP_GT_OQ),
+                                     _mm256_cmp_pd(relativetime, tmax, _CMP_LT_OQ));
+
+        __m256d correction = energyCut.subtractBIB ? _mm256_loadu_pd(view.correction + i) : zero;
+        __m256d energy = _mm256_sub_pd(_mm256_cvtps_pd(_mm_loadu_ps(view.energy + i)), correction);
+        pass = _mm256_and_pd(pass, _mm256_cmp_pd(energy, _mm256_loadu_pd(view.threshold + i), _CMP_GT_OQ));
+
+        // branch-free compress of the 4 lanes
+        unsigned int mask = _mm256_movemask_pd(pass);
+        accepted[nAccepted] = i;
+        nAccepted += mask & 1;
+        accepted[nAccepted] = i + 1;
+        nAccepted += (mask >> 1) & 1;
+        accepted[nAccepted] = i + 2;
+        nAccepted += (mask >> 2) & 1;
+        accepted[nAccepted] = i + 3;
+        nAccepted += (mask >> 3) & 1;
+      }
+
+      for (; i < view.size; i++)
+      {
+        accepted[nAccepted] = i;
+        nAccepted += (energyCut(view, i) && timeCut(view, i)) ? 1 : 0;
+      }
+      return nAccepted;
+    }
+
+    // 8 hits per iteration: floats in __m256, doubles in __m512d
+    __attribute__((target("avx512f"))) size_t selectAVX512(const CaloHitView &view, const CaloEnergyThreshold &energyCut,
+                                                           const CaloTimeWindow &timeCut, size_t *accepted)
+    {
+      const __m512d speedOfLight = _mm512_set1_pd(TMath::C());
+      const __m512d tmin = _mm512_set1_pd(timeCut.tmin);
+      const __m512d tmax = _mm512_set1_pd(timeCut.tmax);
+      const __m512d zero = _mm512_setzero_pd();
+      const __m512i lanes = _mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0);
+
+      size_t nAccepted = 0;
+      size_t i = 0;
+      for (; i + 8 <= view.size; i += 8)
+      {
+        __m512d x = _mm512_cvtps_pd(_mm256_loadu_ps(view.x + i));
+        __m512d y = _mm512_cvtps_pd(_mm256_loadu_ps(view.y + i));
+        __m512d z = _mm512_cvtps_pd(_mm256_loadu_ps(view.z + i));
+        __m256 r = _mm512_cvtpd_ps(_mm512_mul_pd(x, x));
+        r = _mm512_cvtpd_ps(_mm512_add_pd(_mm512_cvtps_pd(r), _mm512_mul_pd(y, y)));
+        r = _mm512_cvtpd_ps(_mm512_add_pd(_mm512_cvtps_pd(r), _mm512_mul_pd(z, z)));
+
+        __m256 timeCorrection = _mm512_cvtpd_ps(_mm512_div_pd(_mm512_cvtps_pd(_mm256_sqrt_ps(r)), speedOfLight));
+        __m512d relativetime = _mm512_cvtps_pd(_mm256_sub_ps(_mm256_loadu_ps(view.time + i), timeCorrection));
+        __mmask8 pass = _mm512_cmp_pd_mask(relativetime, tmin, _CMP_GT_OQ) &
+                        _mm512_cmp_pd_mask(relativetime, tmax, _CMP_LT_OQ);
+
+        __m512d correction = energyCut.subtractBIB ? _mm512_loadu_pd(view.correction + i) : zero;
+        __m512d energy = _mm512_sub_pd(_mm512_cvtps_pd(_mm256_loadu_ps(view.energy + i)), correction);
+        pass &= _mm512_cmp_pd_mask(energy, _mm512_loadu_pd(view.threshold + i), _CMP_GT_OQ);
+
+        __m512i indices = _mm512_add_epi64(_mm512_set1_epi64(static_cast<long long>(i)), lanes);
+        _mm512_mask_compressstoreu_epi64(accepted + nAccepted, pass, indices);
+        nAccepted += __builtin_popcount(pass);
+      }
+
+      for (; i < view.size; i++)
+      {
+        accepted[nAccepted] = i;
+        nAccepted += (energyCut(view, i) && timeCut(view, i)) ? 1 : 0;
+      }
+      return nAccepted;
+    }
+
+#endif
+
+  } // namespace
+
+  SimdLevel detectSimdLevel()
+  {
+#ifdef MYBIBUTILS_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+      return SimdLevel::AVX512;
+    if (__builtin_cpu_supports("avx2"))
+      return SimdLevel::AVX2;
+#endif
+    return SimdLevel::Scalar;
+  }
+
+  SimdLevel resolveSimdLevel(const std::string &requested, const std::string &owner)
+  {
+    std::string name(requested);
+    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c)
+                   { return std::tolower(c); });
+
+    SimdLevel best = detectSimdLevel();
+    SimdLevel wanted = best;
+    if (name == "scalar")
+      wanted = SimdLevel::Scalar;
+    else if (name == "avx2")
+      wanted = SimdLevel::AVX2;
+    else if (name == "avx512")
+      wanted = SimdLevel::AVX512;
+    else if (name != "auto")
+      throw std::runtime_error(owner + ": unknown SimdLevel " + requested + ", use auto, avx512, avx2 or scalar");
+
+    // SimdLevel is ordered by capability
+    return std::min(wanted, best);
+  }
+
+  const char *simdLevelName(SimdLevel level)
+  {
+    switch (level)
+    {
+    case SimdLevel::AVX512:
+      return "avx512";
+    case SimdLevel::AVX2:
+      return "avx2";
+    default:
+      return "scalar";
+    }
+  }
+
+  size_t selectCaloHits(const CaloHitView &view, const CaloEnergyThreshold &energyCut, const CaloTimeWindow &timeCut,
+                        SimdLevel level, std::vector<size_t> &accepted)
+  {
+    size_t nAccepted = 0;
+#ifdef MYBIBUTILS_X86_SIMD
+    if (level == SimdLevel::AVX512)
+    {
+      accepted.resize(view.size);
+      nAccepted = selectAVX512(view, energyCut, timeCut, accepted.data());
+      accepted.resize(nAccepted);
+      return nAccepted;
+    }
+    if (level == SimdLevel::AVX2)
+    {
+      accepted.resize(view.size);
+      nAccepted = selectAVX2(view, energyCut, timeCut, accepted.data());
+      accepted.resize(nAccepted);
+      return nAccepted;
+    }
+#endif
+    nAccepted = selectHits(view, allOf(energyCut, timeCut), accepted);
+    return nAccepted;
+  }
+
+} // namespace SelectionKernel
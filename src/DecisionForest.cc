@@ -0,0 +1,295 @@
+#include "DecisionForest.h"
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define MYBIBUTILS_X86_SIMD 1
+#endif
+
+namespace
+{
+    // deeper trees would make the padded node arrays needlessly large
+    const unsigned int kMaxDepth = 12;
+
+    // hits scored together, so that one tree stays in cache across them
+    const size_t kBlockSize = 64;
+
+    // levels of each tree kept in the padded head tables for the vector path (2^5 - 1 nodes, 32 entries)
+    const unsigned int kHeadDepth = 5;
+    const size_t kHeadSize = 32;
+
+    // features the vector path can hold in registers
+    const size_t kMaxSimdFeatures = 16;
+
+    unsigned int treeDepth(const DecisionForest::Tree &tree, int id, unsigned int depth)
+    {
+        auto found = tree.find(id);
+        if (found == tree.end())
+            throw std::runtime_error("DecisionForest: reference to missing node " + std::to_string(id));
+        if (depth > kMaxDepth)
+            throw std::runtime_error("DecisionForest: tree deeper than " + std::to_string(kMaxDepth) + " or cyclic");
+        if (found->second.isLeaf)
+            return depth;
+        return std::max(treeDepth(tree, found->second.left, depth + 1), treeDepth(tree, found->second.right, depth + 1));
+    }
+
+    // Write node id of the model at breadth-first position pos of the perfect tree
+    void compileNode(const DecisionForest::Tree &tree, int id, size_t pos, size_t nInternal,
+                     int *feature, float *threshold, float *leaf)
+    {
+        const DecisionForest::Node &node = tree.at(id);
+        if (pos >= nInternal)
+        {
+            leaf[pos - nInternal] = node.value;
+            return;
+        }
+
+        if (node.isLeaf)
+        {
+            // padding: a NaN threshold always sends the hit left, both sides end in the same leaf
+            feature[pos] = 0;
+            threshold[pos] = std::numeric_limits<float>::quiet_NaN();
+            compileNode(tree, id, 2 * pos + 1, nInternal, feature, threshold, leaf);
+            compileNode(tree, id, 2 * pos + 2, nInternal, feature, threshold, leaf);
+            return;
+        }
+
+        feature[pos] = node.feature;
+        threshold[pos] = node.threshold;
+        compileNode(tree, node.left, 2 * pos + 1, nInternal, feature, threshold, leaf);
+        compileNode(tree, node.right, 2 * pos + 2, nInternal, feature, threshold, leaf);
+    }
+
+#ifdef MYBIBUTILS_X86_SIMD
+
+    // Sixteen hits per step, one lane per hit; same comparisons and summation order as the scalar loop.
+    // The feature values of the sixteen hits stay in registers and the first five levels of every tree
+    // (the padded head tables) are looked up with in-register permutes, deeper levels with gathers.
+    __attribute__((target("avx512f"))) void evaluateAVX512(const float *features, size_t stride, size_t nFeatures,
+                                                           size_t begin, size_t end,
+                                                           size_t nTrees, unsigned int depth, float baseScore,
+                                                           const int *feature, const float *threshold, const float *leaf,
+                                                           const int *headFeature, const float *headThreshold,
+                                                           float *scores)
+    {
+        const size_t nInternal = (size_t(1) << depth) - 1;
+        const size_t nLeaves = size_t(1) << depth;
+        const __m512i one = _mm512_set1_epi32(1);
+        const __m512i firstLeaf = _mm512_set1_epi32(static_cast<int>(nInternal));
+
+        __m512 x[kMaxSimdFeatures];
+        for (size_t i = begin; i < end; i += 16)
+        {
+            for (size_t itFeature = 0; itFeature < nFeatures; itFeature++)
+                x[itFeature] = _mm512_loadu_ps(features + itFeature * stride + i);
+            __m512 score = _mm512_set1_ps(baseScore);
+
+            for (size_t itTree = 0; itTree < nTrees; itTree++)
+            {
+                const int *treeFeature = feature + itTree * nInternal;
+                const float *treeThreshold = threshold + itTree * nInternal;
+                const __m512i headF0 = _mm512_loadu_si512(headFeature + itTree * kHeadSize);
+                const __m512i headF1 = _mm512_loadu_si512(headFeature + itTree * kHeadSize + 16);
+                const __m512 headT0 = _mm512_loadu_ps(headThreshold + itTree * kHeadSize);
+                const __m512 headT1 = _mm512_loadu_ps(headThreshold + itTree * kHeadSize + 16);
+
+                __m512i node = _mm512_setzero_si512();
+                for (unsigned int level = 0; level < depth; level++)
+                {
+                    __m512i f;
+                    __m512 cut;
+                    if (level < kHeadDepth)
+                    {
+                        f = _mm512_permutex2var_epi32(headF0, node, headF1);
+                        cut = _mm512_permutex2var_ps(headT0, node, headT1);
+                    }
+                    else
+                    {
+                        f = _mm512_i32gather_epi32(node, treeFeature, 4);
+                        cut = _mm512_i32gather_ps(node, treeThreshold, 4);
+                    }
+
+                    __m512 value = x[0];
+                    for (size_t itFeature = 1; itFeature < nFeatures; itFeature++)
+                        value = _mm512_mask_blend_ps(_mm512_cmpeq_epi32_mask(f, _mm512_set1_epi32(static_cast<int>(itFeature))),
+                                                     value, x[itFeature]);
+
+                    // node = 2 * node + 1 + (x >= cut)
+                    __mmask16 right = _mm512_cmp_ps_mask(value, cut, _CMP_GE_OQ);
+                    node = _mm512_add_epi32(_mm512_slli_epi32(node, 1), one);
+                    node = _mm512_mask_add_epi32(node, right, node, one);
+                }
+                score = _mm512_add_ps(score, _mm512_i32gather_ps(_mm512_sub_epi32(node, firstLeaf), leaf + itTree * nLeaves, 4));
+            }
+
+            _mm512_storeu_ps(scores + i, score);
+        }
+    }
+
+#endif
+
+} // namespace
+
+void DecisionForest::load(const std::string &fileName)
+{
+    std::ifstream input(fileName);
+    if (!input.good())
+        throw std::runtime_error("DecisionForest: cannot open model file " + fileName);
+
+    m_featureNames.clear();
+    m_baseScore = 0.;
+    m_trees.clear();
+
+    std::string line;
+    size_t lineNumber = 0;
+    while (std::getline(input, line))
+    {
+        lineNumber++;
+        std::istringstream tokens(line);
+        std::string keyword;
+        if (!(tokens >> keyword) || keyword[0] == '#')
+            continue;
+
+        std::string where = fileName + ":" + std::to_string(lineNumber);
+        if (keyword == "features")
+        {
+            std::string name;
+            while (tokens >> name)
+                m_featureNames.push_back(name);
+        }
+        else if (keyword == "base_score")
+        {
+            if (!(tokens >> m_baseScore))
+                throw std::runtime_error("DecisionForest: bad base_score at " + where);
+        }
+        else if (keyword == "tree")
+        {
+            m_trees.emplace_back();
+        }
+        else
+        {
+            if (m_trees.empty())
+                throw std::runtime_error("DecisionForest: node outside of a tree at " + where);
+
+            Node node;
+            std::string type;
+            int id = 0;
+            try
+            {
+                id = std::stoi(keyword);
+            }
+            catch (std::exception &e)
+            {
+                throw std::runtime_error("DecisionForest: bad node id at " + where);
+            }
+
+            tokens >> type;
+            if (type == "leaf")
+            {
+                node.isLeaf = true;
+                if (!(tokens >> node.value))
+                    throw std::runtime_error("DecisionForest: bad leaf at " + where);
+            }
+            else if (type == "split")
+            {
+                std::string featureName;
+                if (!(tokens >> featureName >> node.threshold >> node.left >> node.right))
+                    throw std::runtime_error("DecisionForest: bad split at " + where);
+                auto found = std::find(m_featureNames.begin(), m_featureNames.end(), featureName);
+                if (found == m_featureNames.end())
+                    throw std::runtime_error("DecisionForest: undeclared feature " + featureName + " at " + where);
+                node.feature = static_cast<int>(found - m_featureNames.begin());
+            }
+            else
+            {
+                throw std::runtime_error("DecisionForest: unknown node type " + type + " at " + where);
+            }
+
+            if (!m_trees.back().emplace(id, node).second)
+                throw std::runtime_error("DecisionForest: duplicate node id at " + where);
+        }
+    }
+
+    if (m_trees.empty())
+        throw std::runtime_error("DecisionForest: no trees in " + fileName);
+
+    m_depth = 0;
+    for (const Tree &tree : m_trees)
+        m_depth = std::max(m_depth, treeDepth(tree, 0, 0));
+
+    m_nTrees = m_trees.size();
+    size_t nInternal = (size_t(1) << m_depth) - 1;
+    size_t nLeaves = size_t(1) << m_depth;
+    m_feature.assign(m_nTrees * nInternal, 0);
+    m_threshold.assign(m_nTrees * nInternal, 0.);
+    m_leaf.assign(m_nTrees * nLeaves, 0.);
+
+    for (size_t itTree = 0; itTree < m_nTrees; itTree++)
+        compileNode(m_trees[itTree], 0, 0, nInternal,
+                    m_feature.data() + itTree * nInternal,
+                    m_threshold.data() + itTree * nInternal,
+                    m_leaf.data() + itTree * nLeaves);
+
+    // copy of the first levels of every tree, padded to a fixed size for the vector path
+    size_t nHead = std::min(nInternal, kHeadSize - 1);
+    m_headFeature.assign(m_nTrees * kHeadSize, 0);
+    m_headThreshold.assign(m_nTrees * kHeadSize, 0.);
+    for (size_t itTree = 0; itTree < m_nTrees; itTree++)
+    {
+        std::copy_n(m_feature.data() + itTree * nInternal, nHead, m_headFeature.data() + itTree * kHeadSize);
+        std::copy_n(m_threshold.data() + itTree * nInternal, nHead, m_headThreshold.data() + itTree * kHeadSize);
+    }
+}
+
+void DecisionForest::evaluateScalar(const float *features, size_t stride, size_t begin, size_t end, float *scores) const
+{
+    const size_t nInternal = (size_t(1) << m_depth) - 1;
+    const size_t nLeaves = size_t(1) << m_depth;
+
+    for (size_t blockBegin = begin; blockBegin < end; blockBegin += kBlockSize)
+    {
+        size_t blockEnd = std::min(blockBegin + kBlockSize, end);
+        std::fill(scores + blockBegin, scores + blockEnd, m_baseScore);
+
+        for (size_t itTree = 0; itTree < m_nTrees; itTree++)
+        {
+            const int *treeFeature = m_feature.data() + itTree * nInternal;
+            const float *treeThreshold = m_threshold.data() + itTree * nInternal;
+            const float *treeLeaf = m_leaf.data() + itTree * nLeaves;
+
+            // descend all hits of the block one level at a time, the hits being independent
+            unsigned int node[kBlockSize] = {};
+            for (unsigned int level = 0; level < m_depth; level++)
+                for (size_t i = blockBegin; i < blockEnd; i++)
+                {
+                    unsigned int &hitNode = node[i - blockBegin];
+                    hitNode = 2 * hitNode + 1 + (features[treeFeature[hitNode] * stride + i] >= treeThreshold[hitNode] ? 1 : 0);
+                }
+            for (size_t i = blockBegin; i < blockEnd; i++)
+                scores[i] += treeLeaf[node[i - blockBegin] - nInternal];
+        }
+    }
+}
+
+void DecisionForest::evaluate(const float *features, size_t stride, size_t n, float *scores, SelectionKernel::SimdLevel level) const
+{
+    size_t nVector = 0;
+#ifdef MYBIBUTILS_X86_SIMD
+    // gather offsets are 32-bit
+    bool fitsInt = m_nTrees * (size_t(1) << m_depth) < static_cast<size_t>(std::numeric_limits<int>::max());
+    if (level == SelectionKernel::SimdLevel::AVX512 && fitsInt && m_featureNames.size() <= kMaxSimdFeatures)
+    {
+        nVector = n - n % 16;
+        evaluateAVX512(features, stride, m_featureNames.size(), 0, nVector, m_nTrees, m_depth, m_baseScore,
+                       m_feature.data(), m_threshold.data(), m_leaf.data(),
+                       m_headFeature.data(), m_headThreshold.data(), scores);
+    }
+#endif
+    evaluateScalar(features, stride, nVector, n, scores);
+}
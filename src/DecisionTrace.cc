@@ -0,0 +1,67 @@
+#include "DecisionTrace.h"
+
+namespace
+{
+    // writer blocks queued before the filling threads wait
+    const size_t kMaxQueuedBlocks = 64;
+
+    struct StreamPayload : BlockWriter::Block
+    {
+        std::string text;
+
+        uint32_t type() const override { return DecisionTrace::StreamBlock; }
+        void encode(std::vector<char> &out) override { out.insert(out.end(), text.begin(), text.end()); }
+    };
+
+    struct RecordPayload : BlockWriter::Block
+    {
+        std::vector<DecisionTrace::Record> records;
+
+        uint32_t type() const override { return DecisionTrace::RecordBlock; }
+        void encode(std::vector<char> &out) override
+        {
+            const char *data = reinterpret_cast<const char *>(records.data());
+            out.insert(out.end(), data, data + records.size() * sizeof(DecisionTrace::Record));
+        }
+    };
+} // namespace
+
+std::shared_ptr<DecisionTrace> DecisionTrace::open(const std::string &fileName)
+{
+    return BlockWriter::shared<DecisionTrace>(fileName, [&fileName]()
+                                              { return new DecisionTrace(fileName); });
+}
+
+DecisionTrace::DecisionTrace(const std::string &fileName) : m_writer(fileName, kMagic, kMaxQueuedBlocks, 0, "DecisionTrace")
+{
+}
+
+uint16_t DecisionTrace::registerStream(const std::string &name, const std::vector<std::string> &valueNames,
+                                       const std::vector<std::string> &decisionNames)
+{
+    std::string text = name + "|";
+    for (size_t itValue = 0; itValue < valueNames.size() && itValue < kNValues; itValue++)
+        text += (itValue > 0 ? "," : "") + valueNames[itValue];
+    text += "|";
+    for (size_t itDecision = 0; itDecision < decisionNames.size(); itDecision++)
+        text += (itDecision > 0 ? "," : "") + decisionNames[itDecision];
+
+    uint16_t stream = m_nStreams++;
+
+    // the stream id leads the text
+    std::unique_ptr<StreamPayload> block(new StreamPayload);
+    block->text = std::string(reinterpret_cast<const char *>(&stream), sizeof(stream)) + text;
+    m_writer.submit(std::move(block));
+    return stream;
+}
+
+void DecisionTrace::Buffer::flush()
+{
+    if (m_trace == nullptr || m_records.empty())
+        return;
+
+    std::unique_ptr<RecordPayload> block(new RecordPayload);
+    block->records.swap(m_records);
+    m_trace->m_writer.submit(std::move(block));
+    m_records.reserve(kBufferRecords);
+}
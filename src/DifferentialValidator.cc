@@ -0,0 +1,147 @@
+#include "DifferentialValidator.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iterator>
+#include <map>
+#include <unordered_map>
+
+#include <EVENT/LCRelation.h>
+
+void DifferentialValidator::configure(double fraction, size_t maxReports)
+{
+    m_fraction = std::min(fraction, 1.);
+    m_maxReports = maxReports;
+    m_credit = 1.;
+}
+
+bool DifferentialValidator::sampleEvent(int run, int event)
+{
+    if (!enabled())
+        return false;
+
+    m_nEvents++;
+    if (m_credit < 1.)
+    {
+        m_credit += m_fraction;
+        return false;
+    }
+
+    m_credit += m_fraction - 1.;
+    m_run = run;
+    m_event = event;
+    m_nValidated++;
+    return true;
+}
+
+void DifferentialValidator::skipEvent()
+{
+    m_nValidated--;
+    m_nSkipped++;
+    m_credit += 1.;
+}
+
+size_t DifferentialValidator::compare(std::vector<size_t> fastHits, std::vector<size_t> referenceHits,
+                                      std::vector<RelationPair> fastPairs, std::vector<RelationPair> referencePairs,
+                                      const HitDescription &describeHit, std::ostream &report)
+{
+    std::sort(fastHits.begin(), fastHits.end());
+    std::sort(referenceHits.begin(), referenceHits.end());
+    std::sort(fastPairs.begin(), fastPairs.end());
+    std::sort(referencePairs.begin(), referencePairs.end());
+
+    std::vector<size_t> fastOnlyHits, referenceOnlyHits;
+    std::set_difference(fastHits.begin(), fastHits.end(), referenceHits.begin(), referenceHits.end(), std::back_inserter(fastOnlyHits));
+    std::set_difference(referenceHits.begin(), referenceHits.end(), fastHits.begin(), fastHits.end(), std::back_inserter(referenceOnlyHits));
+
+    std::vector<RelationPair> fastOnlyPairs, referenceOnlyPairs;
+    std::set_difference(fastPairs.begin(), fastPairs.end(), referencePairs.begin(), referencePairs.end(), std::back_inserter(fastOnlyPairs));
+    std::set_difference(referencePairs.begin(), referencePairs.end(), fastPairs.begin(), fastPairs.end(), std::back_inserter(referenceOnlyPairs));
+
+    m_nHits += referenceHits.size();
+    m_nFastOnlyHits += fastOnlyHits.size();
+    m_nReferenceOnlyHits += referenceOnlyHits.size();
+    m_nPairs += referencePairs.size();
+    m_nFastOnlyPairs += fastOnlyPairs.size();
+    m_nReferenceOnlyPairs += referenceOnlyPairs.size();
+
+    size_t nDifferences = fastOnlyHits.size() + referenceOnlyHits.size() + fastOnlyPairs.size() + referenceOnlyPairs.size();
+    if (nDifferences == 0)
+        return 0;
+    m_nMismatchedEvents++;
+
+    report << "run " << m_run << " event " << m_event << ": " << fastHits.size() << " hits accepted, "
+           << referenceHits.size() << " by the reference; " << fastOnlyHits.size() << " only optimised, "
+           << referenceOnlyHits.size() << " only reference, " << fastOnlyPairs.size() + referenceOnlyPairs.size()
+           << " relation differences" << std::endl;
+
+    size_t nReportsBefore = m_nReports;
+    for (size_t itHit : fastOnlyHits)
+        if (m_nReports++ < m_maxReports)
+            report << "  only optimised: hit " << itHit << " " << describeHit(itHit) << std::endl;
+    for (size_t itHit : referenceOnlyHits)
+        if (m_nReports++ < m_maxReports)
+            report << "  only reference: hit " << itHit << " " << describeHit(itHit) << std::endl;
+    for (const RelationPair &pair : fastOnlyPairs)
+        if (m_nReports++ < m_maxReports)
+            report << "  only optimised: relation " << pair.first << " -> " << pair.second << ", " << describeHit(pair.first) << std::endl;
+    for (const RelationPair &pair : referenceOnlyPairs)
+        if (m_nReports++ < m_maxReports)
+            report << "  only reference: relation " << pair.first << " -> " << pair.second << ", " << describeHit(pair.first) << std::endl;
+    if (m_nReports > m_maxReports && nReportsBefore <= m_maxReports)
+        report << "  (further differences not detailed)" << std::endl;
+
+    return nDifferences;
+}
+
+void DifferentialValidator::print(std::ostream &out, const std::string &processorName) const
+{
+    if (!enabled())
+        return;
+
+    out << processorName << " differential validation: " << m_nValidated << " of " << m_nEvents << " events, "
+        << m_nMismatchedEvents << " with differences";
+    if (m_nSkipped > 0)
+        out << ", " << m_nSkipped << " skipped";
+    out << std::endl;
+    out << "  hits: " << m_nHits << " accepted by the reference, " << m_nFastOnlyHits << " only optimised, "
+        << m_nReferenceOnlyHits << " only reference" << std::endl;
+    out << "  relations: " << m_nPairs << " in the reference, " << m_nFastOnlyPairs << " only optimised, "
+        << m_nReferenceOnlyPairs << " only reference" << std::endl;
+
+    out << "  time: optimised " << std::fixed << std::setprecision(3) << 1000. * m_fastSeconds << " ms, reference "
+        << 1000. * m_referenceSeconds << " ms";
+    if (m_fastSeconds > 0.)
+        out << ", ratio " << std::setprecision(2) << m_referenceSeconds / m_fastSeconds;
+    out << std::defaultfloat << std::setprecision(6) << std::endl;
+}
+
+std::vector<DifferentialValidator::RelationPair> DifferentialValidator::carriedRelations(const EVENT::LCCollection *hitCollection,
+                                                                                        const EVENT::LCCollection *inputRelations,
+                                                                                        const EVENT::LCCollection *outputRelations)
+{
+    static const size_t kNotFound = static_cast<size_t>(-1);
+
+    std::unordered_map<const EVENT::LCObject *, size_t> hitIndices;
+    for (int itHit = 0; itHit < hitCollection->getNumberOfElements(); itHit++)
+        hitIndices.emplace(hitCollection->getElementAt(itHit), itHit);
+
+    std::map<std::pair<const EVENT::LCObject *, const EVENT::LCObject *>, size_t> relationIndices;
+    for (int itRel = 0; itRel < inputRelations->getNumberOfElements(); itRel++)
+    {
+        EVENT::LCRelation *rel = static_cast<EVENT::LCRelation *>(inputRelations->getElementAt(itRel));
+        relationIndices.emplace(std::make_pair(rel->getFrom(), rel->getTo()), itRel);
+    }
+
+    std::vector<RelationPair> pairs;
+    pairs.reserve(outputRelations->getNumberOfElements());
+    for (int itRel = 0; itRel < outputRelations->getNumberOfElements(); itRel++)
+    {
+        EVENT::LCRelation *rel = static_cast<EVENT::LCRelation *>(outputRelations->getElementAt(itRel));
+        auto hit = hitIndices.find(rel->getFrom());
+        auto relation = relationIndices.find(std::make_pair(rel->getFrom(), rel->getTo()));
+        pairs.push_back({hit != hitIndices.end() ? hit->second : kNotFound,
+                         relation != relationIndices.end() ? relation->second : kNotFound});
+    }
+    return pairs;
+}
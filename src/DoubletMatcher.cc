@@ -0,0 +1,542 @@
+#include "DoubletMatcher.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <stdexcept>
+
+#include "SensorOccupancy.h"
+
+#include "TMath.h"
+#include "TVector2.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define MYBIBUTILS_X86_SIMD 1
+#endif
+
+namespace
+{
+    // Synthetic sensor pairs of the calibration: phi span about that of a vertex detector ladder,
+    // sizes doubling between the two bounds, each size timed over this many hit pairs
+    const double kCalibrationPhiSpan = 0.2;
+    const size_t kCalibrationMinHits = 4;
+    const size_t kCalibrationMaxHits = 256;
+    const size_t kCalibrationPairHits = 1 << 16;
+
+    // dR from one inner hit to every outer hit and whether the pair passes both cuts, returns the smallest dR
+    double pairDistancesScalar(double coord, double phi, const double *outerCoord, const double *outerPhi, size_t nOuter,
+                               double dcoordCut, double dphiCut, double *dR, uint8_t *pass)
+    {
+        double min_dR = 999999.;
+        for (size_t itOuter = 0; itOuter < nOuter; itOuter++)
+        {
+            double dcoord = outerCoord[itOuter] - coord;
+            double dphi = TVector2::Phi_mpi_pi(phi - outerPhi[itOuter]);
+            dR[itOuter] = sqrt(dphi * dphi + dcoord * dcoord);
+            pass[itOuter] = !(fabs(dcoord) > dcoordCut) && !(fabs(dphi) > dphiCut);
+            if (dR[itOuter] < min_dR)
+                min_dR = dR[itOuter];
+        }
+        return min_dR;
+    }
+
+#ifdef MYBIBUTILS_X86_SIMD
+
+    // 4 outer hits per iteration, same operations as the scalar loop so that dR is bit-identical;
+    // AVX-512 machines take this path too
+    __attribute__((target("avx2"))) double pairDistancesAVX2(double coord, double phi, const double *outerCoord, const double *outerPhi,
+                                                             size_t nOuter, double dcoordCut, double dphiCut, double *dR, uint8_t *pass)
+    {
+        const __m256d vcoord = _mm256_set1_pd(coord);
+        const __m256d vphi = _mm256_set1_pd(phi);
+        const __m256d pi = _mm256_set1_pd(TMath::Pi());
+        const __m256d minusPi = _mm256_set1_pd(-TMath::Pi());
+        const __m256d twoPi = _mm256_set1_pd(TMath::TwoPi());
+        const __m256d coordCut = _mm256_set1_pd(dcoordCut);
+        const __m256d phiCut = _mm256_set1_pd(dphiCut);
+        const __m256d absMask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffLL));
+        __m256d vmin = _mm256_set1_pd(999999.);
+
+        size_t i = 0;
+        for (; i + 4 <= nOuter; i += 4)
+        {
+            __m256d dcoord = _mm256_sub_pd(_mm256_loadu_pd(outerCoord + i), vcoord);
+            // both phi are in [-pi, pi], one turn brings the difference back as Phi_mpi_pi does
+            __m256d dphi = _mm256_sub_pd(vphi, _mm256_loadu_pd(outerPhi + i));
+            dphi = _mm256_sub_pd(dphi, _mm256_and_pd(_mm256_cmp_pd(dphi, pi, _CMP_GE_OQ), twoPi));
+            dphi = _mm256_add_pd(dphi, _mm256_and_pd(_mm256_cmp_pd(dphi, minusPi, _CMP_LT_OQ), twoPi));
+            __m256d distance = _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(dphi, dphi), _mm256_mul_pd(dcoord, dcoord)));
+            _mm256_storeu_pd(dR + i, distance);
+            // NaN distances are skipped, as by the scalar comparison
+            vmin = _mm256_min_pd(distance, vmin);
+
+            int fail = _mm256_movemask_pd(_mm256_or_pd(_mm256_cmp_pd(_mm256_and_pd(dcoord, absMask), coordCut, _CMP_GT_OQ),
+                                                       _mm256_cmp_pd(_mm256_and_pd(dphi, absMask), phiCut, _CMP_GT_OQ)));
+            for (int lane = 0; lane < 4; lane++)
+                pass[i + lane] = !((fail >> lane) & 1);
+        }
+
+        double lanes[4];
+        _mm256_storeu_pd(lanes, vmin);
+        double min_dR = pairDistancesScalar(coord, phi, outerCoord + i, outerPhi + i, nOuter - i, dcoordCut, dphiCut, dR + i, pass + i);
+        for (double lane : lanes)
+            min_dR = std::min(min_dR, lane);
+        return min_dR;
+    }
+
+#endif
+
+} // namespace
+
+void DoubletMatcher::configure(const Settings &settings, const std::vector<std::string> &layerPairs, const std::string &owner)
+{
+    m_settings = settings;
+
+    if (layerPairs.size() % 4 != 0)
+    {
+        throw std::runtime_error(owner + ": LayerPairs must contain quadruplets of inner layer, outer layer, coordinate cut, phi cut");
+    }
+
+    m_layerPairs.clear();
+    for (size_t itPair = 0; itPair < layerPairs.size(); itPair += 4)
+    {
+        // cuts are parsed in double precision to keep the comparison margins exact
+        LayerPair layerPair;
+        try
+        {
+            layerPair = {static_cast<unsigned int>(std::stoul(layerPairs[itPair])),
+                         static_cast<unsigned int>(std::stoul(layerPairs[itPair + 1])),
+                         std::stod(layerPairs[itPair + 2]),
+                         std::stod(layerPairs[itPair + 3]),
+                         m_settings.windowMinPairHits};
+        }
+        catch (std::exception &e)
+        {
+            throw std::runtime_error(owner + ": cannot parse LayerPairs entry starting at " + layerPairs[itPair]);
+        }
+
+        // every layer may appear only once, so that sensor pairs never share hits
+        for (const auto &other : m_layerPairs)
+        {
+            if (other.first == layerPair.innerLayer || other.first == layerPair.outerLayer ||
+                other.second.outerLayer == layerPair.innerLayer || other.second.outerLayer == layerPair.outerLayer)
+            {
+                throw std::runtime_error(owner + ": layer used in more than one LayerPairs entry");
+            }
+        }
+        m_layerPairs[layerPair.innerLayer] = layerPair;
+    }
+
+    // Crossover between the scan and the phi window, fixed unless a measurement on this machine is requested
+    for (auto &layerPair : m_layerPairs)
+    {
+        layerPair.second.windowMinPairHits = m_settings.windowMinPairHits;
+        if (m_settings.strategy == Strategy::Auto && m_settings.windowMinPairHits == 0)
+            layerPair.second.windowMinPairHits = calibrateWindowMinPairHits(layerPair.second);
+    }
+}
+
+size_t DoubletMatcher::calibrateWindowMinPairHits(const LayerPair &layerPair) const
+{
+    const double window = sqrt(layerPair.dcoord_cut * layerPair.dcoord_cut + layerPair.dphi_cut * layerPair.dphi_cut);
+    if (window >= TMath::Pi())
+        return std::numeric_limits<size_t>::max();
+
+    // only the matching itself is timed
+    DoubletMatcher probe(*this);
+    probe.m_settings.maxZ0 = 0.;
+    probe.m_settings.maxD0 = 0.;
+    probe.m_settings.storeDoublets = false;
+
+    // coordinates spread so that both cuts keep the same fraction of the pairs
+    const double coordSpan = layerPair.dphi_cut > 0. ? layerPair.dcoord_cut * kCalibrationPhiSpan / layerPair.dphi_cut : kCalibrationPhiSpan;
+    std::mt19937 generator(20220315);
+    std::uniform_real_distribution<double> uniform(0., 1.);
+    EventArena arena;
+
+    for (size_t nHits = kCalibrationMinHits; nHits <= kCalibrationMaxHits; nHits *= 2)
+    {
+        // inner hits first, then outer hits
+        std::vector<double> coord(2 * nHits);
+        std::vector<double> phi(2 * nHits);
+        std::vector<double> zero(2 * nHits, 0.);
+        for (size_t itHit = 0; itHit < 2 * nHits; itHit++)
+        {
+            coord[itHit] = coordSpan * uniform(generator);
+            phi[itHit] = kCalibrationPhiSpan * (uniform(generator) - 0.5);
+        }
+        std::vector<size_t> hits(2 * nHits);
+        std::iota(hits.begin(), hits.end(), 0);
+        std::vector<uint8_t> accepted(2 * nHits);
+
+        const Columns columns = {coord.data(), phi.data(), zero.data(), zero.data(), zero.data()};
+        SensorPairTask task = {{hits.data(), hits.data() + nHits}, {hits.data() + nHits, hits.data() + 2 * nHits}, &layerPair};
+        const size_t nRepeats = std::max<size_t>(1, kCalibrationPairHits / (nHits * nHits));
+
+        // best of three, against the noise of a busy machine
+        auto timeOf = [&](bool windowed)
+        {
+            double best = std::numeric_limits<double>::max();
+            for (int itTrial = 0; itTrial < 3; itTrial++)
+            {
+                auto start = std::chrono::steady_clock::now();
+                for (size_t itRepeat = 0; itRepeat < nRepeats; itRepeat++)
+                {
+                    arena.reset();
+                    task.windowed = windowed;
+                    probe.matchSensorPair(columns, task, accepted.data(), arena);
+                }
+                best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+            }
+            return best;
+        };
+
+        // halfway, in log scale, from the previous size where the scan was faster
+        if (timeOf(true) < timeOf(false))
+            return nHits * nHits / 2;
+    }
+
+    return std::numeric_limits<size_t>::max();
+}
+
+void DoubletMatcher::match(const TrackerHitColumns &hitIndex, Scratch &scratch, std::vector<size_t> &acceptedHits) const
+{
+    size_t nHits = hitIndex.size();
+    scratch.accepted.assign(nHits, 0);
+    std::vector<SensorPairTask> &tasks = scratch.tasks;
+    tasks.clear();
+    scratch.maskedPairs.clear();
+    // the doublets of the previous event went with the tasks
+    scratch.arena.reset();
+    for (std::unique_ptr<EventArena> &workerArena : scratch.workerArenas)
+        workerArena->reset();
+    const bool useStates = scratch.sensorStates.size() == hitIndex.sensors().size();
+
+    const Columns columns = {coordinates(hitIndex), hitIndex.phi.data(), hitIndex.x.data(), hitIndex.y.data(), hitIndex.z.data()};
+
+    // Build the list of sensor pairs. We go inside out and skip the outer layers
+    for (size_t itSensor = 0; itSensor < hitIndex.sensors().size(); itSensor++)
+    {
+        const TrackerHitColumns::SensorKey &sensor = hitIndex.sensors()[itSensor];
+        auto layerPair = m_layerPairs.find(sensor.layer);
+        if (layerPair == m_layerPairs.end())
+            continue;
+
+        // Checking if there are any hits in the other layer
+        TrackerHitColumns::HitRange theOther = hitIndex.sensorHits({layerPair->second.outerLayer, sensor.side, sensor.ladder, sensor.module});
+        if (theOther.empty())
+            continue;
+
+        // a pair takes the state of its hotter sensor
+        uint8_t state = SensorOccupancy::Normal;
+        if (useStates)
+            state = std::max(scratch.sensorStates[itSensor], scratch.sensorStates[hitIndex.sensorNumber[*theOther.begin()]]);
+        if (state == SensorOccupancy::Masked)
+        {
+            scratch.maskedPairs.push_back({hitIndex.sensorHits(itSensor), theOther, &layerPair->second});
+            continue;
+        }
+
+        tasks.push_back({hitIndex.sensorHits(itSensor), theOther, &layerPair->second, DoubletVector(ArenaAllocator<Doublet>(&scratch.arena))});
+        tasks.back().hot = (state == SensorOccupancy::Bounded);
+    }
+
+    // Occupancy guard: decided up front from the event size and the sensor occupancies
+    bool guardEvent = m_settings.guardMaxHits > 0 && nHits > static_cast<size_t>(m_settings.guardMaxHits);
+    scratch.nGuardedPairs = 0;
+    scratch.nHotPairs = 0;
+    for (SensorPairTask &task : tasks)
+    {
+        bool guarded = guardEvent || (m_settings.guardMaxPairHits > 0 &&
+                                      task.innerHits.size() * task.outerHits.size() > static_cast<size_t>(m_settings.guardMaxPairHits));
+        // hot sensors take the bounded matching too, without flagging the event
+        task.guarded = guarded || task.hot;
+        scratch.nGuardedPairs += guarded ? 1 : 0;
+        scratch.nHotPairs += task.hot ? 1 : 0;
+
+        // otherwise the cheaper of the scan and the window, both exact
+        const size_t pairHits = task.innerHits.size() * task.outerHits.size();
+        task.windowed = !task.guarded && (m_settings.strategy == Strategy::Window ||
+                                          (m_settings.strategy == Strategy::Auto && pairHits >= task.layerPair->windowMinPairHits));
+    }
+
+    // Each sensor pair only writes the decisions of its own hits, so pairs can be matched concurrently
+    uint8_t *accepted = scratch.accepted.data();
+    scratch.nThreads = std::min<size_t>(std::max(m_settings.nThreads, 1), tasks.size());
+    if (scratch.nThreads <= 1)
+    {
+        for (SensorPairTask &task : tasks)
+            matchSensorPair(columns, task, accepted, scratch.arena);
+    }
+    else
+    {
+        // Largest pairs first, threads pick the next free pair when done with the previous one
+        std::sort(tasks.begin(), tasks.end(), [](const SensorPairTask &a, const SensorPairTask &b)
+                  { return a.innerHits.size() * a.outerHits.size() > b.innerHits.size() * b.outerHits.size(); });
+
+        // every thread allocates from its own arena, the doublets of a pair included
+        while (scratch.workerArenas.size() + 1 < scratch.nThreads)
+            scratch.workerArenas.emplace_back(new EventArena());
+
+        std::atomic<size_t> nextTask(0);
+        auto worker = [&](EventArena *arena)
+        {
+            for (size_t itTask = nextTask++; itTask < tasks.size(); itTask = nextTask++)
+            {
+                tasks[itTask].doublets = DoubletVector(ArenaAllocator<Doublet>(arena));
+                matchSensorPair(columns, tasks[itTask], accepted, *arena);
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (unsigned int itThread = 1; itThread < scratch.nThreads; itThread++)
+            workers.emplace_back(worker, scratch.workerArenas[itThread - 1].get());
+        worker(&scratch.arena);
+        for (std::thread &thread : workers)
+            thread.join();
+    }
+
+    // strategies as applied, pairs with too wide cuts fall back to the scan
+    scratch.nScanPairs = 0;
+    scratch.nWindowPairs = 0;
+    for (const SensorPairTask &task : tasks)
+    {
+        scratch.nScanPairs += (!task.guarded && !task.windowed) ? 1 : 0;
+        scratch.nWindowPairs += task.windowed ? 1 : 0;
+    }
+
+    // Once more to collect the accepted hits
+    acceptedHits.clear();
+    for (size_t itHit = 0; itHit < nHits; itHit++)
+    {
+        if (accepted[itHit])
+            acceptedHits.push_back(itHit);
+    }
+}
+
+void DoubletMatcher::matchSensorPair(const Columns &columns, SensorPairTask &task, uint8_t *accepted, EventArena &arena) const
+{
+    if (task.guarded)
+        matchSensorPairWindowed(columns, task, accepted, arena, std::max(m_settings.guardMaxCandidates, 0));
+    else if (task.windowed)
+        matchSensorPairWindowed(columns, task, accepted, arena, 0);
+    else
+        matchSensorPairScan(columns, task, accepted, arena);
+}
+
+void DoubletMatcher::matchSensorPairScan(const Columns &columns, SensorPairTask &task, uint8_t *accepted, EventArena &arena) const
+{
+    const double dcoord_cut = task.layerPair->dcoord_cut;
+    const double dphi_cut = task.layerPair->dphi_cut;
+    const bool doPointing = m_settings.maxZ0 > 0. || m_settings.maxD0 > 0.;
+    const bool doDoublets = m_settings.storeDoublets;
+
+    // Outer hits gathered in contiguous columns, distances to them kept per inner hit
+    const size_t nOuter = task.outerHits.size();
+    double *outerCoord = static_cast<double *>(arena.allocate(nOuter * (3 * sizeof(double) + 1), 32));
+    double *outerPhi = outerCoord + nOuter;
+    double *dR = outerPhi + nOuter;
+    uint8_t *pass = reinterpret_cast<uint8_t *>(dR + nOuter);
+    const size_t *outer = task.outerHits.begin();
+    for (size_t itOuter = 0; itOuter < nOuter; itOuter++)
+    {
+        outerCoord[itOuter] = columns.coord[outer[itOuter]];
+        outerPhi[itOuter] = columns.phi[outer[itOuter]];
+    }
+
+    for (size_t itHit : task.innerHits)
+    {
+        const size_t firstDoublet = task.doublets.size();
+        double coord = columns.coord[itHit];
+        double phi = columns.phi[itHit];
+
+        double min_dR = 0.;
+#ifdef MYBIBUTILS_X86_SIMD
+        if (m_settings.simdLevel != SelectionKernel::SimdLevel::Scalar)
+            min_dR = pairDistancesAVX2(coord, phi, outerCoord, outerPhi, nOuter, dcoord_cut, dphi_cut, dR, pass);
+        else
+#endif
+            min_dR = pairDistancesScalar(coord, phi, outerCoord, outerPhi, nOuter, dcoord_cut, dphi_cut, dR, pass);
+
+        for (size_t itOuter = 0; itOuter < nOuter; itOuter++)
+        {
+            if (!pass[itOuter])
+                continue;
+            size_t jitHit = outer[itOuter];
+            if (doPointing && !pointsToBeamline(columns, itHit, jitHit))
+                continue;
+
+            // accepted hit in outer layer of pair
+            accepted[jitHit] = 1;
+            if (doDoublets)
+                task.doublets.push_back({itHit, jitHit, static_cast<float>(dR[itOuter])});
+        }
+
+        // closest outer hit: the first one at the smallest dR, as in a scan in collection order
+        double dcoord_closest = 0.;
+        double dphi_closest = 0.;
+        size_t closestHit = 0;
+        bool foundClosest = min_dR < 999999.;
+        if (foundClosest)
+        {
+            size_t closest = std::find(dR, dR + nOuter, min_dR) - dR;
+            closestHit = outer[closest];
+            dcoord_closest = outerCoord[closest] - coord;
+            dphi_closest = TVector2::Phi_mpi_pi(phi - outerPhi[closest]);
+        }
+
+        // accepted hit in inner layer of pair, never without an outer hit
+        if (foundClosest && fabs(dcoord_closest) < dcoord_cut && fabs(dphi_closest) < dphi_cut &&
+            (!doPointing || pointsToBeamline(columns, itHit, closestHit)))
+            accepted[itHit] = 1;
+        // doublets are kept for accepted inner hits only, so that both ends are in the output
+        else if (doDoublets)
+            task.doublets.erase(task.doublets.begin() + firstDoublet, task.doublets.end());
+    }
+}
+
+void DoubletMatcher::matchSensorPairWindowed(const Columns &columns, SensorPairTask &task, uint8_t *accepted, EventArena &arena,
+                                             size_t maxCandidates) const
+{
+    const double dcoord_cut = task.layerPair->dcoord_cut;
+    const double dphi_cut = task.layerPair->dphi_cut;
+    const bool doPointing = m_settings.maxZ0 > 0. || m_settings.maxD0 > 0.;
+    const bool doDoublets = m_settings.storeDoublets;
+
+    // Any pair passing both cuts is closer than this in dR, hence also in |dphi|. A closest partner
+    // outside the window is therefore further than any passing candidate and would fail the cuts,
+    // so without a candidate limit the decisions are the same as in matchSensorPairScan.
+    const double window = sqrt(dcoord_cut * dcoord_cut + dphi_cut * dphi_cut) * (1. + 1.E-9);
+    if (window >= TMath::Pi())
+    {
+        task.guarded = false;
+        task.windowed = false;
+        matchSensorPairScan(columns, task, accepted, arena);
+        return;
+    }
+
+    // Outer hits sorted in phi
+    const double *phiData = columns.phi;
+    std::vector<size_t, ArenaAllocator<size_t>> outer(task.outerHits.begin(), task.outerHits.end(), ArenaAllocator<size_t>(&arena));
+    std::sort(outer.begin(), outer.end(), [phiData](size_t a, size_t b)
+              { return phiData[a] < phiData[b] || (phiData[a] == phiData[b] && a < b); });
+    std::vector<double, ArenaAllocator<double>> outerPhi(outer.size(), 0., ArenaAllocator<double>(&arena));
+    for (size_t itOuter = 0; itOuter < outer.size(); itOuter++)
+        outerPhi[itOuter] = phiData[outer[itOuter]];
+
+    const size_t nOuter = outer.size();
+    maxCandidates = maxCandidates > 0 ? std::min(maxCandidates, nOuter) : nOuter;
+
+    for (size_t itHit : task.innerHits)
+    {
+        const size_t firstDoublet = task.doublets.size();
+        double min_dR = 999999.;
+        double dcoord_closest = 0.;
+        double dphi_closest = 0.;
+        size_t closestHit = 0;
+        bool foundClosest = false;
+        double coord = columns.coord[itHit];
+        double phi = phiData[itHit];
+
+        // walk outwards from phi in both directions, around the circle, nearest first
+        size_t right = std::lower_bound(outerPhi.begin(), outerPhi.end(), phi) - outerPhi.begin();
+        size_t left = right + nOuter - 1;
+        for (size_t nCandidates = 0; nCandidates < maxCandidates; nCandidates++)
+        {
+            double dphiLeft = fabs(TVector2::Phi_mpi_pi(phi - outerPhi[left % nOuter]));
+            double dphiRight = fabs(TVector2::Phi_mpi_pi(phi - outerPhi[right % nOuter]));
+            size_t jitHit = 0;
+            if (dphiRight <= dphiLeft)
+            {
+                if (dphiRight > window)
+                    break;
+                jitHit = outer[right % nOuter];
+                right++;
+            }
+            else
+            {
+                if (dphiLeft > window)
+                    break;
+                jitHit = outer[left % nOuter];
+                left--;
+            }
+
+            double dcoord = columns.coord[jitHit] - coord;
+            double dphi = TVector2::Phi_mpi_pi(phi - phiData[jitHit]);
+            double dR = sqrt(dphi * dphi + dcoord * dcoord);
+            // ties go to the earlier hit, as in the scan in collection order
+            if (dR < min_dR || (dR == min_dR && jitHit < closestHit))
+            {
+                min_dR = dR;
+                dcoord_closest = dcoord;
+                dphi_closest = dphi;
+                closestHit = jitHit;
+                foundClosest = true;
+            }
+            if (fabs(dcoord) > dcoord_cut)
+                continue;
+            if (fabs(dphi) > dphi_cut)
+                continue;
+            if (doPointing && !pointsToBeamline(columns, itHit, jitHit))
+                continue;
+
+            // accepted hit in outer layer of pair
+            accepted[jitHit] = 1;
+            if (doDoublets)
+                task.doublets.push_back({itHit, jitHit, static_cast<float>(dR)});
+        }
+
+        // accepted hit in inner layer of pair
+        if (foundClosest && fabs(dcoord_closest) < dcoord_cut && fabs(dphi_closest) < dphi_cut &&
+            (!doPointing || pointsToBeamline(columns, itHit, closestHit)))
+            accepted[itHit] = 1;
+        // doublets are kept for accepted inner hits only, so that both ends are in the output
+        else if (doDoublets)
+            task.doublets.erase(task.doublets.begin() + firstDoublet, task.doublets.end());
+    }
+}
+
+bool DoubletMatcher::pointsToBeamline(const Columns &columns, size_t innerHit, size_t outerHit) const
+{
+    const double inner[3] = {columns.x[innerHit], columns.y[innerHit], columns.z[innerHit]};
+    const double outer[3] = {columns.x[outerHit], columns.y[outerHit], columns.z[outerHit]};
+    return pointsToBeamline(inner, outer);
+}
+
+bool DoubletMatcher::pointsToBeamline(const double *inner, const double *outer) const
+{
+    // longitudinal: extrapolate the segment in the r-z plane down to r = 0
+    if (m_settings.maxZ0 > 0.)
+    {
+        double r1 = sqrt(inner[0] * inner[0] + inner[1] * inner[1]);
+        double r2 = sqrt(outer[0] * outer[0] + outer[1] * outer[1]);
+        double dr = r2 - r1;
+        // a segment parallel to the beamline never reaches it
+        if (dr == 0.)
+            return false;
+        double z0 = inner[2] - r1 * (outer[2] - inner[2]) / dr;
+        if (fabs(z0 - m_settings.beamSpotZ) > m_settings.maxZ0)
+            return false;
+    }
+
+    // transverse: distance of closest approach of the segment line to the beamline
+    if (m_settings.maxD0 > 0.)
+    {
+        double dx = outer[0] - inner[0];
+        double dy = outer[1] - inner[1];
+        double length = sqrt(dx * dx + dy * dy);
+        if (length == 0.)
+            return false;
+        double d0 = fabs(inner[0] * outer[1] - outer[0] * inner[1]) / length;
+        if (d0 > m_settings.maxD0)
+            return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,53 @@
+#include "EventArena.h"
+
+#include <algorithm>
+
+void *EventArena::allocate(size_t bytes, size_t alignment)
+{
+    m_nAllocations++;
+
+    for (;;)
+    {
+        // first block, in order, with room left
+        for (; m_block < m_blocks.size(); m_block++, m_offset = 0)
+        {
+            Block &block = m_blocks[m_block];
+            uintptr_t base = reinterpret_cast<uintptr_t>(block.data.get());
+            size_t aligned = ((base + m_offset + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1)) - base;
+            if (aligned + bytes <= block.size)
+            {
+                m_offset = aligned + bytes;
+                return block.data.get() + aligned;
+            }
+            m_used += m_offset;
+        }
+
+        // only while warming up, or for an event larger than all before
+        size_t size = std::max(m_blockSize, bytes + alignment);
+        m_blocks.push_back({std::unique_ptr<char[]>(new char[size]), size});
+        m_block = m_blocks.size() - 1;
+        m_offset = 0;
+    }
+}
+
+void EventArena::reset()
+{
+    m_highWater = std::max(m_highWater, m_used + m_offset);
+    m_block = 0;
+    m_offset = 0;
+    m_used = 0;
+}
+
+size_t EventArena::capacity() const
+{
+    size_t bytes = 0;
+    for (const Block &block : m_blocks)
+        bytes += block.size;
+    return bytes;
+}
+
+void EventArena::print(std::ostream &out, const std::string &processorName) const
+{
+    out << processorName << " event arena: " << nBlocks() << " blocks, " << capacity() / 1024 << " kB, largest event "
+        << std::max(m_highWater, m_used + m_offset) / 1024 << " kB, " << m_nAllocations << " allocations" << std::endl;
+}
@@ -0,0 +1,190 @@
+#include "FeatureExport.h"
+
+#include <cstring>
+
+#ifdef MYBIBUTILS_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+#include <EVENT/Exceptions.h>
+
+#include "marlin/VerbosityLevels.h"
+
+namespace
+{
+    // chunks queued before the filling threads wait
+    const size_t kMaxQueuedBlocks = 16;
+
+    // stdio buffer of the output file
+    const size_t kFileBufferSize = 8 << 20;
+
+    template <class T>
+    void append(std::vector<char> &out, const T &value)
+    {
+        const char *data = reinterpret_cast<const char *>(&value);
+        out.insert(out.end(), data, data + sizeof(T));
+    }
+
+    struct SchemaPayload : BlockWriter::Block
+    {
+        uint16_t table;
+        std::string text;
+
+        uint32_t type() const override { return FeatureExport::SchemaBlock; }
+        void encode(std::vector<char> &out) override
+        {
+            append(out, table);
+            out.insert(out.end(), text.begin(), text.end());
+        }
+    };
+
+    struct ChunkPayload : BlockWriter::Block
+    {
+        uint16_t table;
+        uint32_t nRows;
+        std::vector<FeatureExport::ColumnType> types;
+        std::vector<std::vector<uint8_t>> columns;
+
+        uint32_t type() const override { return FeatureExport::ChunkBlock; }
+        void encode(std::vector<char> &out) override;
+    };
+
+    void ChunkPayload::encode(std::vector<char> &out)
+    {
+        append(out, table);
+        append(out, static_cast<uint16_t>(columns.size()));
+        append(out, nRows);
+
+#ifdef MYBIBUTILS_WITH_ZLIB
+        std::vector<uint8_t> shuffled;
+        for (size_t itColumn = 0; itColumn < columns.size(); itColumn++)
+        {
+            const std::vector<uint8_t> &raw = columns[itColumn];
+            size_t elementSize = FeatureExport::typeSize(types[itColumn]);
+
+            // bytes of equal significance next to each other compress much better
+            const uint8_t *input = raw.data();
+            if (elementSize > 1)
+            {
+                shuffled.resize(raw.size());
+                for (size_t itRow = 0; itRow < nRows; itRow++)
+                    for (size_t itByte = 0; itByte < elementSize; itByte++)
+                        shuffled[itByte * nRows + itRow] = raw[itRow * elementSize + itByte];
+                input = shuffled.data();
+            }
+
+            // sizes first, the compressed size is patched in once known
+            size_t sizesOffset = out.size();
+            append(out, static_cast<uint32_t>(0));
+            append(out, static_cast<uint32_t>(raw.size()));
+
+            size_t dataOffset = out.size();
+            uLongf compressedSize = compressBound(raw.size());
+            out.resize(dataOffset + compressedSize);
+            uint32_t compressed = 0;
+            if (compress2(reinterpret_cast<Bytef *>(out.data() + dataOffset), &compressedSize, input, raw.size(), Z_BEST_SPEED) == Z_OK)
+            {
+                out.resize(dataOffset + compressedSize);
+                compressed = static_cast<uint32_t>(compressedSize);
+            }
+            else
+            {
+                // the column is kept, shuffled but uncompressed, and flagged in its size
+                streamlog_out(ERROR) << "FeatureExport: zlib failed on column " << itColumn << " of table " << table
+                                     << ", stored uncompressed" << std::endl;
+                out.resize(dataOffset);
+                out.insert(out.end(), input, input + raw.size());
+                compressed = static_cast<uint32_t>(raw.size()) | FeatureExport::kStoredColumn;
+            }
+            std::memcpy(out.data() + sizesOffset, &compressed, sizeof(compressed));
+        }
+#endif
+    }
+} // namespace
+
+std::shared_ptr<FeatureExport> FeatureExport::open(const std::string &fileName)
+{
+#ifndef MYBIBUTILS_WITH_ZLIB
+    throw EVENT::Exception("FeatureExport: built without zlib, cannot write " + fileName);
+#endif
+    return BlockWriter::shared<FeatureExport>(fileName, [&fileName]()
+                                              { return new FeatureExport(fileName); });
+}
+
+FeatureExport::FeatureExport(const std::string &fileName)
+    : m_writer(fileName, kMagic, kMaxQueuedBlocks, kFileBufferSize, "FeatureExport")
+{
+}
+
+uint16_t FeatureExport::registerTable(const std::string &name, const std::vector<Column> &columns,
+                                     const std::vector<std::string> &decisionNames)
+{
+    std::string text = name + "|";
+    for (size_t itColumn = 0; itColumn < columns.size(); itColumn++)
+        text += (itColumn > 0 ? "," : "") + columns[itColumn].name + ":" + typeName(columns[itColumn].type);
+    text += "|";
+    for (size_t itDecision = 0; itDecision < decisionNames.size(); itDecision++)
+        text += (itDecision > 0 ? "," : "") + decisionNames[itDecision];
+
+    uint16_t table = m_nTables++;
+
+    std::unique_ptr<SchemaPayload> block(new SchemaPayload);
+    block->table = table;
+    block->text = text;
+    m_writer.submit(std::move(block));
+    return table;
+}
+
+void FeatureExport::Table::open(FeatureExport *exporter, const std::string &name, const std::vector<Column> &columns,
+                                const std::vector<std::string> &decisionNames, size_t chunkRows)
+{
+    close();
+    m_export = exporter;
+    m_id = exporter->registerTable(name, columns, decisionNames);
+    m_chunkRows = chunkRows;
+    m_nRows = 0;
+    m_types.clear();
+    for (const Column &column : columns)
+        m_types.push_back(column.type);
+    m_columns.assign(columns.size(), {});
+}
+
+void FeatureExport::Table::close()
+{
+    flush();
+    m_export = nullptr;
+}
+
+size_t FeatureExport::Table::addRows(size_t nRows)
+{
+    size_t firstRow = m_nRows;
+    m_nRows += nRows;
+    for (size_t itColumn = 0; itColumn < m_columns.size(); itColumn++)
+        m_columns[itColumn].resize(m_nRows * typeSize(m_types[itColumn]));
+    return firstRow;
+}
+
+void FeatureExport::Table::endRows()
+{
+    if (m_nRows >= m_chunkRows)
+        flush();
+}
+
+void FeatureExport::Table::flush()
+{
+    if (m_export == nullptr || m_nRows == 0)
+        return;
+
+    std::unique_ptr<ChunkPayload> block(new ChunkPayload);
+    block->table = m_id;
+    block->nRows = static_cast<uint32_t>(m_nRows);
+    block->types = m_types;
+    block->columns.swap(m_columns);
+    m_export->m_writer.submit(std::move(block));
+
+    // the next chunk grows to the same size
+    m_columns.assign(m_types.size(), {});
+    for (size_t itColumn = 0; itColumn < m_columns.size(); itColumn++)
+        m_columns[itColumn].reserve(m_nRows * typeSize(m_types[itColumn]));
+    m_nRows = 0;
+}
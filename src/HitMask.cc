@@ -0,0 +1,69 @@
+#include "HitMask.h"
+
+#include <EVENT/LCIO.h>
+#include <IMPL/LCCollectionVec.h>
+
+HitMask::HitMask(const LCCollection *hitCollection)
+    : m_hitCollection(hitCollection),
+      m_nHits(hitCollection->getNumberOfElements()),
+      m_words((m_nHits + 31) / 32, 0u)
+{
+}
+
+HitMask *HitMask::fromEvent(LCEvent *evt, const std::string &hitCollectionName)
+{
+    try
+    {
+        LCCollection *maskCollection = evt->getCollection(collectionName(hitCollectionName));
+        if (maskCollection->getNumberOfElements() < 1)
+            return nullptr;
+        return dynamic_cast<HitMask *>(maskCollection->getElementAt(0));
+    }
+    catch (DataNotAvailableException &e)
+    {
+        return nullptr;
+    }
+}
+
+HitMask *HitMask::getOrCreate(LCEvent *evt, const std::string &hitCollectionName)
+{
+    HitMask *mask = fromEvent(evt, hitCollectionName);
+    if (mask != nullptr)
+        return mask;
+
+    // throws DataNotAvailableException if the hit collection is missing
+    LCCollection *hitCollection = evt->getCollection(hitCollectionName);
+
+    mask = new HitMask(hitCollection);
+    LCCollectionVec *maskCollection = new LCCollectionVec(LCIO::LCGENERICOBJECT);
+    maskCollection->setTransient(true);
+    maskCollection->addElement(mask);
+    evt->addCollection(maskCollection, collectionName(hitCollectionName));
+
+    return mask;
+}
+
+bool HitMask::setUsedHit(const LCObject *hit)
+{
+    if (m_hitIndex.empty() && m_nHits > 0)
+    {
+        m_hitIndex.reserve(m_nHits);
+        for (size_t itHit = 0; itHit < m_nHits; itHit++)
+            m_hitIndex[m_hitCollection->getElementAt(itHit)] = itHit;
+    }
+
+    auto found = m_hitIndex.find(hit);
+    if (found == m_hitIndex.end())
+        return false;
+
+    setUsed(found->second);
+    return true;
+}
+
+size_t HitMask::countUsed() const
+{
+    size_t nUsed = 0;
+    for (unsigned int word : m_words)
+        nUsed += __builtin_popcount(word);
+    return nUsed;
+}
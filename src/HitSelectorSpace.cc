@@ -1,7 +1,17 @@
 #include "HitSelectorSpace.h"
+#include "SelectionKernel.h"
+#include "LCIOColumns.h"
+#include "AcceptanceMask.h"
+#include "HotLoopLog.h"
+#include "RelationPool.h"
 #include <iostream>
+#include <algorithm>
+#include <limits>
+#include <sstream>
+#include <tuple>
 
 #include <EVENT/LCCollection.h>
+#include <EVENT/Exceptions.h>
 #include <IMPL/TrackerHitPlaneImpl.h>
 
 #include <IMPL/LCCollectionVec.h>
@@ -11,6 +21,7 @@
 #include <UTIL/LCTrackerConf.h>
 
 #include "TMath.h"
+#include "TVector2.h"
 #include "TVector3.h"
 
 // ----- include for verbosity dependend logging ---------
@@ -38,6 +49,160 @@ HitSelectorSpace::HitSelectorSpace() : Processor("HitSelectorSpace")
                                "Good hits from tracker",
                                m_outputHitCollection,
                                std::string("VertexBarrelGoodCollection"));
+
+    // Output doublets
+    registerProcessorParameter("DoubletCollection",
+                               "Relations, weighted by dR, between accepted inner hits and the outer hits passing their cuts, for seeding (empty to disable)",
+                               m_outputDoubletCollection,
+                               std::string(""));
+
+    // Layer pairs, default is the vertex barrel double layers
+    StringVec defaultLayerPairs = {"0", "1", "0.01", "0.001",
+                                   "2", "3", "0.005", "0.001",
+                                   "4", "5", "0.002", "0.001",
+                                   "6", "7", "0.001", "0.001"};
+    registerProcessorParameter("LayerPairs",
+                               "Doublet layer pairs as quadruplets: inner layer, outer layer, max |dtheta| (or |dr| in mm), max |dphi|",
+                               m_layerPairsParam,
+                               defaultLayerPairs);
+
+    // Matching coordinates
+    registerProcessorParameter("DoubletMatching",
+                               "Coordinates used to match doublets: ThetaPhi for barrel layers, RPhi for endcap disks",
+                               m_doubletMatching,
+                               std::string("ThetaPhi"));
+
+    // Beamline pointing
+    registerProcessorParameter("MaxZ0",
+                               "Maximum distance in z from BeamSpotZ of the doublet extrapolated to the beamline, in mm (<= 0 disables the cut)",
+                               m_maxZ0,
+                               double(0.));
+
+    registerProcessorParameter("BeamSpotZ",
+                               "Centre of the luminous region in z used by the MaxZ0 cut, in mm",
+                               m_beamSpotZ,
+                               double(0.));
+
+    registerProcessorParameter("MaxD0",
+                               "Maximum transverse impact parameter of the doublet, in mm (<= 0 disables the cut)",
+                               m_maxD0,
+                               double(0.));
+
+    // Parallelism
+    registerProcessorParameter("NumberOfThreads",
+                               "Number of threads used to match sensor pairs (1 = serial)",
+                               m_nThreads,
+                               int(1));
+
+    // Occupancy guard
+    registerProcessorParameter("GuardMaxHits",
+                               "Above this number of input hits all sensor pairs use the bounded phi-window matching and the event is flagged (<= 0 disables)",
+                               m_guardMaxHits,
+                               int(0));
+
+    registerProcessorParameter("GuardMaxSensorPairHits",
+                               "Above this number of inner x outer hits a sensor pair uses the bounded phi-window matching and the event is flagged (<= 0 disables)",
+                               m_guardMaxPairHits,
+                               int(0));
+
+    registerProcessorParameter("GuardMaxCandidates",
+                               "Outer hits, closest in phi first, examined per inner hit by the bounded matching (<= 0 for no limit)",
+                               m_guardMaxCandidates,
+                               int(32));
+
+    // Hot sensor masking
+    registerProcessorParameter("MaskedSensors",
+                               "Sensors masked in every event as quadruplets: layer, side, ladder (module field), module (sensor field)",
+                               m_maskedSensorsParam,
+                               StringVec());
+
+    registerProcessorParameter("HotSensorMaxHits",
+                               "Hits of a sensor in one event above which the sensor is hot (<= 0 disables)",
+                               m_hotMaxHits,
+                               int(0));
+
+    registerProcessorParameter("HotSensorMaxAverageHits",
+                               "Running average of the hits of a sensor above which the sensor is hot (<= 0 disables)",
+                               m_hotMaxAverageHits,
+                               double(0.));
+
+    registerProcessorParameter("HotSensorAverageEvents",
+                               "Number of events over which the running average of the sensor hits is taken",
+                               m_hotAverageEvents,
+                               int(100));
+
+    registerProcessorParameter("HotSensorMode",
+                               "Mask (reject the sensor pairs of hot sensors) or Bounded (match them in the bounded phi window)",
+                               m_hotSensorMode,
+                               std::string("Mask"));
+
+    // Matching strategy
+    registerProcessorParameter("MatchingStrategy",
+                               "Auto (per sensor pair, from its number of hits), BruteForce (scan of all outer hits) or Window (phi-sorted outer hits)",
+                               m_strategyName,
+                               std::string("Auto"));
+
+    registerProcessorParameter("StrategyCrossoverPairHits",
+                               "Inner x outer hits of a sensor pair from which Auto uses the phi window (<= 0 measures it in init with a short, machine dependent benchmark)",
+                               m_crossoverPairHits,
+                               int(512));
+
+    registerProcessorParameter("SimdLevel",
+                               "Instruction set of the brute-force scan: auto (best supported), scalar, avx2 or avx512",
+                               m_simdLevelName,
+                               std::string("auto"));
+
+    // Subset collections or run-length masks
+    registerProcessorParameter("OutputMode",
+                               "Subset (subset collections) or Mask (run-length encoded masks in <output>_Mask)",
+                               m_outputMode,
+                               std::string("Subset"));
+
+    // Output ordering
+    registerProcessorParameter("OutputOrder",
+                               "Input (keep the input order) or Spatial (accepted hits grouped by sensor); Subset output mode only",
+                               m_outputOrder,
+                               std::string("Input"));
+
+    // Memory instrumentation
+    registerProcessorParameter("MonitorMemory",
+                               "Record heap, RSS and allocations per event and stage, reported at the end",
+                               m_monitorMemory,
+                               bool(false));
+
+    registerProcessorParameter("MemoryMonitorWorstEvents",
+                               "Number of events with the largest memory growth reported at the end",
+                               m_memoryWorstEvents,
+                               int(5));
+
+    // Hardware counter profiling
+    registerProcessorParameter("ProfileStages",
+                               "Report wall time, IPC and cache and branch misses per hit of each stage at the end",
+                               m_profileStages,
+                               bool(false));
+
+    // Binary decision trace
+    registerProcessorParameter("DecisionTraceFile",
+                               "File receiving the decision and cut values of every hit (empty disables)",
+                               m_traceFile,
+                               std::string(""));
+
+    // Columnar feature export
+    registerProcessorParameter("FeatureExportFile",
+                               "File receiving the matching coordinates, doublet dR and decision of every hit as compressed columns (empty disables)",
+                               m_exportFile,
+                               std::string(""));
+
+    // Differential validation
+    registerProcessorParameter("ValidationFraction",
+                               "Fraction of the events also selected with the serial reference loop and compared (0 disables)",
+                               m_validationFraction,
+                               double(0.));
+
+    registerProcessorParameter("ValidationMaxReports",
+                               "Number of differing hits and doublets reported in detail over the job",
+                               m_validationMaxReports,
+                               int(20));
 }
 
 void HitSelectorSpace::init()
@@ -50,10 +215,103 @@ void HitSelectorSpace::init()
 
     _nRun = 0;
     _nEvt = 0;
+
+    m_outputMask = AcceptanceMask::parseOutputMode(m_outputMode, name());
+    m_memory.configure(m_monitorMemory, std::max(m_memoryWorstEvents, 0));
+    m_validator.configure(m_validationFraction, std::max(m_validationMaxReports, 0));
+
+    if (m_profileStages && !m_profiler.configure(true))
+        streamlog_out(WARNING) << "Hardware counters unavailable, profiling wall time only" << std::endl;
+
+    if (m_outputOrder != "Input" && m_outputOrder != "Spatial")
+        throw EVENT::Exception("HitSelectorSpace: unknown OutputOrder " + m_outputOrder + ", use Input or Spatial");
+    m_spatialOrder = (m_outputOrder == "Spatial");
+
+    DoubletMatcher::Settings settings;
+    if (m_doubletMatching == "ThetaPhi")
+    {
+        settings.matchInR = false;
+    }
+    else if (m_doubletMatching == "RPhi")
+    {
+        settings.matchInR = true;
+    }
+    else
+    {
+        throw EVENT::Exception("HitSelectorSpace: unknown DoubletMatching " + m_doubletMatching + ", use ThetaPhi or RPhi");
+    }
+    settings.maxZ0 = m_maxZ0;
+    settings.beamSpotZ = m_beamSpotZ;
+    settings.maxD0 = m_maxD0;
+    settings.nThreads = m_nThreads;
+    settings.guardMaxHits = m_guardMaxHits;
+    settings.guardMaxPairHits = m_guardMaxPairHits;
+    settings.guardMaxCandidates = m_guardMaxCandidates;
+    if (m_strategyName == "Auto")
+        settings.strategy = DoubletMatcher::Strategy::Auto;
+    else if (m_strategyName == "BruteForce")
+        settings.strategy = DoubletMatcher::Strategy::BruteForce;
+    else if (m_strategyName == "Window")
+        settings.strategy = DoubletMatcher::Strategy::Window;
+    else
+        throw EVENT::Exception("HitSelectorSpace: unknown MatchingStrategy " + m_strategyName + ", use Auto, BruteForce or Window");
+    settings.windowMinPairHits = std::max(m_crossoverPairHits, 0);
+    settings.simdLevel = SelectionKernel::resolveSimdLevel(m_simdLevelName, "HitSelectorSpace");
+    // the export needs the doublets for their dR
+    settings.storeDoublets = !m_outputDoubletCollection.empty() || !m_exportFile.empty();
+
+    if (m_hotSensorMode != "Mask" && m_hotSensorMode != "Bounded")
+        throw EVENT::Exception("HitSelectorSpace: unknown HotSensorMode " + m_hotSensorMode + ", use Mask or Bounded");
+    SensorOccupancy::Settings occupancySettings;
+    occupancySettings.maxEventHits = m_hotMaxHits;
+    occupancySettings.maxAverageHits = m_hotMaxAverageHits;
+    occupancySettings.averageEvents = m_hotAverageEvents;
+    occupancySettings.maskHot = (m_hotSensorMode == "Mask");
+    m_occupancy.configure(occupancySettings, m_maskedSensorsParam, "HitSelectorSpace");
+
+    // Unpack the layer pair table, timing the two matching strategies if requested
+    m_matcher.configure(settings, m_layerPairsParam, "HitSelectorSpace");
+    streamlog_out(MESSAGE) << "Matching strategy " << m_strategyName << ", " << SelectionKernel::simdLevelName(settings.simdLevel)
+                           << " scan kernel" << std::endl;
+    for (const auto &layerPair : m_matcher.layerPairs())
+    {
+        streamlog_out(MESSAGE) << "Layer pair " << layerPair.second.innerLayer << " -> " << layerPair.second.outerLayer
+                               << " cuts " << layerPair.second.dcoord_cut << " " << layerPair.second.dphi_cut << std::endl;
+        if (settings.strategy != DoubletMatcher::Strategy::Auto)
+            continue;
+        if (layerPair.second.windowMinPairHits == std::numeric_limits<size_t>::max())
+            streamlog_out(MESSAGE) << "  always scanned" << std::endl;
+        else
+            streamlog_out(MESSAGE) << "  phi window from " << layerPair.second.windowMinPairHits << " inner x outer hits"
+                                   << (m_crossoverPairHits > 0 ? "" : " (calibrated)") << std::endl;
+    }
+
+    if (!m_traceFile.empty())
+    {
+        m_trace = DecisionTrace::open(m_traceFile);
+        m_traceStream = m_trace->registerStream(name() + ":" + m_inputHitCollection, {settings.matchInR ? "r" : "theta", "phi", "layer"},
+                                                {"accepted", "no_sensor_pair", "no_match", "no_match_guarded", "masked_sensor"});
+        m_traceBuffer.setTrace(m_trace.get());
+    }
+
+    if (!m_exportFile.empty())
+    {
+        m_export = FeatureExport::open(m_exportFile);
+        m_exportTable.open(m_export.get(), name() + ":" + m_inputHitCollection,
+                           {{"run", FeatureExport::UInt32}, {"event", FeatureExport::UInt32}, {"hit", FeatureExport::UInt32},
+                            {settings.matchInR ? "r" : "theta", FeatureExport::Float32}, {"phi", FeatureExport::Float32},
+                            {"layer", FeatureExport::UInt32}, {"dR", FeatureExport::Float32}, {"decision", FeatureExport::UInt8}},
+                           {"accepted", "no_sensor_pair", "no_match", "no_match_guarded", "masked_sensor"});
+    }
 }
 
 void HitSelectorSpace::processRunHeader(LCRunHeader *run)
 {
+    // hot sensors of the previous run
+    std::ostringstream report;
+    m_occupancy.report(report, name());
+    if (!report.str().empty())
+        streamlog_out(MESSAGE) << report.str();
 
     _nRun++;
 }
@@ -63,161 +321,355 @@ void HitSelectorSpace::processEvent(LCEvent *evt)
 
     streamlog_out(DEBUG8) << "Processing event " << _nEvt << std::endl;
 
+    // the sample is closed when leaving processEvent, also through an exception
+    MemoryMonitor::Event memoryEvent(m_memory, evt->getRunNumber(), evt->getEventNumber());
+    m_memory.beginStage("index");
+
     // Get the collection of tracker hits
     LCCollection *trackerHitCollection = 0;
     getCollection(trackerHitCollection, m_inputHitCollection, evt);
 
     std::string encoderString = trackerHitCollection->getParameters().getStringVal("CellIDEncoding");
-    UTIL::CellIDDecoder<TrackerHitPlane> myCellIDEncoding(encoderString);
-
-    // Make the output collections
-    LCCollectionVec *GoodHitsCollection = new LCCollectionVec(trackerHitCollection->getTypeName());
-    GoodHitsCollection->setSubset(true);
-    GoodHitsCollection->parameters().setValue("CellIDEncoding", encoderString);
 
     int nHits = trackerHitCollection->getNumberOfElements();
-    // Set the map of responses 
-    memset(&m_accepted, false, nHits);
 
-    // First sort hits in a map
-    m_hitsMap.clear();
-    for (int itHit = 0; itHit < nHits; itHit++)
+    // the validator times the same steps as the reference, indexing and matching
+    bool validate = m_validator.sampleEvent(evt->getRunNumber(), evt->getEventNumber());
+    if (validate)
+        m_validator.beginFast();
+
+    // Use the shared hit index if an indexer ran before, otherwise index the hits here
+    m_profiler.beginStage("decode", nHits);
+    const TrackerHitIndex *hitIndex = TrackerHitIndex::fromEventOrBuild(evt, m_inputHitCollection, trackerHitCollection, m_localIndex);
+
+    // Sensor pairs only write the decisions of their own hits and are matched concurrently
+    m_memory.beginStage("matching");
+    m_profiler.beginStage("match", nHits);
+    if (m_occupancy.enabled())
+        m_occupancy.update(*hitIndex, evt->getRunNumber(), m_scratch.sensorStates);
+    m_matcher.match(*hitIndex, m_scratch, m_acceptedHits);
+    m_profiler.setStageThreads(m_scratch.nThreads);
+    const std::vector<DoubletMatcher::SensorPairTask> &tasks = m_scratch.tasks;
+    size_t nGuardedPairs = m_scratch.nGuardedPairs;
+
+    // the reference has no bounded phi window, events where the guard or a hot sensor bounded a pair are not compared
+    if (validate && (nGuardedPairs > 0 || m_scratch.nHotPairs > 0))
     {
-        // Get the hit
-        TrackerHitPlane *hit = static_cast<TrackerHitPlane *>(trackerHitCollection->getElementAt(itHit));
-        
-        unsigned int layer= myCellIDEncoding(hit)["layer"];
-        unsigned int side= myCellIDEncoding(hit)["side"];
-        unsigned int ladder= myCellIDEncoding(hit)["module"];
-        unsigned int module= myCellIDEncoding(hit)["sensor"];
-
-        MySensorPos sensPos = {layer, side, ladder, module};
-        if (m_hitsMap.find(sensPos) == m_hitsMap.end())
+        streamlog_out(DEBUG5) << "Bounded phi window in this event, skipping the validation" << std::endl;
+        m_validator.skipEvent();
+        validate = false;
+    }
+    else if (validate)
+    {
+        m_validator.endFast();
+    }
+
+    m_nMaskedPairs += m_scratch.maskedPairs.size();
+    m_nHotPairs += m_scratch.nHotPairs;
+    m_nScanPairs += m_scratch.nScanPairs;
+    m_nWindowPairs += m_scratch.nWindowPairs;
+    m_nBoundedPairs += tasks.size() - m_scratch.nScanPairs - m_scratch.nWindowPairs;
+    if (!m_scratch.maskedPairs.empty() || m_scratch.nHotPairs > 0)
+        streamlog_out(DEBUG5) << "Hot sensors: " << m_scratch.maskedPairs.size() << " sensor pairs masked, " << m_scratch.nHotPairs
+                              << " matched in a bounded phi window" << std::endl;
+    if (nGuardedPairs > 0)
+    {
+        m_nGuardedEvents++;
+        streamlog_out(DEBUG5) << "Occupancy guard: " << nHits << " hits, " << nGuardedPairs << " of " << tasks.size()
+                              << " sensor pairs matched in a bounded phi window" << std::endl;
+    }
+
+    streamlog_out(DEBUG0) << "Matched " << tasks.size() << " sensor pairs with " << m_scratch.nThreads << " threads, "
+                          << m_scratch.nScanPairs << " scanned, " << m_scratch.nWindowPairs << " in the phi window" << std::endl;
+
+    m_memory.beginStage("collect");
+    m_profiler.beginStage("fill", nHits);
+    if (m_traceBuffer.active() || m_exportTable.active())
+        fillDecisions(hitIndex, tasks);
+    if (m_traceBuffer.active())
+        traceDecisions(evt, hitIndex);
+    if (m_exportTable.active())
+        exportFeatures(evt, hitIndex, tasks);
+
+    // Group the accepted hits by sensor
+    if (m_spatialOrder && !m_outputMask)
+    {
+        m_sortKeys.resize(m_acceptedHits.size());
+        for (size_t itAccepted = 0; itAccepted < m_acceptedHits.size(); itAccepted++)
+            m_sortKeys[itAccepted] = hitIndex->sensorNumber[m_acceptedHits[itAccepted]];
+        m_sorter.sort(m_sortKeys, m_acceptedHits);
+    }
+
+    // Store the filtered hit collections
+    m_memory.beginStage("output");
+    LCCollectionVec *GoodHitsCollection = 0;
+    if (m_outputMask)
+    {
+        GoodHitsCollection = AcceptanceMask::storeSelection(evt, m_outputHitCollection, m_inputHitCollection, m_acceptedHits, nHits);
+    }
+    else
+    {
+        GoodHitsCollection = LCIOColumns::newSubsetCollection(trackerHitCollection, encoderString);
+        LCIOColumns::fillSubset(GoodHitsCollection, trackerHitCollection, m_acceptedHits);
+        evt->addCollection(GoodHitsCollection, m_outputHitCollection);
+    }
+    GoodHitsCollection->parameters().setValue("OccupancyGuard", int(nGuardedPairs > 0));
+    GoodHitsCollection->parameters().setValue("MaskedSensorPairs", int(m_scratch.maskedPairs.size()));
+
+    // Store the doublets, ordered by inner and outer hit index independently of the threading
+    if (!m_outputDoubletCollection.empty())
+    {
+        m_doublets.clear();
+        for (const DoubletMatcher::SensorPairTask &task : tasks)
+            m_doublets.insert(m_doublets.end(), task.doublets.begin(), task.doublets.end());
+        std::sort(m_doublets.begin(), m_doublets.end());
+
+        // weighted by the doublet dR
+        LCCollectionVec *DoubletCollection = RelationPool::newCollection(trackerHitCollection->getTypeName(), trackerHitCollection->getTypeName(),
+                                                                         m_doublets.size(), true);
+        for (const DoubletMatcher::Doublet &doublet : m_doublets)
         {
-            m_hitsMap[sensPos] = std::vector<size_t>();
-            m_hitsMap[sensPos].reserve(nHits);
+            DoubletCollection->addElement(new PooledRelation(trackerHitCollection->getElementAt(doublet.innerHit),
+                                                             trackerHitCollection->getElementAt(doublet.outerHit),
+                                                             doublet.dR));
         }
-        m_hitsMap[sensPos].push_back(itHit);
 
+        streamlog_out(DEBUG) << "  Doublets: " << DoubletCollection->getNumberOfElements() << std::endl;
+        evt->addCollection(DoubletCollection, m_outputDoubletCollection);
     }
 
-    // Loop over tracker hits
-    for (int itHit = 0; itHit < nHits; itHit++)
+    if (validate)
+        validateEvent(trackerHitCollection, hitIndex, tasks);
+
+    // Per-event scratch: sensor pair tasks with their doublets, decisions, accepted hits and sort keys
+    if (m_memory.enabled())
     {
+        size_t scratchBytes = (tasks.capacity() + m_scratch.maskedPairs.capacity()) * sizeof(DoubletMatcher::SensorPairTask) +
+                              m_scratch.sensorStates.capacity() + m_scratch.accepted.capacity() + m_scratch.arenaCapacity() +
+                              m_acceptedHits.capacity() * sizeof(size_t) + m_sortKeys.capacity() * sizeof(uint64_t) +
+                              m_doublets.capacity() * sizeof(DoubletMatcher::Doublet);
+        m_memory.recordScratch(scratchBytes);
+    }
+    m_profiler.endStage();
 
-        // Skip accepted hits
-        if (m_accepted[itHit]){
-            streamlog_out(DEBUG0) << "Skipping already accepted hit" << std::endl;
-            continue;
+    //-- note: this will not be printed if compiled w/o MARLINDEBUG=1 !
+    streamlog_out(DEBUG) << "   done processing event: " << evt->getEventNumber()
+                         << "   in run:  " << evt->getRunNumber() << std::endl;
+    
+    _nEvt++;
+}
+
+void HitSelectorSpace::fillDecisions(const TrackerHitIndex *hitIndex, const std::vector<DoubletMatcher::SensorPairTask> &tasks)
+{
+    // rejected hits: not in any sensor pair, no match in their pairs (bounded matching if any pair was guarded), or in a masked pair
+    m_decisions.assign(hitIndex->size(), TraceNoSensorPair);
+    for (const DoubletMatcher::SensorPairTask &task : tasks)
+    {
+        uint8_t decision = task.guarded ? TraceNoMatchGuarded : TraceNoMatch;
+        for (size_t itHit : task.innerHits)
+            m_decisions[itHit] = std::max(m_decisions[itHit], decision);
+        for (size_t itHit : task.outerHits)
+            m_decisions[itHit] = std::max(m_decisions[itHit], decision);
+    }
+    for (const DoubletMatcher::SensorPairTask &pair : m_scratch.maskedPairs)
+    {
+        for (size_t itHit : pair.innerHits)
+            m_decisions[itHit] = TraceMaskedSensor;
+        for (size_t itHit : pair.outerHits)
+            m_decisions[itHit] = TraceMaskedSensor;
+    }
+
+    for (size_t itHit = 0; itHit < hitIndex->size(); itHit++)
+        if (m_scratch.accepted[itHit])
+            m_decisions[itHit] = TraceAccepted;
+}
+
+void HitSelectorSpace::traceDecisions(const LCEvent *evt, const TrackerHitIndex *hitIndex)
+{
+    const double *coordData = m_matcher.coordinates(*hitIndex);
+    m_traceBuffer.setEvent(evt->getRunNumber(), evt->getEventNumber());
+    for (size_t itHit = 0; itHit < hitIndex->size(); itHit++)
+        m_traceBuffer.add(m_traceStream, itHit, m_decisions[itHit], coordData[itHit], hitIndex->phi[itHit], hitIndex->layer[itHit]);
+}
+
+void HitSelectorSpace::exportFeatures(const LCEvent *evt, const TrackerHitIndex *hitIndex,
+                                      const std::vector<DoubletMatcher::SensorPairTask> &tasks)
+{
+    const double *coordData = m_matcher.coordinates(*hitIndex);
+    size_t nHits = hitIndex->size();
+    size_t first = m_exportTable.addRows(nHits);
+
+    // columns in the order of the schema registered in init()
+    uint32_t *run = m_exportTable.column<uint32_t>(0, first);
+    uint32_t *event = m_exportTable.column<uint32_t>(1, first);
+    uint32_t *hit = m_exportTable.column<uint32_t>(2, first);
+    float *coord = m_exportTable.column<float>(3, first);
+    float *phi = m_exportTable.column<float>(4, first);
+    uint32_t *layer = m_exportTable.column<uint32_t>(5, first);
+    float *dR = m_exportTable.column<float>(6, first);
+    uint8_t *decision = m_exportTable.column<uint8_t>(7, first);
+
+    for (size_t itHit = 0; itHit < nHits; itHit++)
+    {
+        run[itHit] = evt->getRunNumber();
+        event[itHit] = evt->getEventNumber();
+        hit[itHit] = itHit;
+        coord[itHit] = coordData[itHit];
+        phi[itHit] = hitIndex->phi[itHit];
+        layer[itHit] = hitIndex->layer[itHit];
+        dR[itHit] = std::numeric_limits<float>::quiet_NaN();
+        decision[itHit] = m_decisions[itHit];
+    }
+
+    // smallest dR of the doublets of each hit, at either end
+    for (const DoubletMatcher::SensorPairTask &task : tasks)
+    {
+        for (const DoubletMatcher::Doublet &doublet : task.doublets)
+        {
+            if (!(dR[doublet.innerHit] <= doublet.dR))
+                dR[doublet.innerHit] = doublet.dR;
+            if (!(dR[doublet.outerHit] <= doublet.dR))
+                dR[doublet.outerHit] = doublet.dR;
         }
+    }
+    m_exportTable.endRows();
+}
+
+void HitSelectorSpace::referenceSelection(LCCollection *trackerHitCollection, const std::set<TrackerHitIndex::SensorKey> &maskedSensors,
+                                          std::vector<size_t> &accepted, std::vector<DifferentialValidator::RelationPair> &doublets)
+{
+    std::string encoderString = trackerHitCollection->getParameters().getStringVal("CellIDEncoding");
+    UTIL::CellIDDecoder<TrackerHitPlane> myCellIDEncoding(encoderString);
+
+    int nHits = trackerHitCollection->getNumberOfElements();
+    std::vector<bool> isAccepted(nHits, false);
+    doublets.clear();
+    const bool matchInR = m_matcher.settings().matchInR;
+    const bool doPointing = m_maxZ0 > 0. || m_maxD0 > 0.;
+    const bool doDoublets = m_matcher.settings().storeDoublets;
 
-        // Get the hit
+    // First sort hits in a map
+    std::map<std::tuple<unsigned int, unsigned int, unsigned int, unsigned int>, std::vector<size_t>> hitsMap;
+    for (int itHit = 0; itHit < nHits; itHit++)
+    {
         TrackerHitPlane *hit = static_cast<TrackerHitPlane *>(trackerHitCollection->getElementAt(itHit));
         unsigned int layer = myCellIDEncoding(hit)["layer"];
         unsigned int side = myCellIDEncoding(hit)["side"];
         unsigned int ladder = myCellIDEncoding(hit)["module"];
         unsigned int module = myCellIDEncoding(hit)["sensor"];
+        hitsMap[std::make_tuple(layer, side, ladder, module)].push_back(itHit);
+    }
 
-        streamlog_out(DEBUG0) << "Hit position " << layer << " " << ladder << " " << module << std::endl;
+    // Loop over tracker hits
+    for (int itHit = 0; itHit < nHits; itHit++)
+    {
+        TrackerHitPlane *hit = static_cast<TrackerHitPlane *>(trackerHitCollection->getElementAt(itHit));
+        unsigned int layer = myCellIDEncoding(hit)["layer"];
+        unsigned int side = myCellIDEncoding(hit)["side"];
+        unsigned int ladder = myCellIDEncoding(hit)["module"];
+        unsigned int module = myCellIDEncoding(hit)["sensor"];
 
         // We go inside out and skip the outer layers
-        if(layer==1 || layer==3 || layer==5 ||layer==7){
-            streamlog_out(DEBUG0) << "Skipping hit in outer layer of pair" << std::endl;
+        auto layerPair = m_matcher.layerPairs().find(layer);
+        if (layerPair == m_matcher.layerPairs().end())
+            continue;
+
+        auto theOther = hitsMap.find(std::make_tuple(layerPair->second.outerLayer, side, ladder, module));
+        if (theOther == hitsMap.end())
+            continue;
+
+        // sensor pairs with a masked sensor are rejected
+        if (maskedSensors.count({layer, side, ladder, module}) > 0 ||
+            maskedSensors.count({layerPair->second.outerLayer, side, ladder, module}) > 0)
             continue;
-        }
 
         // get the hit position
         TVector3 pos(hit->getPosition()[0], hit->getPosition()[1], hit->getPosition()[2]);
+        double coord = matchInR ? pos.Perp() : pos.Theta();
+        double dcoord_cut = layerPair->second.dcoord_cut;
+        double dphi_cut = layerPair->second.dphi_cut;
         double min_dR = 999999.;
-        double dtheta_closest = 0.;
+        double dcoord_closest = 0.;
         double dphi_closest = 0.;
-        double theta = pos.Theta();
-        double dtheta_cut = 0.01;
-        double dphi_cut = 0.001;
+        const double *closestPosition = nullptr;
+        bool foundClosest = false;
+        const size_t firstDoublet = doublets.size();
 
-        unsigned int the_other_layer = 1;
-        if (layer == 2)
-        {
-            the_other_layer = 3;
-            dtheta_cut = 0.005;
-            dphi_cut = 0.001;
-        }
-        if (layer == 4)
-        {
-            the_other_layer = 5;
-            dtheta_cut = 0.002;
-            dphi_cut = 0.001;
-        }
-        if (layer == 6)
-        {
-            the_other_layer = 7;
-            dtheta_cut = 0.001;
-            dphi_cut = 0.001;
-        }
-
-        const MySensorPos theOtherPos = {the_other_layer, side, ladder, module};
-
-        // Checking if there are any hits in the other layer
-        if (m_hitsMap.find(theOtherPos) == m_hitsMap.end())
-        {
-            streamlog_out(DEBUG0) << "No hits in outer layer of pair" << std::endl;
-            continue;
-        }
-
-        for (size_t jitHit : m_hitsMap.at(theOtherPos))
+        for (size_t jitHit : theOther->second)
         {
             TrackerHitPlane *hit2 = static_cast<TrackerHitPlane *>(trackerHitCollection->getElementAt(jitHit));
             TVector3 pos2(hit2->getPosition()[0], hit2->getPosition()[1], hit2->getPosition()[2]);
-            double dtheta = pos2.Theta() - theta;
+            double dcoord = (matchInR ? pos2.Perp() : pos2.Theta()) - coord;
             double dphi = pos.DeltaPhi(pos2);
-            double dR = sqrt(dphi * dphi + dtheta * dtheta);
+            double dR = sqrt(dphi * dphi + dcoord * dcoord);
             if (dR < min_dR)
             {
                 min_dR = dR;
-                dtheta_closest = dtheta;
+                dcoord_closest = dcoord;
                 dphi_closest = dphi;
+                closestPosition = hit2->getPosition();
+                foundClosest = true;
             }
-            if (fabs(dtheta) > dtheta_cut){
-                streamlog_out(DEBUG0) << " -> fail dtheta " << fabs(dtheta) << std::endl;
+            if (fabs(dcoord) > dcoord_cut)
                 continue;
-            }
-            if (fabs(dphi) > dphi_cut){
-                streamlog_out(DEBUG0) << " -> fail dphi " << fabs(dphi) << std::endl;
+            if (fabs(dphi) > dphi_cut)
+                continue;
+            if (doPointing && !m_matcher.pointsToBeamline(hit->getPosition(), hit2->getPosition()))
                 continue;
-            }
-            unsigned int layer2 = myCellIDEncoding(hit2)["layer"];
-
-            streamlog_out(DEBUG0) << " --> accepted hit in outer layer (" << layer2 << ") of pair with " << dtheta << " " << dphi << std::endl;
-            m_accepted[jitHit] = true;
-        }
 
-        if (fabs(dtheta_closest) < dtheta_cut && fabs(dphi_closest) < dphi_cut)
-        {
-            streamlog_out(DEBUG0) << " --> accepted hit in inner layer of pair with " << fabs(dtheta_closest) << std::endl;
-            m_accepted[itHit] = true;
+            isAccepted[jitHit] = true;
+            if (doDoublets)
+                doublets.push_back({static_cast<size_t>(itHit), jitHit});
         }
 
+        // never accepted without an outer hit, with or without pointing
+        if (foundClosest && fabs(dcoord_closest) < dcoord_cut && fabs(dphi_closest) < dphi_cut &&
+            (!doPointing || m_matcher.pointsToBeamline(hit->getPosition(), closestPosition)))
+            isAccepted[itHit] = true;
+        else
+            doublets.resize(firstDoublet);
     }
 
-    // Once more to add the hits to the output (in slices)
-    for (size_t itHit = 0; itHit < nHits; itHit++)
-    {
-        TrackerHitPlane *hit = static_cast<TrackerHitPlane *>(trackerHitCollection->getElementAt(itHit));
-
-        if (m_accepted[itHit])
-        {
-            GoodHitsCollection->addElement(hit);
-        }
-    }
-
-    // Store the filtered hit collections
-    evt->addCollection(GoodHitsCollection, m_outputHitCollection);
+    accepted.clear();
+    for (int itHit = 0; itHit < nHits; itHit++)
+        if (isAccepted[itHit])
+            accepted.push_back(itHit);
+}
 
-    //-- note: this will not be printed if compiled w/o MARLINDEBUG=1 !
-    streamlog_out(DEBUG) << "   done processing event: " << evt->getEventNumber()
-                         << "   in run:  " << evt->getRunNumber() << std::endl;
-    
-    _nEvt++;
+void HitSelectorSpace::validateEvent(LCCollection *trackerHitCollection, const TrackerHitIndex *hitIndex,
+                                     const std::vector<DoubletMatcher::SensorPairTask> &tasks)
+{
+    // the masks come from the occupancies of the event, shared with the reference
+    std::set<TrackerHitIndex::SensorKey> maskedSensors;
+    for (size_t itSensor = 0; itSensor < m_scratch.sensorStates.size(); itSensor++)
+        if (m_scratch.sensorStates[itSensor] == SensorOccupancy::Masked)
+            maskedSensors.insert(hitIndex->sensors()[itSensor]);
+
+    m_validator.beginReference();
+    referenceSelection(trackerHitCollection, maskedSensors, m_referenceAccepted, m_referenceDoublets);
+    m_validator.endReference();
+
+    // doublets as (inner, outer) hit indices
+    std::vector<DifferentialValidator::RelationPair> fastDoublets;
+    for (const DoubletMatcher::SensorPairTask &task : tasks)
+        for (const DoubletMatcher::Doublet &doublet : task.doublets)
+            fastDoublets.push_back({doublet.innerHit, doublet.outerHit});
+
+    const double *coordData = m_matcher.coordinates(*hitIndex);
+    auto describeHit = [&](size_t itHit)
+    {
+        if (itHit >= hitIndex->size())
+            return std::string("not in the input collection");
+        std::ostringstream details;
+        details << "layer " << hitIndex->layer[itHit] << " sensor " << hitIndex->sensorNumber[itHit]
+                << (m_matcher.settings().matchInR ? " r " : " theta ") << coordData[itHit] << " phi " << hitIndex->phi[itHit]
+                << " z " << hitIndex->z[itHit];
+        return details.str();
+    };
+
+    std::ostringstream report;
+    if (m_validator.compare(m_acceptedHits, m_referenceAccepted, fastDoublets, m_referenceDoublets, describeHit, report) > 0)
+        streamlog_out(WARNING) << name() << " differs from the reference selection in " << report.str();
 }
 
 void HitSelectorSpace::check(LCEvent *evt)
@@ -227,6 +679,58 @@ void HitSelectorSpace::check(LCEvent *evt)
 
 void HitSelectorSpace::end()
 {
+    // flush the last records before the writer is released
+    m_traceBuffer.setTrace(nullptr);
+    m_trace.reset();
+    m_exportTable.close();
+    m_export.reset();
+
+    streamlog_out(MESSAGE) << name() << ": occupancy guard triggered in " << m_nGuardedEvents
+                           << " of " << _nEvt << " events" << std::endl;
+    streamlog_out(MESSAGE) << name() << ": matching strategies: " << m_nScanPairs << " sensor pairs scanned, " << m_nWindowPairs
+                           << " in the phi window, " << m_nBoundedPairs << " in the bounded phi window" << std::endl;
+
+    if (m_occupancy.enabled())
+    {
+        std::ostringstream report;
+        m_occupancy.report(report, name());
+        streamlog_out(MESSAGE) << report.str();
+        streamlog_out(MESSAGE) << name() << ": " << m_nMaskedPairs << " sensor pairs masked, " << m_nHotPairs
+                               << " matched in a bounded phi window for hot sensors" << std::endl;
+    }
+
+    if (m_matcher.settings().storeDoublets)
+    {
+        std::ostringstream summary;
+        m_scratch.arena.print(summary, name());
+        for (size_t itArena = 0; itArena < m_scratch.workerArenas.size(); itArena++)
+            m_scratch.workerArenas[itArena]->print(summary, name() + " thread " + std::to_string(itArena + 1));
+        if (!m_outputDoubletCollection.empty())
+            RelationPool::print(summary, name());
+        streamlog_out(MESSAGE) << summary.str();
+    }
+
+    if (m_memory.enabled())
+    {
+        std::ostringstream summary;
+        m_memory.print(summary, name());
+        streamlog_out(MESSAGE) << summary.str();
+    }
+
+    if (m_profiler.enabled())
+    {
+        std::ostringstream profile;
+        m_profiler.print(profile, name());
+        streamlog_out(MESSAGE) << profile.str();
+    }
+
+    if (m_validator.enabled())
+    {
+        std::ostringstream summary;
+        m_validator.print(summary, name());
+        streamlog_out(MESSAGE) << summary.str();
+    }
+
 
     //   std::cout << "HitSelectorSpace::end()  " << name()
     // 	    << " processed " << _nEvt << " events in " << _nRun << " runs "
@@ -1,7 +1,15 @@
 #include "HitSelectorTime.h"
+#include "SelectionKernel.h"
+#include "LCIOColumns.h"
+#include "AcceptanceMask.h"
+#include <algorithm>
+#include <limits>
 #include <iostream>
+#include <sstream>
 #include "TMath.h"
+#include "TVector3.h"
 
+#include <EVENT/Exceptions.h>
 #include <EVENT/LCCollection.h>
 #include <EVENT/SimTrackerHit.h>
 
@@ -38,6 +46,65 @@ HitSelectorTime::HitSelectorTime() : Processor("HitSelectorTime")
                                "Good hits from tracker",
                                m_outputHitCollection,
                                std::string("VertexBarrelGoodCollection"));
+
+    // Cuts or decision forest
+    registerProcessorParameter("SelectionMode",
+                               "Cuts (time of flight window) or Forest (decision forest score)",
+                               m_selectionMode,
+                               std::string("Cuts"));
+
+    // Forest model
+    registerProcessorParameter("ForestModelFile",
+                               "Decision forest model, features among time, theta, r, layer",
+                               m_forestModelFile,
+                               std::string(""));
+
+    // Forest score cut
+    registerProcessorParameter("ForestCut",
+                               "Minimum decision forest score of accepted hits",
+                               m_forestCut,
+                               0.);
+
+    // Instruction set of the forest evaluation
+    registerProcessorParameter("SimdLevel",
+                               "Forest evaluation: auto, avx512, avx2 or scalar (falls back to what the CPU supports)",
+                               m_simdLevelName,
+                               std::string("auto"));
+
+    // Subset collections or run-length masks
+    registerProcessorParameter("OutputMode",
+                               "Subset (subset collections) or Mask (run-length encoded masks in <output>_Mask)",
+                               m_outputMode,
+                               std::string("Subset"));
+
+    // Output ordering
+    registerProcessorParameter("OutputOrder",
+                               "Input (keep the input order) or Spatial (accepted hits grouped by sensor); Subset output mode only",
+                               m_outputOrder,
+                               std::string("Input"));
+
+    // Binary decision trace
+    registerProcessorParameter("DecisionTraceFile",
+                               "File receiving the decision and cut values of every hit (empty disables)",
+                               m_traceFile,
+                               std::string(""));
+
+    // Columnar feature export
+    registerProcessorParameter("FeatureExportFile",
+                               "File receiving the features and decision of every hit as compressed columns (empty disables)",
+                               m_exportFile,
+                               std::string(""));
+
+    // Differential validation
+    registerProcessorParameter("ValidationFraction",
+                               "Fraction of the events also selected with the reference per-hit loop and compared (0 disables)",
+                               m_validationFraction,
+                               double(0.));
+
+    registerProcessorParameter("ValidationMaxReports",
+                               "Number of differing hits reported in detail over the job",
+                               m_validationMaxReports,
+                               int(20));
 }
 
 void HitSelectorTime::init()
@@ -50,6 +117,62 @@ void HitSelectorTime::init()
 
     _nRun = 0;
     _nEvt = 0;
+
+    m_outputMask = AcceptanceMask::parseOutputMode(m_outputMode, name());
+
+    if (m_outputOrder != "Input" && m_outputOrder != "Spatial")
+        throw EVENT::Exception("HitSelectorTime: unknown OutputOrder " + m_outputOrder + ", use Input or Spatial");
+    m_spatialOrder = (m_outputOrder == "Spatial");
+
+    TrackerTimeSelection::Settings settings;
+    settings.forestCut = m_forestCut;
+    settings.simdLevel = SelectionKernel::resolveSimdLevel(m_simdLevelName, "HitSelectorTime");
+    m_selection.configure(settings);
+
+    if (m_selectionMode == "Forest")
+    {
+        m_selection.loadForest(m_forestModelFile, "HitSelectorTime");
+        streamlog_out(MESSAGE) << " decision forest: " << m_selection.forest().nTrees() << " trees of depth " << m_selection.forest().depth()
+                               << ", " << SelectionKernel::simdLevelName(settings.simdLevel) << " kernel" << std::endl;
+    }
+    else if (m_selectionMode != "Cuts")
+    {
+        throw EVENT::Exception("HitSelectorTime: unknown SelectionMode " + m_selectionMode + ", use Cuts or Forest");
+    }
+
+    if (!m_traceFile.empty())
+    {
+        m_trace = DecisionTrace::open(m_traceFile);
+        if (m_selection.useForest())
+            m_traceStream = m_trace->registerStream(name() + ":" + m_inputHitCollection, {"score", "cut"}, {"accepted", "low_score"});
+        else
+            m_traceStream = m_trace->registerStream(name() + ":" + m_inputHitCollection, {"time", "tmin", "tmax"}, {"accepted", "early", "late"});
+        m_traceBuffer.setTrace(m_trace.get());
+    }
+
+    if (!m_exportFile.empty())
+    {
+        m_export = FeatureExport::open(m_exportFile);
+        std::vector<std::string> decisionNames = {"accepted", "early", "late"};
+        if (m_selection.useForest())
+            decisionNames = {"accepted", "low_score"};
+        m_exportTable.open(m_export.get(), name() + ":" + m_inputHitCollection,
+                           {{"run", FeatureExport::UInt32}, {"event", FeatureExport::UInt32}, {"hit", FeatureExport::UInt32},
+                            {"time", FeatureExport::Float32}, {"theta", FeatureExport::Float32}, {"r", FeatureExport::Float32},
+                            {"layer", FeatureExport::UInt32}, {"score", FeatureExport::Float32}, {"decision", FeatureExport::UInt8}},
+                           decisionNames);
+    }
+
+    m_validator.configure(m_validationFraction, std::max(m_validationMaxReports, 0));
+
+    // the layer is needed by the export and a forest using it, the sensors by the spatial order
+    const std::vector<TrackerTimeSelection::ForestFeature> &features = m_selection.forestFeatures();
+    m_indexContent = TrackerHitIndex::Positions;
+    if (!m_exportFile.empty() || (m_selection.useForest() && std::find(features.begin(), features.end(),
+                                                                        TrackerTimeSelection::ForestFeature::Layer) != features.end()))
+        m_indexContent = TrackerHitIndex::CellIDFields;
+    if (m_spatialOrder)
+        m_indexContent = TrackerHitIndex::Sensors;
 }
 
 void HitSelectorTime::processRunHeader(LCRunHeader *run)
@@ -68,45 +191,52 @@ void HitSelectorTime::processEvent(LCEvent *evt)
     getCollection(trackerHitCollection, m_inputHitCollection, evt);
 
     std::string encoderString = trackerHitCollection->getParameters().getStringVal("CellIDEncoding");
-    UTIL::CellIDDecoder<TrackerHitPlane> myCellIDEncoding(encoderString);
 
-    // Make the output collections
-    LCCollectionVec *GoodHitsCollection = new LCCollectionVec(trackerHitCollection->getTypeName());
-    GoodHitsCollection->setSubset(true);
-    GoodHitsCollection->parameters().setValue("CellIDEncoding", encoderString);
+    bool validate = m_validator.sampleEvent(evt->getRunNumber(), evt->getEventNumber());
+    if (validate)
+        m_validator.beginFast();
 
-    // Loop over tracker hits
-    int nHits = trackerHitCollection->getNumberOfElements();
-    for (int itHit = 0; itHit < nHits; itHit++)
-    {
-        // Get the hit
-        TrackerHitPlane *hit = static_cast<TrackerHitPlane *>(trackerHitCollection->getElementAt(itHit));
-        unsigned int layer = myCellIDEncoding(hit)["layer"];
-        unsigned int subdet = myCellIDEncoding(hit)["system"];
-        unsigned int module = myCellIDEncoding(hit)["module"];
-        unsigned int side = myCellIDEncoding(hit)["side"];
-        unsigned int sensor = myCellIDEncoding(hit)["sensor"];
+    // Use the shared hit index if an indexer ran before, otherwise index the hits here
+    const TrackerHitIndex *hitIndex = TrackerHitIndex::fromEventOrBuild(evt, m_inputHitCollection, trackerHitCollection, m_localIndex,
+                                                                        m_indexContent);
 
-        streamlog_out(DEBUG0) << " " << std::endl;
-        streamlog_out(DEBUG0) << " Found hit L " << layer << " Su " << subdet << " M " << module << " Si " << side << " Se " << sensor << std::endl;
+    const SelectionKernel::TrackerToFWindow &tofWindow = m_selection.settings().tofWindow;
+    m_selection.select(*hitIndex, m_scratch, m_accepted);
+    if (validate)
+        m_validator.endFast();
 
-        // hit position
-        double r = sqrt(hit->getPosition()[0] * hit->getPosition()[0] + hit->getPosition()[1] * hit->getPosition()[1]);
-        streamlog_out(DEBUG0) << " E " << hit->getEDep() << " time " << hit->getTime() << " r " << r << std::endl;
-        double t_fly = r * 1.E6 / TMath::C();
-        double t_arr = hit->getTime() - t_fly + 0.2167; // ugly should implement in digitizer
+    streamlog_out(DEBUG) << "  Accepted " << m_accepted.size() << " of " << hitIndex->size() << " hits" << std::endl;
 
-        streamlog_out(DEBUG0) << " t " << hit->getTime() << " t_fly " << t_fly << " t_arr " << t_arr << std::endl;
+    if (m_traceBuffer.active() || m_exportTable.active())
+        fillDecisions(hitIndex, tofWindow);
+    if (m_traceBuffer.active())
+        traceDecisions(evt, hitIndex, tofWindow);
+    if (m_exportTable.active())
+        exportFeatures(evt, hitIndex, tofWindow);
 
-        // The following conditions are tentative
-        if (t_arr > -0.15 && t_arr < 0.15){
-            streamlog_out(DEBUG0) << " --> accepted" << std::endl;
-            GoodHitsCollection->addElement(hit);
-        }
+    // Group the accepted hits by sensor
+    if (m_spatialOrder && !m_outputMask)
+    {
+        m_sortKeys.resize(m_accepted.size());
+        for (size_t itAccepted = 0; itAccepted < m_accepted.size(); itAccepted++)
+            m_sortKeys[itAccepted] = hitIndex->sensorNumber[m_accepted[itAccepted]];
+        m_sorter.sort(m_sortKeys, m_accepted);
     }
 
     // Store the filtered hit collections
-    evt->addCollection(GoodHitsCollection, m_outputHitCollection);
+    if (m_outputMask)
+    {
+        AcceptanceMask::storeSelection(evt, m_outputHitCollection, m_inputHitCollection, m_accepted, hitIndex->size());
+    }
+    else
+    {
+        LCCollectionVec *GoodHitsCollection = LCIOColumns::newSubsetCollection(trackerHitCollection, encoderString);
+        LCIOColumns::fillSubset(GoodHitsCollection, trackerHitCollection, m_accepted);
+        evt->addCollection(GoodHitsCollection, m_outputHitCollection);
+    }
+
+    if (validate)
+        validateEvent(trackerHitCollection, tofWindow);
 
     //-- note: this will not be printed if compiled w/o MARLINDEBUG=1 !
     streamlog_out(DEBUG) << "   done processing event: " << evt->getEventNumber()
@@ -122,12 +252,172 @@ void HitSelectorTime::check(LCEvent *evt)
 
 void HitSelectorTime::end()
 {
+    // flush the last records before the writer is released
+    m_traceBuffer.setTrace(nullptr);
+    m_trace.reset();
+    m_exportTable.close();
+    m_export.reset();
+
+    if (m_validator.enabled())
+    {
+        std::ostringstream summary;
+        m_validator.print(summary, name());
+        streamlog_out(MESSAGE) << summary.str();
+    }
 
     //   std::cout << "HitSelectorTime::end()  " << name()
     // 	    << " processed " << _nEvt << " events in " << _nRun << " runs "
     // 	    << std::endl ;
 }
 
+void HitSelectorTime::fillDecisions(const TrackerHitIndex *hitIndex, const SelectionKernel::TrackerToFWindow &tofWindow)
+{
+    SelectionKernel::TrackerHitView view = hitIndex->view();
+    m_decisions.resize(hitIndex->size());
+
+    // m_accepted is still in input order here
+    size_t itAccepted = 0;
+    for (size_t itHit = 0; itHit < hitIndex->size(); itHit++)
+    {
+        bool accepted = itAccepted < m_accepted.size() && m_accepted[itAccepted] == itHit;
+        itAccepted += accepted ? 1 : 0;
+
+        if (accepted)
+            m_decisions[itHit] = 0;
+        else if (m_selection.useForest())
+            m_decisions[itHit] = 1;
+        else
+            m_decisions[itHit] = SelectionKernel::TrackerToFWindow::arrivalTime(view, itHit, tofWindow.offset) > tofWindow.tmin ? 2 : 1;
+    }
+}
+
+void HitSelectorTime::traceDecisions(const LCEvent *evt, const TrackerHitIndex *hitIndex, const SelectionKernel::TrackerToFWindow &tofWindow)
+{
+    m_traceBuffer.setEvent(evt->getRunNumber(), evt->getEventNumber());
+    SelectionKernel::TrackerHitView view = hitIndex->view();
+
+    for (size_t itHit = 0; itHit < hitIndex->size(); itHit++)
+    {
+        if (m_selection.useForest())
+        {
+            m_traceBuffer.add(m_traceStream, itHit, m_decisions[itHit], m_scratch.scores[itHit], m_forestCut);
+        }
+        else
+        {
+            double time = SelectionKernel::TrackerToFWindow::arrivalTime(view, itHit, tofWindow.offset);
+            m_traceBuffer.add(m_traceStream, itHit, m_decisions[itHit], time, tofWindow.tmin, tofWindow.tmax);
+        }
+    }
+}
+
+void HitSelectorTime::exportFeatures(const LCEvent *evt, const TrackerHitIndex *hitIndex, const SelectionKernel::TrackerToFWindow &tofWindow)
+{
+    SelectionKernel::TrackerHitView view = hitIndex->view();
+    size_t nHits = hitIndex->size();
+    size_t first = m_exportTable.addRows(nHits);
+
+    // columns in the order of the schema registered in init()
+    uint32_t *run = m_exportTable.column<uint32_t>(0, first);
+    uint32_t *event = m_exportTable.column<uint32_t>(1, first);
+    uint32_t *hit = m_exportTable.column<uint32_t>(2, first);
+    float *time = m_exportTable.column<float>(3, first);
+    float *theta = m_exportTable.column<float>(4, first);
+    float *r = m_exportTable.column<float>(5, first);
+    uint32_t *layer = m_exportTable.column<uint32_t>(6, first);
+    float *score = m_exportTable.column<float>(7, first);
+    uint8_t *decision = m_exportTable.column<uint8_t>(8, first);
+
+    for (size_t itHit = 0; itHit < nHits; itHit++)
+    {
+        run[itHit] = evt->getRunNumber();
+        event[itHit] = evt->getEventNumber();
+        hit[itHit] = itHit;
+        time[itHit] = SelectionKernel::TrackerToFWindow::arrivalTime(view, itHit, tofWindow.offset);
+        theta[itHit] = hitIndex->theta[itHit];
+        r[itHit] = hitIndex->r[itHit];
+        layer[itHit] = hitIndex->layer[itHit];
+        score[itHit] = m_selection.useForest() ? m_scratch.scores[itHit] : std::numeric_limits<float>::quiet_NaN();
+        decision[itHit] = m_decisions[itHit];
+    }
+    m_exportTable.endRows();
+}
+
+void HitSelectorTime::referenceSelection(LCCollection *trackerHitCollection, const SelectionKernel::TrackerToFWindow &tofWindow,
+                                         std::vector<size_t> &accepted)
+{
+    std::string encoderString = trackerHitCollection->getParameters().getStringVal("CellIDEncoding");
+    UTIL::CellIDDecoder<TrackerHitPlane> myCellIDEncoding(encoderString);
+
+    accepted.clear();
+    const std::vector<TrackerTimeSelection::ForestFeature> &forestFeatures = m_selection.forestFeatures();
+    std::vector<float> features(forestFeatures.size());
+    int nHits = trackerHitCollection->getNumberOfElements();
+    for (int itHit = 0; itHit < nHits; itHit++)
+    {
+        // Get the hit
+        TrackerHitPlane *hit = static_cast<TrackerHitPlane *>(trackerHitCollection->getElementAt(itHit));
+
+        // hit position
+        TVector3 pos(hit->getPosition()[0], hit->getPosition()[1], hit->getPosition()[2]);
+        double r = pos.Perp();
+        double t_fly = r * 1.E6 / TMath::C();
+        double t_arr = hit->getTime() - t_fly + tofWindow.offset;
+
+        if (!m_selection.useForest())
+        {
+            if (t_arr > tofWindow.tmin && t_arr < tofWindow.tmax)
+                accepted.push_back(itHit);
+            continue;
+        }
+
+        // one hit at a time through the scalar forest
+        for (size_t itFeature = 0; itFeature < forestFeatures.size(); itFeature++)
+        {
+            switch (forestFeatures[itFeature])
+            {
+            case TrackerTimeSelection::ForestFeature::Time:
+                features[itFeature] = t_arr;
+                break;
+            case TrackerTimeSelection::ForestFeature::Theta:
+                features[itFeature] = pos.Theta();
+                break;
+            case TrackerTimeSelection::ForestFeature::R:
+                features[itFeature] = r;
+                break;
+            case TrackerTimeSelection::ForestFeature::Layer:
+                features[itFeature] = static_cast<unsigned int>(myCellIDEncoding(hit)["layer"]);
+                break;
+            }
+        }
+        float score = 0.;
+        m_selection.forest().evaluate(features.data(), 1, 1, &score);
+        if (score > m_forestCut)
+            accepted.push_back(itHit);
+    }
+}
+
+void HitSelectorTime::validateEvent(LCCollection *trackerHitCollection, const SelectionKernel::TrackerToFWindow &tofWindow)
+{
+    m_validator.beginReference();
+    referenceSelection(trackerHitCollection, tofWindow, m_referenceAccepted);
+    m_validator.endReference();
+
+    auto describeHit = [&](size_t itHit)
+    {
+        TrackerHit *hit = static_cast<TrackerHit *>(trackerHitCollection->getElementAt(itHit));
+        std::ostringstream details;
+        details << "cellID " << hit->getCellID0() << " position (" << hit->getPosition()[0] << ", " << hit->getPosition()[1]
+                << ", " << hit->getPosition()[2] << ") time " << hit->getTime();
+        if (m_selection.useForest() && itHit < m_scratch.scores.size())
+            details << " score " << m_scratch.scores[itHit];
+        return details.str();
+    };
+
+    std::ostringstream report;
+    if (m_validator.compare(m_accepted, m_referenceAccepted, {}, {}, describeHit, report) > 0)
+        streamlog_out(WARNING) << name() << " differs from the reference selection in " << report.str();
+}
+
 void HitSelectorTime::getCollection(LCCollection *&collection, std::string collectionName, LCEvent *evt)
 {
     try
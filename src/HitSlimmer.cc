@@ -1,20 +1,17 @@
 #include "HitSlimmer.h"
+#include "HitMask.h"
+#include "HotLoopLog.h"
+#include <algorithm>
 #include <iostream>
+#include <set>
+#include <sstream>
 
 #include <EVENT/LCCollection.h>
 #include <EVENT/Track.h>
-#include <EVENT/LCRelation.h>
+#include <EVENT/TrackerHit.h>
 
-#include <IMPL/TrackerHitPlaneImpl.h>
 #include <IMPL/LCCollectionVec.h>
 
-#include <UTIL/CellIDDecoder.h>
-#include <UTIL/CellIDEncoder.h>
-#include <UTIL/LCTrackerConf.h>
-
-#include "TMath.h"
-#include "TVector3.h"
-
 // ----- include for verbosity dependend logging ---------
 #include "marlin/VerbosityLevels.h"
 
@@ -42,9 +39,31 @@ HitSlimmer::HitSlimmer() : Processor("HitSlimmer")
 
     // Output collection
     registerProcessorParameter("SlimmedHitsCollectionName",
-                               "Name of the slimmed hits output collection",
+                               "Name of the slimmed hits output collection (empty to only update the hit mask)",
                                m_outputHitCollection,
                                std::string("SlimmedHits"));
+
+    // Memory instrumentation
+    registerProcessorParameter("MonitorMemory",
+                               "Record heap, RSS and allocations per event and stage, reported at the end",
+                               m_monitorMemory,
+                               bool(false));
+
+    registerProcessorParameter("MemoryMonitorWorstEvents",
+                               "Number of events with the largest memory growth reported at the end",
+                               m_memoryWorstEvents,
+                               int(5));
+
+    // Differential validation
+    registerProcessorParameter("ValidationFraction",
+                               "Fraction of the events also slimmed with the reference per-hit loop and compared (0 disables)",
+                               m_validationFraction,
+                               double(0.));
+
+    registerProcessorParameter("ValidationMaxReports",
+                               "Number of differing hits reported in detail over the job",
+                               m_validationMaxReports,
+                               int(20));
 }
 
 void HitSlimmer::init()
@@ -57,6 +76,9 @@ void HitSlimmer::init()
 
     _nRun = 0;
     _nEvt = 0;
+
+    m_memory.configure(m_monitorMemory, std::max(m_memoryWorstEvents, 0));
+    m_validator.configure(m_validationFraction, std::max(m_validationMaxReports, 0));
 }
 
 void HitSlimmer::processRunHeader(LCRunHeader *run)
@@ -70,122 +92,84 @@ void HitSlimmer::processEvent(LCEvent *evt)
 
     streamlog_out(DEBUG8) << "Processing event " << _nEvt << std::endl;
 
+    // the sample is closed when leaving processEvent, also through an exception
+    MemoryMonitor::Event memoryEvent(m_memory, evt->getRunNumber(), evt->getEventNumber());
+    m_memory.beginStage("mask");
+
     // Get the collection of tracker hits
     LCCollection *trackerHitCollection = 0;
     getCollection(trackerHitCollection, m_inputHitCollection, evt);
 
     std::string encoderString = trackerHitCollection->getParameters().getStringVal("CellIDEncoding");
-    UTIL::CellIDDecoder<TrackerHitPlane> myCellIDEncoding(encoderString);
 
     // Get the collection of tracks
     LCCollection *trackCollection = 0;
     getCollection(trackCollection, m_inputTrackCollection, evt);
 
-    // vector of used hits
-    LCCollectionVec *UsedHitsCollection = new LCCollectionVec(trackerHitCollection->getTypeName());
-    UsedHitsCollection->parameters().setValue("CellIDEncoding", encoderString);
-    UsedHitsCollection->setTransient(true);
+    // Mask of used hits, shared with the previous iterations on the same hit collection
+    HitMask *usedHits = HitMask::getOrCreate(evt, m_inputHitCollection);
+    size_t nUsedBefore = usedHits->countUsed();
 
-    // Make the output collections
-    LCCollectionVec *SlimmedHitsCollection = new LCCollectionVec(trackerHitCollection->getTypeName());
-    SlimmedHitsCollection->setSubset(true);
-    SlimmedHitsCollection->parameters().setValue("CellIDEncoding", encoderString);
+    // the reference starts from the hits used by the previous iterations
+    bool validate = m_validator.sampleEvent(evt->getRunNumber(), evt->getEventNumber());
+    if (validate)
+    {
+        m_usedBefore.resize(usedHits->size());
+        for (size_t itHit = 0; itHit < usedHits->size(); itHit++)
+            m_usedBefore[itHit] = usedHits->isUsed(itHit);
+        m_validator.beginFast();
+    }
 
     int nTracks = trackCollection->getNumberOfElements();
     streamlog_out(DEBUG) << "  N tracks: " << nTracks << std::endl;
 
-    // Loop over tracker hits
+    // Loop over the new tracks only and mark their hits as used
     for (size_t itTrack = 0; itTrack < nTracks; itTrack++)
     {
         // Get the track
         EVENT::Track *track = static_cast<EVENT::Track *>(trackCollection->getElementAt(itTrack));
 
-        // Loop over all hits in a track and mark them as used
         for (EVENT::TrackerHit *hit : track->getTrackerHits())
         {
-            UsedHitsCollection->addElement(hit);
-        }
-    }
-
-    // Add the hits to the output
-    int nHits = trackerHitCollection->getNumberOfElements();
-    // Set the map of responses 
-    memset(&m_used, false, nHits);
-
-    // First sort hits in a map
-    m_hitsMap.clear();
-    for (int itHit = 0; itHit < nHits; itHit++)
-    {
-        // Get the hit
-        TrackerHitPlane *hit = static_cast<TrackerHitPlane *>(trackerHitCollection->getElementAt(itHit));
-        
-        unsigned int layer= myCellIDEncoding(hit)["layer"];
-        unsigned int side= myCellIDEncoding(hit)["side"];
-        unsigned int ladder= myCellIDEncoding(hit)["module"];
-        unsigned int module= myCellIDEncoding(hit)["sensor"];
-
-        MySensorPos sensPos = {layer, side, ladder, module};
-        if (m_hitsMap.find(sensPos) == m_hitsMap.end())
-        {
-            m_hitsMap[sensPos] = std::vector<size_t>();
-            m_hitsMap[sensPos].reserve(nHits);
+            if (!usedHits->setUsedHit(hit))
+            {
+                hotloop_out(DEBUG0) << "Track hit not in " << m_inputHitCollection << std::endl;
+            }
         }
-        m_hitsMap[sensPos].push_back(itHit);
-
     }
 
-    int nUsedHits = UsedHitsCollection->getNumberOfElements();
+    if (validate)
+        m_validator.endFast();
 
+    int nHits = trackerHitCollection->getNumberOfElements();
     streamlog_out(DEBUG4) << "  Total hits: " << nHits
-                          << "  Used hits:  " << nUsedHits << std::endl;
+                          << "  Used hits:  " << usedHits->countUsed()
+                          << "  (new: " << usedHits->countUsed() - nUsedBefore << ")" << std::endl;
 
-    for (size_t itHit = 0; itHit < nUsedHits; itHit++)
+    // Add the unused hits to the output, if requested
+    m_memory.beginStage("output");
+    if (!m_outputHitCollection.empty())
     {
-        // Get the hit
-        TrackerHitPlane *hit = static_cast<TrackerHitPlane *>(UsedHitsCollection->getElementAt(itHit));
-        unsigned int layer = myCellIDEncoding(hit)["layer"];
-        unsigned int side = myCellIDEncoding(hit)["side"];
-        unsigned int ladder = myCellIDEncoding(hit)["module"];
-        unsigned int module = myCellIDEncoding(hit)["sensor"];
-
-        streamlog_out(DEBUG0) << "Hit position " << layer << " " << ladder << " " << module << std::endl;
-        const MySensorPos theOtherPos = {layer, side, ladder, module};
-
-        // Checking if there are any hits in the other layer
-        if (m_hitsMap.find(theOtherPos) == m_hitsMap.end())
-        {
-            streamlog_out(ERROR) << "No hit found, this should never happen!" << std::endl;
-            continue;
-        }
+        LCCollectionVec *SlimmedHitsCollection = new LCCollectionVec(trackerHitCollection->getTypeName());
+        SlimmedHitsCollection->setSubset(true);
+        SlimmedHitsCollection->parameters().setValue("CellIDEncoding", encoderString);
 
-        for (size_t jitHit : m_hitsMap.at(theOtherPos))
+        for (size_t itHit = 0; itHit < nHits; itHit++)
         {
-            TrackerHitPlane *hit2 = static_cast<TrackerHitPlane *>(trackerHitCollection->getElementAt(jitHit));
-            TVector3 pos2(hit2->getPosition()[0], hit2->getPosition()[1], hit2->getPosition()[2]);
-
-            if ((hit->getU() == hit2->getU()) && (hit->getV() == hit2->getV()))
+            if (!usedHits->isUsed(itHit))
             {
-                streamlog_out(DEBUG0) << " --> found hit " << std::endl;
-                m_used[itHit] = true;
+                SlimmedHitsCollection->addElement(trackerHitCollection->getElementAt(itHit));
             }
         }
-    }
 
-    // Once more to add the hits to the output (in slices)
-    for (size_t itHit = 0; itHit < nHits; itHit++)
-    {
-        TrackerHitPlane *hit = static_cast<TrackerHitPlane *>(trackerHitCollection->getElementAt(itHit));
+        streamlog_out(DEBUG4) << "  Unused hits:  " << SlimmedHitsCollection->getNumberOfElements() << std::endl;
 
-        if (!m_used[itHit])
-        {
-            SlimmedHitsCollection->addElement(hit);
-        }
+        // Store the filtered hit collections
+        evt->addCollection(SlimmedHitsCollection, m_outputHitCollection);
     }
 
-    streamlog_out(DEBUG4) << "  Unused hits:  " << SlimmedHitsCollection->getNumberOfElements() << std::endl;
-
-    // Store the filtered hit collections
-    evt->addCollection(SlimmedHitsCollection, m_outputHitCollection);
+    if (validate)
+        validateEvent(trackerHitCollection, trackCollection, usedHits);
 
     //-- note: this will not be printed if compiled w/o MARLINDEBUG=1 !
     streamlog_out(DEBUG4) << "   done processing event: " << evt->getEventNumber()
@@ -194,6 +178,51 @@ void HitSlimmer::processEvent(LCEvent *evt)
     _nEvt++;
 }
 
+void HitSlimmer::referenceSlimming(LCCollection *trackerHitCollection, LCCollection *trackCollection, std::vector<size_t> &unused) const
+{
+    std::set<const EVENT::TrackerHit *> trackHits;
+    for (int itTrack = 0; itTrack < trackCollection->getNumberOfElements(); itTrack++)
+    {
+        EVENT::Track *track = static_cast<EVENT::Track *>(trackCollection->getElementAt(itTrack));
+        for (EVENT::TrackerHit *hit : track->getTrackerHits())
+            trackHits.insert(hit);
+    }
+
+    unused.clear();
+    int nHits = trackerHitCollection->getNumberOfElements();
+    for (int itHit = 0; itHit < nHits; itHit++)
+    {
+        const EVENT::TrackerHit *hit = static_cast<const EVENT::TrackerHit *>(trackerHitCollection->getElementAt(itHit));
+        if (!m_usedBefore[itHit] && trackHits.find(hit) == trackHits.end())
+            unused.push_back(itHit);
+    }
+}
+
+void HitSlimmer::validateEvent(LCCollection *trackerHitCollection, LCCollection *trackCollection, const HitMask *usedHits)
+{
+    m_validator.beginReference();
+    referenceSlimming(trackerHitCollection, trackCollection, m_referenceUnused);
+    m_validator.endReference();
+
+    m_unused.clear();
+    for (size_t itHit = 0; itHit < usedHits->size(); itHit++)
+        if (!usedHits->isUsed(itHit))
+            m_unused.push_back(itHit);
+
+    auto describeHit = [&](size_t itHit)
+    {
+        TrackerHit *hit = static_cast<TrackerHit *>(trackerHitCollection->getElementAt(itHit));
+        std::ostringstream details;
+        details << "cellID " << hit->getCellID0() << " position (" << hit->getPosition()[0] << ", " << hit->getPosition()[1]
+                << ", " << hit->getPosition()[2] << ") used before " << bool(m_usedBefore[itHit]);
+        return details.str();
+    };
+
+    std::ostringstream report;
+    if (m_validator.compare(m_unused, m_referenceUnused, {}, {}, describeHit, report) > 0)
+        streamlog_out(WARNING) << name() << " differs from the reference slimming in " << report.str();
+}
+
 void HitSlimmer::check(LCEvent *evt)
 {
     // nothing to check here - could be used to fill checkplots in reconstruction processor
@@ -201,6 +230,19 @@ void HitSlimmer::check(LCEvent *evt)
 
 void HitSlimmer::end()
 {
+    if (m_memory.enabled())
+    {
+        std::ostringstream summary;
+        m_memory.print(summary, name());
+        streamlog_out(MESSAGE) << summary.str();
+    }
+
+    if (m_validator.enabled())
+    {
+        std::ostringstream summary;
+        m_validator.print(summary, name());
+        streamlog_out(MESSAGE) << summary.str();
+    }
 
     //   std::cout << "HitSlimmer::end()  " << name()
     // 	    << " processed " << _nEvt << " events in " << _nRun << " runs "
@@ -1,10 +1,16 @@
 #include "HitSplitter.h"
+#include "LCIOColumns.h"
+#include "AcceptanceMask.h"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <sstream>
 
 #include <EVENT/LCCollection.h>
 #include <IMPL/TrackerHitPlaneImpl.h>
 
 #include <IMPL/LCCollectionVec.h>
+#include <IMPL/LCGenericObjectImpl.h>
 
 #include <UTIL/CellIDDecoder.h>
 #include <UTIL/CellIDEncoder.h>
@@ -25,7 +31,7 @@ HitSplitter::HitSplitter() : Processor("HitSplitter")
 {
 
     // Modify processor description
-    _description = "HitSplitter splits hits in theta bins";
+    _description = "HitSplitter splits hits in theta (or eta) and phi regions";
 
     // Input collection
     registerProcessorParameter("TrackerHitCollectionName",
@@ -38,6 +44,61 @@ HitSplitter::HitSplitter() : Processor("HitSplitter")
                                "Split hits from tracker",
                                m_outputHitCollection,
                                std::string("SplitCollection"));
+
+    // Subset collections or run-length masks
+    registerProcessorParameter("OutputMode",
+                               "Subset (subset collections) or Mask (run-length encoded masks in <output>_Mask)",
+                               m_outputMode,
+                               std::string("Subset"));
+
+    // Region grid
+    registerProcessorParameter("PolarVariable",
+                               "Theta (edges in degrees) or Eta",
+                               m_polarVariable,
+                               std::string("Theta"));
+
+    FloatVec defaultEdges = {0., 30., 50., 70., 90., 110., 130., 150., 180.};
+    registerProcessorParameter("PolarEdges",
+                               "Increasing bin edges of the polar variable",
+                               m_polarEdgesParameter,
+                               defaultEdges);
+
+    registerProcessorParameter("PhiSectors",
+                               "Number of equal phi sectors, starting at -pi",
+                               m_nPhiSectors,
+                               int(1));
+
+    registerProcessorParameter("PolarOverlap",
+                               "Margin added on both sides of each polar bin, in units of the polar variable",
+                               m_polarOverlap,
+                               float(0.));
+
+    registerProcessorParameter("PhiOverlap",
+                               "Margin added on both sides of each phi sector [rad]",
+                               m_phiOverlap,
+                               float(0.));
+
+    registerProcessorParameter("RegionMapCollection",
+                               "Collection with the region bounds and the home region of each hit (empty: none)",
+                               m_regionMapCollection,
+                               std::string(""));
+
+    // Hardware counter profiling
+    registerProcessorParameter("ProfileStages",
+                               "Report wall time, IPC and cache and branch misses per hit of each stage at the end",
+                               m_profileStages,
+                               bool(false));
+
+    // Differential validation
+    registerProcessorParameter("ValidationFraction",
+                               "Fraction of the events also split with the reference per-hit loop and compared (0 disables)",
+                               m_validationFraction,
+                               double(0.));
+
+    registerProcessorParameter("ValidationMaxReports",
+                               "Number of differing region assignments reported in detail over the job",
+                               m_validationMaxReports,
+                               int(20));
 }
 
 void HitSplitter::init()
@@ -50,6 +111,19 @@ void HitSplitter::init()
 
     _nRun = 0;
     _nEvt = 0;
+
+    m_outputMask = AcceptanceMask::parseOutputMode(m_outputMode, name());
+
+    if (m_profileStages && !m_profiler.configure(true))
+        streamlog_out(WARNING) << "Hardware counters unavailable, profiling wall time only" << std::endl;
+    m_validator.configure(m_validationFraction, std::max(m_validationMaxReports, 0));
+
+    std::vector<double> polarEdges(m_polarEdgesParameter.begin(), m_polarEdgesParameter.end());
+    m_grid.configure(m_polarVariable, polarEdges, m_nPhiSectors, m_polarOverlap, m_phiOverlap, "HitSplitter");
+
+    m_regionNames.clear();
+    for (const std::string &suffix : m_grid.regionSuffixes())
+        m_regionNames.push_back(m_outputHitCollection + suffix);
 }
 
 void HitSplitter::processRunHeader(LCRunHeader *run)
@@ -68,86 +142,51 @@ void HitSplitter::processEvent(LCEvent *evt)
     getCollection(trackerHitCollection, m_inputHitCollection, evt);
 
     std::string encoderString = trackerHitCollection->getParameters().getStringVal("CellIDEncoding");
-    UTIL::CellIDDecoder<TrackerHitPlane> myCellIDEncoding(encoderString);
-
-    // Make the output collections
-    LCCollectionVec *SplitHitsCollection030 = new LCCollectionVec(trackerHitCollection->getTypeName());
-    SplitHitsCollection030->setSubset(true);
-    SplitHitsCollection030->parameters().setValue("CellIDEncoding", encoderString);
-    LCCollectionVec *SplitHitsCollection3050 = new LCCollectionVec(trackerHitCollection->getTypeName());
-    SplitHitsCollection3050->setSubset(true);
-    SplitHitsCollection3050->parameters().setValue("CellIDEncoding", encoderString);
-    LCCollectionVec *SplitHitsCollection5070 = new LCCollectionVec(trackerHitCollection->getTypeName());
-    SplitHitsCollection5070->setSubset(true);
-    SplitHitsCollection5070->parameters().setValue("CellIDEncoding", encoderString);
-    LCCollectionVec *SplitHitsCollection7090 = new LCCollectionVec(trackerHitCollection->getTypeName());
-    SplitHitsCollection7090->setSubset(true);
-    SplitHitsCollection7090->parameters().setValue("CellIDEncoding", encoderString);
-    LCCollectionVec *SplitHitsCollectionN030 = new LCCollectionVec(trackerHitCollection->getTypeName());
-    SplitHitsCollectionN030->setSubset(true);
-    SplitHitsCollectionN030->parameters().setValue("CellIDEncoding", encoderString);
-    LCCollectionVec *SplitHitsCollectionN3050 = new LCCollectionVec(trackerHitCollection->getTypeName());
-    SplitHitsCollectionN3050->setSubset(true);
-    SplitHitsCollectionN3050->parameters().setValue("CellIDEncoding", encoderString);
-    LCCollectionVec *SplitHitsCollectionN5070 = new LCCollectionVec(trackerHitCollection->getTypeName());
-    SplitHitsCollectionN5070->setSubset(true);
-    SplitHitsCollectionN5070->parameters().setValue("CellIDEncoding", encoderString);
-    LCCollectionVec *SplitHitsCollectionN7090 = new LCCollectionVec(trackerHitCollection->getTypeName());
-    SplitHitsCollectionN7090->setSubset(true);
-    SplitHitsCollectionN7090->parameters().setValue("CellIDEncoding", encoderString);
 
     int nHits = trackerHitCollection->getNumberOfElements();
 
-    // Loop over tracker hits
-    for (size_t itHit = 0; itHit < nHits; itHit++)
-    {
-        TrackerHitPlane *hit = static_cast<TrackerHitPlane *>(trackerHitCollection->getElementAt(itHit));
-        TVector3 pos(hit->getPosition()[0], hit->getPosition()[1], hit->getPosition()[2]);
-        double deg_theta = pos.Theta() * 180. / TMath::Pi();
+    bool validate = m_validator.sampleEvent(evt->getRunNumber(), evt->getEventNumber());
+    if (validate)
+        m_validator.beginFast();
 
-        if (deg_theta >= 150.)
-        {
-            SplitHitsCollectionN030->addElement(hit);
-        }
-        else if (deg_theta < 150. && deg_theta >= 130.)
-        {
-            SplitHitsCollectionN3050->addElement(hit);
-        }
-        else if (deg_theta < 130. && deg_theta >= 110.)
-        {
-            SplitHitsCollectionN5070->addElement(hit);
-        }
-        else if (deg_theta < 110. && deg_theta >= 90.)
-        {
-            SplitHitsCollectionN7090->addElement(hit);
-        }
-        else if (deg_theta < 90. && deg_theta >= 70.)
-        {
-            SplitHitsCollection7090->addElement(hit);
-        }
-        else if (deg_theta < 70. && deg_theta >= 50.)
-        {
-               SplitHitsCollection5070->addElement(hit);
-        }
-        else if (deg_theta < 50. && deg_theta >= 30.)
-        {
-               SplitHitsCollection3050->addElement(hit);
-        }
-        else
+    // Use the shared hit index if an indexer ran before, otherwise index the hits here
+    m_profiler.beginStage("decode", nHits);
+    // only theta and phi are needed, the cellID is not decoded
+    const TrackerHitIndex *hitIndex = TrackerHitIndex::fromEventOrBuild(evt, m_inputHitCollection, trackerHitCollection, m_localIndex,
+                                                                        TrackerHitIndex::Positions);
+
+    // Regions of every hit
+    m_profiler.beginStage("group", nHits);
+    m_grid.assign(hitIndex->theta.data(), hitIndex->phi.data(), nHits, m_assignment);
+    if (validate)
+        m_validator.endFast();
+
+    // Store the filtered hit collections, or all regions as masks of one collection
+    m_profiler.beginStage("fill", nHits);
+    if (m_outputMask)
+    {
+        LCCollectionVec *maskCollection = AcceptanceMask::newMaskCollection(m_inputHitCollection);
+        for (size_t itRegion = 0; itRegion < m_regionNames.size(); itRegion++)
+            AcceptanceMask::addMask(maskCollection, m_regionNames[itRegion], m_assignment.regionHits[itRegion], nHits);
+        evt->addCollection(maskCollection, AcceptanceMask::collectionName(m_outputHitCollection));
+    }
+    else
+    {
+        for (size_t itRegion = 0; itRegion < m_regionNames.size(); itRegion++)
         {
-            SplitHitsCollection030->addElement(hit);
+            LCCollectionVec *SplitHitsCollection = LCIOColumns::newSubsetCollection(trackerHitCollection, encoderString);
+            LCIOColumns::fillSubset(SplitHitsCollection, trackerHitCollection, m_assignment.regionHits[itRegion]);
+            evt->addCollection(SplitHitsCollection, m_regionNames[itRegion]);
         }
     }
 
-    // Store the filtered hit collections
-    evt->addCollection(SplitHitsCollection030, m_outputHitCollection + "030");
-    evt->addCollection(SplitHitsCollection3050, m_outputHitCollection + "3050");
-    evt->addCollection(SplitHitsCollection5070, m_outputHitCollection + "5070");
-    evt->addCollection(SplitHitsCollection7090, m_outputHitCollection + "7090");
-    evt->addCollection(SplitHitsCollectionN030, m_outputHitCollection + "N030");
-    evt->addCollection(SplitHitsCollectionN3050, m_outputHitCollection + "N3050");
-    evt->addCollection(SplitHitsCollectionN5070, m_outputHitCollection + "N5070");
-    evt->addCollection(SplitHitsCollectionN7090, m_outputHitCollection + "N7090");
+    if (validate)
+        validateEvent(trackerHitCollection);
+
+    // Region bounds and home regions, to keep each track of overlapping regions once
+    if (!m_regionMapCollection.empty())
+        evt->addCollection(newRegionMap(nHits), m_regionMapCollection);
+    m_profiler.endStage();
 
     //-- note: this will not be printed if compiled w/o MARLINDEBUG=1 !
     streamlog_out(DEBUG) << "   done processing event: " << evt->getEventNumber()
@@ -156,6 +195,96 @@ void HitSplitter::processEvent(LCEvent *evt)
     _nEvt++;
 }
 
+LCCollectionVec *HitSplitter::newRegionMap(size_t nHits) const
+{
+    LCCollectionVec *regionMap = new LCCollectionVec(LCIO::LCGENERICOBJECT);
+    regionMap->parameters().setValue("InputCollection", m_inputHitCollection);
+    regionMap->parameters().setValue("PolarVariable", m_polarVariable);
+    regionMap->parameters().setValues("RegionNames", m_regionNames);
+
+    // one element per region: polar bin, phi sector and the bounds without overlap
+    for (size_t itRegion = 0; itRegion < m_regionNames.size(); itRegion++)
+    {
+        double bounds[4];
+        m_grid.regionBounds(itRegion, bounds);
+        LCGenericObjectImpl *region = new LCGenericObjectImpl();
+        region->setIntVal(0, itRegion / m_grid.nPhiSectors());
+        region->setIntVal(1, itRegion % m_grid.nPhiSectors());
+        for (int itBound = 0; itBound < 4; itBound++)
+            region->setDoubleVal(itBound, bounds[itBound]);
+        regionMap->addElement(region);
+    }
+
+    // last element: the home region of every hit
+    LCGenericObjectImpl *homeRegions = new LCGenericObjectImpl();
+    for (size_t itHit = 0; itHit < nHits; itHit++)
+        homeRegions->setIntVal(itHit, m_grid.homeRegion(m_assignment, itHit));
+    regionMap->addElement(homeRegions);
+
+    return regionMap;
+}
+
+void HitSplitter::referenceAssignment(LCCollection *trackerHitCollection, std::vector<DifferentialValidator::RelationPair> &hitRegions) const
+{
+    hitRegions.clear();
+    int nPolarBins = m_grid.polarEdges().size() - 1;
+    int nPhiSectors = m_grid.nPhiSectors();
+    int nHits = trackerHitCollection->getNumberOfElements();
+    for (int itHit = 0; itHit < nHits; itHit++)
+    {
+        TrackerHit *hit = static_cast<TrackerHit *>(trackerHitCollection->getElementAt(itHit));
+        TVector3 pos(hit->getPosition()[0], hit->getPosition()[1], hit->getPosition()[2]);
+        double polar = m_grid.useEta() ? pos.Eta() : pos.Theta() * 180. / TMath::Pi();
+        double phi = pos.Phi();
+
+        // every region whose bounds widened by the overlaps contain the hit,
+        // the outer polar bins open ended and the phi sectors wrapping around
+        for (size_t itRegion = 0; itRegion < m_grid.nRegions(); itRegion++)
+        {
+            double bounds[4];
+            m_grid.regionBounds(itRegion, bounds);
+            int polarBin = itRegion / nPhiSectors;
+            bool inPolar = (polarBin == 0 || polar + m_polarOverlap >= bounds[0]) &&
+                           (polarBin == nPolarBins - 1 || polar - m_polarOverlap < bounds[1]);
+
+            bool inPhi = (nPhiSectors == 1);
+            for (int itTurn = -1; itTurn <= 1 && !inPhi; itTurn++)
+            {
+                double turnPhi = phi + itTurn * TMath::TwoPi();
+                inPhi = (turnPhi + m_phiOverlap >= bounds[2] && turnPhi - m_phiOverlap < bounds[3]);
+            }
+
+            if (inPolar && inPhi)
+                hitRegions.push_back({size_t(itHit), itRegion});
+        }
+    }
+}
+
+void HitSplitter::validateEvent(LCCollection *trackerHitCollection)
+{
+    m_validator.beginReference();
+    referenceAssignment(trackerHitCollection, m_referenceHitRegions);
+    m_validator.endReference();
+
+    m_hitRegions.clear();
+    for (size_t itRegion = 0; itRegion < m_assignment.regionHits.size(); itRegion++)
+        for (size_t itHit : m_assignment.regionHits[itRegion])
+            m_hitRegions.push_back({itHit, itRegion});
+
+    auto describeHit = [&](size_t itHit)
+    {
+        TrackerHit *hit = static_cast<TrackerHit *>(trackerHitCollection->getElementAt(itHit));
+        std::ostringstream details;
+        details << "position (" << hit->getPosition()[0] << ", " << hit->getPosition()[1] << ", " << hit->getPosition()[2]
+                << ") polar " << m_assignment.polar[itHit] << " home region " << m_grid.homeRegion(m_assignment, itHit);
+        return details.str();
+    };
+
+    std::ostringstream report;
+    if (m_validator.compare({}, {}, m_hitRegions, m_referenceHitRegions, describeHit, report) > 0)
+        streamlog_out(WARNING) << name() << " differs from the reference region assignment in " << report.str();
+}
+
 void HitSplitter::check(LCEvent *evt)
 {
     // nothing to check here - could be used to fill checkplots in reconstruction processor
@@ -163,6 +292,19 @@ void HitSplitter::check(LCEvent *evt)
 
 void HitSplitter::end()
 {
+    if (m_profiler.enabled())
+    {
+        std::ostringstream profile;
+        m_profiler.print(profile, name());
+        streamlog_out(MESSAGE) << profile.str();
+    }
+
+    if (m_validator.enabled())
+    {
+        std::ostringstream summary;
+        m_validator.print(summary, name());
+        streamlog_out(MESSAGE) << summary.str();
+    }
 
     //   std::cout << "HitSplitter::end()  " << name()
     // 	    << " processed " << _nEvt << " events in " << _nRun << " runs "
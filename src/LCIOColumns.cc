@@ -0,0 +1,41 @@
+#include "LCIOColumns.h"
+
+#include <EVENT/CalorimeterHit.h>
+#include <EVENT/LCIO.h>
+#include <UTIL/CellIDDecoder.h>
+
+using namespace lcio;
+
+// hits prefetched ahead of the one being copied
+static const size_t kPrefetchDistance = 8;
+
+void LCIOColumns::gather(const EVENT::LCCollection *caloHitCollection, CaloHitColumns &columns)
+{
+    std::string encoderString = caloHitCollection->getParameters().getStringVal(LCIO::CellIDEncoding);
+    UTIL::CellIDDecoder<CalorimeterHit> myCellIDEncoding(encoderString);
+
+    size_t nHits = caloHitCollection->getNumberOfElements();
+    columns.resize(nHits);
+
+    // read the element pointers straight from the vector when possible, skipping the virtual getElementAt
+    const LCCollectionVec *hitVec = dynamic_cast<const LCCollectionVec *>(caloHitCollection);
+    auto elementAt = [caloHitCollection, hitVec](size_t itHit)
+    { return hitVec != nullptr ? (*hitVec)[itHit] : caloHitCollection->getElementAt(itHit); };
+
+    for (size_t itHit = 0; itHit < nHits; itHit++)
+    {
+        if (itHit + kPrefetchDistance < nHits)
+            __builtin_prefetch(elementAt(itHit + kPrefetchDistance));
+
+        CalorimeterHit *hit = static_cast<CalorimeterHit *>(elementAt(itHit));
+
+        columns.energy[itHit] = hit->getEnergy();
+        columns.time[itHit] = hit->getTime();
+        columns.x[itHit] = hit->getPosition()[0];
+        columns.y[itHit] = hit->getPosition()[1];
+        columns.z[itHit] = hit->getPosition()[2];
+        columns.layer[itHit] = myCellIDEncoding(hit)["layer"];
+    }
+
+    columns.finish();
+}
@@ -0,0 +1,86 @@
+#include "MaskExpander.h"
+#include "AcceptanceMask.h"
+#include <iostream>
+
+#include <EVENT/LCCollection.h>
+
+// ----- include for verbosity dependend logging ---------
+#include "marlin/VerbosityLevels.h"
+
+using namespace lcio;
+using namespace marlin;
+
+MaskExpander aMaskExpander;
+
+MaskExpander::MaskExpander() : Processor("MaskExpander")
+{
+
+    // Modify processor description
+    _description = "MaskExpander expands run-length acceptance masks into subset collections";
+
+    // Input collections
+    StringVec defaultCollections = {"VertexBarrelGoodCollection"};
+    registerProcessorParameter("MaskedCollectionNames",
+                               "Output collection names whose <name>_Mask collections are expanded",
+                               m_maskedCollections,
+                               defaultCollections);
+}
+
+void MaskExpander::init()
+{
+
+    streamlog_out(DEBUG) << "   init called  " << std::endl;
+
+    // usually a good idea to
+    printParameters();
+
+    _nRun = 0;
+    _nEvt = 0;
+}
+
+void MaskExpander::processRunHeader(LCRunHeader *run)
+{
+
+    _nRun++;
+}
+
+void MaskExpander::processEvent(LCEvent *evt)
+{
+
+    streamlog_out(DEBUG8) << "Processing event " << _nEvt << std::endl;
+
+    for (const std::string &collectionName : m_maskedCollections)
+    {
+        try
+        {
+            AcceptanceMask::expandToEvent(evt, collectionName, m_existingNames);
+            for (const std::string &existingName : m_existingNames)
+                streamlog_out(WARNING) << "Collection " << existingName << " already in the event, mask of "
+                                       << AcceptanceMask::collectionName(collectionName) << " not expanded" << std::endl;
+        }
+        catch (DataNotAvailableException &e)
+        {
+            streamlog_out(DEBUG5) << "- cannot get collection. Collection " << AcceptanceMask::collectionName(collectionName)
+                                  << " or its input is unavailable" << std::endl;
+        }
+    }
+
+    //-- note: this will not be printed if compiled w/o MARLINDEBUG=1 !
+    streamlog_out(DEBUG) << "   done processing event: " << evt->getEventNumber()
+                         << "   in run:  " << evt->getRunNumber() << std::endl;
+
+    _nEvt++;
+}
+
+void MaskExpander::check(LCEvent *evt)
+{
+    // nothing to check here - could be used to fill checkplots in reconstruction processor
+}
+
+void MaskExpander::end()
+{
+
+    //   std::cout << "MaskExpander::end()  " << name()
+    // 	    << " processed " << _nEvt << " events in " << _nRun << " runs "
+    // 	    << std::endl ;
+}
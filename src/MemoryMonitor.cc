@@ -0,0 +1,206 @@
+#include "MemoryMonitor.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+
+#include <dlfcn.h>
+#include <malloc.h>
+#include <unistd.h>
+
+namespace
+{
+    typedef void (*AllocationCountsFunction)(uint64_t *allocations, uint64_t *bytes);
+
+    // exported by libMyBIBUtilsAllocationCounter when it is preloaded
+    AllocationCountsFunction allocationCounts()
+    {
+        static AllocationCountsFunction function = reinterpret_cast<AllocationCountsFunction>(dlsym(RTLD_DEFAULT, "mybibutils_allocation_counts"));
+        return function;
+    }
+
+    int64_t residentBytes()
+    {
+        static const long pageSize = sysconf(_SC_PAGESIZE);
+        long size = 0;
+        long resident = 0;
+        FILE *statm = std::fopen("/proc/self/statm", "r");
+        if (statm == nullptr)
+            return 0;
+        if (std::fscanf(statm, "%ld %ld", &size, &resident) != 2)
+            resident = 0;
+        std::fclose(statm);
+        return static_cast<int64_t>(resident) * pageSize;
+    }
+
+    std::string megabytes(int64_t bytes, bool withSign = true)
+    {
+        char text[32];
+        std::snprintf(text, sizeof(text), withSign ? "%+.2f MB" : "%.2f MB", bytes / 1048576.);
+        return text;
+    }
+} // namespace
+
+MemoryMonitor::Sample MemoryMonitor::sample()
+{
+    Sample sample;
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info = mallinfo2();
+    sample.heapBytes = static_cast<int64_t>(info.uordblks + info.hblkhd);
+#elif defined(__GLIBC__)
+    struct mallinfo info = mallinfo();
+    sample.heapBytes = static_cast<int64_t>(static_cast<unsigned int>(info.uordblks)) + static_cast<unsigned int>(info.hblkhd);
+#endif
+    sample.rssBytes = residentBytes();
+    if (AllocationCountsFunction counts = allocationCounts())
+        counts(&sample.allocations, &sample.allocatedBytes);
+    return sample;
+}
+
+bool MemoryMonitor::countsAllocations()
+{
+    return allocationCounts() != nullptr;
+}
+
+void MemoryMonitor::Usage::add(const Sample &begin, const Sample &end)
+{
+    allocations += end.allocations - begin.allocations;
+    allocatedBytes += end.allocatedBytes - begin.allocatedBytes;
+    heapDelta += end.heapBytes - begin.heapBytes;
+    rssDelta += end.rssBytes - begin.rssBytes;
+}
+
+void MemoryMonitor::configure(bool enabled, size_t nWorstEvents)
+{
+    m_enabled = enabled;
+    m_nWorstEvents = nWorstEvents;
+}
+
+void MemoryMonitor::beginEvent(int run, int event)
+{
+    if (!m_enabled)
+        return;
+    if (m_inEvent)
+        endEvent();
+
+    m_event.run = run;
+    m_event.event = event;
+    m_event.usage = Usage();
+    m_event.peakHeapGrowth = 0;
+    m_event.peakScratch = 0;
+    m_event.stages.assign(m_stageNames.size(), Usage());
+    m_inStage = false;
+    m_inEvent = true;
+    m_eventBegin = sample();
+}
+
+void MemoryMonitor::endEvent()
+{
+    if (!m_enabled || !m_inEvent)
+        return;
+    if (m_inStage)
+        endStage();
+    m_inEvent = false;
+
+    Sample end = sample();
+    m_event.usage.add(m_eventBegin, end);
+    m_event.peakHeapGrowth = std::max(m_event.peakHeapGrowth, end.heapBytes - m_eventBegin.heapBytes);
+    m_total.add(m_eventBegin, end);
+    m_nEvents++;
+
+    // keep the worst events, largest growth first
+    auto position = std::upper_bound(m_worstEvents.begin(), m_worstEvents.end(), m_event, [](const EventRecord &a, const EventRecord &b)
+                                     { return a.growth() > b.growth(); });
+    if (static_cast<size_t>(position - m_worstEvents.begin()) < m_nWorstEvents)
+    {
+        m_worstEvents.insert(position, m_event);
+        if (m_worstEvents.size() > m_nWorstEvents)
+            m_worstEvents.pop_back();
+    }
+}
+
+size_t MemoryMonitor::stageIndex(const char *stage)
+{
+    for (size_t itStage = 0; itStage < m_stageNames.size(); itStage++)
+        if (m_stageNames[itStage] == stage || std::strcmp(m_stageNames[itStage], stage) == 0)
+            return itStage;
+
+    m_stageNames.push_back(stage);
+    m_stageTotals.emplace_back();
+    m_event.stages.emplace_back();
+    return m_stageNames.size() - 1;
+}
+
+void MemoryMonitor::beginStage(const char *stage)
+{
+    if (!m_enabled)
+        return;
+    if (m_inStage)
+        endStage();
+
+    m_stage = stageIndex(stage);
+    m_inStage = true;
+    m_stageBegin = sample();
+}
+
+void MemoryMonitor::endStage()
+{
+    if (!m_enabled || !m_inStage)
+        return;
+
+    Sample end = sample();
+    Usage usage;
+    usage.add(m_stageBegin, end);
+    m_event.stages[m_stage].add(m_stageBegin, end);
+    m_event.peakHeapGrowth = std::max(m_event.peakHeapGrowth, end.heapBytes - m_eventBegin.heapBytes);
+
+    StageTotal &total = m_stageTotals[m_stage];
+    total.calls++;
+    total.usage.add(m_stageBegin, end);
+    total.maxHeapDelta = std::max(total.maxHeapDelta, usage.heapDelta);
+    m_inStage = false;
+}
+
+void MemoryMonitor::recordScratch(size_t bytes)
+{
+    if (m_enabled)
+        m_event.peakScratch = std::max(m_event.peakScratch, bytes);
+}
+
+void MemoryMonitor::print(std::ostream &out, const std::string &processorName) const
+{
+    if (!m_enabled)
+        return;
+
+    bool counted = countsAllocations();
+    out << processorName << " memory over " << m_nEvents << " events: heap " << megabytes(m_total.heapDelta)
+        << ", RSS " << megabytes(m_total.rssDelta);
+    if (counted)
+        out << ", " << m_total.allocations << " allocations of " << megabytes(m_total.allocatedBytes, false);
+    else
+        out << " (preload libMyBIBUtilsAllocationCounter.so to count allocations)";
+    out << std::endl;
+
+    for (size_t itStage = 0; itStage < m_stageNames.size(); itStage++)
+    {
+        const StageTotal &total = m_stageTotals[itStage];
+        out << "  stage " << std::setw(12) << std::left << m_stageNames[itStage] << std::right
+            << " calls " << total.calls << ", largest heap growth " << megabytes(total.maxHeapDelta);
+        if (counted && total.calls > 0)
+            out << ", " << total.usage.allocations / total.calls << " allocations of "
+                << megabytes(total.usage.allocatedBytes / total.calls, false) << " per call";
+        out << std::endl;
+    }
+
+    for (const EventRecord &record : m_worstEvents)
+    {
+        out << "  run " << record.run << " event " << record.event << ": peak heap growth " << megabytes(record.peakHeapGrowth)
+            << ", RSS " << megabytes(record.usage.rssDelta) << ", scratch " << megabytes(record.peakScratch, false);
+        if (counted)
+            out << ", " << record.usage.allocations << " allocations";
+        for (size_t itStage = 0; itStage < record.stages.size(); itStage++)
+            out << "; " << m_stageNames[itStage] << " heap " << megabytes(record.stages[itStage].heapDelta);
+        out << std::endl;
+    }
+}
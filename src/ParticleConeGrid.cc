@@ -0,0 +1,126 @@
+#include "ParticleConeGrid.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "TMath.h"
+
+void ParticleConeGrid::build(const double *px, const double *py, const double *pz, size_t n, double coneSize)
+{
+    m_px = px;
+    m_py = py;
+    m_pz = pz;
+    m_n = n;
+    m_coneSize = coneSize;
+    m_degenerate.clear();
+
+    // with fewer than three rows the grid saves nothing
+    m_useGrid = coneSize > 0. && coneSize < TMath::Pi() / 3.;
+    if (!m_useGrid)
+        return;
+
+    m_nTheta = static_cast<size_t>(TMath::Pi() / coneSize);
+    m_nPhi = static_cast<size_t>(TMath::TwoPi() / coneSize);
+    m_cellTheta = TMath::Pi() / m_nTheta;
+    m_cellPhi = TMath::TwoPi() / m_nPhi;
+
+    m_rowMinSin.resize(m_nTheta);
+    for (size_t itRow = 0; itRow < m_nTheta; itRow++)
+        m_rowMinSin[itRow] = std::max(0., std::min(std::sin(itRow * m_cellTheta), std::sin((itRow + 1) * m_cellTheta)));
+
+    // counting sort of the particles into their cells
+    std::vector<size_t> particleCell(n);
+    m_cellOffsets.assign(nCells() + 1, 0);
+    for (size_t itPart = 0; itPart < n; itPart++)
+    {
+        double p2 = px[itPart] * px[itPart] + py[itPart] * py[itPart] + pz[itPart] * pz[itPart];
+        if (!(p2 > 0.) || !std::isfinite(p2))
+        {
+            m_degenerate.push_back(itPart);
+            particleCell[itPart] = nCells();
+            continue;
+        }
+
+        double theta = std::atan2(std::sqrt(px[itPart] * px[itPart] + py[itPart] * py[itPart]), pz[itPart]);
+        double phi = std::atan2(py[itPart], px[itPart]) + TMath::Pi();
+        size_t row = std::min(static_cast<size_t>(theta / m_cellTheta), m_nTheta - 1);
+        size_t column = std::min(static_cast<size_t>(phi / m_cellPhi), m_nPhi - 1);
+        particleCell[itPart] = row * m_nPhi + column;
+        m_cellOffsets[particleCell[itPart] + 1]++;
+    }
+    for (size_t itCell = 0; itCell < nCells(); itCell++)
+        m_cellOffsets[itCell + 1] += m_cellOffsets[itCell];
+
+    std::vector<size_t> fill(m_cellOffsets.begin(), m_cellOffsets.end() - 1);
+    m_cellParticles.resize(m_cellOffsets.back());
+    for (size_t itPart = 0; itPart < n; itPart++)
+        if (particleCell[itPart] < nCells())
+            m_cellParticles[fill[particleCell[itPart]]++] = itPart;
+}
+
+bool ParticleConeGrid::inAnyConeFullLoop(double x, double y, double z, double hitMag2) const
+{
+    for (size_t itPart = 0; itPart < m_n; itPart++)
+        if (std::fabs(SelectionKernel::ConeAroundAny::angle(m_px[itPart], m_py[itPart], m_pz[itPart], x, y, z, hitMag2)) < m_coneSize)
+            return true;
+    return false;
+}
+
+bool ParticleConeGrid::inAnyConeOfCell(size_t cell, double x, double y, double z, double hitMag2) const
+{
+    for (size_t itSlot = m_cellOffsets[cell]; itSlot < m_cellOffsets[cell + 1]; itSlot++)
+    {
+        size_t itPart = m_cellParticles[itSlot];
+        if (std::fabs(SelectionKernel::ConeAroundAny::angle(m_px[itPart], m_py[itPart], m_pz[itPart], x, y, z, hitMag2)) < m_coneSize)
+            return true;
+    }
+    return false;
+}
+
+bool ParticleConeGrid::inAnyCone(double x, double y, double z) const
+{
+    double hitMag2 = x * x + y * y + z * z;
+    if (!m_useGrid || !(hitMag2 > 0.) || !std::isfinite(hitMag2))
+        return inAnyConeFullLoop(x, y, z, hitMag2);
+
+    for (size_t itPart : m_degenerate)
+        if (std::fabs(SelectionKernel::ConeAroundAny::angle(m_px[itPart], m_py[itPart], m_pz[itPart], x, y, z, hitMag2)) < m_coneSize)
+            return true;
+
+    double theta = std::atan2(std::sqrt(x * x + y * y), z);
+    double phi = std::atan2(y, x) + TMath::Pi();
+    double sinTheta = std::sin(theta);
+    double sinHalfCone = std::sin(m_coneSize / 2.);
+
+    // rows within one cone in theta, plus one row of margin for rounding
+    long firstRow = std::max(0L, static_cast<long>(std::floor((theta - m_coneSize) / m_cellTheta)) - 1);
+    long lastRow = std::min(static_cast<long>(m_nTheta) - 1, static_cast<long>(std::floor((theta + m_coneSize) / m_cellTheta)) + 1);
+    for (long row = firstRow; row <= lastRow; row++)
+    {
+        // widest phi distance still allowing an angle below the cone size
+        double sinProduct = sinTheta * m_rowMinSin[row];
+        double bound = sinProduct > 0. ? sinHalfCone / std::sqrt(sinProduct) : 2.;
+        long nColumns = static_cast<long>(m_nPhi);
+        long firstColumn = 0;
+        long lastColumn = nColumns - 1;
+        if (bound < 1.)
+        {
+            double maxDphi = 2. * std::asin(bound);
+            firstColumn = static_cast<long>(std::floor((phi - maxDphi) / m_cellPhi)) - 1;
+            lastColumn = static_cast<long>(std::floor((phi + maxDphi) / m_cellPhi)) + 1;
+            if (lastColumn - firstColumn + 1 >= nColumns)
+            {
+                firstColumn = 0;
+                lastColumn = nColumns - 1;
+            }
+        }
+
+        for (long column = firstColumn; column <= lastColumn; column++)
+        {
+            long wrapped = ((column % nColumns) + nColumns) % nColumns;
+            if (inAnyConeOfCell(row * m_nPhi + wrapped, x, y, z, hitMag2))
+                return true;
+        }
+    }
+    return false;
+}
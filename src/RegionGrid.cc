@@ -0,0 +1,150 @@
+#include "RegionGrid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+#include "TMath.h"
+
+namespace
+{
+    // Number of edges at or below each value, so values below the second edge
+    // (or NaN) land in the first bin and values above the last edge in the last
+    void countEdges(const double *values, size_t n, double shift, const std::vector<double> &innerEdges, int *bins)
+    {
+        for (size_t i = 0; i < n; i++)
+            bins[i] = 0;
+        for (double edge : innerEdges)
+            for (size_t i = 0; i < n; i++)
+                bins[i] += (values[i] + shift >= edge);
+    }
+
+    // Unwrapped phi sector of each value, sector 0 starting at -pi
+    void phiSectors(const double *phi, size_t n, double shift, double invWidth, int *sectors)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            double u = (phi[i] + shift + TMath::Pi()) * invWidth;
+            u = (u == u) ? u : 0.;
+            sectors[i] = static_cast<int>(std::floor(u));
+        }
+    }
+
+    std::string edgeName(double edge)
+    {
+        std::ostringstream name;
+        name << edge;
+        return name.str();
+    }
+} // namespace
+
+void RegionGrid::configure(const std::string &polarVariable, const std::vector<double> &polarEdges, int nPhiSectors,
+                           double polarOverlap, double phiOverlap, const std::string &owner)
+{
+    if (polarVariable == "Theta")
+        m_useEta = false;
+    else if (polarVariable == "Eta")
+        m_useEta = true;
+    else
+        throw std::runtime_error(owner + ": unknown PolarVariable " + polarVariable + ", use Theta or Eta");
+
+    if (polarEdges.size() < 2)
+        throw std::runtime_error(owner + ": PolarEdges needs at least two edges");
+    m_polarEdges = polarEdges;
+    for (size_t itEdge = 1; itEdge < m_polarEdges.size(); itEdge++)
+        if (!(m_polarEdges[itEdge] > m_polarEdges[itEdge - 1]))
+            throw std::runtime_error(owner + ": PolarEdges must be increasing");
+    m_innerEdges.assign(m_polarEdges.begin() + 1, m_polarEdges.end() - 1);
+
+    if (nPhiSectors < 1)
+        throw std::runtime_error(owner + ": PhiSectors must be at least 1");
+    if (!(polarOverlap >= 0.) || !(phiOverlap >= 0.))
+        throw std::runtime_error(owner + ": overlaps must not be negative");
+    m_nPhiSectors = nPhiSectors;
+    m_polarOverlap = polarOverlap;
+    m_phiOverlap = phiOverlap;
+
+    size_t nPolarBins = m_polarEdges.size() - 1;
+    m_regionSuffixes.clear();
+    for (size_t itPolar = 0; itPolar < nPolarBins; itPolar++)
+    {
+        double low = m_polarEdges[itPolar];
+        double high = m_polarEdges[itPolar + 1];
+        std::string polarName;
+        if (m_useEta)
+            polarName = "E" + std::to_string(itPolar);
+        else if (low >= 90.)
+            polarName = "N" + edgeName(180. - high) + edgeName(180. - low);
+        else
+            polarName = edgeName(low) + edgeName(high);
+
+        for (int itPhi = 0; itPhi < m_nPhiSectors; itPhi++)
+            m_regionSuffixes.push_back(polarName + (m_nPhiSectors > 1 ? "_P" + std::to_string(itPhi) : ""));
+    }
+}
+
+void RegionGrid::regionBounds(size_t region, double bounds[4]) const
+{
+    int polarBin = region / m_nPhiSectors;
+    int phiSector = region % m_nPhiSectors;
+    double sectorWidth = TMath::TwoPi() / m_nPhiSectors;
+    bounds[0] = m_polarEdges[polarBin];
+    bounds[1] = m_polarEdges[polarBin + 1];
+    bounds[2] = -TMath::Pi() + phiSector * sectorWidth;
+    bounds[3] = -TMath::Pi() + (phiSector + 1) * sectorWidth;
+}
+
+void RegionGrid::assign(const double *theta, const double *phi, size_t nHits, Assignment &assignment) const
+{
+    // Polar variable of every hit
+    assignment.polar.resize(nHits);
+    for (size_t itHit = 0; itHit < nHits; itHit++)
+        assignment.polar[itHit] = theta[itHit] * 180. / TMath::Pi();
+    if (m_useEta)
+        for (size_t itHit = 0; itHit < nHits; itHit++)
+            assignment.polar[itHit] = -std::log(std::tan(theta[itHit] / 2.));
+
+    // Home bins and the bins reached through the overlap margins, column by column
+    assignment.polarHome.resize(nHits);
+    assignment.polarFirst.resize(nHits);
+    assignment.polarLast.resize(nHits);
+    countEdges(assignment.polar.data(), nHits, 0., m_innerEdges, assignment.polarHome.data());
+    if (m_polarOverlap > 0.)
+    {
+        countEdges(assignment.polar.data(), nHits, -m_polarOverlap, m_innerEdges, assignment.polarFirst.data());
+        countEdges(assignment.polar.data(), nHits, m_polarOverlap, m_innerEdges, assignment.polarLast.data());
+    }
+    else
+    {
+        assignment.polarFirst = assignment.polarHome;
+        assignment.polarLast = assignment.polarHome;
+    }
+
+    assignment.phiHome.assign(nHits, 0);
+    assignment.phiFirst.assign(nHits, 0);
+    assignment.phiLast.assign(nHits, 0);
+    if (m_nPhiSectors > 1)
+    {
+        double invWidth = m_nPhiSectors / TMath::TwoPi();
+        phiSectors(phi, nHits, 0., invWidth, assignment.phiHome.data());
+        phiSectors(phi, nHits, -m_phiOverlap, invWidth, assignment.phiFirst.data());
+        phiSectors(phi, nHits, m_phiOverlap, invWidth, assignment.phiLast.data());
+    }
+
+    // Hits of each region, in region order
+    assignment.regionHits.resize(nRegions());
+    for (std::vector<size_t> &regionHits : assignment.regionHits)
+        regionHits.clear();
+
+    for (size_t itHit = 0; itHit < nHits; itHit++)
+    {
+        int nSectors = std::min(assignment.phiLast[itHit] - assignment.phiFirst[itHit] + 1, m_nPhiSectors);
+        for (int itPolar = assignment.polarFirst[itHit]; itPolar <= assignment.polarLast[itHit]; itPolar++)
+            for (int itSector = 0; itSector < nSectors; itSector++)
+            {
+                int sector = ((assignment.phiFirst[itHit] + itSector) % m_nPhiSectors + m_nPhiSectors) % m_nPhiSectors;
+                assignment.regionHits[itPolar * m_nPhiSectors + sector].push_back(itHit);
+            }
+    }
+}
@@ -0,0 +1,108 @@
+#include "RelationPool.h"
+
+#include <EVENT/LCIO.h>
+
+#include <mutex>
+#include <new>
+
+namespace
+{
+    const size_t kSlotSize = (sizeof(PooledRelation) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+    const size_t kSlotsPerBlock = 4096;
+
+    struct FreeSlot
+    {
+        FreeSlot *next;
+    };
+
+    // never destroyed, events may still delete relations during the static destruction
+    struct PoolState
+    {
+        std::mutex mutex;
+        FreeSlot *freeSlots = nullptr;
+        char *freshSlot = nullptr;
+        char *blockEnd = nullptr;
+        RelationPool::Stats stats;
+    };
+
+    PoolState &poolState()
+    {
+        static PoolState *state = new PoolState;
+        return *state;
+    }
+} // namespace
+
+void *RelationPool::allocate(size_t bytes)
+{
+    // classes deriving from PooledRelation with more members use the heap
+    if (bytes > kSlotSize)
+        return ::operator new(bytes);
+
+    PoolState &pool = poolState();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    pool.stats.nServed++;
+    pool.stats.nLive++;
+
+    if (pool.freeSlots != nullptr)
+    {
+        FreeSlot *slot = pool.freeSlots;
+        pool.freeSlots = slot->next;
+        pool.stats.nReused++;
+        return slot;
+    }
+
+    if (pool.freshSlot == pool.blockEnd)
+    {
+        pool.freshSlot = static_cast<char *>(::operator new(kSlotSize * kSlotsPerBlock));
+        pool.blockEnd = pool.freshSlot + kSlotSize * kSlotsPerBlock;
+        pool.stats.nBlocks++;
+        pool.stats.nSlots += kSlotsPerBlock;
+    }
+    void *slot = pool.freshSlot;
+    pool.freshSlot += kSlotSize;
+    return slot;
+}
+
+void RelationPool::release(void *slot, size_t bytes)
+{
+    if (slot == nullptr)
+        return;
+    if (bytes > kSlotSize)
+    {
+        ::operator delete(slot);
+        return;
+    }
+
+    PoolState &pool = poolState();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    FreeSlot *freeSlot = static_cast<FreeSlot *>(slot);
+    freeSlot->next = pool.freeSlots;
+    pool.freeSlots = freeSlot;
+    pool.stats.nLive--;
+}
+
+RelationPool::Stats RelationPool::stats()
+{
+    PoolState &pool = poolState();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    return pool.stats;
+}
+
+IMPL::LCCollectionVec *RelationPool::newCollection(const std::string &fromType, const std::string &toType, size_t reserve,
+                                                   bool weighted)
+{
+    IMPL::LCCollectionVec *collection = new IMPL::LCCollectionVec(EVENT::LCIO::LCRELATION);
+    if (weighted)
+        collection->setFlag(collection->getFlag() | (1 << EVENT::LCIO::LCREL_WEIGHTED));
+    collection->parameters().setValue("FromType", fromType);
+    collection->parameters().setValue("ToType", toType);
+    collection->reserve(reserve);
+    return collection;
+}
+
+void RelationPool::print(std::ostream &out, const std::string &processorName)
+{
+    Stats pool = stats();
+    out << processorName << " relation pool: " << pool.nServed << " relations, " << pool.nReused << " in recycled slots, "
+        << pool.nBlocks << " heap allocations for " << pool.nSlots << " slots, " << pool.nLive << " held by events" << std::endl;
+}
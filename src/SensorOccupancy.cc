@@ -0,0 +1,116 @@
+#include "SensorOccupancy.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <stdexcept>
+
+void SensorOccupancy::configure(const Settings &settings, const std::vector<std::string> &maskedSensors, const std::string &owner)
+{
+    m_settings = settings;
+
+    if (m_settings.averageEvents < 1)
+        throw std::runtime_error(owner + ": the running average of the sensor occupancy needs at least one event");
+    m_decay = 1. - 1. / m_settings.averageEvents;
+
+    if (maskedSensors.size() % 4 != 0)
+        throw std::runtime_error(owner + ": MaskedSensors must contain quadruplets of layer, side, ladder, module");
+
+    m_maskedSensors.clear();
+    for (size_t itSensor = 0; itSensor < maskedSensors.size(); itSensor += 4)
+    {
+        try
+        {
+            // side is signed, stored as the bits of the int like the decoded field
+            m_maskedSensors.insert({static_cast<unsigned int>(std::stoul(maskedSensors[itSensor])),
+                                    static_cast<unsigned int>(std::stoi(maskedSensors[itSensor + 1])),
+                                    static_cast<unsigned int>(std::stoul(maskedSensors[itSensor + 2])),
+                                    static_cast<unsigned int>(std::stoul(maskedSensors[itSensor + 3]))});
+        }
+        catch (std::exception &e)
+        {
+            throw std::runtime_error(owner + ": cannot parse MaskedSensors entry starting at " + maskedSensors[itSensor]);
+        }
+    }
+
+    m_weight = 0.;
+    m_nEvents = 0;
+    m_averages.clear();
+    m_nRunEvents = 0;
+    m_runHot.clear();
+}
+
+void SensorOccupancy::update(const TrackerHitColumns &hitIndex, int run, std::vector<uint8_t> &states)
+{
+    const std::vector<TrackerHitColumns::SensorKey> &sensors = hitIndex.sensors();
+    states.assign(sensors.size(), Normal);
+
+    m_run = run;
+    m_nRunEvents++;
+    m_nEvents++;
+    m_weight = m_weight * m_decay + 1.;
+
+    for (size_t itSensor = 0; itSensor < sensors.size(); itSensor++)
+    {
+        const TrackerHitColumns::SensorKey &sensor = sensors[itSensor];
+        size_t nHits = hitIndex.sensorHits(itSensor).size();
+
+        // events since the last hits of the sensor had none, the sum decays once for each
+        double average = 0.;
+        if (m_settings.maxAverageHits > 0.)
+        {
+            Average &sensorAverage = m_averages[sensor];
+            sensorAverage.sum = sensorAverage.sum * std::pow(m_decay, static_cast<double>(m_nEvents - sensorAverage.lastEvent)) + nHits;
+            sensorAverage.lastEvent = m_nEvents;
+            average = sensorAverage.sum / m_weight;
+        }
+
+        bool hot = (m_settings.maxEventHits > 0 && nHits > static_cast<size_t>(m_settings.maxEventHits)) ||
+                   (m_settings.maxAverageHits > 0. && average > m_settings.maxAverageHits);
+        if (m_maskedSensors.count(sensor) > 0)
+            states[itSensor] = Masked;
+        else if (hot)
+            states[itSensor] = m_settings.maskHot ? Masked : Bounded;
+        else
+            continue;
+
+        RunEntry &entry = m_runHot[sensor];
+        entry.hotEvents++;
+        entry.maxHits = std::max(entry.maxHits, nHits);
+        entry.lastAverage = average;
+    }
+}
+
+void SensorOccupancy::report(std::ostream &out, const std::string &processorName)
+{
+    if (!enabled() || m_nRunEvents == 0)
+        return;
+
+    out << processorName << " run " << m_run << ": " << m_runHot.size() << " hot sensors in " << m_nRunEvents << " events, "
+        << (m_settings.maskHot ? "masked" : "bounded matching") << std::endl;
+    for (const auto &entry : m_runHot)
+    {
+        const TrackerHitColumns::SensorKey &sensor = entry.first;
+        out << "  layer " << sensor.layer << " side " << static_cast<int>(sensor.side) << " ladder " << sensor.ladder << " module " << sensor.module;
+        if (m_maskedSensors.count(sensor) > 0)
+            out << ": masked in the steering";
+        else
+            out << ": hot in " << entry.second.hotEvents << " events";
+        out << ", at most " << entry.second.maxHits << " hits";
+        if (m_settings.maxAverageHits > 0.)
+            out << ", average " << std::fixed << std::setprecision(1) << entry.second.lastAverage << std::defaultfloat << std::setprecision(6);
+        out << std::endl;
+    }
+
+    // steering input of the next jobs: the sensors already masked and those hot in this run
+    std::set<TrackerHitColumns::SensorKey> masked = m_maskedSensors;
+    for (const auto &entry : m_runHot)
+        masked.insert(entry.first);
+    out << "  <parameter name=\"MaskedSensors\" type=\"StringVec\">";
+    for (const TrackerHitColumns::SensorKey &sensor : masked)
+        out << " " << sensor.layer << " " << static_cast<int>(sensor.side) << " " << sensor.ladder << " " << sensor.module;
+    out << " </parameter>" << std::endl;
+
+    m_nRunEvents = 0;
+    m_runHot.clear();
+}
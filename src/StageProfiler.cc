@@ -0,0 +1,192 @@
+#include "StageProfiler.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+#if defined(__linux__)
+    const uint64_t kCounterConfigs[StageProfiler::kNCounters] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                                  PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+    // user space counter of the calling thread, on any CPU
+    int openCounter(uint64_t config, int groupFd)
+    {
+        struct perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config;
+        attr.disabled = (groupFd < 0) ? 1 : 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, groupFd, 0));
+    }
+#endif
+
+    const char *const kCounterNames[StageProfiler::kNCounters] = {"cycles", "instructions", "LLC misses", "branch misses"};
+} // namespace
+
+StageProfiler::~StageProfiler()
+{
+    close();
+}
+
+void StageProfiler::close()
+{
+#if defined(__linux__)
+    for (int &fd : m_fds)
+    {
+        if (fd >= 0)
+            ::close(fd);
+        fd = -1;
+    }
+#endif
+    m_groupFd = -1;
+}
+
+bool StageProfiler::configure(bool enabled)
+{
+    close();
+    m_enabled = enabled;
+    m_unavailableReason.clear();
+    if (!m_enabled)
+        return false;
+
+#if defined(__linux__)
+    m_fds[Cycles] = openCounter(kCounterConfigs[Cycles], -1);
+    if (m_fds[Cycles] < 0)
+    {
+        m_unavailableReason = std::string("perf_event_open: ") + std::strerror(errno);
+        return false;
+    }
+    m_groupFd = m_fds[Cycles];
+
+    // the other counters are optional members of the group
+    for (int counter = Instructions; counter < kNCounters; counter++)
+        m_fds[counter] = openCounter(kCounterConfigs[counter], m_groupFd);
+
+    ioctl(m_groupFd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(m_groupFd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return true;
+#else
+    m_unavailableReason = "perf events need Linux";
+    return false;
+#endif
+}
+
+StageProfiler::Reading StageProfiler::read() const
+{
+    Reading reading;
+    reading.time = std::chrono::steady_clock::now();
+
+#if defined(__linux__)
+    if (m_groupFd < 0)
+        return reading;
+
+    // nr, time enabled, time running, then the values in the order the counters joined the group
+    uint64_t buffer[3 + kNCounters] = {};
+    if (::read(m_groupFd, buffer, sizeof(buffer)) < static_cast<ssize_t>(3 * sizeof(uint64_t)))
+        return reading;
+
+    double scale = (buffer[2] > 0) ? static_cast<double>(buffer[1]) / buffer[2] : 0.;
+    size_t itValue = 0;
+    for (int counter = 0; counter < kNCounters && itValue < buffer[0]; counter++)
+        if (m_fds[counter] >= 0)
+            reading.values[counter] = buffer[3 + itValue++] * scale;
+#endif
+    return reading;
+}
+
+void StageProfiler::beginStage(const char *stage, size_t nItems)
+{
+    if (!m_enabled)
+        return;
+    if (m_inStage)
+        endStage();
+
+    for (m_stage = 0; m_stage < m_stages.size(); m_stage++)
+        if (m_stages[m_stage].name == stage || std::strcmp(m_stages[m_stage].name, stage) == 0)
+            break;
+    if (m_stage == m_stages.size())
+    {
+        m_stages.emplace_back();
+        m_stages.back().name = stage;
+    }
+
+    m_stages[m_stage].items += nItems;
+    m_inStage = true;
+    m_stageThreads = 1;
+    m_begin = read();
+}
+
+void StageProfiler::endStage()
+{
+    if (!m_enabled || !m_inStage)
+        return;
+
+    Reading end = read();
+    StageTotal &total = m_stages[m_stage];
+    total.calls++;
+    if (m_stageThreads > 1)
+        total.threadedCalls++;
+    total.seconds += std::chrono::duration<double>(end.time - m_begin.time).count();
+    for (int counter = 0; counter < kNCounters; counter++)
+        total.values[counter] += end.values[counter] - m_begin.values[counter];
+    m_inStage = false;
+}
+
+void StageProfiler::setStageThreads(size_t nThreads)
+{
+    if (m_enabled && m_inStage)
+        m_stageThreads = nThreads;
+}
+
+void StageProfiler::print(std::ostream &out, const std::string &processorName) const
+{
+    if (!m_enabled)
+        return;
+
+    out << processorName << " stage profile";
+    if (!countersAvailable())
+        out << " (wall time only, " << m_unavailableReason << ")";
+    out << std::endl;
+
+    for (const StageTotal &total : m_stages)
+    {
+        double perCall = total.calls > 0 ? 1000. * total.seconds / total.calls : 0.;
+        out << "  " << std::setw(10) << std::left << total.name << std::right << " calls " << total.calls
+            << ", " << std::fixed << std::setprecision(3) << perCall << " ms/call";
+
+        if (countersAvailable())
+        {
+            if (m_fds[Instructions] >= 0 && total.values[Cycles] > 0.)
+                out << ", IPC " << std::setprecision(2) << total.values[Instructions] / total.values[Cycles];
+            for (int counter = CacheMisses; counter < kNCounters; counter++)
+            {
+                if (m_fds[counter] < 0)
+                    out << ", " << kCounterNames[counter] << " n/a";
+                else if (total.items > 0)
+                    out << ", " << kCounterNames[counter] << "/hit " << std::setprecision(3) << total.values[counter] / total.items;
+                else
+                    out << ", " << kCounterNames[counter] << " " << std::setprecision(0) << total.values[counter];
+            }
+            if (total.items > 0)
+                out << ", cycles/hit " << std::setprecision(1) << total.values[Cycles] / total.items;
+            if (total.threadedCalls > 0)
+                out << " (partial: " << total.threadedCalls << " of " << total.calls
+                    << " calls multithreaded, counters of the calling thread only)";
+        }
+        out << std::defaultfloat << std::setprecision(6) << std::endl;
+    }
+}
@@ -0,0 +1,134 @@
+#include "ThresholdMap.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <sys/stat.h>
+
+#include "TAxis.h"
+#include "TFile.h"
+#include "TH2D.h"
+
+void ThresholdMap::Axis::copy(const TAxis *axis)
+{
+    nBins = axis->GetNbins();
+    min = axis->GetXmin();
+    max = axis->GetXmax();
+    variable = axis->IsVariableBinSize();
+    edges.resize(nBins + 1);
+    for (size_t itBin = 0; itBin <= nBins; itBin++)
+        edges[itBin] = axis->GetBinLowEdge(itBin + 1);
+    centres.resize(nBins);
+    for (size_t itBin = 0; itBin < nBins; itBin++)
+        centres[itBin] = 0.5 * (edges[itBin] + edges[itBin + 1]);
+}
+
+size_t ThresholdMap::Axis::findBin(double x) const
+{
+    if (x < min)
+        return 0;
+    if (!(x < max))
+        return nBins + 1;
+    if (!variable)
+        return 1 + static_cast<int>(nBins * (x - min) / (max - min));
+    return std::upper_bound(edges.begin(), edges.end(), x) - edges.begin();
+}
+
+void ThresholdMap::copyContents(const TH2D *histogram, std::vector<double> &contents) const
+{
+    contents.resize((m_xAxis.nBins + 2) * (m_yAxis.nBins + 2));
+    for (size_t biny = 0; biny < m_yAxis.nBins + 2; biny++)
+        for (size_t binx = 0; binx < m_xAxis.nBins + 2; binx++)
+            contents[biny * (m_xAxis.nBins + 2) + binx] = histogram->GetBinContent(binx, biny);
+}
+
+void ThresholdMap::load(const std::string &fileName)
+{
+    TFile file(fileName.c_str());
+    if (file.IsZombie())
+        throw std::runtime_error("ThresholdMap: cannot open threshold file " + fileName);
+
+    TH2D *thresholdMap = (TH2D *)file.Get("th_2dmode_sym");
+    TH2D *stddevMap = (TH2D *)file.Get("stddev_sym");
+    if (thresholdMap == nullptr || stddevMap == nullptr)
+        throw std::runtime_error("ThresholdMap: no th_2dmode_sym or stddev_sym histogram in " + fileName);
+
+    m_fileName = fileName;
+    m_xAxis.copy(thresholdMap->GetXaxis());
+    m_yAxis.copy(thresholdMap->GetYaxis());
+    if (stddevMap->GetNbinsX() != static_cast<int>(m_xAxis.nBins) || stddevMap->GetNbinsY() != static_cast<int>(m_yAxis.nBins))
+        throw std::runtime_error("ThresholdMap: th_2dmode_sym and stddev_sym binnings differ in " + fileName);
+
+    copyContents(thresholdMap, m_mode);
+    copyContents(stddevMap, m_stddev);
+    file.Close();
+
+    computeCells();
+}
+
+void ThresholdMap::computeCells()
+{
+    size_t nCellsX = m_xAxis.nBins + 1;
+    size_t nCellsY = m_yAxis.nBins + 1;
+    m_cells.resize(nCellsX * nCellsY);
+
+    for (size_t cellY = 0; cellY < nCellsY; cellY++)
+    {
+        // bin centres bounding the cell, the same bin twice in the outer cells
+        size_t biny0 = std::max<size_t>(cellY, 1);
+        size_t biny1 = std::min(cellY + 1, m_yAxis.nBins);
+        double y0 = m_yAxis.centres[biny0 - 1];
+        double invDy = (biny1 > biny0) ? 1. / (m_yAxis.centres[biny1 - 1] - y0) : 0.;
+
+        for (size_t cellX = 0; cellX < nCellsX; cellX++)
+        {
+            size_t binx0 = std::max<size_t>(cellX, 1);
+            size_t binx1 = std::min(cellX + 1, m_xAxis.nBins);
+            double x0 = m_xAxis.centres[binx0 - 1];
+            double invDx = (binx1 > binx0) ? 1. / (m_xAxis.centres[binx1 - 1] - x0) : 0.;
+
+            // f = A + B tx + C ty + D tx ty with tx = (x - x0) invDx, ty = (y - y0) invDy,
+            // expanded in x and y
+            auto coefficients = [&](const std::vector<double> &contents, double *out)
+            {
+                size_t rowStride = m_xAxis.nBins + 2;
+                double f00 = contents[biny0 * rowStride + binx0];
+                double f10 = contents[biny0 * rowStride + binx1];
+                double f01 = contents[biny1 * rowStride + binx0];
+                double f11 = contents[biny1 * rowStride + binx1];
+                double A = f00;
+                double B = f10 - f00;
+                double C = f01 - f00;
+                double D = f11 - f10 - f01 + f00;
+                double qx = -x0 * invDx;
+                double qy = -y0 * invDy;
+                out[0] = A + B * qx + C * qy + D * qx * qy;
+                out[1] = (B + D * qy) * invDx;
+                out[2] = (C + D * qx) * invDy;
+                out[3] = D * invDx * invDy;
+            };
+
+            Cell &cell = m_cells[cellY * nCellsX + cellX];
+            coefficients(m_mode, cell.mode);
+            coefficients(m_stddev, cell.stddev);
+        }
+    }
+}
+
+const ThresholdMap &ThresholdMapCache::get(const std::string &fileName)
+{
+    // remote or missing files have no modification time and are read once
+    struct stat status;
+    long modificationTime = (stat(fileName.c_str(), &status) == 0) ? static_cast<long>(status.st_mtime) : -1;
+
+    Entry &entry = m_entries[fileName];
+    if (!entry.map || entry.modificationTime != modificationTime)
+    {
+        std::unique_ptr<ThresholdMap> map(new ThresholdMap());
+        map->load(fileName);
+        entry.map = std::move(map);
+        entry.modificationTime = modificationTime;
+        m_nLoads++;
+    }
+    return *entry.map;
+}
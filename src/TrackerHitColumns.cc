@@ -0,0 +1,92 @@
+#include "TrackerHitColumns.h"
+
+#include <algorithm>
+#include <numeric>
+
+#include "TVector3.h"
+
+TrackerHitColumns::TrackerHitColumns(size_t nHits)
+{
+    resize(nHits);
+}
+
+void TrackerHitColumns::resize(size_t nHits)
+{
+    m_nHits = nHits;
+    layer.resize(m_nHits);
+    side.resize(m_nHits);
+    ladder.resize(m_nHits);
+    module.resize(m_nHits);
+    x.resize(m_nHits);
+    y.resize(m_nHits);
+    z.resize(m_nHits);
+    r.resize(m_nHits);
+    theta.resize(m_nHits);
+    phi.resize(m_nHits);
+    time.resize(m_nHits);
+}
+
+void TrackerHitColumns::finish(Content content)
+{
+    m_content = content;
+    for (size_t itHit = 0; itHit < m_nHits; itHit++)
+    {
+        TVector3 pos(x[itHit], y[itHit], z[itHit]);
+        r[itHit] = pos.Perp();
+        theta[itHit] = pos.Theta();
+        phi[itHit] = pos.Phi();
+    }
+
+    // Group hits by sensor, keeping the collection order inside each sensor
+    m_sensors.clear();
+    m_sensorOffsets.clear();
+    if (content < Sensors)
+    {
+        m_sensorOffsets.push_back(0);
+        m_sensorHits.clear();
+        sensorNumber.clear();
+        return;
+    }
+
+    m_sensorHits.resize(m_nHits);
+    std::iota(m_sensorHits.begin(), m_sensorHits.end(), 0);
+    auto keyOf = [this](size_t itHit)
+    { return SensorKey{layer[itHit], side[itHit], ladder[itHit], module[itHit]}; };
+    // ties broken by index, as stable_sort would, without its temporary buffer
+    std::sort(m_sensorHits.begin(), m_sensorHits.end(), [&keyOf](size_t a, size_t b)
+              { return keyOf(a) < keyOf(b) || (keyOf(a) == keyOf(b) && a < b); });
+
+    for (size_t itSorted = 0; itSorted < m_nHits; itSorted++)
+    {
+        SensorKey key = keyOf(m_sensorHits[itSorted]);
+        if (m_sensors.empty() || !(m_sensors.back() == key))
+        {
+            m_sensors.push_back(key);
+            m_sensorOffsets.push_back(itSorted);
+        }
+    }
+    m_sensorOffsets.push_back(m_nHits);
+
+    sensorNumber.resize(m_nHits);
+    for (size_t itSensor = 0; itSensor < m_sensors.size(); itSensor++)
+        for (size_t itHit : sensorHits(itSensor))
+            sensorNumber[itHit] = itSensor;
+}
+
+TrackerHitColumns::HitRange TrackerHitColumns::sensorHits(const SensorKey &key) const
+{
+    auto found = std::lower_bound(m_sensors.begin(), m_sensors.end(), key);
+    if (found == m_sensors.end() || !(*found == key))
+        return HitRange();
+    return sensorHits(static_cast<size_t>(found - m_sensors.begin()));
+}
+
+SelectionKernel::TrackerHitView TrackerHitColumns::view() const
+{
+    SelectionKernel::TrackerHitView view;
+    view.size = m_nHits;
+    view.r = r.data();
+    view.theta = theta.data();
+    view.time = time.data();
+    return view;
+}
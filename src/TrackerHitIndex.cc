@@ -0,0 +1,93 @@
+#include "TrackerHitIndex.h"
+
+#include <EVENT/LCIO.h>
+#include <EVENT/TrackerHitPlane.h>
+#include <IMPL/LCCollectionVec.h>
+#include <UTIL/CellIDDecoder.h>
+
+TrackerHitIndex::TrackerHitIndex(const LCCollection *hitCollection, Content content)
+{
+    rebuild(hitCollection, content);
+}
+
+void TrackerHitIndex::rebuild(const LCCollection *hitCollection, Content content)
+{
+    resize(hitCollection->getNumberOfElements());
+    m_hitCollection = hitCollection;
+
+    for (size_t itHit = 0; itHit < m_nHits; itHit++)
+    {
+        TrackerHitPlane *hit = static_cast<TrackerHitPlane *>(hitCollection->getElementAt(itHit));
+        x[itHit] = hit->getPosition()[0];
+        y[itHit] = hit->getPosition()[1];
+        z[itHit] = hit->getPosition()[2];
+        time[itHit] = hit->getTime();
+    }
+
+    // Decode every hit once, the encoding must have the fields
+    if (content >= CellIDFields)
+    {
+        std::string encoderString = hitCollection->getParameters().getStringVal("CellIDEncoding");
+        UTIL::CellIDDecoder<TrackerHitPlane> myCellIDEncoding(encoderString);
+        for (size_t itHit = 0; itHit < m_nHits; itHit++)
+        {
+            TrackerHitPlane *hit = static_cast<TrackerHitPlane *>(hitCollection->getElementAt(itHit));
+            layer[itHit] = myCellIDEncoding(hit)["layer"];
+            side[itHit] = myCellIDEncoding(hit)["side"];
+            ladder[itHit] = myCellIDEncoding(hit)["module"];
+            module[itHit] = myCellIDEncoding(hit)["sensor"];
+        }
+    }
+
+    finish(content);
+}
+
+const TrackerHitIndex *TrackerHitIndex::fromEvent(LCEvent *evt, const std::string &hitCollectionName, const LCCollection *hitCollection)
+{
+    try
+    {
+        LCCollection *indexCollection = evt->getCollection(collectionName(hitCollectionName));
+        if (indexCollection->getNumberOfElements() < 1)
+            return nullptr;
+        const TrackerHitIndex *index = dynamic_cast<TrackerHitIndex *>(indexCollection->getElementAt(0));
+
+        // only trust an index built from this very collection
+        if (index == nullptr || index->hitCollection() != hitCollection ||
+            index->size() != static_cast<size_t>(hitCollection->getNumberOfElements()))
+            return nullptr;
+        return index;
+    }
+    catch (DataNotAvailableException &e)
+    {
+        return nullptr;
+    }
+}
+
+const TrackerHitIndex *TrackerHitIndex::fromEventOrBuild(LCEvent *evt, const std::string &hitCollectionName, const LCCollection *hitCollection,
+                                                         std::unique_ptr<TrackerHitIndex> &localIndex, Content content)
+{
+    // the published index holds everything
+    const TrackerHitIndex *index = fromEvent(evt, hitCollectionName, hitCollection);
+    if (index != nullptr)
+        return index;
+
+    // the private index is rebuilt in place, keeping its columns' storage
+    if (!localIndex)
+        localIndex.reset(new TrackerHitIndex());
+    localIndex->rebuild(hitCollection, content);
+    return localIndex.get();
+}
+
+const TrackerHitIndex *TrackerHitIndex::publish(LCEvent *evt, const std::string &hitCollectionName)
+{
+    // throws DataNotAvailableException if the hit collection is missing
+    LCCollection *hitCollection = evt->getCollection(hitCollectionName);
+
+    TrackerHitIndex *index = new TrackerHitIndex(hitCollection);
+    LCCollectionVec *indexCollection = new LCCollectionVec(LCIO::LCGENERICOBJECT);
+    indexCollection->setTransient(true);
+    indexCollection->addElement(index);
+    evt->addCollection(indexCollection, collectionName(hitCollectionName));
+
+    return index;
+}
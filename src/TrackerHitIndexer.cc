@@ -0,0 +1,84 @@
+#include "TrackerHitIndexer.h"
+#include "TrackerHitIndex.h"
+#include <iostream>
+
+#include <EVENT/LCCollection.h>
+
+// ----- include for verbosity dependend logging ---------
+#include "marlin/VerbosityLevels.h"
+
+using namespace lcio;
+using namespace marlin;
+
+TrackerHitIndexer aTrackerHitIndexer;
+
+TrackerHitIndexer::TrackerHitIndexer() : Processor("TrackerHitIndexer")
+{
+
+    // Modify processor description
+    _description = "TrackerHitIndexer decodes tracker hits once and publishes a shared per-event index";
+
+    // Input collections
+    StringVec defaultCollections = {"VertexBarrelCollection"};
+    registerProcessorParameter("TrackerHitCollectionNames",
+                               "Names of the TrackerHit input collections to index",
+                               m_inputHitCollections,
+                               defaultCollections);
+}
+
+void TrackerHitIndexer::init()
+{
+
+    streamlog_out(DEBUG) << "   init called  " << std::endl;
+
+    // usually a good idea to
+    printParameters();
+
+    _nRun = 0;
+    _nEvt = 0;
+}
+
+void TrackerHitIndexer::processRunHeader(LCRunHeader *run)
+{
+
+    _nRun++;
+}
+
+void TrackerHitIndexer::processEvent(LCEvent *evt)
+{
+
+    streamlog_out(DEBUG8) << "Processing event " << _nEvt << std::endl;
+
+    for (const std::string &collectionName : m_inputHitCollections)
+    {
+        try
+        {
+            const TrackerHitIndex *index = TrackerHitIndex::publish(evt, collectionName);
+            streamlog_out(DEBUG) << "  Indexed " << index->size() << " hits on "
+                                 << index->sensors().size() << " sensors in " << collectionName << std::endl;
+        }
+        catch (DataNotAvailableException &e)
+        {
+            streamlog_out(DEBUG5) << "- cannot get collection. Collection " << collectionName.c_str() << " is unavailable" << std::endl;
+        }
+    }
+
+    //-- note: this will not be printed if compiled w/o MARLINDEBUG=1 !
+    streamlog_out(DEBUG) << "   done processing event: " << evt->getEventNumber()
+                         << "   in run:  " << evt->getRunNumber() << std::endl;
+
+    _nEvt++;
+}
+
+void TrackerHitIndexer::check(LCEvent *evt)
+{
+    // nothing to check here - could be used to fill checkplots in reconstruction processor
+}
+
+void TrackerHitIndexer::end()
+{
+
+    //   std::cout << "TrackerHitIndexer::end()  " << name()
+    // 	    << " processed " << _nEvt << " events in " << _nRun << " runs "
+    // 	    << std::endl ;
+}
@@ -0,0 +1,68 @@
+#include "TrackerTimeSelection.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+void TrackerTimeSelection::loadForest(const std::string &modelFile, const std::string &owner)
+{
+    m_forest.load(modelFile);
+
+    static const std::vector<std::string> knownFeatures = {"time", "theta", "r", "layer"};
+    m_forestFeatures.clear();
+    for (const std::string &name : m_forest.featureNames())
+    {
+        auto found = std::find(knownFeatures.begin(), knownFeatures.end(), name);
+        if (found == knownFeatures.end())
+            throw std::runtime_error(owner + ": unknown forest feature " + name);
+        m_forestFeatures.push_back(static_cast<ForestFeature>(found - knownFeatures.begin()));
+    }
+    m_useForest = true;
+}
+
+void TrackerTimeSelection::fillForestFeatures(const TrackerHitColumns &hitIndex, AlignedVector<float> &featureMatrix) const
+{
+    size_t nHits = hitIndex.size();
+    SelectionKernel::TrackerHitView view = hitIndex.view();
+    featureMatrix.resize(m_forestFeatures.size() * nHits);
+
+    for (size_t itFeature = 0; itFeature < m_forestFeatures.size(); itFeature++)
+    {
+        float *column = featureMatrix.data() + itFeature * nHits;
+        switch (m_forestFeatures[itFeature])
+        {
+        case ForestFeature::Time:
+            for (size_t itHit = 0; itHit < nHits; itHit++)
+                column[itHit] = SelectionKernel::TrackerToFWindow::arrivalTime(view, itHit, m_settings.tofWindow.offset);
+            break;
+        case ForestFeature::Theta:
+            std::copy(hitIndex.theta.begin(), hitIndex.theta.end(), column);
+            break;
+        case ForestFeature::R:
+            std::copy(hitIndex.r.begin(), hitIndex.r.end(), column);
+            break;
+        case ForestFeature::Layer:
+            std::copy(hitIndex.layer.begin(), hitIndex.layer.end(), column);
+            break;
+        }
+    }
+}
+
+void TrackerTimeSelection::select(const TrackerHitColumns &hitIndex, Scratch &scratch, std::vector<size_t> &accepted) const
+{
+    if (m_useForest)
+    {
+        size_t nHits = hitIndex.size();
+        fillForestFeatures(hitIndex, scratch.featureMatrix);
+        scratch.scores.resize(nHits);
+        m_forest.evaluate(scratch.featureMatrix.data(), nHits, nHits, scratch.scores.data(), m_settings.simdLevel);
+
+        SelectionKernel::ScoreView scoreView;
+        scoreView.size = nHits;
+        scoreView.score = scratch.scores.data();
+        SelectionKernel::selectHits(scoreView, SelectionKernel::ScoreAbove{m_settings.forestCut}, accepted);
+    }
+    else
+    {
+        SelectionKernel::selectHits(hitIndex.view(), m_settings.tofWindow, accepted);
+    }
+}
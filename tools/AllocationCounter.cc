@@ -0,0 +1,60 @@
+// Counting replacement of the global operator new, built as
+// libMyBIBUtilsAllocationCounter and loaded with LD_PRELOAD so that it takes
+// precedence over libstdc++. MemoryMonitor reads the counts through
+// mybibutils_allocation_counts().
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    std::atomic<uint64_t> g_allocations(0);
+    std::atomic<uint64_t> g_allocatedBytes(0);
+
+    void *countedAllocate(std::size_t size, std::size_t alignment)
+    {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+        g_allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+        if (size == 0)
+            size = 1;
+        if (alignment <= alignof(std::max_align_t))
+            return std::malloc(size);
+        void *pointer = nullptr;
+        return posix_memalign(&pointer, alignment, size) == 0 ? pointer : nullptr;
+    }
+
+    void *allocateOrThrow(std::size_t size, std::size_t alignment)
+    {
+        void *pointer = countedAllocate(size, alignment);
+        if (pointer == nullptr)
+            throw std::bad_alloc();
+        return pointer;
+    }
+} // namespace
+
+extern "C" void mybibutils_allocation_counts(uint64_t *allocations, uint64_t *bytes)
+{
+    *allocations = g_allocations.load(std::memory_order_relaxed);
+    *bytes = g_allocatedBytes.load(std::memory_order_relaxed);
+}
+
+void *operator new(std::size_t size) { return allocateOrThrow(size, 0); }
+void *operator new[](std::size_t size) { return allocateOrThrow(size, 0); }
+void *operator new(std::size_t size, std::align_val_t alignment) { return allocateOrThrow(size, static_cast<std::size_t>(alignment)); }
+void *operator new[](std::size_t size, std::align_val_t alignment) { return allocateOrThrow(size, static_cast<std::size_t>(alignment)); }
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept { return countedAllocate(size, 0); }
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept { return countedAllocate(size, 0); }
+
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+void operator delete[](void *pointer) noexcept { std::free(pointer); }
+void operator delete(void *pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete(void *pointer, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete(void *pointer, std::size_t, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, std::size_t, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete(void *pointer, const std::nothrow_t &) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, const std::nothrow_t &) noexcept { std::free(pointer); }
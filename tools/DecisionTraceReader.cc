@@ -0,0 +1,177 @@
+// mybib-trace: print or summarise a DecisionTrace file
+//
+//   mybib-trace [-e event] [-s stream] [-d decision] [-c] file
+//
+//   -e  only records of this event number
+//   -s  only streams whose name contains this text
+//   -d  only records with this decision name
+//   -c  counts per stream and decision instead of the records
+
+#include "DecisionTrace.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+    struct Stream
+    {
+        std::string name;
+        std::vector<std::string> valueNames;
+        std::vector<std::string> decisionNames;
+        std::vector<uint64_t> counts;
+
+        std::string decisionName(unsigned int decision) const
+        {
+            return decision < decisionNames.size() ? decisionNames[decision] : std::to_string(decision);
+        }
+    };
+
+    std::vector<std::string> split(const std::string &text, char separator)
+    {
+        std::vector<std::string> fields;
+        std::stringstream stream(text);
+        std::string field;
+        while (std::getline(stream, field, separator))
+            fields.push_back(field);
+        return fields;
+    }
+
+    void usage()
+    {
+        std::fprintf(stderr, "usage: mybib-trace [-e event] [-s stream] [-d decision] [-c] file\n");
+        std::exit(2);
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    long eventFilter = -1;
+    std::string streamFilter;
+    std::string decisionFilter;
+    bool countOnly = false;
+
+    int option;
+    while ((option = getopt(argc, argv, "e:s:d:c")) != -1)
+    {
+        switch (option)
+        {
+        case 'e':
+            eventFilter = std::atol(optarg);
+            break;
+        case 's':
+            streamFilter = optarg;
+            break;
+        case 'd':
+            decisionFilter = optarg;
+            break;
+        case 'c':
+            countOnly = true;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind + 1 != argc)
+        usage();
+
+    std::FILE *file = std::fopen(argv[optind], "rb");
+    if (file == nullptr)
+    {
+        std::perror(argv[optind]);
+        return 1;
+    }
+
+    char magic[8];
+    if (std::fread(magic, 1, 8, file) != 8 || std::memcmp(magic, DecisionTrace::kMagic, 8) != 0)
+    {
+        std::fprintf(stderr, "%s: not a decision trace\n", argv[optind]);
+        return 1;
+    }
+
+    std::map<uint16_t, Stream> streams;
+    std::vector<char> payload;
+    uint32_t header[2];
+    while (std::fread(header, sizeof(uint32_t), 2, file) == 2)
+    {
+        payload.resize(header[1]);
+        if (std::fread(payload.data(), 1, header[1], file) != header[1])
+        {
+            std::fprintf(stderr, "truncated block, trace incomplete\n");
+            break;
+        }
+
+        if (header[0] == DecisionTrace::StreamBlock && header[1] >= sizeof(uint16_t))
+        {
+            uint16_t id;
+            std::memcpy(&id, payload.data(), sizeof(id));
+            std::vector<std::string> fields = split(std::string(payload.begin() + sizeof(id), payload.end()), '|');
+            fields.resize(3);
+            Stream &stream = streams[id];
+            stream.name = fields[0];
+            stream.valueNames = split(fields[1], ',');
+            stream.decisionNames = split(fields[2], ',');
+            if (!countOnly && (streamFilter.empty() || stream.name.find(streamFilter) != std::string::npos))
+            {
+                std::printf("# stream %u %s: stream,run,event,hit,decision", id, stream.name.c_str());
+                for (const std::string &valueName : stream.valueNames)
+                    std::printf(",%s", valueName.c_str());
+                std::printf("\n");
+            }
+        }
+        else if (header[0] == DecisionTrace::RecordBlock)
+        {
+            size_t nRecords = header[1] / sizeof(DecisionTrace::Record);
+            for (size_t itRecord = 0; itRecord < nRecords; itRecord++)
+            {
+                DecisionTrace::Record record;
+                std::memcpy(&record, payload.data() + itRecord * sizeof(record), sizeof(record));
+
+                Stream &stream = streams[record.stream];
+                if (eventFilter >= 0 && record.event != static_cast<uint32_t>(eventFilter))
+                    continue;
+                if (!streamFilter.empty() && stream.name.find(streamFilter) == std::string::npos)
+                    continue;
+                std::string decision = stream.decisionName(record.decision);
+                if (!decisionFilter.empty() && decision != decisionFilter)
+                    continue;
+
+                if (countOnly)
+                {
+                    if (stream.counts.size() <= record.decision)
+                        stream.counts.resize(record.decision + 1);
+                    stream.counts[record.decision]++;
+                    continue;
+                }
+
+                std::printf("%u,%u,%u,%u,%s", record.stream, record.run, record.event, record.hit, decision.c_str());
+                for (size_t itValue = 0; itValue < stream.valueNames.size() && itValue < record.nValues; itValue++)
+                    std::printf(",%g", record.values[itValue]);
+                std::printf("\n");
+            }
+        }
+    }
+    std::fclose(file);
+
+    if (countOnly)
+    {
+        for (const auto &entry : streams)
+        {
+            uint64_t total = 0;
+            for (uint64_t count : entry.second.counts)
+                total += count;
+            std::printf("%s: %llu hits\n", entry.second.name.c_str(), static_cast<unsigned long long>(total));
+            for (size_t decision = 0; decision < entry.second.counts.size(); decision++)
+                if (entry.second.counts[decision] > 0)
+                    std::printf("  %-20s %llu\n", entry.second.decisionName(decision).c_str(),
+                                static_cast<unsigned long long>(entry.second.counts[decision]));
+        }
+    }
+    return 0;
+}
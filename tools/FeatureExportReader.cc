@@ -0,0 +1,313 @@
+// mybib-features: summarise, print or unpack a FeatureExport file
+//
+//   mybib-features [-t table] [-c] [-x directory] file
+//
+//   -t  only tables whose name contains this text
+//   -c  rows as CSV instead of the summary
+//   -x  unpack every column into directory/<table>.<column>.<type>, raw
+//       little-endian arrays to be memory-mapped by the analysis
+
+#include "FeatureExport.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include <zlib.h>
+
+namespace
+{
+    struct Table
+    {
+        std::string name;
+        std::vector<std::string> columnNames;
+        std::vector<FeatureExport::ColumnType> columnTypes;
+        std::vector<std::string> decisionNames;
+        std::vector<std::FILE *> columnFiles;
+        uint64_t rows = 0;
+        uint64_t compressedBytes = 0;
+        uint64_t rawBytes = 0;
+        bool selected = false;
+    };
+
+    std::vector<std::string> split(const std::string &text, char separator)
+    {
+        std::vector<std::string> fields;
+        std::stringstream stream(text);
+        std::string field;
+        while (std::getline(stream, field, separator))
+            fields.push_back(field);
+        return fields;
+    }
+
+    // table names hold the processor and collection names, keep them file name safe
+    std::string fileNamePart(const std::string &text)
+    {
+        std::string part = text;
+        for (char &c : part)
+            if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_' && c != '-')
+                c = '_';
+        return part;
+    }
+
+    bool unpackColumn(const uint8_t *compressed, uint32_t compressedSize, uint32_t rawSize, size_t elementSize, uint32_t nRows,
+                      std::vector<uint8_t> &shuffled, std::vector<uint8_t> &column)
+    {
+        if (rawSize != static_cast<uint64_t>(nRows) * elementSize)
+            return false;
+        shuffled.resize(rawSize);
+        if (compressedSize & FeatureExport::kStoredColumn)
+        {
+            // stored uncompressed by the writer
+            if ((compressedSize & ~FeatureExport::kStoredColumn) != rawSize)
+                return false;
+            std::memcpy(shuffled.data(), compressed, rawSize);
+        }
+        else
+        {
+            uLongf size = rawSize;
+            if (uncompress(shuffled.data(), &size, compressed, compressedSize) != Z_OK || size != rawSize)
+                return false;
+        }
+
+        column.resize(rawSize);
+        for (size_t itRow = 0; itRow < nRows; itRow++)
+            for (size_t itByte = 0; itByte < elementSize; itByte++)
+                column[itRow * elementSize + itByte] = shuffled[itByte * nRows + itRow];
+        return true;
+    }
+
+    void printValue(const Table &table, size_t itColumn, const uint8_t *values, size_t itRow)
+    {
+        switch (table.columnTypes[itColumn])
+        {
+        case FeatureExport::Float32:
+        {
+            float value;
+            std::memcpy(&value, values + 4 * itRow, 4);
+            std::printf("%g", value);
+            break;
+        }
+        case FeatureExport::UInt32:
+        {
+            uint32_t value;
+            std::memcpy(&value, values + 4 * itRow, 4);
+            std::printf("%u", value);
+            break;
+        }
+        case FeatureExport::UInt8:
+        {
+            unsigned int value = values[itRow];
+            if (table.columnNames[itColumn] == "decision" && value < table.decisionNames.size())
+                std::printf("%s", table.decisionNames[value].c_str());
+            else
+                std::printf("%u", value);
+            break;
+        }
+        }
+    }
+
+    void usage()
+    {
+        std::fprintf(stderr, "usage: mybib-features [-t table] [-c] [-x directory] file\n");
+        std::exit(2);
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::string tableFilter;
+    bool csv = false;
+    std::string unpackDirectory;
+
+    int option;
+    while ((option = getopt(argc, argv, "t:cx:")) != -1)
+    {
+        switch (option)
+        {
+        case 't':
+            tableFilter = optarg;
+            break;
+        case 'c':
+            csv = true;
+            break;
+        case 'x':
+            unpackDirectory = optarg;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind + 1 != argc)
+        usage();
+
+    std::FILE *file = std::fopen(argv[optind], "rb");
+    if (file == nullptr)
+    {
+        std::perror(argv[optind]);
+        return 1;
+    }
+
+    char magic[8];
+    if (std::fread(magic, 1, 8, file) != 8 || std::memcmp(magic, FeatureExport::kMagic, 8) != 0)
+    {
+        std::fprintf(stderr, "%s: not a feature export\n", argv[optind]);
+        return 1;
+    }
+
+    std::map<uint16_t, Table> tables;
+    std::vector<uint8_t> payload, shuffled;
+    std::vector<std::vector<uint8_t>> columns;
+    uint32_t header[2];
+    int status = 0;
+    while (std::fread(header, sizeof(uint32_t), 2, file) == 2)
+    {
+        payload.resize(header[1]);
+        if (std::fread(payload.data(), 1, header[1], file) != header[1])
+        {
+            std::fprintf(stderr, "truncated block, export incomplete\n");
+            status = 1;
+            break;
+        }
+
+        if (header[0] == FeatureExport::SchemaBlock && header[1] >= sizeof(uint16_t))
+        {
+            uint16_t id;
+            std::memcpy(&id, payload.data(), sizeof(id));
+            std::vector<std::string> fields = split(std::string(payload.begin() + sizeof(id), payload.end()), '|');
+            fields.resize(3);
+
+            Table &table = tables[id];
+            table.name = fields[0];
+            table.decisionNames = split(fields[2], ',');
+            for (const std::string &column : split(fields[1], ','))
+            {
+                size_t colon = column.rfind(':');
+                std::string type = colon == std::string::npos ? "" : column.substr(colon + 1);
+                table.columnNames.push_back(column.substr(0, colon));
+                table.columnTypes.push_back(type == "f32" ? FeatureExport::Float32 : (type == "u32" ? FeatureExport::UInt32 : FeatureExport::UInt8));
+            }
+            table.selected = tableFilter.empty() || table.name.find(tableFilter) != std::string::npos;
+
+            if (table.selected && csv)
+            {
+                std::printf("# table %u %s: ", id, table.name.c_str());
+                for (size_t itColumn = 0; itColumn < table.columnNames.size(); itColumn++)
+                    std::printf("%s%s", itColumn > 0 ? "," : "", table.columnNames[itColumn].c_str());
+                std::printf("\n");
+            }
+
+            if (table.selected && !unpackDirectory.empty())
+            {
+                for (size_t itColumn = 0; itColumn < table.columnNames.size(); itColumn++)
+                {
+                    std::string fileName = unpackDirectory + "/" + fileNamePart(table.name) + "." + fileNamePart(table.columnNames[itColumn]) +
+                                           "." + FeatureExport::typeName(table.columnTypes[itColumn]);
+                    std::FILE *columnFile = std::fopen(fileName.c_str(), "wb");
+                    if (columnFile == nullptr)
+                    {
+                        std::perror(fileName.c_str());
+                        return 1;
+                    }
+                    table.columnFiles.push_back(columnFile);
+                }
+            }
+        }
+        else if (header[0] == FeatureExport::ChunkBlock && header[1] >= 2 * sizeof(uint16_t) + sizeof(uint32_t))
+        {
+            uint16_t id, nColumns;
+            uint32_t nRows;
+            std::memcpy(&id, payload.data(), sizeof(id));
+            std::memcpy(&nColumns, payload.data() + 2, sizeof(nColumns));
+            std::memcpy(&nRows, payload.data() + 4, sizeof(nRows));
+
+            auto found = tables.find(id);
+            if (found == tables.end() || nColumns != found->second.columnNames.size())
+            {
+                std::fprintf(stderr, "chunk of unknown table %u skipped\n", id);
+                status = 1;
+                continue;
+            }
+            Table &table = found->second;
+            table.rows += nRows;
+            if (!table.selected)
+                continue;
+
+            // unpack the columns, checking each against the end of the block
+            bool complete = true;
+            size_t offset = 8;
+            columns.resize(nColumns);
+            for (size_t itColumn = 0; itColumn < nColumns && complete; itColumn++)
+            {
+                uint32_t sizes[2] = {0, 0};
+                complete = offset + sizeof(sizes) <= payload.size();
+                if (complete)
+                {
+                    std::memcpy(sizes, payload.data() + offset, sizeof(sizes));
+                    offset += sizeof(sizes);
+                    uint32_t storedSize = sizes[0] & ~FeatureExport::kStoredColumn;
+                    complete = offset + storedSize <= payload.size() &&
+                               unpackColumn(payload.data() + offset, sizes[0], sizes[1], FeatureExport::typeSize(table.columnTypes[itColumn]),
+                                            nRows, shuffled, columns[itColumn]);
+                    offset += storedSize;
+                    table.compressedBytes += storedSize;
+                    table.rawBytes += sizes[1];
+                }
+            }
+            if (!complete)
+            {
+                std::fprintf(stderr, "corrupt chunk of table %s skipped\n", table.name.c_str());
+                status = 1;
+                continue;
+            }
+
+            for (size_t itColumn = 0; itColumn < table.columnFiles.size(); itColumn++)
+                std::fwrite(columns[itColumn].data(), 1, columns[itColumn].size(), table.columnFiles[itColumn]);
+
+            if (csv)
+            {
+                for (size_t itRow = 0; itRow < nRows; itRow++)
+                {
+                    for (size_t itColumn = 0; itColumn < nColumns; itColumn++)
+                    {
+                        if (itColumn > 0)
+                            std::printf(",");
+                        printValue(table, itColumn, columns[itColumn].data(), itRow);
+                    }
+                    std::printf("\n");
+                }
+            }
+        }
+    }
+    std::fclose(file);
+
+    for (auto &entry : tables)
+    {
+        for (std::FILE *columnFile : entry.second.columnFiles)
+            std::fclose(columnFile);
+
+        if (csv || !entry.second.selected)
+            continue;
+        const Table &table = entry.second;
+        std::printf("%s: %llu rows", table.name.c_str(), static_cast<unsigned long long>(table.rows));
+        if (table.compressedBytes > 0)
+            std::printf(", %.1f MB in columns, compression %.2f", table.rawBytes / 1.E6, double(table.rawBytes) / table.compressedBytes);
+        std::printf("\n");
+        for (size_t itColumn = 0; itColumn < table.columnNames.size(); itColumn++)
+            std::printf("  %-12s %s\n", table.columnNames[itColumn].c_str(), FeatureExport::typeName(table.columnTypes[itColumn]));
+        if (!table.decisionNames.empty())
+        {
+            std::printf("  decisions:");
+            for (size_t itDecision = 0; itDecision < table.decisionNames.size(); itDecision++)
+                std::printf(" %zu=%s", itDecision, table.decisionNames[itDecision].c_str());
+            std::printf("\n");
+        }
+    }
+    return status;
+}